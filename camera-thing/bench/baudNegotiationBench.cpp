@@ -0,0 +1,173 @@
+// baudNegotiationBench.cpp
+// Runs the baud negotiation (main/baudNegotiation.h) against a simulated
+// SIM800L, on a simulated clock. Each SIM800L autobauds at power on, then only
+// takes some bauds over AT+IPR, or garbles bytes at some of them, like one on
+// long wires does at 460800. Each has to end up at the fastest baud it's
+// reliable at, and for each it prints how long negotiating took, and how long
+// a 6KB JPEG spends crossing the UART at the initial baud & the negotiated one.
+
+#include <cstdio>
+#include <random>
+#include "../main/baudNegotiation.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Config
+
+//How big a JPEG is, in bytes
+#define JPEG_BYTES (6 * 1024)
+
+//How long the SIM800L takes to respond to a command, in milliseconds
+#define MODEM_LATENCY_MS 2.0
+
+//How long setBaud waits for the UART to settle, as gprsClient.cpp's does
+#define SETTLE_MS 100.0
+
+/////////////////////////////////////////////////////////////////////////////
+// Simulated SIM800L
+
+struct simulatedSIM800L {
+  const char *name;
+  uint32_t modemBaud;  //The baud it's at, or 0 while it's still autobauding
+  uint32_t maxBaud;    //The fastest baud it takes over AT+IPR
+  uint32_t badBaud;    //A baud it garbles bytes at, or 0
+  double badRate;      //How many bytes it garbles at badBaud
+  uint32_t expected;   //The baud it should end up at
+
+  uint32_t ourBaud;
+  double clockMs;
+  int commands;
+  std::mt19937 random;
+};
+
+//byteMs is how long a byte takes to cross the UART at `baud`, with its start &
+//stop bits
+double byteMs(uint32_t baud) {
+  return 10000.0 / baud;
+}
+
+//garbleRate is the chance of each byte being garbled at `baud`
+double garbleRate(simulatedSIM800L *modem, uint32_t baud) {
+  return baud == modem->badBaud ? modem->badRate : 0;
+}
+
+//crosses is true if `bytes` bytes get across the UART without being garbled
+bool crosses(simulatedSIM800L *modem, int bytes) {
+  std::uniform_real_distribution<double> chance(0, 1);
+  double rate = garbleRate(modem, modem->ourBaud);
+  for(int i = 0; i < bytes; i++) {
+    if(chance(modem->random) < rate) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//command sends a command of `bytes` bytes, returning true if the SIM800L got
+//it. If it didn't, or we're at the wrong baud, we wait out the timeout.
+bool command(simulatedSIM800L *modem, int bytes, uint32_t timeoutMs) {
+  modem->commands++;
+  modem->clockMs += bytes * byteMs(modem->ourBaud);
+  if(modem->modemBaud == 0 && modem->ourBaud <= 115200) {
+    modem->modemBaud = modem->ourBaud;
+  }
+  if(modem->ourBaud != modem->modemBaud || !crosses(modem, bytes)) {
+    modem->clockMs += timeoutMs;
+    return false;
+  }
+  modem->clockMs += MODEM_LATENCY_MS;
+  return true;
+}
+
+//respond sends a response of `bytes` bytes back, returning true if we got it
+bool respond(simulatedSIM800L *modem, int bytes, uint32_t timeoutMs) {
+  modem->clockMs += bytes * byteMs(modem->ourBaud);
+  if(!crosses(modem, bytes)) {
+    modem->clockMs += timeoutMs;
+    return false;
+  }
+  return true;
+}
+
+bool simulatedTestAT(uint32_t timeoutMs, void *arg) {
+  simulatedSIM800L *modem = (simulatedSIM800L *)arg;
+  //"AT\r", then "\r\nOK\r\n"
+  return command(modem, 3, timeoutMs) && respond(modem, 6, timeoutMs);
+}
+
+bool simulatedSetModemBaud(uint32_t baud, void *arg) {
+  simulatedSIM800L *modem = (simulatedSIM800L *)arg;
+  //"AT+IPR=460800\r", then "\r\nOK\r\n" or "\r\nERROR\r\n"
+  if(!command(modem, 14, 1000)) {
+    return false;
+  }
+  if(baud > modem->maxBaud) {
+    respond(modem, 9, 1000);
+    return false;
+  }
+  //The OK goes at the old baud, then it moves
+  bool ok = respond(modem, 6, 1000);
+  modem->modemBaud = baud;
+  return ok;
+}
+
+void simulatedSetBaud(uint32_t baud, void *arg) {
+  simulatedSIM800L *modem = (simulatedSIM800L *)arg;
+  modem->ourBaud = baud;
+  modem->clockMs += SETTLE_MS;
+}
+
+void printTried(uint32_t baud, baudResult result, void *arg) {
+  const char *results[] = {"rejected", "unreliable", "reliable"};
+  printf("[main] -   %6u baud %s\n", baud, results[result]);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Main
+
+int main() {
+  simulatedSIM800L modems[] = {
+    {"is fresh from power on", 0, 460800, 0, 0, 460800},
+    {"garbles at 460800", 0, 460800, 460800, 0.05, 230400},
+    //Once it's at 460800 nothing gets through to move it back, so it's lost
+    //until it's power cycled
+    {"garbles everything at 460800", 0, 460800, 460800, 0.5, 0},
+    {"takes up to 115200", 0, 115200, 0, 0, 115200},
+    {"kept 230400 through a reset", 230400, 230400, 0, 0, 230400},
+    {"kept 460800 but garbles it", 460800, 460800, 460800, 0.05, 230400},
+  };
+
+  int failures = 0;
+  for(simulatedSIM800L &modem : modems) {
+    modem.ourBaud = SIM800L_INITIAL_BAUD;
+    modem.random.seed(1);
+    baudLink link = {simulatedTestAT, simulatedSetModemBaud, simulatedSetBaud, printTried, &modem};
+
+    printf("[main] - SIM800L that %s:\n", modem.name);
+    uint32_t baud = findBaud(&link);
+    if(baud != 0) {
+      printf("[main] -   %6u baud found\n", baud);
+      baud = negotiateBaud(&link, baud);
+    }
+    if(baud != modem.expected || (baud != 0 && modem.modemBaud != baud)) {
+      printf("[main] -   Ended up at %u baud (SIM800L at %u) rather than %u :(\n", baud, modem.modemBaud, modem.expected);
+      failures++;
+      continue;
+    }
+    if(baud == 0) {
+      printf("[main] -   Lost the SIM800L after %.0f ms, as expected\n", modem.clockMs);
+      continue;
+    }
+
+    double before = JPEG_BYTES * byteMs(SIM800L_INITIAL_BAUD);
+    double after = JPEG_BYTES * byteMs(baud);
+    printf(
+      "[main] -   Negotiated %u baud in %.0f ms over %d commands, 6KB takes %.0f ms rather than %.0f ms (%.0fx faster)\n",
+      baud, modem.clockMs, modem.commands, after, before, before / after
+    );
+  }
+  if(failures > 0) {
+    printf("[main] - %d SIM800Ls ended up at the wrong baud :(\n", failures);
+    return 1;
+  }
+  return 0;
+}
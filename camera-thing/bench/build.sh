@@ -0,0 +1,7 @@
+g++ -std=c++17 -O2 -Wall -o motionBench motionBench.cpp
+g++ -std=c++17 -O2 -Wall -o ledFadeCheck ledFadeCheck.cpp
+g++ -std=c++17 -O2 -Wall -o classifierCheck classifierCheck.cpp
+g++ -std=c++17 -O2 -Wall -o preprocessBench preprocessBench.cpp -ljpeg
+g++ -std=c++17 -O2 -Wall -o frameStreamCheck frameStreamCheck.cpp
+g++ -std=c++17 -O2 -Wall -o frameCheckBench frameCheckBench.cpp
+g++ -std=c++17 -O2 -Wall -o baudNegotiationBench baudNegotiationBench.cpp
@@ -0,0 +1,250 @@
+// classifierCheck.cpp
+// Checks the on-device classifier's kernels (main/classifierKernels.h) bit for
+// bit against a plain reference implementation, on random models and frames:
+// every layer's output has to match exactly, as well as the confidences. The
+// reference checks the padding on every tap and does its arithmetic in 64
+// bits, so it's slow but hard to get wrong. Then it times the kernels, for a
+// rough idea of how they'll do on the ESP32.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "../main/classifierKernels.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Config
+
+//How many random models to check, and how many frames to check each on
+#define MODELS 64
+#define FRAMES 8
+//How many times to run the kernels when timing them
+#define ROUNDS 200
+
+/////////////////////////////////////////////////////////////////////////////
+// Reference
+
+//refRequantise scales an accumulator down with floor division, rather than
+//shifting, then clamps it
+int32_t refRequantise(int64_t acc, int32_t multiplier, int shift, int32_t min, int32_t max) {
+  int64_t divisor = (int64_t)1 << (31 + shift);
+  int64_t num = acc * multiplier + divisor / 2;
+  int64_t q = num >= 0 ? num / divisor : -((-num + divisor - 1) / divisor);
+  return q < min ? min : (q > max ? max : (int32_t)q);
+}
+
+//refShrink averages each 4x4 block of a YUV422 frame a pixel at a time
+void refShrink(const uint8_t *yuyv, int8_t *out) {
+  for(int y = 0; y < CLASSIFIER_INPUT_HEIGHT; y++) {
+    for(int x = 0; x < CLASSIFIER_INPUT_WIDTH; x++) {
+      int sums[3] = {0, 0, 0};
+      for(int py = y * 4; py < y * 4 + 4; py++) {
+        for(int px = x * 4; px < x * 4 + 4; px++) {
+          const uint8_t *pair = yuyv + (py * CLASSIFIER_FRAME_WIDTH + (px & ~1)) * 2;
+          sums[0] += pair[(px & 1) * 2];
+          //Each pixel pair shares a U & V, so count them once a pair
+          if((px & 1) == 0) {
+            sums[1] += pair[1];
+            sums[2] += pair[3];
+          }
+        }
+      }
+      int8_t *o = out + (y * CLASSIFIER_INPUT_WIDTH + x) * 3;
+      o[0] = (int8_t)((sums[0] + 8) / 16 - 128);
+      o[1] = (int8_t)((sums[1] + 4) / 8 - 128);
+      o[2] = (int8_t)((sums[2] + 4) / 8 - 128);
+    }
+  }
+}
+
+//refConvolve runs a 3x3, stride 2, padded convolution with a ReLU
+void refConvolve(const int8_t *in, int w, int h, int inC, const classifierLayer *layer, int8_t *out, int outC) {
+  int outW = (w + 1) / 2;
+  int outH = (h + 1) / 2;
+  for(int oy = 0; oy < outH; oy++) {
+    for(int ox = 0; ox < outW; ox++) {
+      for(int oc = 0; oc < outC; oc++) {
+        int64_t acc = layer->bias[oc];
+        for(int ky = 0; ky < 3; ky++) {
+          for(int kx = 0; kx < 3; kx++) {
+            int iy = oy * 2 + ky - 1;
+            int ix = ox * 2 + kx - 1;
+            if(iy < 0 || iy >= h || ix < 0 || ix >= w) {
+              continue;
+            }
+            for(int ic = 0; ic < inC; ic++) {
+              acc += (int64_t)in[(iy * w + ix) * inC + ic] * layer->weights[((oc * 3 + ky) * 3 + kx) * inC + ic];
+            }
+          }
+        }
+        out[(oy * outW + ox) * outC + oc] = (int8_t)refRequantise(acc, layer->multiplier, layer->shift, 0, 127);
+      }
+    }
+  }
+}
+
+//refClassify runs the whole network, filling in a reference scratch
+void refClassify(const classifierModel *model, const uint8_t *yuyv, classifierScratch *s, uint8_t *confidences) {
+  memset(s, 0, sizeof(*s));
+  refShrink(yuyv, &s->input[0][0][0]);
+  refConvolve(&s->input[0][0][0], CLASSIFIER_INPUT_WIDTH, CLASSIFIER_INPUT_HEIGHT, 3, &model->conv1, &s->conv1[0][0][0], CLASSIFIER_CONV1_CHANNELS);
+  refConvolve(&s->conv1[0][0][0], CLASSIFIER_CONV1_WIDTH, CLASSIFIER_CONV1_HEIGHT, CLASSIFIER_CONV1_CHANNELS, &model->conv2, &s->conv2[0][0][0], CLASSIFIER_CONV2_CHANNELS);
+
+  //Average pool, rounding halves up
+  int pixels = CLASSIFIER_CONV2_WIDTH * CLASSIFIER_CONV2_HEIGHT;
+  for(int c = 0; c < CLASSIFIER_CONV2_CHANNELS; c++) {
+    int64_t sum = 0;
+    for(int i = 0; i < pixels; i++) {
+      sum += (&s->conv2[0][0][0])[i * CLASSIFIER_CONV2_CHANNELS + c];
+    }
+    s->pooled[c] = (int8_t)((sum * 2 + pixels) / (pixels * 2));
+  }
+
+  //Dense
+  for(int o = 0; o < model->classes; o++) {
+    int64_t acc = model->dense.bias[o];
+    for(int i = 0; i < CLASSIFIER_CONV2_CHANNELS; i++) {
+      acc += (int64_t)s->pooled[i] * model->dense.weights[o * CLASSIFIER_CONV2_CHANNELS + i];
+    }
+    s->logits[o] = (int8_t)refRequantise(acc, model->dense.multiplier, model->dense.shift, -128, 127);
+  }
+
+  //Softmax, from the same table of e^(-d/16)
+  int biggest = *std::max_element(s->logits, s->logits + model->classes);
+  uint64_t sum = 0;
+  for(int o = 0; o < model->classes; o++) {
+    int d = biggest - s->logits[o];
+    sum += d < CLASSIFIER_EXP_TABLE_SIZE ? classifierExpTable[d] : 0;
+  }
+  for(int o = 0; o < model->classes; o++) {
+    int d = biggest - s->logits[o];
+    uint64_t e = d < CLASSIFIER_EXP_TABLE_SIZE ? classifierExpTable[d] : 0;
+    confidences[o] = (uint8_t)(e * 100 / sum);
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Random models & frames
+
+//A model along with the weights it points to
+struct randomModel {
+  std::vector<int8_t> conv1Weights, conv2Weights, denseWeights;
+  std::vector<int32_t> conv1Bias, conv2Bias, denseBias;
+  classifierModel model;
+};
+
+//makeLayer fills in random weights & biases, and a random scale. Models with
+//big weights and small shifts saturate a lot, which is worth checking too.
+classifierLayer makeLayer(std::mt19937 &random, std::vector<int8_t> &weights, std::vector<int32_t> &bias, int weightCount, int outputs, int maxWeight, int minShift) {
+  std::uniform_int_distribution<int> weight(-maxWeight - 1, maxWeight);
+  std::uniform_int_distribution<int32_t> biasValue(-20000, 20000);
+  std::uniform_int_distribution<int32_t> multiplier(1 << 30, INT32_MAX);
+  std::uniform_int_distribution<int> shift(minShift, minShift + 6);
+  weights.resize(weightCount);
+  bias.resize(outputs);
+  for(auto &w : weights) {
+    w = (int8_t)weight(random);
+  }
+  for(auto &b : bias) {
+    b = biasValue(random);
+  }
+  return classifierLayer{weights.data(), bias.data(), multiplier(random), shift(random)};
+}
+
+//makeModel makes a random model, whose dense layer shifts by at least
+//`denseShift`, so some models are confident and some aren't
+void makeModel(std::mt19937 &random, randomModel *m, int denseShift) {
+  static const char *labels[CLASSIFIER_MAX_CLASSES] = {"label"};
+  bool saturating = random() % 4 == 0;
+  int maxWeight = saturating ? 127 : 31;
+  int minShift = saturating ? 0 : 4;
+  int classes = 1 + random() % CLASSIFIER_MAX_CLASSES;
+  m->model.conv1 = makeLayer(random, m->conv1Weights, m->conv1Bias, CLASSIFIER_CONV1_CHANNELS * 9 * CLASSIFIER_INPUT_CHANNELS, CLASSIFIER_CONV1_CHANNELS, maxWeight, minShift);
+  m->model.conv2 = makeLayer(random, m->conv2Weights, m->conv2Bias, CLASSIFIER_CONV2_CHANNELS * 9 * CLASSIFIER_CONV1_CHANNELS, CLASSIFIER_CONV2_CHANNELS, maxWeight, minShift);
+  m->model.dense = makeLayer(random, m->denseWeights, m->denseBias, classes * CLASSIFIER_CONV2_CHANNELS, classes, maxWeight, denseShift);
+  m->model.classes = classes;
+  m->model.labels = labels;
+}
+
+//makeFrame makes a frame of noise, or of smooth gradients with a little noise,
+//which looks more like a photo
+void makeFrame(std::mt19937 &random, std::vector<uint8_t> &frame) {
+  frame.resize(CLASSIFIER_FRAME_WIDTH * CLASSIFIER_FRAME_HEIGHT * 2);
+  bool noise = random() % 2 == 0;
+  int dx = random() % 3, dy = random() % 3, base = random() % 64;
+  for(int y = 0; y < CLASSIFIER_FRAME_HEIGHT; y++) {
+    for(int x = 0; x < CLASSIFIER_FRAME_WIDTH * 2; x++) {
+      int v = noise ? random() & 0xFF : base + x * dx / 2 + y * dy + (int)(random() % 16);
+      frame[y * CLASSIFIER_FRAME_WIDTH * 2 + x] = (uint8_t)(v > 255 ? 255 : v);
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Main
+
+int main() {
+  std::mt19937 random(1);
+  std::vector<uint8_t> frame;
+  classifierScratch kernels, reference;
+  uint8_t kernelConfidences[CLASSIFIER_MAX_CLASSES], refConfidences[CLASSIFIER_MAX_CLASSES];
+  int confident = 0;
+
+  //Check the kernels against the reference on every frame of every model
+  randomModel m;
+  for(int i = 0; i < MODELS; i++) {
+    makeModel(random, &m, i % 8);
+    for(int f = 0; f < FRAMES; f++) {
+      makeFrame(random, frame);
+      memset(&kernels, 0, sizeof(kernels));
+      classifyYUV422(&m.model, frame.data(), &kernels, kernelConfidences);
+      refClassify(&m.model, frame.data(), &reference, refConfidences);
+
+      const char *mismatch = nullptr;
+      if(memcmp(kernels.input, reference.input, sizeof(kernels.input)) != 0) {
+        mismatch = "shrunk input";
+      } else if(memcmp(kernels.conv1, reference.conv1, sizeof(kernels.conv1)) != 0) {
+        mismatch = "first convolution";
+      } else if(memcmp(kernels.conv2, reference.conv2, sizeof(kernels.conv2)) != 0) {
+        mismatch = "second convolution";
+      } else if(memcmp(kernels.pooled, reference.pooled, sizeof(kernels.pooled)) != 0) {
+        mismatch = "pooling";
+      } else if(memcmp(kernels.logits, reference.logits, m.model.classes) != 0) {
+        mismatch = "logits";
+      } else if(memcmp(kernelConfidences, refConfidences, m.model.classes) != 0) {
+        mismatch = "confidences";
+      }
+      if(mismatch != nullptr) {
+        printf("[main] - Kernels disagree with the reference on the %s, model %d frame %d :(\n", mismatch, i, f);
+        return 1;
+      }
+      confident += *std::max_element(kernelConfidences, kernelConfidences + m.model.classes) >= 80;
+    }
+  }
+  printf("[main] - Kernels match the reference on %d frames of %d models (%d confident)\n", FRAMES * MODELS, MODELS, confident);
+
+  //Time the kernels on the last model
+  uint32_t checksum = 0;
+  auto started = std::chrono::steady_clock::now();
+  for(int r = 0; r < ROUNDS; r++) {
+    classifyYUV422(&m.model, frame.data(), &kernels, kernelConfidences);
+    checksum += kernelConfidences[r % m.model.classes];
+  }
+  double kernelMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+
+  started = std::chrono::steady_clock::now();
+  for(int r = 0; r < ROUNDS; r++) {
+    refClassify(&m.model, frame.data(), &reference, refConfidences);
+    checksum += refConfidences[r % m.model.classes];
+  }
+  double refMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+
+  printf("[main] - Reference: %.2f us per frame\n", refMicros / ROUNDS);
+  printf("[main] - Kernels:   %.2f us per frame (%.1fx)\n", kernelMicros / ROUNDS, refMicros / kernelMicros);
+  printf("[main] - Scratch: %zu bytes\n", sizeof(classifierScratch));
+  printf("[main] - (checksum %u)\n", checksum);
+  return 0;
+}
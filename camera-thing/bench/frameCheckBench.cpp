@@ -0,0 +1,183 @@
+// frameCheckBench.cpp
+// Checks the frame check (main/frameCheck.h) on the host: QQVGA YUV422 frames
+// of scenes from a dark room to a blown out sky have to pass, and frames with
+// each of the glitches the OV7670 gives us have to be caught as that glitch.
+// Then it times the check on the good frames, which is the price every frame
+// pays, and on a black frame.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+#include "../main/frameCheck.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Config
+
+#define FRAME_WIDTH 160
+#define FRAME_HEIGHT 120
+#define FRAME_BYTES (FRAME_WIDTH * FRAME_HEIGHT * 2)
+#define FRAME_WORDS (FRAME_BYTES / 4)
+
+//How many good frames of each scene to make, and how many times to time them
+#define FRAMES 64
+#define ROUNDS 200
+
+/////////////////////////////////////////////////////////////////////////////
+// Utils
+
+//cycles reads the CPU's timestamp counter, or falls back to nanoseconds
+uint64_t cycles() {
+  #if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+  #else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  #endif
+}
+
+//setPixel sets a pixel's luma, and the U or V that goes with it
+void setPixel(uint8_t *frame, int x, int y, float luma, float chroma) {
+  uint8_t *pixel = frame + (y * FRAME_WIDTH + x) * 2;
+  pixel[0] = luma < 0 ? 0 : (luma > 255 ? 255 : luma);
+  pixel[1] = chroma < 0 ? 0 : (chroma > 255 ? 255 : chroma);
+}
+
+//The scenes the good frames are of
+enum scene {
+  SCENE_ROOM,  //A dim room, like preprocessBench's
+  SCENE_DARK,  //A room at night, hardly above the sensor's black level
+  SCENE_SKY,   //The top half blown out to white
+  SCENES,
+};
+const char *sceneNames[SCENES] = {"room", "dark", "sky"};
+
+//makeFrame draws a scene with sensor noise, somewhere different in each frame
+void makeFrame(uint8_t *frame, scene s, int f, std::mt19937 &random) {
+  std::normal_distribution<float> noise(0, s == SCENE_DARK ? 2 : 5);
+  for(int y = 0; y < FRAME_HEIGHT; y++) {
+    for(int x = 0; x < FRAME_WIDTH; x++) {
+      float shade = 0.3f + 0.3f * x / FRAME_WIDTH + 0.1f * y / FRAME_HEIGHT;
+      if(abs(x - 40 - f) < 20 && abs(y - 60) < 30) {
+        shade = 0.15f;
+      }
+      if(s == SCENE_SKY && y < FRAME_HEIGHT / 2) {
+        setPixel(frame, x, y, 255, 128);
+      } else if(s == SCENE_DARK) {
+        setPixel(frame, x, y, 8 + 10 * shade + noise(random), 128 + noise(random) / 2);
+      } else {
+        setPixel(frame, x, y, 70 + 90 * shade + noise(random), 128 + 10 * shade + noise(random) / 2);
+      }
+    }
+  }
+}
+
+//fillFrame sets every pixel of a frame to the same luma & chroma
+void fillFrame(uint8_t *frame, int luma, int chroma) {
+  for(int i = 0; i < FRAME_BYTES; i += 2) {
+    frame[i] = luma;
+    frame[i + 1] = chroma;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Main
+
+int main() {
+  std::mt19937 random(1);
+  frameStats stats;
+  int failures = 0;
+
+  //Every good frame has to pass
+  std::vector<std::vector<uint32_t>> frames;
+  for(int s = 0; s < SCENES; s++) {
+    int worstDetail = 1 << 30;
+    for(int f = 0; f < FRAMES; f++) {
+      std::vector<uint32_t> frame(FRAME_WORDS);
+      makeFrame((uint8_t *)frame.data(), (scene)s, f, random);
+      frameFault fault = checkFrame(frame.data(), FRAME_BYTES, FRAME_WIDTH, FRAME_HEIGHT, &stats);
+      if(fault != FRAME_OK) {
+        printf("[main] - Good %s frame %d was %s :(\n", sceneNames[s], f, frameFaultName(fault));
+        failures++;
+      }
+      worstDetail = stats.detail < worstDetail ? stats.detail : worstDetail;
+      frames.push_back(frame);
+    }
+    printf("[main] - Checked %d %s frames, luma %d, detail down to %d/16\n", FRAMES, sceneNames[s], stats.meanLuma, worstDetail);
+  }
+
+  //Every glitch has to be caught as what it is
+  struct glitch {
+    const char *name;
+    frameFault expected;
+    size_t len;
+    void (*make)(uint8_t *frame);
+  };
+  glitch glitches[] = {
+    {"short frame", FRAME_WRONG_SIZE, FRAME_BYTES - FRAME_WIDTH * 2, [](uint8_t *) {}},
+    {"long frame", FRAME_WRONG_SIZE, FRAME_BYTES + 4, [](uint8_t *) {}},
+    {"unfinished DMA", FRAME_TRUNCATED, FRAME_BYTES, [](uint8_t *frame) {
+      memset(frame + FRAME_BYTES * 3 / 4, 0, FRAME_BYTES / 4);
+    }},
+    {"zeroed frame", FRAME_TRUNCATED, FRAME_BYTES, [](uint8_t *frame) {
+      memset(frame, 0, FRAME_BYTES);
+    }},
+    {"doubled rows", FRAME_REPEATED_ROWS, FRAME_BYTES, [](uint8_t *frame) {
+      for(int y = 40; y < 80; y += 2) {
+        memcpy(frame + (y + 1) * FRAME_WIDTH * 2, frame + y * FRAME_WIDTH * 2, FRAME_WIDTH * 2);
+      }
+    }},
+    {"stuck rows", FRAME_REPEATED_ROWS, FRAME_BYTES, [](uint8_t *frame) {
+      for(int y = 100; y < FRAME_HEIGHT; y++) {
+        memcpy(frame + y * FRAME_WIDTH * 2, frame + 99 * FRAME_WIDTH * 2, FRAME_WIDTH * 2);
+      }
+    }},
+    {"black frame", FRAME_BLACK, FRAME_BYTES, [](uint8_t *frame) {
+      for(int i = 0; i < FRAME_BYTES; i += 2) {
+        frame[i] = (i / 2) % 7 == 0 ? 4 : 1;
+        frame[i + 1] = 128;
+      }
+    }},
+    {"white frame", FRAME_WHITE, FRAME_BYTES, [](uint8_t *frame) { fillFrame(frame, 255, 128); }},
+    {"grey frame", FRAME_FLAT, FRAME_BYTES, [](uint8_t *frame) { fillFrame(frame, 128, 128); }},
+  };
+  std::vector<uint32_t> bad(FRAME_WORDS + 1);
+  for(glitch &g : glitches) {
+    memcpy(bad.data(), frames[0].data(), FRAME_BYTES);
+    g.make((uint8_t *)bad.data());
+    frameFault fault = checkFrame(bad.data(), g.len, FRAME_WIDTH, FRAME_HEIGHT, &stats);
+    if(fault != g.expected) {
+      printf("[main] - The %s was %s rather than %s :(\n", g.name, frameFaultName(fault), frameFaultName(g.expected));
+      failures++;
+    }
+  }
+  if(failures > 0) {
+    printf("[main] - %d frames were checked wrong :(\n", failures);
+    return 1;
+  }
+  printf("[main] - Passed all %d good frames, and caught all %d glitches\n", (int)frames.size(), (int)(sizeof(glitches) / sizeof(glitches[0])));
+
+  //Time the check on the good frames, and on the black frame
+  uint64_t total = 0;
+  for(int r = 0; r < ROUNDS; r++) {
+    for(std::vector<uint32_t> &frame : frames) {
+      uint64_t started = cycles();
+      checkFrame(frame.data(), FRAME_BYTES, FRAME_WIDTH, FRAME_HEIGHT, &stats);
+      total += cycles() - started;
+    }
+  }
+  printf("[main] - %-11s %8.0f cycles per frame\n", "good frames", (double)total / (ROUNDS * frames.size()));
+  glitches[6].make((uint8_t *)bad.data());
+  total = 0;
+  for(int r = 0; r < ROUNDS; r++) {
+    uint64_t started = cycles();
+    checkFrame(bad.data(), FRAME_BYTES, FRAME_WIDTH, FRAME_HEIGHT, &stats);
+    total += cycles() - started;
+  }
+  printf("[main] - %-11s %8.0f cycles per frame\n", "black frame", (double)total / ROUNDS);
+  return 0;
+}
@@ -0,0 +1,111 @@
+// frameStreamCheck.cpp
+// Checks the frame stream protocol (main/frameStreamProtocol.h) round trips
+// through the viewer's reader (viewer/frameReader.h): frames in every layout
+// and encoding, with log text between them, fed in at odd sized chunks, have
+// to come out exactly as they went in, and a frame mangled on the way has to
+// be dropped without losing the ones after it. Also prints how much PackBits
+// saves on each kind of frame.
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "../viewer/frameReader.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Config
+
+#define FRAME_WIDTH 160
+#define FRAME_HEIGHT 120
+#define FRAME_BYTES (FRAME_WIDTH * FRAME_HEIGHT * 2)
+
+/////////////////////////////////////////////////////////////////////////////
+// Utils
+
+//appendBytes is a frameStreamWriter into a vector
+void appendBytes(const uint8_t *data, size_t len, void *arg) {
+  std::vector<uint8_t> *out = (std::vector<uint8_t> *)arg;
+  out->insert(out->end(), data, data + len);
+}
+
+//expectedPayload is what a frame's payload should decode to
+std::vector<uint8_t> expectedPayload(const std::vector<uint8_t> &frame, frameLayout layout) {
+  if(layout == FRAME_LAYOUT_YUV422) {
+    return frame;
+  }
+  std::vector<uint8_t> luma;
+  for(size_t i = 0; i < frame.size(); i += 2) {
+    luma.push_back(frame[i]);
+  }
+  return luma;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Main
+
+int main() {
+  //Frames of noise, of flat colour, and of a flat background with a noisy
+  //square on it, which is about the best & worst cases for PackBits
+  std::mt19937 random(1);
+  std::vector<std::vector<uint8_t>> frames(3, std::vector<uint8_t>(FRAME_BYTES));
+  const char *kinds[] = {"noise", "flat", "square"};
+  for(int i = 0; i < FRAME_BYTES; i++) {
+    int x = i / 2 % FRAME_WIDTH, y = i / 2 / FRAME_WIDTH;
+    frames[0][i] = random() & 0xFF;
+    frames[1][i] = i % 2 ? 128 : 90;
+    frames[2][i] = (x > 40 && x < 100 && y > 30 && y < 90) ? random() & 0xFF : (i % 4 == 1 ? 100 : 60);
+  }
+
+  //Send every frame in every layout & encoding, with some log in between
+  std::vector<uint8_t> stream;
+  std::vector<std::vector<uint8_t>> sent;
+  std::string log;
+  uint32_t sequence = 0;
+  for(int layout = FRAME_LAYOUT_YUV422; layout <= FRAME_LAYOUT_LUMA; layout++) {
+    for(int encoding = FRAME_ENCODING_RAW; encoding <= FRAME_ENCODING_PACKBITS; encoding++) {
+      for(int f = 0; f < 3; f++) {
+        std::string line = "[loop] - Frame " + std::to_string(sequence) + " next, CTF and C then CTF1\n";
+        stream.insert(stream.end(), line.begin(), line.end());
+        log += line;
+
+        size_t before = stream.size();
+        frameInfo info = {sequence++, 0, FRAME_WIDTH, FRAME_HEIGHT, (frameLayout)layout, (frameEncoding)encoding, 0};
+        sendFrame(frames[f].data(), info, appendBytes, &stream);
+        sent.push_back(expectedPayload(frames[f], (frameLayout)layout));
+        printf("[main] - %-6s %-6s %-8s %6zu bytes for %5zu bytes of frame\n",
+          kinds[f], layout == FRAME_LAYOUT_LUMA ? "luma" : "YUV422",
+          encoding == FRAME_ENCODING_PACKBITS ? "PackBits" : "raw",
+          stream.size() - before, sent.back().size());
+      }
+    }
+  }
+
+  //Then one that gets a byte flipped in the middle, and one after it that
+  //should still get through
+  size_t mangledAt = stream.size() + FRAME_STREAM_HEADER_SIZE + 1000;
+  frameInfo info = {sequence++, 0, FRAME_WIDTH, FRAME_HEIGHT, FRAME_LAYOUT_YUV422, FRAME_ENCODING_PACKBITS, 0};
+  sendFrame(frames[2].data(), info, appendBytes, &stream);
+  stream[mangledAt] ^= 0x5A;
+  info.sequence = sequence++;
+  sendFrame(frames[2].data(), info, appendBytes, &stream);
+  sent.push_back(frames[2]);
+
+  //Read it all back in odd sized chunks
+  FrameReader reader;
+  std::string gotLog;
+  std::vector<std::vector<uint8_t>> got;
+  reader.onText = [&](const uint8_t *text, size_t len) { gotLog.append((const char *)text, len); };
+  reader.onFrame = [&](const frameInfo &info, const std::vector<uint8_t> &payload) { got.push_back(payload); };
+  for(size_t i = 0; i < stream.size();) {
+    size_t len = std::min<size_t>(1 + random() % 3000, stream.size() - i);
+    reader.feed(stream.data() + i, len);
+    i += len;
+  }
+
+  bool ok = got == sent && reader.badFrames == 1 && gotLog.compare(0, log.size(), log) == 0;
+  printf("[main] - Got %zu of %zu frames back, %d dropped, log %s\n",
+    got.size(), sent.size(), reader.badFrames, gotLog.compare(0, log.size(), log) == 0 ? "intact" : "mangled");
+  printf(ok ? "Frames round trip\n" : "Frames don't round trip :(\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+// ledFadeCheck.cpp
+// Checks the fade engine's version of each AsyncLED animation (main/ledFades.h)
+// against the software version's waveform, a millisecond at a time over a few
+// loops of each, for a range of periods. Holds have to match exactly, and ramps
+// have to stay within a few duty cycle levels of the curve they approximate.
+// Prints the worst error for each animation, and fails if any's too big.
+
+#include <cmath>
+#include <cstdio>
+#include "../main/ledFades.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Config
+
+//How many loops of each animation to check
+#define LOOPS 3
+
+//How far a ramp can be from the curve it's approximating, in duty cycle levels
+#define LINEAR_TOLERANCE 1
+#define CURVE_TOLERANCE 3
+
+/////////////////////////////////////////////////////////////////////////////
+// Waveforms
+
+//fadeDuty gets the duty cycle `t` milliseconds into a loop of fades, the way
+//the LEDC would run them (starting from the last fade's duty cycle)
+int fadeDuty(ledFade *fades, int count, int t) {
+  t %= loopMillis(fades, count);
+  int from = fades[count - 1].duty;
+  for(int i = 0; i < count; i++) {
+    if(t < fades[i].millis) {
+      if(!fades[i].ramp) {
+        return fades[i].duty;
+      }
+      return (int)round(from + (fades[i].duty - from) * (double)t / fades[i].millis);
+    }
+    t -= fades[i].millis;
+    from = fades[i].duty;
+  }
+  return from;
+}
+
+//The software animations' duty cycles `t` milliseconds in, copied from
+//asyncLed.cpp
+int flashDuty(int delay, int t) {
+  return (t % (2 * delay)) < delay ? 255 : 0;
+}
+
+int blinkDuty(int offPeriod, int onPeriod, int t) {
+  return (t % (offPeriod + onPeriod)) < onPeriod ? 255 : 0;
+}
+
+int triangleDuty(int p, int t) {
+  float period = (float)p;
+  float delta = (float)(t % p);
+  if(delta < period/2) {
+    return round(255.0 * (2 * (delta/period)));
+  }
+  return round(255.0 * (2 - (2 * (delta/period))));
+}
+
+int breatheDuty(int period, int t) {
+  float delta = (float)t;
+  return round(255.0 * ((1.0 - cos((2*delta/period) * M_PI)) / 2.0));
+}
+
+int throbDuty(int a, int d, int t) {
+  float attack = (float)a;
+  float decay = (float)d;
+  float pos = fmod((float)t, (attack+decay));
+  if (pos < attack) {
+    return round(255.0 * ((1.0 - cos((pos/attack) * M_PI)) / 2.0));
+  }
+  return round(255.0 * ((1.0 + cos(((pos-attack)/decay) * M_PI)) / 2.0));
+}
+
+int stepDuty(int p, int steps, int t) {
+  float period = (float)p;
+  float pos = fmod((float)t, period)/period;
+  int dutyCycle = 255.0 * round(pos*steps - 0.5) / (steps - 1);
+  //round(-0.5) is -1, so the software version writes -1 at the very start
+  return dutyCycle < 0 ? 0 : dutyCycle;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Checks
+
+bool ok = true;
+
+//check compares one animation's fades with its software waveform, printing
+//the worst error, and returning it
+template <typename F>
+int check(const char *name, ledFade *fades, int count, int loop, int tolerance, F software) {
+  int worst = 0;
+  int worstAt = 0;
+  for(int t = 0; t < loop * LOOPS; t++) {
+    int err = abs(fadeDuty(fades, count, t) - software(t));
+    if(err > worst) {
+      worst = err;
+      worstAt = t;
+    }
+  }
+  bool passed = worst <= tolerance;
+  printf("%-28s %2d fades, worst error %3d at %5dms %s\n", name, count, worst, worstAt, passed ? "" : "FAIL");
+  ok = ok && passed;
+  return worst;
+}
+
+//checkShort checks an animation too short for its curves lasts `loop`
+//milliseconds, and that none of its fades take no time (which the fade engine
+//can't ramp over, and which would have divided by zero making them)
+void checkShort(const char *name, ledFade *fades, int count, int loop) {
+  bool passed = loopMillis(fades, count) == loop;
+  for(int i = 0; i < count; i++) {
+    passed = passed && fades[i].millis > 0;
+  }
+  printf("%-28s %2d fades, lasting %5dms %s\n", name, count, loopMillis(fades, count), passed ? "" : "FAIL");
+  ok = ok && passed;
+}
+
+int main() {
+  ledFade fades[LED_MAX_FADES];
+  char name[64];
+
+  int periods[] = {100, 333, 1000, 2500, 6000};
+  for(int period : periods) {
+    snprintf(name, sizeof(name), "flash(%d)", period);
+    check(name, fades, flashFades(period, fades), 2 * period, 0, [=](int t) { return flashDuty(period, t); });
+
+    snprintf(name, sizeof(name), "blink(%d, %d)", period, period / 3);
+    check(name, fades, blinkFades(period, period / 3, fades), period + period / 3, 0,
+      [=](int t) { return blinkDuty(period, period / 3, t); });
+
+    snprintf(name, sizeof(name), "triangle(%d)", period);
+    check(name, fades, triangleFades(period, fades), period, LINEAR_TOLERANCE,
+      [=](int t) { return triangleDuty(period, t); });
+
+    snprintf(name, sizeof(name), "breathe(%d)", period);
+    check(name, fades, breatheFades(period, fades), period, CURVE_TOLERANCE,
+      [=](int t) { return breatheDuty(period, t); });
+
+    snprintf(name, sizeof(name), "throb(%d, %d)", period / 4, period);
+    check(name, fades, throbFades(period / 4, period, fades), period / 4 + period, CURVE_TOLERANCE,
+      [=](int t) { return throbDuty(period / 4, period, t); });
+
+    for(int steps = 2; steps <= 8; steps *= 2) {
+      snprintf(name, sizeof(name), "step(%d, %d)", period, steps);
+      check(name, fades, stepFades(period, steps, fades), period, 0,
+        [=](int t) { return stepDuty(period, steps, t); });
+    }
+  }
+
+  //Periods too short to have a curve in them still have to last as long as
+  //asked, without any fades that take no time
+  checkShort("triangle(1)", fades, triangleFades(1, fades), 1);
+  checkShort("breathe(1)", fades, breatheFades(1, fades), 1);
+  checkShort("throb(0, 100)", fades, throbFades(0, 100, fades), 100);
+  checkShort("throb(0, 0)", fades, throbFades(0, 0, fades), 0);
+
+  printf(ok ? "All animations match\n" : "Some animations don't match\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+// motionBench.cpp
+// Benchmarks the motion detector's SAD kernel (main/motionSAD.h) on the host,
+// against a plain byte at a time version, over QQVGA YUV422 frames laid out
+// the way the camera gives them to us. Both have to agree on every block of
+// every frame, or it says so and fails.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "../main/motionSAD.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Config
+
+//The same frame and block sizes as motion.cpp
+#define FRAME_WIDTH 160
+#define FRAME_HEIGHT 120
+#define BLOCK_WIDTH 16
+#define BLOCK_HEIGHT 15
+#define BLOCKS (FRAME_WIDTH / BLOCK_WIDTH * FRAME_HEIGHT / BLOCK_HEIGHT)
+
+//How many frames to generate, and how many times to go through them
+#define FRAMES 16
+#define ROUNDS 500
+
+/////////////////////////////////////////////////////////////////////////////
+// Kernels
+
+//blockSADsScalar gets the SAD of each block between two YUV422 frames, a byte
+//at a time
+void blockSADsScalar(const uint8_t *frame, const uint8_t *last, uint32_t *sads) {
+  memset(sads, 0, sizeof(uint32_t) * BLOCKS);
+  for(int y = 0; y < FRAME_HEIGHT; y++) {
+    for(int x = 0; x < FRAME_WIDTH; x++) {
+      int i = (y * FRAME_WIDTH + x) * 2; //Luma is every other byte
+      int block = y / BLOCK_HEIGHT * (FRAME_WIDTH / BLOCK_WIDTH) + x / BLOCK_WIDTH;
+      sads[block] += abs(frame[i] - last[i]);
+    }
+  }
+}
+
+//blockSADsSWAR gets the SAD of each block between a YUV422 frame and the last
+//frame's packed luma, like changedBlocks in motion.cpp
+void blockSADsSWAR(const uint32_t *frame, uint32_t *lastLuma, uint32_t *sads) {
+  int blocksAcross = FRAME_WIDTH / BLOCK_WIDTH;
+  for(int top = 0; top < FRAME_HEIGHT; top += BLOCK_HEIGHT) {
+    uint32_t *totals = sads + top / BLOCK_HEIGHT * blocksAcross;
+    memset(totals, 0, sizeof(uint32_t) * blocksAcross);
+    for(int y = top; y < top + BLOCK_HEIGHT; y++) {
+      const uint32_t *row = frame + y * FRAME_WIDTH / 2;
+      uint32_t *lastRow = lastLuma + y * FRAME_WIDTH / 4;
+      for(int b = 0; b < blocksAcross; b++) {
+        int x = b * BLOCK_WIDTH;
+        totals[b] += sadLumaRow(row + x / 2, lastRow + x / 4, BLOCK_WIDTH);
+      }
+    }
+    for(int b = 0; b < blocksAcross; b++) {
+      totals[b] = sumLumaLanes(totals[b]);
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Main
+
+int main() {
+  //Frames of noise, each with a bright square moving across it, so there's
+  //every size of difference from 0 to 255
+  std::mt19937 random(1);
+  std::vector<std::vector<uint32_t>> frames(FRAMES, std::vector<uint32_t>(FRAME_WIDTH * FRAME_HEIGHT / 2));
+  for(int f = 0; f < FRAMES; f++) {
+    uint8_t *bytes = (uint8_t *)frames[f].data();
+    for(size_t i = 0; i < frames[f].size() * 4; i++) {
+      bytes[i] = random() & 0xFF;
+    }
+    for(int y = 40; y < 80; y++) {
+      for(int x = f * 8; x < f * 8 + 30 && x < FRAME_WIDTH; x++) {
+        bytes[(y * FRAME_WIDTH + x) * 2] = 255;
+      }
+    }
+  }
+
+  //Check the kernels agree on every pair of frames
+  std::vector<uint32_t> lastLuma(FRAME_WIDTH * FRAME_HEIGHT / 4);
+  uint32_t scalar[BLOCKS], swar[BLOCKS];
+  blockSADsSWAR(frames[FRAMES - 1].data(), lastLuma.data(), swar);
+  for(int f = 0; f < FRAMES; f++) {
+    const uint8_t *last = (const uint8_t *)frames[(f + FRAMES - 1) % FRAMES].data();
+    blockSADsScalar((const uint8_t *)frames[f].data(), last, scalar);
+    blockSADsSWAR(frames[f].data(), lastLuma.data(), swar);
+    if(memcmp(scalar, swar, sizeof(scalar)) != 0) {
+      printf("[main] - Kernels disagree on frame %d :(\n", f);
+      return 1;
+    }
+  }
+  printf("[main] - Kernels agree on all %d frames\n", FRAMES);
+
+  //Time them both
+  uint32_t checksum = 0;
+  auto started = std::chrono::steady_clock::now();
+  for(int r = 0; r < ROUNDS; r++) {
+    for(int f = 0; f < FRAMES; f++) {
+      blockSADsScalar((const uint8_t *)frames[f].data(), (const uint8_t *)frames[(f + 1) % FRAMES].data(), scalar);
+      checksum += scalar[r % BLOCKS];
+    }
+  }
+  double scalarMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+
+  started = std::chrono::steady_clock::now();
+  for(int r = 0; r < ROUNDS; r++) {
+    for(int f = 0; f < FRAMES; f++) {
+      blockSADsSWAR(frames[f].data(), lastLuma.data(), swar);
+      checksum += swar[r % BLOCKS];
+    }
+  }
+  double swarMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+
+  printf("[main] - Scalar: %.2f us per frame\n", scalarMicros / (ROUNDS * FRAMES));
+  printf("[main] - SWAR:   %.2f us per frame (%.1fx)\n", swarMicros / (ROUNDS * FRAMES), scalarMicros / swarMicros);
+  printf("[main] - (checksum %u)\n", checksum);
+  return 0;
+}
@@ -0,0 +1,258 @@
+// preprocessBench.cpp
+// Benchmarks the preprocessing kernels (main/preprocessKernels.h) on the host,
+// against plain byte at a time versions, over QQVGA YUV422 frames of a dim,
+// noisy scene like the OV7670 gives us. Both versions have to agree on every
+// byte of every frame, or it says so and fails. Then it encodes the frames at
+// the same quality as the CameraThing, with and without each kernel, to show
+// what the preprocessing does to the JPEG's size. Needs libjpeg.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <jpeglib.h>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+#include "../main/preprocessKernels.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Config
+
+//The same frame size and levels settings as preprocess.cpp
+#define FRAME_WIDTH 160
+#define FRAME_HEIGHT 120
+#define FRAME_WORDS (FRAME_WIDTH * FRAME_HEIGHT / 2)
+#define LEVELS_ROW_STEP 2
+#define LEVELS_CLIP 5
+
+//The same quality as encodeFrame in camera.cpp
+#define JPEG_QUALITY 90
+
+//How many frames to generate, and how many times to go through them
+#define FRAMES 16
+#define ROUNDS 200
+
+/////////////////////////////////////////////////////////////////////////////
+// Reference kernels
+
+//applyLevelsScalar is applyLevels a byte at a time
+void applyLevelsScalar(uint8_t *frame, lumaLevels levels) {
+  for(int i = 0; i < FRAME_WIDTH * FRAME_HEIGHT * 2; i += 2) {
+    int luma = frame[i] - (int)levels.black;
+    luma = luma < 0 ? 0 : (luma * (int)levels.gain + LEVELS_GAIN_ONE / 2) >> LEVELS_GAIN_BITS;
+    frame[i] = luma > 255 ? 255 : luma;
+  }
+}
+
+//denoiseLumaScalar is denoiseLuma a pixel at a time, from a copy of the luma
+void denoiseLumaScalar(uint8_t *frame) {
+  static uint8_t luma[FRAME_HEIGHT][FRAME_WIDTH];
+  for(int y = 0; y < FRAME_HEIGHT; y++) {
+    for(int x = 0; x < FRAME_WIDTH; x++) {
+      luma[y][x] = frame[(y * FRAME_WIDTH + x) * 2];
+    }
+  }
+  //The edges mirror the pixel inside them
+  auto at = [](int y, int x) {
+    y = y < 0 ? 1 : (y >= FRAME_HEIGHT ? FRAME_HEIGHT - 2 : y);
+    x = x < 0 ? 1 : (x >= FRAME_WIDTH ? FRAME_WIDTH - 2 : x);
+    return (int)luma[y][x];
+  };
+  const int weights[3] = {1, 2, 1};
+  for(int y = 0; y < FRAME_HEIGHT; y++) {
+    for(int x = 0; x < FRAME_WIDTH; x++) {
+      int total = 8;
+      for(int dy = -1; dy <= 1; dy++) {
+        for(int dx = -1; dx <= 1; dx++) {
+          total += weights[dy + 1] * weights[dx + 1] * at(y + dy, x + dx);
+        }
+      }
+      frame[(y * FRAME_WIDTH + x) * 2] = total >> 4;
+    }
+  }
+}
+
+//levelsFrame works out and applies a frame's levels, with either version
+void levelsFrame(uint32_t *frame, bool swar) {
+  static uint32_t histogram[256];
+  int pixels = lumaHistogram(frame, FRAME_WIDTH, FRAME_HEIGHT, LEVELS_ROW_STEP, histogram);
+  lumaLevels levels;
+  if(!findLevels(histogram, pixels, LEVELS_CLIP, &levels)) {
+    return;
+  }
+  if(swar) {
+    applyLevels(frame, FRAME_WORDS, levels);
+  } else {
+    applyLevelsScalar((uint8_t *)frame, levels);
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Utils
+
+//cycles reads the CPU's timestamp counter, or falls back to nanoseconds
+uint64_t cycles() {
+  #if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+  #else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  #endif
+}
+
+//jpegSize encodes a YUV422 frame as a JPEG, returning how many bytes it took
+size_t jpegSize(const uint8_t *frame) {
+  jpeg_compress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+  unsigned char *out = nullptr;
+  unsigned long outSize = 0;
+  jpeg_mem_dest(&cinfo, &out, &outSize);
+  cinfo.image_width = FRAME_WIDTH;
+  cinfo.image_height = FRAME_HEIGHT;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_YCbCr;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, JPEG_QUALITY, TRUE);
+  jpeg_start_compress(&cinfo, TRUE);
+  uint8_t row[FRAME_WIDTH * 3];
+  while(cinfo.next_scanline < cinfo.image_height) {
+    const uint8_t *yuyv = frame + cinfo.next_scanline * FRAME_WIDTH * 2;
+    for(int x = 0; x < FRAME_WIDTH; x += 2) {
+      const uint8_t *pair = yuyv + x * 2;
+      row[x * 3 + 0] = pair[0];
+      row[x * 3 + 1] = pair[1];
+      row[x * 3 + 2] = pair[3];
+      row[x * 3 + 3] = pair[2];
+      row[x * 3 + 4] = pair[1];
+      row[x * 3 + 5] = pair[3];
+    }
+    JSAMPROW rows[1] = {row};
+    jpeg_write_scanlines(&cinfo, rows, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+  free(out);
+  return outSize;
+}
+
+//makeFrame draws a dim, low contrast scene with sensor noise: a gradient
+//with a few blocks & discs on it, somewhere different in each frame
+void makeFrame(uint8_t *frame, int f, std::mt19937 &random) {
+  std::normal_distribution<float> noise(0, 5);
+  for(int y = 0; y < FRAME_HEIGHT; y++) {
+    for(int x = 0; x < FRAME_WIDTH; x++) {
+      float scene = 0.3f + 0.3f * x / FRAME_WIDTH + 0.1f * y / FRAME_HEIGHT;
+      if(abs(x - 40 - f * 4) < 20 && abs(y - 60) < 30) {
+        scene = 0.15f + 0.05f * ((x / 4 + y / 4) % 2);
+      }
+      float dx = x - 110 + f * 2, dy = y - 50;
+      if(dx * dx + dy * dy < 500) {
+        scene = 0.85f - 0.002f * (dx * dx + dy * dy) / 10;
+      }
+      float luma = 70 + 90 * scene + noise(random);
+      uint8_t *pixel = frame + (y * FRAME_WIDTH + x) * 2;
+      pixel[0] = luma < 0 ? 0 : (luma > 255 ? 255 : luma);
+      pixel[1] = 128 + (int)(10 * scene) + (int)noise(random) / 2; //U or V
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Main
+
+int main() {
+  std::mt19937 random(1);
+  std::vector<std::vector<uint32_t>> frames(FRAMES, std::vector<uint32_t>(FRAME_WORDS));
+  for(int f = 0; f < FRAMES; f++) {
+    makeFrame((uint8_t *)frames[f].data(), f, random);
+  }
+
+  //Check the kernels agree with the references on every frame
+  std::vector<uint32_t> scalar(FRAME_WORDS), swar(FRAME_WORDS);
+  std::vector<uint32_t> scratch(DENOISE_SCRATCH_WORDS(FRAME_WIDTH));
+  for(int f = 0; f < FRAMES; f++) {
+    scalar = frames[f];
+    swar = frames[f];
+    denoiseLumaScalar((uint8_t *)scalar.data());
+    denoiseLuma(swar.data(), FRAME_WIDTH, FRAME_HEIGHT, scratch.data());
+    if(scalar != swar) {
+      printf("[main] - Denoise kernels disagree on frame %d :(\n", f);
+      return 1;
+    }
+    levelsFrame(scalar.data(), false);
+    levelsFrame(swar.data(), true);
+    if(scalar != swar) {
+      printf("[main] - Levels kernels disagree on frame %d :(\n", f);
+      return 1;
+    }
+  }
+  //And on every possible black point & gain, over every luma
+  std::vector<uint32_t> ramp(FRAME_WORDS);
+  for(int i = 0; i < FRAME_WORDS; i++) {
+    ramp[i] = (i * 2 % 256) | 0x8000 | ((i * 2 + 1) % 256) << 16 | 0x80000000u;
+  }
+  for(uint32_t black = 0; black < 256; black++) {
+    for(uint32_t gain = LEVELS_GAIN_ONE; gain <= LEVELS_MAX_GAIN; gain++) {
+      scalar = ramp;
+      swar = ramp;
+      applyLevelsScalar((uint8_t *)scalar.data(), {black, gain});
+      applyLevels(swar.data(), FRAME_WORDS, {black, gain});
+      if(scalar != swar) {
+        printf("[main] - Levels kernels disagree with black %u, gain %u :(\n", black, gain);
+        return 1;
+      }
+    }
+  }
+  printf("[main] - Kernels agree on all %d frames, and every black point & gain\n", FRAMES);
+
+  //Time each kernel, both ways, on fresh copies of the frames
+  struct kernel {
+    const char *name;
+    void (*run)(uint32_t *frame, uint32_t *scratch);
+  };
+  static uint32_t histogram[256];
+  kernel kernels[] = {
+    {"histogram", [](uint32_t *frame, uint32_t *) { lumaHistogram(frame, FRAME_WIDTH, FRAME_HEIGHT, LEVELS_ROW_STEP, histogram); }},
+    {"levels scalar", [](uint32_t *frame, uint32_t *) { levelsFrame(frame, false); }},
+    {"levels SWAR", [](uint32_t *frame, uint32_t *) { levelsFrame(frame, true); }},
+    {"denoise scalar", [](uint32_t *frame, uint32_t *) { denoiseLumaScalar((uint8_t *)frame); }},
+    {"denoise SWAR", [](uint32_t *frame, uint32_t *scratch) { denoiseLuma(frame, FRAME_WIDTH, FRAME_HEIGHT, scratch); }},
+  };
+  std::vector<std::vector<uint32_t>> copies = frames;
+  for(kernel &k : kernels) {
+    uint64_t total = 0;
+    for(int r = 0; r < ROUNDS; r++) {
+      for(int f = 0; f < FRAMES; f++) {
+        memcpy(copies[f].data(), frames[f].data(), FRAME_WORDS * sizeof(uint32_t));
+        uint64_t started = cycles();
+        k.run(copies[f].data(), scratch.data());
+        total += cycles() - started;
+      }
+    }
+    printf("[main] - %-15s %8.0f cycles per frame\n", k.name, (double)total / (ROUNDS * FRAMES));
+  }
+
+  //Then see what each does to the JPEG's size
+  const char *variants[] = {"as captured", "levels", "denoise", "denoise+levels"};
+  for(int v = 0; v < 4; v++) {
+    size_t total = 0;
+    for(int f = 0; f < FRAMES; f++) {
+      std::vector<uint32_t> frame = frames[f];
+      if(v & 2) {
+        denoiseLuma(frame.data(), FRAME_WIDTH, FRAME_HEIGHT, scratch.data());
+      }
+      if(v & 1) {
+        levelsFrame(frame.data(), true);
+      }
+      total += jpegSize((const uint8_t *)frame.data());
+    }
+    printf("[main] - JPEG %-15s %6zu bytes per frame\n", variants[v], total / FRAMES);
+  }
+  return 0;
+}
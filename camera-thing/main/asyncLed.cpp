@@ -3,9 +3,18 @@
 // thread. Uses PWM to make nice animations.
 
 #include <Arduino.h>
+#include "driver/ledc.h"
 #include "utils.h"
+#include "telemetry.h"
 #include "asyncLed.h"
 
+/////////////////////////////////////////////////////////////////////////////
+// Config
+
+//The stacks of the tasks running the software & fade engine animations
+#define LED_ANIMATION_STACK 10000
+#define LED_FADE_STACK 4096
+
 /////////////////////////////////////////////////////////////////////////////
 // Constructor
 
@@ -23,21 +32,21 @@ AsyncLED::AsyncLED(int p, int c) {
 void AsyncLED::on() {
   Serial.printf("[AsyncLED.on] [Pin %d] - Turning LED on\n", pin);
   killAnimation();
-  ledcWrite(15, 255);
+  writeDuty(255);
 }
 
 //Kills any animations and turns the LED off
 void AsyncLED::off(){
   Serial.printf("[AsyncLED.off] [Pin %d] - Turning LED off\n", pin);
   killAnimation();
-  ledcWrite(15, 0);
+  writeDuty(0);
 };
 
 //Kills any animations and sets the LED to a given brightness (0-255)
 void AsyncLED::set(int dutyCycle){
   Serial.printf("[AsyncLED.off] [Pin %d] - Turning LED off\n", pin);
   killAnimation();
-  ledcWrite(15, dutyCycle);
+  writeDuty(dutyCycle);
 };
 
 /////////////////////////////////////////////////////////////////////////////
@@ -69,6 +78,13 @@ void AsyncLED::flash(int delay){
     killAnimation();
   }
 
+  //Let the fade engine run the animation if we can
+  #ifdef LED_FADE_ENGINE
+    ledFade fades[LED_MAX_FADES];
+    startFades(fades, flashFades(delay, fades));
+    return;
+  #endif
+
   //Create animation params
   currFlashAnimationParams = new flashAnimationParams{pin,channel,delay};
 
@@ -87,8 +103,9 @@ void AsyncLED::flash(int delay){
 
   //Create new animation task
   xTaskCreatePinnedToCore(
-    flashAnimationLoop, "flashAnimationLoop", 10000, currFlashAnimationParams, 1, &animationTask, 0
+    flashAnimationLoop, "flashAnimationLoop", LED_ANIMATION_STACK, currFlashAnimationParams, 1, &animationTask, 0
   );
+  watchTask("led", animationTask, LED_ANIMATION_STACK);
 
   //Tell everyone we're animating now
   animating = true;
@@ -123,6 +140,13 @@ void AsyncLED::blink(int offPeriod, int onPeriod){
     killAnimation();
   }
 
+  //Let the fade engine run the animation if we can
+  #ifdef LED_FADE_ENGINE
+    ledFade fades[LED_MAX_FADES];
+    startFades(fades, blinkFades(offPeriod, onPeriod, fades));
+    return;
+  #endif
+
   //Create animation params
   currBlinkAnimationParams = new blinkAnimationParams{pin,channel,offPeriod,onPeriod};
 
@@ -141,8 +165,9 @@ void AsyncLED::blink(int offPeriod, int onPeriod){
 
   //Create new animation task
   xTaskCreatePinnedToCore(
-    blinkAnimationLoop, "blinkAnimationLoop", 10000, currBlinkAnimationParams, 1, &animationTask, 0
+    blinkAnimationLoop, "blinkAnimationLoop", LED_ANIMATION_STACK, currBlinkAnimationParams, 1, &animationTask, 0
   );
+  watchTask("led", animationTask, LED_ANIMATION_STACK);
 
   //Tell everyone we're animating now
   animating = true;
@@ -177,6 +202,13 @@ void AsyncLED::triangle(int period) {
     killAnimation();
   }
 
+  //Let the fade engine run the animation if we can
+  #ifdef LED_FADE_ENGINE
+    ledFade fades[LED_MAX_FADES];
+    startFades(fades, triangleFades(period, fades));
+    return;
+  #endif
+
   //Create animation params
   currTriangleAnimationParams = new triangleAnimationParams{pin,channel,period};
 
@@ -208,8 +240,9 @@ void AsyncLED::triangle(int period) {
 
   //Create new animation task
   xTaskCreatePinnedToCore(
-    triangleAnimationLoop, "triangleAnimationLoop", 10000, currTriangleAnimationParams, 1, &animationTask, 0
+    triangleAnimationLoop, "triangleAnimationLoop", LED_ANIMATION_STACK, currTriangleAnimationParams, 1, &animationTask, 0
   );
+  watchTask("led", animationTask, LED_ANIMATION_STACK);
 
   //Tell everyone we're animating now
   animating = true;
@@ -244,6 +277,13 @@ void AsyncLED::breathe(int period) {
     killAnimation();
   }
 
+  //Let the fade engine run the animation if we can
+  #ifdef LED_FADE_ENGINE
+    ledFade fades[LED_MAX_FADES];
+    startFades(fades, breatheFades(period, fades));
+    return;
+  #endif
+
   //Create animation params
   currBreatheAnimationParams = new breatheAnimationParams{pin,channel,period};
 
@@ -270,8 +310,9 @@ void AsyncLED::breathe(int period) {
 
   //Create new animation task
   xTaskCreatePinnedToCore(
-    breatheAnimationLoop, "breatheAnimationLoop", 10000, currBreatheAnimationParams, 1, &animationTask, 0
+    breatheAnimationLoop, "breatheAnimationLoop", LED_ANIMATION_STACK, currBreatheAnimationParams, 1, &animationTask, 0
   );
+  watchTask("led", animationTask, LED_ANIMATION_STACK);
 
   //Tell everyone we're animating now
   animating = true;
@@ -311,6 +352,13 @@ void AsyncLED::throb(int attack, int decay) {
     killAnimation();
   }
 
+  //Let the fade engine run the animation if we can
+  #ifdef LED_FADE_ENGINE
+    ledFade fades[LED_MAX_FADES];
+    startFades(fades, throbFades(attack, decay, fades));
+    return;
+  #endif
+
   //Create animation params
   currThrobAnimationParams = new throbAnimationParams{pin,channel,attack,decay};
 
@@ -344,8 +392,9 @@ void AsyncLED::throb(int attack, int decay) {
 
   //Create new animation task
   xTaskCreatePinnedToCore(
-    throbAnimationLoop, "throbAnimationLoop", 10000, currThrobAnimationParams, 1, &animationTask, 0
+    throbAnimationLoop, "throbAnimationLoop", LED_ANIMATION_STACK, currThrobAnimationParams, 1, &animationTask, 0
   );
+  watchTask("led", animationTask, LED_ANIMATION_STACK);
 
   //Tell everyone we're animating now.
   animating = true;
@@ -381,6 +430,13 @@ void AsyncLED::step(int period, int steps) {
     killAnimation();
   }
 
+  //Let the fade engine run the animation if we can
+  #ifdef LED_FADE_ENGINE
+    ledFade fades[LED_MAX_FADES];
+    startFades(fades, stepFades(period, steps, fades));
+    return;
+  #endif
+
   //Create animation params
   currStepAnimationParams = new stepAnimationParams{pin,channel,period,steps};
 
@@ -410,20 +466,122 @@ void AsyncLED::step(int period, int steps) {
 
   //Create new animation task
   xTaskCreatePinnedToCore(
-    stepAnimationLoop, "stepAnimationLoop", 10000, currStepAnimationParams, 1, &animationTask, 0
+    stepAnimationLoop, "stepAnimationLoop", LED_ANIMATION_STACK, currStepAnimationParams, 1, &animationTask, 0
   );
+  watchTask("led", animationTask, LED_ANIMATION_STACK);
 
   //Tell everyone we're animating now.
   animating = true;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// Fade engine
+// With LED_FADE_ENGINE defined, each animation is a loop of fades (see
+// ledFades.h) which the LEDC runs in hardware. The animation's task starts each
+// fade then blocks until the fade-complete interrupt wakes it to start the
+// next, so it only runs a handful of times per loop rather than every 30ms.
+// Holds just block for as long as they last. The task can only be stopped
+// between fades, as deleting it mid-fade would leave the LEDC driver's fade
+// lock held, so killAnimation asks it to stop and waits for it.
+
+//Arduino numbers the LEDC's channels 0-15: the first 8 are the high speed
+//group's, and the rest are the low speed group's
+#define LEDC_MODE(channel)    ((ledc_mode_t)((channel) / 8))
+#define LEDC_CHANNEL(channel) ((ledc_channel_t)((channel) % 8))
+
+//Whether ledc_fade_func_install has been called yet
+bool fadeEngineInstalled = false;
+
+//Sets the LED to a given brightness (0-255) without touching any animation
+void AsyncLED::writeDuty(int dutyCycle) {
+  #ifdef LED_FADE_ENGINE
+    //ledcWrite would restart the last fade from the new duty cycle, but the
+    //driver clears the fade out
+    ledc_set_duty(LEDC_MODE(channel), LEDC_CHANNEL(channel), dutyCycle);
+    ledc_update_duty(LEDC_MODE(channel), LEDC_CHANNEL(channel));
+  #else
+    ledcWrite(channel, dutyCycle);
+  #endif
+}
+
+//Starts a task looping through `count` fades on the fade engine. A loop that
+//takes no time would never block, so it just sets where it ends up.
+void AsyncLED::startFades(ledFade *fades, int count) {
+  if(count == 0) {
+    return;
+  }
+  if(loopMillis(fades, count) == 0) {
+    writeDuty(fades[count - 1].duty);
+    return;
+  }
+  if(!fadeEngineInstalled) {
+    ledc_fade_func_install(0);
+    fadeEngineInstalled = true;
+  }
+
+  //Create animation
+  currFadeAnimation = new fadeAnimation{channel, {}, count, false, xSemaphoreCreateBinary()};
+  memcpy(currFadeAnimation->fades, fades, sizeof(ledFade) * count);
+
+  //Declare animation loop used for every fade engine animation
+  auto fadeAnimationLoop = [](void* p) {
+    //Cast void pointer to animation
+    fadeAnimation* animation = (fadeAnimation*)p;
+    ledc_mode_t mode = LEDC_MODE(animation->channel);
+    ledc_channel_t channel = LEDC_CHANNEL(animation->channel);
+
+    //Every loop ends at the duty cycle it starts at, so start from there
+    ledc_set_duty(mode, channel, animation->fades[animation->count - 1].duty);
+    ledc_update_duty(mode, channel);
+    for(int i = 0; !animation->stopping; i = (i + 1) % animation->count) {
+      ledFade* fade = &animation->fades[i];
+      if(fade->ramp && fade->millis > 0) {
+        ledc_set_fade_with_time(mode, channel, fade->duty, fade->millis);
+        ledc_fade_start(mode, channel, LEDC_FADE_WAIT_DONE);
+      } else {
+        ledc_set_duty(mode, channel, fade->duty);
+        ledc_update_duty(mode, channel);
+        //killAnimation notifies us, so a long hold doesn't hold it up
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(fade->millis));
+      }
+    }
+
+    //Let killAnimation know we're done
+    xSemaphoreGive(animation->stopped);
+    vTaskDelete(NULL);
+  };
+
+  //Create new animation task
+  xTaskCreatePinnedToCore(
+    fadeAnimationLoop, "fadeAnimationLoop", LED_FADE_STACK, currFadeAnimation, 1, &animationTask, 0
+  );
+  watchTask("led", animationTask, LED_FADE_STACK);
+
+  //Tell everyone we're animating now
+  animating = true;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // Animation utils
 
 //killAnimation stops any currently running animations.
 void AsyncLED::killAnimation() {
-  //Kill animation task if running
+  //Note how much stack the animation task used while it's still around
   if(animating) {
+    forgetTask(animationTask);
+  }
+
+  //Kill animation task if running
+  if(animating && currFadeAnimation != nullptr) {
+    //Fade engine animations have to stop themselves, see startFades
+    Serial.printf("[AsyncLED.killAnimation] [Pin %d] - Stopping current animation\n", pin);
+    currFadeAnimation->stopping = true;
+    xTaskNotifyGive(animationTask);
+    xSemaphoreTake(currFadeAnimation->stopped, portMAX_DELAY);
+    vSemaphoreDelete(currFadeAnimation->stopped);
+    delete(currFadeAnimation);
+    currFadeAnimation = nullptr;
+  } else if(animating) {
     Serial.printf("[AsyncLED.killAnimation] [Pin %d] - Killing current animation\n", pin);
     vTaskDelete(animationTask);
   } else {
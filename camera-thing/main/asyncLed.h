@@ -1,6 +1,24 @@
 // asyncLed.h
 // Defines and exports the AsyncLED class
 
+#ifndef ASYNC_LED_USED
+#define ASYNC_LED_USED
+
+#include "ledFades.h"
+
+//Comment this out to animate the LED in software, writing a new duty cycle
+//every 30ms, rather than with the LEDC's hardware fade engine
+#define LED_FADE_ENGINE
+
+//One loop of an animation for the fade engine to run, see ledFades.h
+struct fadeAnimation {
+  int channel;
+  ledFade fades[LED_MAX_FADES];
+  int count;
+  volatile bool stopping;     //Set to ask the animation task to stop
+  SemaphoreHandle_t stopped;  //Given by the animation task once it's stopped
+};
+
 class AsyncLED {
   private:
     int pin; //The pin of the LED
@@ -10,6 +28,10 @@ class AsyncLED {
     TaskHandle_t animationTask; //Holds the task running the current animation
     void killAnimation(); //Kills the current animation
 
+    fadeAnimation *currFadeAnimation = nullptr; //The fade engine's current animation
+    void startFades(ledFade *fades, int count); //Runs an animation on the fade engine
+    void writeDuty(int dutyCycle); //Sets the duty cycle straight away
+
   public:
     //Constructor
     AsyncLED(int p, int c);
@@ -26,4 +48,6 @@ class AsyncLED {
     void breathe(int period);
     void throb(int attackTime, int decayTime);
     void step(int period, int steps);
-};
\ No newline at end of file
+};
+
+#endif
@@ -0,0 +1,148 @@
+// baudNegotiation.h
+// Moves the SIM800L's UART up from the baud it autobauds at to the fastest one
+// it works reliably at. The SIM800L's reached through a baudLink, so this is
+// plain C++ with no Arduino dependencies, and can be run against a simulated
+// SIM800L on the host too (see camera-thing/bench).
+
+#ifndef BAUD_NEGOTIATION_USED
+  #define BAUD_NEGOTIATION_USED
+
+  #include <stdint.h>
+
+  //The baud we first talk to the SIM800L at. It autobauds at power on, so this
+  //just needs to be one it can detect.
+  #define SIM800L_INITIAL_BAUD 4800
+  //The bauds we try to move the SIM800L up to, fastest first. At 4800 baud a
+  //6KB JPEG spends over 12 seconds just crossing the UART!
+  static const uint32_t SIM800L_BAUDS[] = {460800, 230400, 115200, 57600};
+  //How many ATs must succeed in a row at a new baud before we trust it
+  #define SIM800L_BAUD_CHECKS 5
+
+  //How trying a baud went
+  enum baudResult {
+    BAUD_REJECTED,    //The SIM800L didn't accept AT+IPR
+    BAUD_UNRELIABLE,  //It did, but then didn't respond reliably
+    BAUD_RELIABLE,    //It did, and then responded every time
+  };
+
+  //How negotiateBaud talks to the SIM800L
+  struct baudLink {
+    //Sends AT, returning true if OK came back within `timeoutMs`
+    bool (*testAT)(uint32_t timeoutMs, void *arg);
+    //Sends AT+IPR=`baud`, returning true if OK came back. The OK comes back at
+    //the old baud, and the SIM800L's at the new one after that.
+    bool (*setModemBaud)(uint32_t baud, void *arg);
+    //Moves our end of the UART to `baud`, once what's been sent has gone, and
+    //gives it time to settle
+    void (*setBaud)(uint32_t baud, void *arg);
+    //Told how each baud tried went, for logging. Can be nullptr.
+    void (*tried)(uint32_t baud, baudResult result, void *arg);
+    void *arg;
+  };
+
+  //checkBaud checks the SIM800L responds to SIM800L_BAUD_CHECKS ATs in a row at
+  //the baud we're currently using
+  static inline bool checkBaud(const baudLink *link) {
+    for(int i = 0; i < SIM800L_BAUD_CHECKS; i++) {
+      if(!link->testAT(500, link->arg)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //findBaud looks for the baud the SIM800L is using by trying the initial baud
+  //and each of SIM800L_BAUDS until it responds. This is needed if we lose track
+  //of it, e.g. if the ESP32 reset but the SIM800L kept the baud we set before.
+  //Returns the baud, or 0 if the SIM800L didn't respond at any of them.
+  static inline uint32_t findBaud(const baudLink *link) {
+    link->setBaud(SIM800L_INITIAL_BAUD, link->arg);
+    if(link->testAT(1000, link->arg)) {
+      return SIM800L_INITIAL_BAUD;
+    }
+    for(uint32_t baud : SIM800L_BAUDS) {
+      link->setBaud(baud, link->arg);
+      if(link->testAT(1000, link->arg)) {
+        return baud;
+      }
+    }
+    return 0;
+  }
+
+  //revertBaud moves the SIM800L back to `baud` after it's been moved to one it
+  //isn't reliable at. It's at the unreliable baud now, so that's what we have
+  //to ask it at, a few times if need be. Returns true if it's responding at
+  //`baud` again.
+  static inline bool revertBaud(const baudLink *link, uint32_t baud) {
+    for(int i = 0; i < SIM800L_BAUD_CHECKS; i++) {
+      if(link->setModemBaud(baud, link->arg)) {
+        link->setBaud(baud, link->arg);
+        return link->testAT(1000, link->arg);
+      }
+    }
+    link->setBaud(baud, link->arg);
+    return link->testAT(1000, link->arg);
+  }
+
+  //negotiateBaud moves the SIM800L up to the fastest baud in SIM800L_BAUDS it
+  //works reliably at, starting from `current`, the baud it's responding at.
+  //Each baud is set with AT+IPR, then verified; if it isn't reliable we go back
+  //to the last baud that was. Returns the baud in use, or 0 if we lost the
+  //SIM800L on the way.
+  static inline uint32_t negotiateBaud(const baudLink *link, uint32_t current) {
+    //findBaud only needs one AT through, so if the SIM800L kept a baud from
+    //before that it isn't reliable at, start again from the initial baud
+    uint32_t tooFast = 0;
+    if(current != SIM800L_INITIAL_BAUD && !checkBaud(link)) {
+      if(link->tried != nullptr) {
+        link->tried(current, BAUD_UNRELIABLE, link->arg);
+      }
+      tooFast = current;
+      if(!revertBaud(link, SIM800L_INITIAL_BAUD)) {
+        return 0;
+      }
+      current = SIM800L_INITIAL_BAUD;
+    }
+
+    for(uint32_t baud : SIM800L_BAUDS) {
+      //Don't bother going slower than we already are, or trying again a baud
+      //that's already turned out to be unreliable
+      if(baud <= current) {
+        break;
+      }
+      if(tooFast != 0 && baud >= tooFast) {
+        continue;
+      }
+
+      //Ask for the new baud; the OK comes back at the old one
+      if(!link->setModemBaud(baud, link->arg)) {
+        if(link->tried != nullptr) {
+          link->tried(baud, BAUD_REJECTED, link->arg);
+        }
+        continue;
+      }
+      link->setBaud(baud, link->arg);
+
+      //Check we can talk reliably at the new baud
+      if(checkBaud(link)) {
+        if(link->tried != nullptr) {
+          link->tried(baud, BAUD_RELIABLE, link->arg);
+        }
+        return baud;
+      }
+
+      //Otherwise, go back to the last baud that worked
+      if(link->tried != nullptr) {
+        link->tried(baud, BAUD_UNRELIABLE, link->arg);
+      }
+      if(!revertBaud(link, current)) {
+        //We've lost it, so go looking for it
+        current = findBaud(link);
+        if(current == 0) {
+          return 0;
+        }
+      }
+    }
+    return current;
+  }
+#endif
@@ -3,6 +3,9 @@
 
 #include <Arduino.h>
 #include "esp_camera.h"
+#include "driver/ledc.h"
+#include "trace.h"
+#include "frameCheck.h"
 #include "camera.h"
 
 /////////////////////////////////////////////////////////////////////////////
@@ -48,7 +51,8 @@ static camera_config_t camera_config = {
     .pin_href = CAM_PIN_HREF,
     .pin_pclk = CAM_PIN_PCLK,
 
-    //XCLK 20MHz or 10MHz for OV2640 double FPS (Experimental)
+    //XCLK 20MHz or 10MHz for OV2640 double FPS (Experimental). This is just
+    //what it starts at, the capture profiles below set it from then on.
     .xclk_freq_hz = 10000000,
     .ledc_timer = LEDC_TIMER_0,
     .ledc_channel = LEDC_CHANNEL_0,
@@ -60,6 +64,243 @@ static camera_config_t camera_config = {
     .fb_count = 1 //if more than one, i2s runs in continuous mode. Use only with JPEG
 };
 
+//Held by whoever has the frame buffer, as the pipeline and the motion detector
+//both take frames
+SemaphoreHandle_t cameraMutex;
+
+/////////////////////////////////////////////////////////////////////////////
+// Capture profiles
+// Each profile is a handful of sensor register writes, so switching between
+// them is quick, unlike changing camera_config, which means reinitialising the
+// driver. The frame size & pixel format are the same for all of them, as the
+// frame buffer's sized for them at init and everything downstream expects
+// QQVGA YUV422. Changing the clocks changes how long each row's exposed for, so
+// the first few frames after a switch are thrown away while the sensor's auto
+// exposure catches up.
+
+struct profileSettings {
+  const char *name;
+  int xclkMHz;       //XCLK. The OV7670 needs 10-48MHz.
+  int clockDivider;  //The sensor's internal clock is XCLK / this (CLKRC)
+  bool lockExposure; //Freeze exposure, gain & white balance once settled
+  int settleFrames;  //Frames to throw away after switching to it
+};
+
+const profileSettings profiles[] = {
+  //Preview: the sensor at half speed, for idling on & the frame stream
+  {"preview", 10, 2, false, 2},
+  //Motion: full frame rate, with the exposure locked so comparing frames
+  //sees things moving rather than the auto exposure hunting
+  {"motion", 10, 1, true, 10},
+  //Still: double XCLK, so the frame's read out in half the time with half
+  //the rolling shutter skew
+  {"still", 20, 1, false, 4},
+};
+
+//How long a locked exposure's kept before it's settled & locked again, so it
+//follows the light changing through the day, in milliseconds
+#define PROFILE_RELOCK_INTERVAL 300000
+
+//The sensor's clock prescaler register, and its divider bits
+#define OV7670_REG_CLKRC 0x11
+#define OV7670_CLKRC_DIVIDER 0x3F
+
+int currentProfile = -1;         //The profile the sensor's set up for, -1 before any
+int currentXclk = 0;             //The XCLK & divider it's set up with
+int currentDivider = 0;
+int settleLeft = 0;              //Frames still to throw away before it's settled
+bool lockPending = false;        //Whether to lock the exposure once it's settled
+unsigned long lockedAt = 0;      //millis() when the exposure was last locked
+unsigned long switchWriteMicros; //How long the last switch's register writes took
+int settles = 0;                 //How many times the sensor's been settled
+
+//setSensor calls one of the sensor's setters, if this sensor's driver has it
+void setSensor(sensor_t *sensor, int (*setter)(sensor_t *, int), int value) {
+  if(setter != nullptr) {
+    setter(sensor, value);
+  }
+}
+
+//setXclk changes XCLK, through the driver if it supports it, or otherwise on
+//the LEDC timer that's generating it
+void setXclk(sensor_t *sensor, int mhz) {
+  if(sensor->set_xclk != nullptr) {
+    sensor->set_xclk(sensor, camera_config.ledc_timer, mhz);
+  } else {
+    ledc_set_freq(LEDC_HIGH_SPEED_MODE, camera_config.ledc_timer, mhz * 1000000);
+  }
+}
+
+//applyProfile writes a profile's settings to the sensor, leaving it to settle
+//on the next capture. Only the settings that differ are written. Auto exposure
+//is always turned on, so it can catch up while settling. Must hold cameraMutex.
+bool applyProfile(captureProfile profile) {
+  sensor_t *sensor = esp_camera_sensor_get();
+  if(sensor == nullptr) {
+    Serial.println("[applyProfile] - No sensor :(");
+    return false;
+  }
+  const profileSettings &settings = profiles[profile];
+
+  TRACE_BEGIN("profile");
+  unsigned long started = micros();
+  if(settings.xclkMHz != currentXclk) {
+    setXclk(sensor, settings.xclkMHz);
+    currentXclk = settings.xclkMHz;
+  }
+  if(settings.clockDivider != currentDivider && sensor->set_reg != nullptr) {
+    sensor->set_reg(sensor, OV7670_REG_CLKRC, OV7670_CLKRC_DIVIDER, settings.clockDivider - 1);
+    currentDivider = settings.clockDivider;
+  }
+  if(currentProfile < 0 || profiles[currentProfile].lockExposure || settings.lockExposure) {
+    setSensor(sensor, sensor->set_exposure_ctrl, 1);
+    setSensor(sensor, sensor->set_gain_ctrl, 1);
+    setSensor(sensor, sensor->set_whitebal, 1);
+  }
+  switchWriteMicros = micros() - started;
+  TRACE_END("profile");
+
+  currentProfile = profile;
+  settleLeft = settings.settleFrames;
+  lockPending = settings.lockExposure;
+  return true;
+}
+
+//settleProfile throws away frames until the sensor's settled into the profile
+//it was switched to, then locks its exposure if the profile wants it, and logs
+//how long the switch took. Must hold cameraMutex. Returns false if a frame
+//couldn't be captured.
+bool settleProfile() {
+  if(settleLeft == 0 && !lockPending) {
+    return true;
+  }
+  TRACE_BEGIN("settle");
+  unsigned long settleStarted = micros();
+  int thrownAway = settleLeft;
+  for(; settleLeft > 0; settleLeft--) {
+    camera_fb_t* frameBuffer = esp_camera_fb_get();
+    if (!frameBuffer) {
+      TRACE_END("settle");
+      return false;
+    }
+    esp_camera_fb_return(frameBuffer);
+  }
+  if(lockPending) {
+    sensor_t *sensor = esp_camera_sensor_get();
+    setSensor(sensor, sensor->set_exposure_ctrl, 0);
+    setSensor(sensor, sensor->set_gain_ctrl, 0);
+    setSensor(sensor, sensor->set_whitebal, 0);
+    lockPending = false;
+    lockedAt = millis();
+  }
+  settles++;
+  TRACE_END("settle");
+  Serial.printf(
+    "[settleProfile] - Switched to %s with %lu us of writes, then settled over %d frames in %lu us\n",
+    profiles[currentProfile].name, switchWriteMicros, thrownAway, micros() - settleStarted
+  );
+  return true;
+}
+
+//useProfile gets the sensor ready to capture a frame in `profile`, switching to
+//it if it isn't already, and settling it. A locked exposure that's getting old
+//is settled & locked again. Must hold cameraMutex. Returns false for fail.
+bool useProfile(captureProfile profile) {
+  bool stale = profiles[profile].lockExposure && millis() - lockedAt > PROFILE_RELOCK_INTERVAL;
+  if(profile != currentProfile || stale) {
+    if(!applyProfile(profile)) {
+      return false;
+    }
+  }
+  return settleProfile();
+}
+
+//cameraSettles counts how many times the camera's settled into a profile. A
+//frame captured after it changes isn't comparable with the one before.
+int cameraSettles() {
+  return settles;
+}
+
+//idleCamera switches the camera to the preview profile, which runs the sensor
+//slower, once whoever's using it is done. The switch is just register writes,
+//the settling's left until the next capture.
+void idleCamera() {
+  xSemaphoreTake(cameraMutex, portMAX_DELAY);
+  if(currentProfile != PROFILE_PREVIEW) {
+    applyProfile(PROFILE_PREVIEW);
+  }
+  xSemaphoreGive(cameraMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Frame checks
+// Every frame that might be tweeted is checked (see frameCheck.h) as soon as
+// it's captured, and a bad one is thrown away and captured again, which only
+// costs a frame's time. Frames grabbed for motion detection & the frame stream
+// aren't checked, as the motion detector ignores changes to the whole frame,
+// and a glitch is what you'd want to see on the stream.
+
+//How many times a bad frame's recaptured before we give up on getting a good one
+#define FRAME_MAX_RECAPTURES 3
+
+frameCheckCounts checkCounts = {};
+
+//checkedFrame captures a frame, recapturing it straight away if it's bad. If
+//it's still bad after FRAME_MAX_RECAPTURES, a frame that might just be what the
+//camera's looking at, like a black one at night, is kept anyway, but a garbled
+//one is given up on. Must hold cameraMutex. Returns nullptr if capture fails.
+camera_fb_t* checkedFrame() {
+  for(int recaptures = 0; ; recaptures++) {
+    camera_fb_t* frameBuffer = esp_camera_fb_get();
+    if (!frameBuffer || frameBuffer->format != PIXFORMAT_YUV422) {
+      return frameBuffer;
+    }
+
+    TRACE_BEGIN("check");
+    unsigned long started = micros();
+    frameStats stats;
+    frameFault fault = checkFrame(
+      (const uint32_t*)frameBuffer->buf, frameBuffer->len,
+      frameBuffer->width, frameBuffer->height, &stats
+    );
+    unsigned long checkMicros = micros() - started;
+    TRACE_END("check");
+    checkCounts.checked++;
+    if (fault == FRAME_OK) {
+      return frameBuffer;
+    }
+
+    checkCounts.faults[fault]++;
+    Serial.printf(
+      "[checkedFrame] - Frame was %s (luma %d, detail %d/16, %d repeated rows), checked in %lu us :(\n",
+      frameFaultName(fault), stats.meanLuma, stats.detail, stats.repeated, checkMicros
+    );
+    if (recaptures == FRAME_MAX_RECAPTURES) {
+      if (frameFaultSerious(fault)) {
+        esp_camera_fb_return(frameBuffer);
+        frameBuffer = nullptr;
+        checkCounts.givenUp++;
+      } else {
+        checkCounts.kept++;
+      }
+      Serial.printf(
+        "[checkedFrame] - %s it after %d recaptures. %d recaptured, %d kept & %d given up on of %d frames so far\n",
+        frameBuffer ? "Keeping" : "Giving up on", recaptures,
+        checkCounts.recaptured, checkCounts.kept, checkCounts.givenUp, checkCounts.checked
+      );
+      return frameBuffer;
+    }
+    esp_camera_fb_return(frameBuffer);
+    checkCounts.recaptured++;
+  }
+}
+
+//frameChecks gets how many frames have been checked, and what was done with
+//the bad ones
+const frameCheckCounts *frameChecks() {
+  return &checkCounts;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // Setup
 
@@ -71,6 +312,12 @@ bool setupCamera(){
         digitalWrite(CAM_PIN_PWDN, LOW);
     }
 
+    cameraMutex = xSemaphoreCreateMutex();
+    if (!cameraMutex) {
+        Serial.println("[setupCamera] - Failed to create camera mutex :(");
+        return false;
+    }
+
     //initialize the camera
     esp_err_t err = esp_camera_init(&camera_config);
 
@@ -80,6 +327,13 @@ bool setupCamera(){
         return false;
     }
 
+    //Start off idling
+    currentXclk = camera_config.xclk_freq_hz / 1000000;
+    if (!applyProfile(PROFILE_PREVIEW)) {
+        Serial.println("[setupCamera] - Couldn't set up capture profile :(");
+        return false;
+    }
+
     //Otherwise, true for success!
     return true;
 }
@@ -90,10 +344,13 @@ bool setupCamera(){
 //takePicture gets an image from the camera's frame buffer and processes it.
 bool getJPEG(uint8_t** jpgBuffer, size_t* jpgLen){
   //acquire a frame
-  camera_fb_t* frameBuffer = esp_camera_fb_get();
+  xSemaphoreTake(cameraMutex, portMAX_DELAY);
+  camera_fb_t* frameBuffer = useProfile(PROFILE_STILL) ? checkedFrame() : nullptr;
 
   //If it failed, log & return false for fail
   if (!frameBuffer) {
+    applyProfile(PROFILE_PREVIEW);
+    xSemaphoreGive(cameraMutex);
     Serial.println("[getFrameBuffer] - Camera Capture Failed :(");
     return false;
   }
@@ -105,8 +362,10 @@ bool getJPEG(uint8_t** jpgBuffer, size_t* jpgLen){
   //Compress frameBuffer to JPEG
   bool converted = frame2jpg(frameBuffer, 90, jpgBuffer, jpgLen);
 
-  //return the frame buffer back to the driver for reuse
+  //return the frame buffer back to the driver for reuse, and go back to idling
   esp_camera_fb_return(frameBuffer);
+  applyProfile(PROFILE_PREVIEW);
+  xSemaphoreGive(cameraMutex);
 
   //Return false and log if failed to compress, otherwise true
   if (!converted) {
@@ -116,6 +375,57 @@ bool getJPEG(uint8_t** jpgBuffer, size_t* jpgLen){
   return true;
 }
 
+//captureFrame acquires a checked frame from the camera in the still profile,
+//which must be given back with releaseFrame once done with. Call idleCamera once
+//there are no more to take. Returns nullptr if capture fails.
+camera_fb_t* captureFrame() {
+  xSemaphoreTake(cameraMutex, portMAX_DELAY);
+  camera_fb_t* frameBuffer = useProfile(PROFILE_STILL) ? checkedFrame() : nullptr;
+  if (!frameBuffer) {
+    xSemaphoreGive(cameraMutex);
+    Serial.println("[captureFrame] - Camera Capture Failed :(");
+    return nullptr;
+  }
+
+  #ifdef DEBUG_IMG_TO_SERIAL
+    frameBufferToSerial(frameBuffer);
+  #endif
+
+  return frameBuffer;
+}
+
+//encodeFrame JPEG compresses a frame, passing the output to `callback` as it
+//is produced rather than into one big buffer, so the JPEG can be sent while
+//it's still being encoded.
+bool encodeFrame(camera_fb_t* frameBuffer, jpg_out_cb callback, void* arg) {
+  bool converted = frame2jpg_cb(frameBuffer, 90, callback, arg);
+  if (!converted) {
+    Serial.println("[encodeFrame] - JPEG conversion Failed :(");
+    return false;
+  }
+  return true;
+}
+
+//releaseFrame returns a frame buffer back to the driver for reuse
+void releaseFrame(camera_fb_t* frameBuffer) {
+  esp_camera_fb_return(frameBuffer);
+  xSemaphoreGive(cameraMutex);
+}
+
+//grabFrame acquires a frame in `profile` like captureFrame, but gives up if
+//the camera's busy for longer than `wait`, and never outputs the frame to serial
+camera_fb_t* grabFrame(TickType_t wait, captureProfile profile) {
+  if (xSemaphoreTake(cameraMutex, wait) != pdTRUE) {
+    return nullptr;
+  }
+  camera_fb_t* frameBuffer = useProfile(profile) ? esp_camera_fb_get() : nullptr;
+  if (!frameBuffer) {
+    xSemaphoreGive(cameraMutex);
+    return nullptr;
+  }
+  return frameBuffer;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // Debug utils
 
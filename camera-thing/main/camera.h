@@ -2,6 +2,14 @@
 // Exports the utils for dealing with the camera
 
 #include "esp_camera.h"
+#include "frameCheck.h"
+
+//The capture profiles the camera switches between, see camera.cpp
+enum captureProfile {
+  PROFILE_PREVIEW, //Low power, for idling & previews
+  PROFILE_MOTION,  //Exposure locked, for comparing frames
+  PROFILE_STILL,   //Full speed, for photos
+};
 
 //Setup method
 bool setupCamera();
@@ -9,5 +17,32 @@ bool setupCamera();
 //Image getters
 bool getJPEG(uint8_t** jpgBuffer, size_t* jpgLen);
 
+//Split up capture & encode so they can run as separate stages of the pipeline.
+//Frames are captured in the still profile, until idleCamera.
+camera_fb_t* captureFrame();
+bool encodeFrame(camera_fb_t* frameBuffer, jpg_out_cb callback, void* arg);
+void releaseFrame(camera_fb_t* frameBuffer);
+void idleCamera();
+
+//Grabs a frame in `profile` for looking at rather than tweeting, e.g. for
+//motion detection. Returns nullptr if the camera's still busy after `wait` ticks.
+camera_fb_t* grabFrame(TickType_t wait, captureProfile profile);
+
+//Counts the times the camera's switched profile or relocked its exposure, after
+//which frames look different even if nothing's changed
+int cameraSettles();
+
+//How many frames have been checked for glitches, and what was done with the
+//bad ones. Bad frames are recaptured, and after a few goes, kept if they might
+//be what the camera's looking at or otherwise given up on.
+struct frameCheckCounts {
+  int checked;              //Frames checked, including recaptures
+  int faults[FRAME_FAULTS]; //Bad frames, by what was wrong with them
+  int recaptured;           //Bad frames thrown away & captured again
+  int kept;                 //Bad frames kept as no good one came
+  int givenUp;              //Captures that failed as no good frame came
+};
+const frameCheckCounts *frameChecks();
+
 //Debug utils
 void frameBufferToSerial(camera_fb_t* frameBuffer);
\ No newline at end of file
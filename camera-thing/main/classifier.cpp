@@ -0,0 +1,109 @@
+// classifier.cpp
+// Labels frames with a tiny quantised network (see classifierKernels.h) so
+// each photo can be sent with the CameraThing's best guesses at what's in it.
+// If the tweeter trusts the top guess, it tweets with our labels rather than
+// waiting on its recogniser. The network's weights live in flash, its 7.3KB of
+// scratch is allocated once, and it does the same work for every frame, so
+// labelling takes the same few milliseconds every time.
+
+#include <Arduino.h>
+#include "trace.h"
+#include "classifier.h"
+
+#ifdef ON_DEVICE_CLASSIFIER
+  #include "classifierModel.h"
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Config
+
+  //How many labels to send with each photo, at most
+  #define CLASSIFIER_TOP_LABELS 3
+  //Labels we're less confident in than this (out of 100) aren't worth sending
+  #define CLASSIFIER_MIN_CONFIDENCE 5
+
+  /////////////////////////////////////////////////////////////////////////////
+  // State
+
+  //Only the capture stage classifies frames, so one lot of scratch will do
+  classifierScratch *scratch = nullptr;
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Setup
+
+  //setupClassifier checks the model fits the kernels and allocates the
+  //scratch. Returns false for fail, true for success.
+  bool setupClassifier() {
+    if(onDeviceModel.classes < 1 || onDeviceModel.classes > CLASSIFIER_MAX_CLASSES) {
+      Serial.printf("[setupClassifier] - Model has %d classes, it must have 1-%d :(\n", onDeviceModel.classes, CLASSIFIER_MAX_CLASSES);
+      return false;
+    }
+    scratch = (classifierScratch*)malloc(sizeof(classifierScratch));
+    if(scratch == nullptr) {
+      Serial.println("[setupClassifier] - Failed to allocate scratch :(");
+      return false;
+    }
+    Serial.printf("[setupClassifier] - Model has %d classes, using %u bytes of scratch\n", onDeviceModel.classes, (unsigned)sizeof(classifierScratch));
+    return true;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Classifying
+
+  //classifyFrame runs the model on a frame and writes out the labels we're
+  //most confident in, most confident first. Returns false if the frame isn't
+  //one the model can run on.
+  bool classifyFrame(camera_fb_t *frameBuffer, char *labels, size_t labelsSize) {
+    labels[0] = '\0';
+    if(
+      frameBuffer->format != PIXFORMAT_YUV422 ||
+      frameBuffer->width != CLASSIFIER_FRAME_WIDTH ||
+      frameBuffer->height != CLASSIFIER_FRAME_HEIGHT
+    ) {
+      Serial.println("[classifyFrame] - Frame isn't QQVGA YUV422, not classifying it :(");
+      return false;
+    }
+
+    TRACE_BEGIN("classify");
+    unsigned long start = micros();
+    uint8_t confidences[CLASSIFIER_MAX_CLASSES];
+    classifyYUV422(&onDeviceModel, frameBuffer->buf, scratch, confidences);
+
+    //Pick out the top few labels, biggest first
+    size_t written = 0;
+    for(int n = 0; n < CLASSIFIER_TOP_LABELS; n++) {
+      int best = 0;
+      for(int i = 1; i < onDeviceModel.classes; i++) {
+        if(confidences[i] > confidences[best]) {
+          best = i;
+        }
+      }
+      if(confidences[best] < CLASSIFIER_MIN_CONFIDENCE) {
+        break;
+      }
+      int len = snprintf(
+        labels + written, labelsSize - written, "%s%s:%d",
+        written > 0 ? "," : "", onDeviceModel.labels[best], confidences[best]
+      );
+      //Leave off a label that doesn't fit rather than sending half of it
+      if(len < 0 || written + len >= labelsSize) {
+        labels[written] = '\0';
+        break;
+      }
+      written += len;
+      confidences[best] = 0;
+    }
+    TRACE_END("classify");
+
+    Serial.printf("[classifyFrame] - Classified frame in %lu us: %s\n", micros() - start, labels);
+    return true;
+  }
+#else
+  //Without ON_DEVICE_CLASSIFIER, the tweeter's recogniser labels every photo
+  bool setupClassifier() {
+    return true;
+  }
+  bool classifyFrame(camera_fb_t *frameBuffer, char *labels, size_t labelsSize) {
+    labels[0] = '\0';
+    return false;
+  }
+#endif
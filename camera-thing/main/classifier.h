@@ -0,0 +1,25 @@
+// classifier.h
+// Exports the on-device classifier, which guesses what's in each photo before
+// it's uploaded, so the tweeter can skip its recogniser when we're confident
+
+#ifndef CLASSIFIER_USED
+  #define CLASSIFIER_USED
+
+  #include "esp_camera.h"
+
+  //Uncomment this to label photos on the CameraThing with the model in
+  //classifierModel.h (see classifierModel.example.h), and send the labels
+  //along with each photo
+  // #define ON_DEVICE_CLASSIFIER
+
+  //Room for the labels of a photo, e.g. "cat:87,dog:9,fox:2"
+  #define CLASSIFIER_LABELS_SIZE 64
+
+  //Setup func, checks the model
+  bool setupClassifier();
+
+  //Labels a frame, writing its top labels & their confidences (0-100) into
+  //`labels` as "label:confidence,...". `labels` is left empty if the frame
+  //can't be labelled, or without ON_DEVICE_CLASSIFIER.
+  bool classifyFrame(camera_fb_t *frameBuffer, char *labels, size_t labelsSize);
+#endif
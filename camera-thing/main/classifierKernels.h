@@ -0,0 +1,244 @@
+// classifierKernels.h
+// The fixed point kernels of the on-device classifier (see classifier.cpp), a
+// tiny quantised convolutional network run on the QQVGA frame:
+//
+//   YUV422 160x120 --shrink 4x4--> 40x30x3 --conv 3x3/2, ReLU--> 20x15x8
+//     --conv 3x3/2, ReLU--> 10x8x16 --average--> 16 --dense--> classes
+//     --softmax--> confidences
+//
+// Activations and weights are int8, accumulators int32, and each layer scales
+// its accumulators back to int8 with an integer multiplier and shift, so
+// there's no floating point anywhere and the results are the same on any CPU.
+// The shape's fixed, so every frame takes the same ~160k multiply-adds and
+// the same 7.3KB of scratch. It's plain C++ with no Arduino dependencies, so
+// it can be checked bit for bit against a reference on the host (see
+// camera-thing/bench).
+
+#ifndef CLASSIFIER_KERNELS_USED
+  #define CLASSIFIER_KERNELS_USED
+
+  #include <stdint.h>
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Shape
+
+  //The frame we're given, which must be what camera.cpp captures
+  #define CLASSIFIER_FRAME_WIDTH 160
+  #define CLASSIFIER_FRAME_HEIGHT 120
+
+  //The frame shrunk by CLASSIFIER_SHRINK each way, with Y, U & V channels
+  #define CLASSIFIER_SHRINK 4
+  #define CLASSIFIER_INPUT_WIDTH (CLASSIFIER_FRAME_WIDTH / CLASSIFIER_SHRINK)
+  #define CLASSIFIER_INPUT_HEIGHT (CLASSIFIER_FRAME_HEIGHT / CLASSIFIER_SHRINK)
+  #define CLASSIFIER_INPUT_CHANNELS 3
+
+  //Each convolution is 3x3 with a stride of 2, padded with zeroes by 1
+  #define CLASSIFIER_CONV_OUT(size) (((size) + 1) / 2)
+  #define CLASSIFIER_CONV1_WIDTH CLASSIFIER_CONV_OUT(CLASSIFIER_INPUT_WIDTH)
+  #define CLASSIFIER_CONV1_HEIGHT CLASSIFIER_CONV_OUT(CLASSIFIER_INPUT_HEIGHT)
+  #define CLASSIFIER_CONV1_CHANNELS 8
+  #define CLASSIFIER_CONV2_WIDTH CLASSIFIER_CONV_OUT(CLASSIFIER_CONV1_WIDTH)
+  #define CLASSIFIER_CONV2_HEIGHT CLASSIFIER_CONV_OUT(CLASSIFIER_CONV1_HEIGHT)
+  #define CLASSIFIER_CONV2_CHANNELS 16
+
+  //The most classes a model can have
+  #define CLASSIFIER_MAX_CLASSES 32
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Model
+
+  //A quantised layer. Its int32 accumulator is scaled back to int8 by
+  //multiplying by `multiplier` / 2^31 then shifting right by `shift`, rounding
+  //to nearest, as in TensorFlow Lite.
+  struct classifierLayer {
+    const int8_t *weights; //Convolutions: [out][kernel y][kernel x][in]; dense: [out][in]
+    const int32_t *bias;   //[out], added to the accumulator
+    int32_t multiplier;    //From 2^30 to 2^31 - 1, i.e. 0.5 to just under 1
+    int shift;             //0 to 31
+  };
+
+  //A model is its layers, and a label for each class. Its dense layer's
+  //output (the logits) must be in 16ths of a nat, which is what the softmax's
+  //table expects.
+  struct classifierModel {
+    classifierLayer conv1;
+    classifierLayer conv2;
+    classifierLayer dense;
+    int classes;
+    const char *const *labels;
+  };
+
+  //Where each layer's output goes. It's about 7.3KB, so it's best not put on
+  //a task's stack.
+  struct classifierScratch {
+    int8_t input[CLASSIFIER_INPUT_HEIGHT][CLASSIFIER_INPUT_WIDTH][CLASSIFIER_INPUT_CHANNELS];
+    int8_t conv1[CLASSIFIER_CONV1_HEIGHT][CLASSIFIER_CONV1_WIDTH][CLASSIFIER_CONV1_CHANNELS];
+    int8_t conv2[CLASSIFIER_CONV2_HEIGHT][CLASSIFIER_CONV2_WIDTH][CLASSIFIER_CONV2_CHANNELS];
+    int8_t pooled[CLASSIFIER_CONV2_CHANNELS];
+    int8_t logits[CLASSIFIER_MAX_CLASSES];
+  };
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Kernels
+
+  //requantise scales an accumulator back down as described for
+  //classifierLayer, clamping it to [min, max]
+  static inline int32_t requantise(int32_t acc, int32_t multiplier, int shift, int32_t min, int32_t max) {
+    int total = 31 + shift;
+    int64_t scaled = ((int64_t)acc * multiplier + ((int64_t)1 << (total - 1))) >> total;
+    return scaled < min ? min : (scaled > max ? max : (int32_t)scaled);
+  }
+
+  //shrinkFrame averages each 4x4 block of a YUV422 (Y0 U Y1 V) frame into one
+  //pixel of the input, centring each channel on 0
+  static inline void shrinkFrame(const uint8_t *yuyv, classifierScratch *scratch) {
+    const int rowBytes = CLASSIFIER_FRAME_WIDTH * 2;
+    for(int y = 0; y < CLASSIFIER_INPUT_HEIGHT; y++) {
+      const uint8_t *blockRow = yuyv + y * CLASSIFIER_SHRINK * rowBytes;
+      for(int x = 0; x < CLASSIFIER_INPUT_WIDTH; x++) {
+        //Each block's 4 pixels wide, which is 8 bytes with 2 U's & 2 V's
+        const uint8_t *p = blockRow + x * CLASSIFIER_SHRINK * 2;
+        uint32_t sumY = 0;
+        uint32_t sumU = 0;
+        uint32_t sumV = 0;
+        for(int row = 0; row < CLASSIFIER_SHRINK; row++, p += rowBytes) {
+          sumY += p[0] + p[2] + p[4] + p[6];
+          sumU += p[1] + p[5];
+          sumV += p[3] + p[7];
+        }
+        scratch->input[y][x][0] = (int8_t)(((sumY + 8) >> 4) - 128);
+        scratch->input[y][x][1] = (int8_t)(((sumU + 4) >> 3) - 128);
+        scratch->input[y][x][2] = (int8_t)(((sumV + 4) >> 3) - 128);
+      }
+    }
+  }
+
+  //convolve runs a 3x3, stride 2 convolution padded by 1 with a ReLU, over
+  //HWC int8 maps. The kernel's clipped to the input once per output pixel,
+  //rather than checking every tap, and the input pixel's loaded once for all
+  //the output channels.
+  static inline void convolve(
+    const int8_t *in, int inWidth, int inHeight, int inChannels,
+    const classifierLayer *layer, int8_t *out, int outChannels
+  ) {
+    int outWidth = CLASSIFIER_CONV_OUT(inWidth);
+    int outHeight = CLASSIFIER_CONV_OUT(inHeight);
+    int32_t acc[CLASSIFIER_CONV2_CHANNELS];
+    for(int oy = 0; oy < outHeight; oy++) {
+      int ky0 = oy == 0 ? 1 : 0;
+      int ky1 = 2 * oy + 1 < inHeight ? 3 : 2;
+      for(int ox = 0; ox < outWidth; ox++) {
+        int kx0 = ox == 0 ? 1 : 0;
+        int kx1 = 2 * ox + 1 < inWidth ? 3 : 2;
+        for(int oc = 0; oc < outChannels; oc++) {
+          acc[oc] = layer->bias[oc];
+        }
+        for(int ky = ky0; ky < ky1; ky++) {
+          const int8_t *row = in + ((2 * oy + ky - 1) * inWidth + (2 * ox - 1)) * inChannels;
+          for(int kx = kx0; kx < kx1; kx++) {
+            const int8_t *pixel = row + kx * inChannels;
+            const int8_t *w = layer->weights + (ky * 3 + kx) * inChannels;
+            for(int oc = 0; oc < outChannels; oc++, w += 9 * inChannels) {
+              int32_t sum = 0;
+              for(int ic = 0; ic < inChannels; ic++) {
+                sum += pixel[ic] * w[ic];
+              }
+              acc[oc] += sum;
+            }
+          }
+        }
+        int8_t *o = out + (oy * outWidth + ox) * outChannels;
+        for(int oc = 0; oc < outChannels; oc++) {
+          o[oc] = (int8_t)requantise(acc[oc], layer->multiplier, layer->shift, 0, 127);
+        }
+      }
+    }
+  }
+
+  //poolAverage averages each channel of a HWC map, which is never negative
+  //after a ReLU
+  static inline void poolAverage(const int8_t *in, int pixels, int channels, int8_t *out) {
+    int32_t sums[CLASSIFIER_CONV2_CHANNELS] = {0};
+    for(int i = 0; i < pixels; i++, in += channels) {
+      for(int c = 0; c < channels; c++) {
+        sums[c] += in[c];
+      }
+    }
+    for(int c = 0; c < channels; c++) {
+      out[c] = (int8_t)((sums[c] + pixels / 2) / pixels);
+    }
+  }
+
+  //dense runs a fully connected layer with no activation
+  static inline void dense(const int8_t *in, int inLen, const classifierLayer *layer, int8_t *out, int outLen) {
+    const int8_t *w = layer->weights;
+    for(int o = 0; o < outLen; o++, w += inLen) {
+      int32_t acc = layer->bias[o];
+      for(int i = 0; i < inLen; i++) {
+        acc += in[i] * w[i];
+      }
+      out[o] = (int8_t)requantise(acc, layer->multiplier, layer->shift, -128, 127);
+    }
+  }
+
+  //e^(-d/16) in 1/65536ths, for the softmax. It's 0 from d = 189 onwards.
+  #define CLASSIFIER_EXP_TABLE_SIZE 192
+  static const uint32_t classifierExpTable[CLASSIFIER_EXP_TABLE_SIZE] = {
+    65536, 61565, 57835, 54331, 51039, 47947, 45042, 42313, 39750, 37341, 35079, 32954,
+    30957, 29081, 27319, 25664, 24109, 22649, 21276, 19987, 18776, 17639, 16570, 15566,
+    14623, 13737, 12905, 12123, 11388, 10698, 10050, 9441, 8869, 8332, 7827, 7353,
+    6907, 6489, 6096, 5726, 5380, 5054, 4747, 4460, 4190, 3936, 3697, 3473,
+    3263, 3065, 2879, 2705, 2541, 2387, 2243, 2107, 1979, 1859, 1746, 1641,
+    1541, 1448, 1360, 1278, 1200, 1128, 1059, 995, 935, 878, 825, 775,
+    728, 684, 642, 604, 567, 533, 500, 470, 442, 415, 390, 366,
+    344, 323, 303, 285, 268, 252, 236, 222, 209, 196, 184, 173,
+    162, 153, 143, 135, 127, 119, 112, 105, 99, 93, 87, 82,
+    77, 72, 68, 64, 60, 56, 53, 50, 47, 44, 41, 39,
+    36, 34, 32, 30, 28, 27, 25, 23, 22, 21, 19, 18,
+    17, 16, 15, 14, 13, 13, 12, 11, 10, 10, 9, 9,
+    8, 8, 7, 7, 6, 6, 6, 5, 5, 5, 4, 4,
+    4, 4, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2,
+    2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0,
+  };
+
+  //softmax turns logits in 16ths of a nat into percentages, rounded down
+  static inline void softmax(const int8_t *logits, int classes, uint8_t *confidences) {
+    int32_t biggest = -128;
+    for(int i = 0; i < classes; i++) {
+      biggest = logits[i] > biggest ? logits[i] : biggest;
+    }
+    uint32_t exps[CLASSIFIER_MAX_CLASSES];
+    uint32_t sum = 0;
+    for(int i = 0; i < classes; i++) {
+      int32_t d = biggest - logits[i];
+      exps[i] = d < CLASSIFIER_EXP_TABLE_SIZE ? classifierExpTable[d] : 0;
+      sum += exps[i];
+    }
+    for(int i = 0; i < classes; i++) {
+      confidences[i] = (uint8_t)(exps[i] * 100 / sum);
+    }
+  }
+
+  //classifyYUV422 runs the whole network on a frame, filling in a confidence
+  //(0-100) for each of the model's classes
+  static inline void classifyYUV422(
+    const classifierModel *model, const uint8_t *yuyv, classifierScratch *scratch, uint8_t *confidences
+  ) {
+    shrinkFrame(yuyv, scratch);
+    convolve(
+      &scratch->input[0][0][0], CLASSIFIER_INPUT_WIDTH, CLASSIFIER_INPUT_HEIGHT, CLASSIFIER_INPUT_CHANNELS,
+      &model->conv1, &scratch->conv1[0][0][0], CLASSIFIER_CONV1_CHANNELS
+    );
+    convolve(
+      &scratch->conv1[0][0][0], CLASSIFIER_CONV1_WIDTH, CLASSIFIER_CONV1_HEIGHT, CLASSIFIER_CONV1_CHANNELS,
+      &model->conv2, &scratch->conv2[0][0][0], CLASSIFIER_CONV2_CHANNELS
+    );
+    poolAverage(
+      &scratch->conv2[0][0][0], CLASSIFIER_CONV2_WIDTH * CLASSIFIER_CONV2_HEIGHT, CLASSIFIER_CONV2_CHANNELS,
+      scratch->pooled
+    );
+    dense(scratch->pooled, CLASSIFIER_CONV2_CHANNELS, &model->dense, scratch->logits, model->classes);
+    softmax(scratch->logits, model->classes, confidences);
+  }
+#endif
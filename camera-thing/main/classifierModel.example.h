@@ -0,0 +1,44 @@
+///////////////////////////////////////////////////////////////////////////
+// On-device classifier model
+// With ON_DEVICE_CLASSIFIER defined in classifier.h, copy this file to
+// classifierModel.h and fill in your own model's weights. The network's shape
+// is fixed (see classifierKernels.h); only the weights, the quantisation and
+// the classes are the model's.
+//
+// To export a model trained in TensorFlow, quantise it to int8 with per tensor
+// symmetric scales (zero points of 0), and an output scale of 1/16 on the
+// dense layer. For each layer, multiplier * 2^-(31 + shift) should be
+// input scale * weight scale / output scale, and each bias is the float bias
+// divided by input scale * weight scale. Weights are laid out as described
+// for classifierLayer.
+//
+// This example's weights are all zero, so it runs exactly as long as a real
+// model but is never confident about anything, and the tweeter will never use
+// its labels instead of the recogniser's.
+
+#include "classifierKernels.h"
+
+//The labels of the model's classes. They're sent to the tweeter as they are,
+//so mustn't contain spaces, ',' or ':' (the tweeter turns '_' into a space).
+static const char *const classifierLabels[] = {
+  "cat", "dog", "person", "bird", "car", "nothing",
+};
+#define CLASSIFIER_CLASSES 6
+
+//The weights & biases. They're const, so they stay in flash rather than
+//taking up RAM.
+static const int8_t classifierConv1Weights[CLASSIFIER_CONV1_CHANNELS * 9 * CLASSIFIER_INPUT_CHANNELS] = {0};
+static const int32_t classifierConv1Bias[CLASSIFIER_CONV1_CHANNELS] = {0};
+static const int8_t classifierConv2Weights[CLASSIFIER_CONV2_CHANNELS * 9 * CLASSIFIER_CONV1_CHANNELS] = {0};
+static const int32_t classifierConv2Bias[CLASSIFIER_CONV2_CHANNELS] = {0};
+static const int8_t classifierDenseWeights[CLASSIFIER_CLASSES * CLASSIFIER_CONV2_CHANNELS] = {0};
+static const int32_t classifierDenseBias[CLASSIFIER_CLASSES] = {0};
+
+//The model itself. The multipliers here are all 0.5.
+static const classifierModel onDeviceModel = {
+  {classifierConv1Weights, classifierConv1Bias, 1 << 30, 0},
+  {classifierConv2Weights, classifierConv2Bias, 1 << 30, 0},
+  {classifierDenseWeights, classifierDenseBias, 1 << 30, 0},
+  CLASSIFIER_CLASSES,
+  classifierLabels,
+};
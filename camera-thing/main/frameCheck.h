@@ -0,0 +1,159 @@
+// frameCheck.h
+// The check every frame gets straight off the camera, so a bad one can be
+// recaptured before it's preprocessed, encoded & tweeted. The OV7670 now & then
+// gives us a frame that's black or white all over, or whose rows slipped when
+// it lost sync, or that the DMA never finished filling in. Like motionSAD.h,
+// the luma's looked at two pixels at a time in each 32 bit word, and it's plain
+// C++ so it can be checked on the host too (see camera-thing/bench).
+
+#ifndef FRAME_CHECK_USED
+  #define FRAME_CHECK_USED
+
+  #include <stddef.h>
+  #include <stdint.h>
+  #include "motionSAD.h"
+
+  //The luma statistics are worked out from every this many rows
+  #define FRAME_CHECK_ROW_STEP 4
+
+  //Frames with an average luma below/above these are black/white all over
+  #define FRAME_BLACK_LUMA 6
+  #define FRAME_WHITE_LUMA 250
+
+  //Frames whose neighbouring pixels differ by less than this on average, in
+  //16ths of a level, have nothing in them. Even a dark room gives us a few
+  //levels of sensor noise.
+  #define FRAME_MIN_DETAIL 4
+
+  //How many rows can be exactly the same as the one above before the frame's
+  //rows have slipped. Rows that are one colour all the way along don't count,
+  //as a blown out sky is the same row after row.
+  #define FRAME_MAX_REPEATED_ROWS 2
+
+  //What's wrong with a frame, from the most to the least serious
+  enum frameFault {
+    FRAME_OK,
+    FRAME_WRONG_SIZE,     //Its length isn't width * height * 2
+    FRAME_TRUNCATED,      //Its last row was never filled in
+    FRAME_REPEATED_ROWS,  //Rows were repeated when the sensor lost sync
+    FRAME_BLACK,          //It's black all over
+    FRAME_WHITE,          //It's white all over
+    FRAME_FLAT,           //It's one colour all over
+    FRAME_FAULTS,         //How many there are
+  };
+
+  static inline const char *frameFaultName(frameFault fault) {
+    switch(fault) {
+      case FRAME_OK: return "ok";
+      case FRAME_WRONG_SIZE: return "wrong size";
+      case FRAME_TRUNCATED: return "truncated";
+      case FRAME_REPEATED_ROWS: return "repeated rows";
+      case FRAME_BLACK: return "black";
+      case FRAME_WHITE: return "white";
+      case FRAME_FLAT: return "flat";
+      default: return "unknown";
+    }
+  }
+
+  //frameFaultSerious is true for faults that mean the frame's data is wrong,
+  //rather than that it may be what the camera's really looking at, like a
+  //black frame with the lens covered
+  static inline bool frameFaultSerious(frameFault fault) {
+    return fault == FRAME_WRONG_SIZE || fault == FRAME_TRUNCATED || fault == FRAME_REPEATED_ROWS;
+  }
+
+  //What checkFrame found out about a frame's luma
+  struct frameStats {
+    int meanLuma;  //0-255
+    int detail;    //Average difference between neighbouring pixels, in 16ths
+    int repeated;  //Rows the same as the one above
+  };
+
+  //rowUniform is true if every word of a row is the same, so it's one colour
+  static inline bool rowUniform(const uint32_t *row, int words) {
+    for(int i = 1; i < words; i++) {
+      if(row[i] != row[0]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //rowRepeated is true if a row is exactly the row above, and isn't one colour
+  static inline bool rowRepeated(const uint32_t *row, const uint32_t *above, int words) {
+    for(int i = 0; i < words; i++) {
+      if(row[i] != above[i]) {
+        return false;
+      }
+    }
+    return !rowUniform(row, words);
+  }
+
+  //lumaRowStats adds a row's luma to `sum`, and the differences between each
+  //pixel and the one two along to `detail`, both in two 16 bit lanes. That's
+  //room for rows of up to 512 pixels.
+  static inline void lumaRowStats(const uint32_t *row, int words, uint32_t *sum, uint32_t *detail) {
+    uint32_t laneSum = 0;
+    uint32_t laneDetail = 0;
+    uint32_t last = row[0] & LUMA_LANES;
+    for(int i = 0; i < words; i++) {
+      uint32_t luma = row[i] & LUMA_LANES;
+      laneSum += luma;
+      laneDetail += sadLumaLanes(luma, last);
+      last = luma;
+    }
+    *sum += (laneSum & 0xFFFF) + (laneSum >> 16);
+    *detail += (laneDetail & 0xFFFF) + (laneDetail >> 16);
+  }
+
+  //checkFrame looks for what's wrong with a QQVGA-ish YUV422 frame of `len`
+  //bytes, filling in `stats` if it gets as far as the luma. The width must be
+  //a multiple of 4 and no more than 512.
+  static inline frameFault checkFrame(const uint32_t *yuyv, size_t len, int width, int height, frameStats *stats) {
+    stats->meanLuma = 0;
+    stats->detail = 0;
+    stats->repeated = 0;
+    if(width <= 0 || height <= 0 || len != (size_t)width * height * 2) {
+      return FRAME_WRONG_SIZE;
+    }
+    int words = width / 2;
+
+    //A row the DMA never got to is left zeroed, which the sensor can't give
+    //us, as its chroma sits around 128 even when it's black
+    const uint32_t *last = yuyv + (height - 1) * words;
+    if(rowUniform(last, words) && last[0] == 0) {
+      return FRAME_TRUNCATED;
+    }
+
+    //Comparing rows usually stops at their first word, so this is cheap
+    for(int y = 1; y < height; y++) {
+      if(rowRepeated(yuyv + y * words, yuyv + (y - 1) * words, words)) {
+        stats->repeated++;
+      }
+    }
+
+    uint32_t sum = 0;
+    uint32_t detail = 0;
+    int pixels = 0;
+    for(int y = 0; y < height; y += FRAME_CHECK_ROW_STEP) {
+      lumaRowStats(yuyv + y * words, words, &sum, &detail);
+      pixels += width;
+    }
+    stats->meanLuma = sum / pixels;
+    stats->detail = detail * 16 / pixels;
+
+    if(stats->repeated > FRAME_MAX_REPEATED_ROWS) {
+      return FRAME_REPEATED_ROWS;
+    }
+    if(stats->meanLuma < FRAME_BLACK_LUMA) {
+      return FRAME_BLACK;
+    }
+    if(stats->meanLuma > FRAME_WHITE_LUMA) {
+      return FRAME_WHITE;
+    }
+    if(stats->detail < FRAME_MIN_DETAIL) {
+      return FRAME_FLAT;
+    }
+    return FRAME_OK;
+  }
+#endif
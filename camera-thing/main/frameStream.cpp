@@ -0,0 +1,104 @@
+// frameStream.cpp
+// While the pipeline's idle, a task on the camera core grabs frames as fast as
+// the sensor makes them and sends each one over serial in the binary protocol
+// in frameStreamProtocol.h, which the viewer in camera-thing/viewer decodes &
+// shows. Unlike DEBUG_IMG_TO_SERIAL, the log carries on around the frames and
+// photos still upload, so new units can be checked with the viewer running.
+//
+// At 2M baud, a whole QQVGA YUV422 frame takes about 0.2s to send, so serial
+// sets the pace; PackBits gets some of that back on flat areas of the frame.
+
+#include <Arduino.h>
+#include "utils.h"
+#include "camera.h"
+#include "pipeline.h"
+#include "power.h"
+#include "telemetry.h"
+#include "frameStream.h"
+
+#ifdef DEBUG_FRAME_STREAM
+  /////////////////////////////////////////////////////////////////////////////
+  // Config
+
+  //The stream shares the camera core with the capture stage, below it and
+  //alongside the Arduino loop, like the motion detector
+  #define FRAME_STREAM_CORE 1
+  #define FRAME_STREAM_PRIORITY 1
+  #define FRAME_STREAM_STACK 4096
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Streaming
+
+  //writeSerial is the frameStreamWriter that sends frames out over serial
+  void writeSerial(const uint8_t *data, size_t len, void *arg) {
+    Serial.write(data, len);
+  }
+
+  //frameStreamTask sends frames while the pipeline's idle, until the end of
+  //time, logging the frame rate every so often
+  void frameStreamTask(void *p) {
+    uint32_t sequence = 0;
+    unsigned long since = millis();
+    int sent = 0;
+    for(;;) {
+      //Leave the camera to the pipeline while it's taking a photo
+      if(!pipelineIdle()) {
+        WAIT_MS(100);
+        continue;
+      }
+
+      camera_fb_t *frameBuffer = grabFrame(pdMS_TO_TICKS(100), PROFILE_PREVIEW);
+      if(frameBuffer == nullptr) {
+        WAIT_MS(100);
+        continue;
+      }
+      if(frameBuffer->format != PIXFORMAT_YUV422 || frameBuffer->len != frameBuffer->width * frameBuffer->height * 2) {
+        releaseFrame(frameBuffer);
+        Serial.println("[frameStreamTask] - Frames aren't YUV422, frame stream stopped :(");
+        //Stop telemetry sampling our stack before it's freed
+        forgetTask(xTaskGetCurrentTaskHandle());
+        vTaskDelete(NULL);
+      }
+
+      frameInfo info = {
+        sequence++, (uint32_t)millis(), (uint16_t)frameBuffer->width, (uint16_t)frameBuffer->height,
+        FRAME_STREAM_LAYOUT, FRAME_STREAM_ENCODING, 0
+      };
+      sendFrame(frameBuffer->buf, info, writeSerial, nullptr);
+      releaseFrame(frameBuffer);
+
+      sent++;
+      if(millis() - since >= 10000) {
+        Serial.printf("\n[frameStreamTask] - Sent %d frames in %lu ms\n", sent, millis() - since);
+        since = millis();
+        sent = 0;
+      }
+    }
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Setup
+
+  //setupFrameStream starts the stream. Must be called after setupCamera.
+  //Returns false for fail, true for success.
+  bool setupFrameStream() {
+    //The camera's running all the time now, so the CPU can't light sleep
+    stayAwake(true);
+
+    TaskHandle_t task;
+    BaseType_t created = xTaskCreatePinnedToCore(
+      frameStreamTask, "frameStreamTask", FRAME_STREAM_STACK, nullptr, FRAME_STREAM_PRIORITY, &task, FRAME_STREAM_CORE
+    );
+    if(created != pdPASS) {
+      Serial.println("[setupFrameStream] - Failed to create frame stream task :(");
+      return false;
+    }
+    watchTask("stream", task, FRAME_STREAM_STACK);
+    return true;
+  }
+#else
+  //Without DEBUG_FRAME_STREAM, frames only leave as photos
+  bool setupFrameStream() {
+    return true;
+  }
+#endif
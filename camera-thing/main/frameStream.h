@@ -0,0 +1,25 @@
+// frameStream.h
+// Exports the frame stream, a debug mode that sends the camera's frames over
+// serial as fast as it can, for the viewer in camera-thing/viewer to show
+
+#ifndef FRAME_STREAM_USED
+  #define FRAME_STREAM_USED
+
+  #include "frameStreamProtocol.h"
+
+  //Uncomment this to stream frames over serial while the pipeline's idle, e.g.
+  //for checking the camera's wiring & focus. Serial runs at FRAME_STREAM_BAUD
+  //rather than 115200, so use the viewer rather than the serial monitor.
+  // #define DEBUG_FRAME_STREAM
+
+  //The serial baud while streaming, which USB serial adapters can keep up with
+  #define FRAME_STREAM_BAUD 2000000
+
+  //What to send of each frame (see frameStreamProtocol.h). Just the luma is
+  //half the bytes, so twice the frame rate, but it's greyscale.
+  #define FRAME_STREAM_LAYOUT FRAME_LAYOUT_YUV422
+  #define FRAME_STREAM_ENCODING FRAME_ENCODING_PACKBITS
+
+  //Setup func, starts the stream's task
+  bool setupFrameStream();
+#endif
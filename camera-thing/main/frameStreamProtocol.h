@@ -0,0 +1,278 @@
+// frameStreamProtocol.h
+// The binary protocol DEBUG_FRAME_STREAM sends frames over serial with, shared
+// by the firmware (frameStream.cpp) and the host's frame viewer
+// (camera-thing/viewer). It's plain C++ with no Arduino dependencies.
+//
+// Each frame is a header, the payload, then a trailer, all little endian:
+//
+//   header:  "CTF1", sequence (u32), millis (u32), width (u16), height (u16),
+//            layout (u8), encoding (u8), raw length (u32), CRC-32 of the
+//            header so far (u32)
+//   payload: the frame's bytes in `layout`, raw or PackBits encoded. PackBits
+//            YUV422 has all the Y bytes then all the U & V bytes, as Y and UV
+//            hardly ever repeat each other, but each often repeats itself.
+//   trailer: "CTFE", CRC-32 of the decoded payload (u32)
+//
+// The log carries on over the same serial port in between frames, so the
+// viewer looks for the magic, and only trusts a header whose CRC matches.
+// Anything else is log text. A frame whose payload CRC doesn't match (e.g.
+// because another task logged something in the middle of it) is dropped.
+
+#ifndef FRAME_STREAM_PROTOCOL_USED
+  #define FRAME_STREAM_PROTOCOL_USED
+
+  #include <stdint.h>
+  #include <stddef.h>
+  #include <string.h>
+
+  #define FRAME_STREAM_MAGIC "CTF1"
+  #define FRAME_STREAM_END_MAGIC "CTFE"
+  #define FRAME_STREAM_HEADER_SIZE 28
+  #define FRAME_STREAM_TRAILER_SIZE 8
+
+  //What's in the payload
+  enum frameLayout : uint8_t {
+    FRAME_LAYOUT_YUV422 = 0, //Y0 U Y1 V, 2 bytes a pixel, as the camera gives them
+    FRAME_LAYOUT_LUMA = 1,   //Just the Y, 1 byte a pixel
+  };
+
+  //How the payload's encoded
+  enum frameEncoding : uint8_t {
+    FRAME_ENCODING_RAW = 0,
+    FRAME_ENCODING_PACKBITS = 1,
+  };
+
+  //The details of a frame, from its header
+  struct frameInfo {
+    uint32_t sequence;
+    uint32_t millis;
+    uint16_t width;
+    uint16_t height;
+    frameLayout layout;
+    frameEncoding encoding;
+    uint32_t rawLength;
+  };
+
+  /////////////////////////////////////////////////////////////////////////////
+  // CRC-32
+
+  //The usual CRC-32 (as in zlib), a nibble at a time so the table's tiny.
+  //Start with FRAME_STREAM_CRC_INIT, and finish with frameStreamCRCDone.
+  #define FRAME_STREAM_CRC_INIT 0xFFFFFFFFu
+  static inline uint32_t frameStreamCRC(uint32_t crc, const uint8_t *data, size_t len) {
+    static const uint32_t table[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+      0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    for(size_t i = 0; i < len; i++) {
+      crc ^= data[i];
+      crc = (crc >> 4) ^ table[crc & 0xF];
+      crc = (crc >> 4) ^ table[crc & 0xF];
+    }
+    return crc;
+  }
+  static inline uint32_t frameStreamCRCDone(uint32_t crc) {
+    return ~crc;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Sending
+
+  //A frameStreamWriter sends `len` bytes of a frame on its way
+  typedef void (*frameStreamWriter)(const uint8_t *data, size_t len, void *arg);
+
+  static inline void putU16(uint8_t *out, uint16_t value) {
+    out[0] = value;
+    out[1] = value >> 8;
+  }
+  static inline void putU32(uint8_t *out, uint32_t value) {
+    putU16(out, value);
+    putU16(out + 2, value >> 16);
+  }
+
+  //A frameStreamSender gathers the payload's bytes into packets, so they're
+  //written a few hundred at a time rather than one by one
+  struct frameStreamSender {
+    frameStreamWriter write;
+    void *arg;
+    uint8_t packet[256];
+    size_t packetLen;
+  };
+
+  static inline void senderFlush(frameStreamSender *sender) {
+    if(sender->packetLen > 0) {
+      sender->write(sender->packet, sender->packetLen, sender->arg);
+      sender->packetLen = 0;
+    }
+  }
+
+  static inline void senderPut(frameStreamSender *sender, const uint8_t *data, size_t len) {
+    if(sender->packetLen + len > sizeof(sender->packet)) {
+      senderFlush(sender);
+    }
+    memcpy(sender->packet + sender->packetLen, data, len);
+    sender->packetLen += len;
+  }
+
+  //sendPackBits encodes `count` bytes, `stride` bytes apart, with PackBits: a
+  //control byte n of 0-127 is followed by n + 1 literal bytes, and one of
+  //129-255 by a single byte repeated 257 - n times
+  static inline void sendPackBits(frameStreamSender *sender, const uint8_t *src, size_t count, int stride) {
+    size_t i = 0;
+    while(i < count) {
+      //How long a run starts here
+      uint8_t value = src[i * stride];
+      size_t run = 1;
+      while(i + run < count && run < 128 && src[(i + run) * stride] == value) {
+        run++;
+      }
+      if(run >= 3) {
+        uint8_t packet[2] = {(uint8_t)(257 - run), value};
+        senderPut(sender, packet, 2);
+        i += run;
+        continue;
+      }
+
+      //Otherwise literals, up until the next run of 3 or more
+      uint8_t packet[129];
+      size_t literals = 0;
+      while(i < count && literals < 128) {
+        uint8_t b = src[i * stride];
+        if(
+          i + 2 < count &&
+          src[(i + 1) * stride] == b &&
+          src[(i + 2) * stride] == b
+        ) {
+          break;
+        }
+        packet[1 + literals++] = b;
+        i++;
+      }
+      packet[0] = literals - 1;
+      senderPut(sender, packet, literals + 1);
+    }
+  }
+
+  //sendFrame sends a YUV422 frame in `layout` and `encoding` through `write`
+  static inline void sendFrame(const uint8_t *yuyv, const frameInfo &info, frameStreamWriter write, void *arg) {
+    frameStreamSender sender = {write, arg, {}, 0};
+    size_t pixels = (size_t)info.width * info.height;
+    int stride = info.layout == FRAME_LAYOUT_LUMA ? 2 : 1;
+    size_t count = info.layout == FRAME_LAYOUT_LUMA ? pixels : pixels * 2;
+
+    uint8_t header[FRAME_STREAM_HEADER_SIZE];
+    memcpy(header, FRAME_STREAM_MAGIC, 4);
+    putU32(header + 4, info.sequence);
+    putU32(header + 8, info.millis);
+    putU16(header + 12, info.width);
+    putU16(header + 14, info.height);
+    header[16] = info.layout;
+    header[17] = info.encoding;
+    putU32(header + 18, count);
+    header[22] = 0; //Reserved
+    header[23] = 0;
+    putU32(header + 24, frameStreamCRCDone(frameStreamCRC(FRAME_STREAM_CRC_INIT, header, 24)));
+    senderPut(&sender, header, sizeof(header));
+
+    if(info.encoding == FRAME_ENCODING_PACKBITS && stride == 1) {
+      sendPackBits(&sender, yuyv, pixels, 2);
+      sendPackBits(&sender, yuyv + 1, pixels, 2);
+    } else if(info.encoding == FRAME_ENCODING_PACKBITS) {
+      sendPackBits(&sender, yuyv, count, stride);
+    } else if(stride == 1) {
+      senderFlush(&sender);
+      write(yuyv, count, arg);
+    } else {
+      for(size_t i = 0; i < count; i++) {
+        senderPut(&sender, yuyv + i * stride, 1);
+      }
+    }
+
+    //The CRC's of the raw bytes, so it checks the decoding too
+    uint32_t crc = FRAME_STREAM_CRC_INIT;
+    if(stride == 1) {
+      crc = frameStreamCRC(crc, yuyv, count);
+    } else {
+      for(size_t i = 0; i < count; i++) {
+        crc = frameStreamCRC(crc, yuyv + i * stride, 1);
+      }
+    }
+    uint8_t trailer[FRAME_STREAM_TRAILER_SIZE];
+    memcpy(trailer, FRAME_STREAM_END_MAGIC, 4);
+    putU32(trailer + 4, frameStreamCRCDone(crc));
+    senderPut(&sender, trailer, sizeof(trailer));
+    senderFlush(&sender);
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Receiving
+
+  static inline uint16_t getU16(const uint8_t *in) {
+    return in[0] | (in[1] << 8);
+  }
+  static inline uint32_t getU32(const uint8_t *in) {
+    return getU16(in) | ((uint32_t)getU16(in + 2) << 16);
+  }
+
+  //parseFrameHeader checks a header's magic & CRC, and that its frame isn't
+  //silly, filling in `info`. Returns false if it's not a header.
+  static inline bool parseFrameHeader(const uint8_t *header, frameInfo *info) {
+    if(memcmp(header, FRAME_STREAM_MAGIC, 4) != 0) {
+      return false;
+    }
+    if(getU32(header + 24) != frameStreamCRCDone(frameStreamCRC(FRAME_STREAM_CRC_INIT, header, 24))) {
+      return false;
+    }
+    info->sequence = getU32(header + 4);
+    info->millis = getU32(header + 8);
+    info->width = getU16(header + 12);
+    info->height = getU16(header + 14);
+    info->layout = (frameLayout)header[16];
+    info->encoding = (frameEncoding)header[17];
+    info->rawLength = getU32(header + 18);
+    size_t pixels = (size_t)info->width * info->height;
+    return info->layout <= FRAME_LAYOUT_LUMA
+      && info->encoding <= FRAME_ENCODING_PACKBITS
+      && info->rawLength == (info->layout == FRAME_LAYOUT_LUMA ? pixels : pixels * 2);
+  }
+
+  //unpackBits decodes PackBits from `in` into `out`, stopping when either's
+  //used up. Returns how many bytes of `in` it used, and adds how many it wrote
+  //to `written`. A packet cut off at the end of `in` is left for next time.
+  static inline size_t unpackBits(const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen, size_t *written) {
+    size_t used = 0;
+    while(used < inLen && *written < outLen) {
+      uint8_t control = in[used];
+      if(control < 128) {
+        size_t literals = control + 1;
+        if(used + 1 + literals > inLen || *written + literals > outLen) {
+          break;
+        }
+        memcpy(out + *written, in + used + 1, literals);
+        *written += literals;
+        used += 1 + literals;
+      } else if(control > 128) {
+        size_t run = 257 - control;
+        if(used + 2 > inLen || *written + run > outLen) {
+          break;
+        }
+        memset(out + *written, in[used + 1], run);
+        *written += run;
+        used += 2;
+      } else {
+        used++; //128 is a no-op
+      }
+    }
+    return used;
+  }
+
+  //interleavePlanes turns PackBits YUV422's Y bytes then U & V bytes back into
+  //Y0 U Y1 V, through `scratch`, which must be as big as the frame
+  static inline void interleavePlanes(uint8_t *frame, size_t len, uint8_t *scratch) {
+    memcpy(scratch, frame, len);
+    for(size_t i = 0; i < len / 2; i++) {
+      frame[i * 2] = scratch[i];
+      frame[i * 2 + 1] = scratch[len / 2 + i];
+    }
+  }
+#endif
@@ -6,9 +6,11 @@
 
 #ifdef APN
   #include <Arduino.h>
+  #include "driver/uart.h"
   #include "gprsClient.h"
   #include "utils.h"
   #include "asyncLed.h"
+  #include "baudNegotiation.h"
 
   //TTGO T-Call pin definitions
   #define SIM800L_RX     26
@@ -16,11 +18,87 @@
   #define SIM800L_PWRKEY 4
   #define SIM800L_RST    5
   #define SIM800L_POWER  23
+  //RTS & CTS aren't wired on the TTGO T-Call, so hardware flow control is off.
+  //If you've wired them up, set their GPIO pins here to turn it on.
+  #define SIM800L_RTS    -1
+  #define SIM800L_CTS    -1
+
+  //The UART SerialAT uses, for setting up flow control
+  #define SIM800L_UART   UART_NUM_2
+
+  //How big the receive buffer for SerialAT should be. It's only 256 bytes by
+  //default, which a response can overflow at higher bauds.
+  #define SIM800L_RX_BUFFER 4096
 
   //Remember if we're already turned the SIM800L on so we don't have to wait as
   //long when we make another request
   bool SIM800LOn = false;
 
+  //The baudLink the SIM800L's baud is negotiated through, see baudNegotiation.h
+  bool linkTestAT(uint32_t timeoutMs, void *arg) {
+    return modem.testAT(timeoutMs);
+  }
+
+  bool linkSetModemBaud(uint32_t baud, void *arg) {
+    modem.sendAT("+IPR=", baud);
+    return modem.waitResponse(1000) == 1;
+  }
+
+  void linkSetBaud(uint32_t baud, void *arg) {
+    SerialAT.flush();
+    SerialAT.updateBaudRate(baud);
+    WAIT_MS(100);
+  }
+
+  void linkTried(uint32_t baud, baudResult result, void *arg) {
+    const char *results[] = {"rejected :(", "unreliable :(", "success!"};
+    Serial.printf("[negotiateBaud] - Trying %d baud... %s\n", baud, results[result]);
+  }
+
+  const baudLink SIM800LLink = {linkTestAT, linkSetModemBaud, linkSetBaud, linkTried, nullptr};
+
+  //negotiateBaud moves the SIM800L up to the fastest baud it works reliably at,
+  //and saves it. Returns the baud in use.
+  uint32_t negotiateBaud() {
+    uint32_t current = findBaud(&SIM800LLink);
+    if(current == 0) {
+      Serial.println("[negotiateBaud] - SIM800L isn't responding at any baud :(");
+      SerialAT.updateBaudRate(SIM800L_INITIAL_BAUD);
+      return SIM800L_INITIAL_BAUD;
+    }
+    Serial.printf("[negotiateBaud] - SIM800L responding at %d baud\n", current);
+
+    current = negotiateBaud(&SIM800LLink, current);
+    if(current == 0) {
+      Serial.println("[negotiateBaud] - Lost the SIM800L :(");
+      SerialAT.updateBaudRate(SIM800L_INITIAL_BAUD);
+      return SIM800L_INITIAL_BAUD;
+    }
+
+    //Save the baud so the SIM800L keeps it through modem.restart()
+    modem.sendAT("&W");
+    modem.waitResponse();
+
+    Serial.printf("[negotiateBaud] - Using %d baud (~%d bytes/s)\n", current, current/10);
+    return current;
+  }
+
+  //setupFlowControl turns on RTS/CTS flow control on both ends of the UART, if
+  //the pins are wired up.
+  void setupFlowControl() {
+    if(SIM800L_RTS < 0 || SIM800L_CTS < 0) {
+      return;
+    }
+    uart_set_pin(SIM800L_UART, SIM800L_TX, SIM800L_RX, SIM800L_RTS, SIM800L_CTS);
+    uart_set_hw_flow_ctrl(SIM800L_UART, UART_HW_FLOWCTRL_CTS_RTS, 100);
+    modem.sendAT("+IFC=2,2");
+    if(modem.waitResponse(1000) != 1) {
+      Serial.println("[setupFlowControl] - SIM800L didn't accept AT+IFC :(");
+      return;
+    }
+    Serial.println("[setupFlowControl] - Using RTS/CTS flow control");
+  }
+
   //powerSIM800L sets up power to the SIM800L
   void powerSIM800L() {
     //We don't need to do anything if the SIM800L is already on
@@ -42,10 +120,15 @@
 
     //Initialise SerialAT...
     Serial.print("[setupGPRSClient] - Starting SerialAT...");
-    SerialAT.begin(4800, SERIAL_8N1, SIM800L_RX, SIM800L_TX);
+    SerialAT.setRxBufferSize(SIM800L_RX_BUFFER);
+    SerialAT.begin(SIM800L_INITIAL_BAUD, SERIAL_8N1, SIM800L_RX, SIM800L_TX);
     WAIT_MS(3000);
     Serial.println(" done :)");
 
+    //Get the UART up to speed
+    setupFlowControl();
+    negotiateBaud();
+
     //Set SIM800LOn to true because we've turned it on, now.
     SIM800LOn = true;
   }
@@ -76,6 +159,19 @@
     return true;
   }
 
+  //sleepGPRSClient detaches from GPRS and turns the SIM800L's radio off, which
+  //saves a lot of power while we're not using it. setupGPRSClient restarts the
+  //SIM800L, which turns it back on.
+  void sleepGPRSClient() {
+    Serial.print("[sleepGPRSClient] - Turning radio off...");
+    modem.gprsDisconnect();
+    if(!modem.radioOff()){
+      Serial.println(" fail :(");
+      return;
+    }
+    Serial.println(" success!");
+  }
+
   //sentTweetText sends a text to SMS_TARGET
   bool sendTweetText(String tweetURL) {
     #ifdef SMS_TARGET
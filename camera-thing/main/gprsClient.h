@@ -6,7 +6,7 @@
 
   //Config for TinyGsmClient.h
   #define TINY_GSM_MODEM_SIM800
-  #define TINY_GSM_RX_BUFFER 1024
+  #define TINY_GSM_RX_BUFFER 4096
   #include <TinyGsmClient.h>
 
   //Initialise modem
@@ -17,12 +17,15 @@
   // StreamDebugger debugger(SerialAT, Serial);
   // TinyGsm modem(debugger);
 
-  //Initialise client
-  inline TinyGsmClient webClient(modem);
+  //Initialise the 2G transport for webClient (see networkClient.h)
+  inline TinyGsmClient gprsWebClient(modem);
 
   //Setup func
   bool setupGPRSClient();
 
+  //Turns the radio off until setupGPRSClient is next called
+  void sleepGPRSClient();
+
   //Func to send tweet SMS
   bool sendTweetText(String tweetURL);
 #endif
\ No newline at end of file
@@ -0,0 +1,175 @@
+// healthMonitor.cpp
+// A low priority task that checks the tweeter's /health endpoint in the
+// background, so we don't have to block startup on it. Requests to /tweet also
+// report whether they reached the tweeter, so while photos are being taken we
+// don't need to check separately.
+
+#include <Arduino.h>
+#include "utils.h"
+#include "secrets.h"
+#include "tweeter.h"
+#include "networkClient.h"
+#include "pipeline.h"
+#include "telemetry.h"
+#include "healthMonitor.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Config
+
+//The monitor runs on the network core, below the pipeline's network stage
+#define HEALTH_MONITOR_CORE 0
+#define HEALTH_MONITOR_PRIORITY 1
+
+//Checks may do a TLS handshake, which needs a lot more stack!
+#ifdef TWEETER_TLS
+  #define HEALTH_MONITOR_STACK 16384
+#else
+  #define HEALTH_MONITOR_STACK 10000
+#endif
+
+//How long to wait before the first check after startup, in milliseconds
+#define HEALTH_FIRST_CHECK_DELAY 2000
+
+//How often to check the tweeter while it's reachable, in milliseconds. Each
+//check over 2G means restarting the SIM800L, so we check much less often.
+#define HEALTH_CHECK_INTERVAL 300000
+#define HEALTH_CHECK_INTERVAL_GPRS 900000
+
+//While the tweeter's unreachable, we retry after HEALTH_RETRY_MIN ms, doubling
+//each time up to HEALTH_CHECK_INTERVAL
+#define HEALTH_RETRY_MIN 10000
+
+//Timeout for each /health request, in milliseconds
+#define HEALTH_CHECK_TIMEOUT 10000
+
+//Bits sent to the monitor's task notification
+#define HEALTH_CHECK_NOW (1 << 0) //Someone wants a check right now
+#define HEALTH_RECORDED  (1 << 1) //A /tweet request reported the health
+
+/////////////////////////////////////////////////////////////////////////////
+// State
+
+enum tweeterHealth {
+  TWEETER_HEALTH_UNKNOWN,
+  TWEETER_HEALTH_REACHABLE,
+  TWEETER_HEALTH_UNREACHABLE,
+};
+
+volatile tweeterHealth health = TWEETER_HEALTH_UNKNOWN;
+
+//How many checks the monitor has completed, so waiters can see a new one
+volatile int checksDone = 0;
+
+TaskHandle_t healthMonitorTask = nullptr;
+
+/////////////////////////////////////////////////////////////////////////////
+// Utils
+
+//checkInterval gets how long to wait between checks while the tweeter's
+//reachable, which depends on which transport we're using
+int checkInterval() {
+  return currentTransport() == NETWORK_GPRS ? HEALTH_CHECK_INTERVAL_GPRS : HEALTH_CHECK_INTERVAL;
+}
+
+//setHealth updates the cached state, logging if it's changed
+void setHealth(bool reachable) {
+  tweeterHealth prev = health;
+  health = reachable ? TWEETER_HEALTH_REACHABLE : TWEETER_HEALTH_UNREACHABLE;
+  if(prev != health) {
+    Serial.printf("[healthMonitor] - Tweeter is now %s\n", reachable ? "reachable :)" : "unreachable :(");
+  }
+}
+
+//recordTweeterHealth is how requests to /tweet report back. It also resets the
+//monitor's timer, as there's no point checking something we've just seen.
+void recordTweeterHealth(bool reachable) {
+  setHealth(reachable);
+  if(healthMonitorTask != nullptr) {
+    xTaskNotify(healthMonitorTask, HEALTH_RECORDED, eSetBits);
+  }
+}
+
+//tweeterReachable is true unless we know the tweeter can't be reached
+bool tweeterReachable() {
+  return health != TWEETER_HEALTH_UNREACHABLE;
+}
+
+//waitForTweeterReachable asks the monitor for a check now, and waits for it to
+//finish (or `timeout` ms to pass).
+bool waitForTweeterReachable(int timeout) {
+  if(healthMonitorTask == nullptr) {
+    return tweeterReachable();
+  }
+  int checksBefore = checksDone;
+  xTaskNotify(healthMonitorTask, HEALTH_CHECK_NOW, eSetBits);
+  int started = millis();
+  while(checksDone == checksBefore && millis() - started < timeout) {
+    WAIT_MS(250);
+  }
+  return tweeterReachable();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Task
+
+//healthMonitorLoop checks the tweeter every checkInterval() while it's
+//reachable, and with exponential backoff while it isn't.
+void healthMonitorLoop(void *p) {
+  int retryDelay = HEALTH_RETRY_MIN;
+  int wait = HEALTH_FIRST_CHECK_DELAY;
+
+  for(;;) {
+    uint32_t bits = 0;
+    bool notified = xTaskNotifyWait(0, 0xFFFFFFFF, &bits, pdMS_TO_TICKS(wait)) == pdTRUE;
+
+    //If a /tweet request just told us the health, start waiting again
+    if(notified && !(bits & HEALTH_CHECK_NOW)) {
+      if(tweeterReachable()) {
+        retryDelay = HEALTH_RETRY_MIN;
+        wait = checkInterval();
+      } else {
+        wait = retryDelay;
+      }
+      continue;
+    }
+
+    //Scheduled checks are skipped while photos are on their way, as the
+    //uploads will tell us the health anyway and shouldn't have to wait on us
+    if(!notified && !pipelineIdle()) {
+      wait = HEALTH_RETRY_MIN;
+      continue;
+    }
+
+    Serial.println("[healthMonitor] - Checking tweeter health...");
+    bool reachable = checkTweeterAccessible(HEALTH_CHECK_TIMEOUT);
+    setHealth(reachable);
+    checksDone++;
+
+    //Back off while the tweeter's unreachable
+    if(reachable) {
+      retryDelay = HEALTH_RETRY_MIN;
+      wait = checkInterval();
+    } else {
+      wait = retryDelay;
+      retryDelay = min(retryDelay * 2, checkInterval());
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Setup
+
+//setupHealthMonitor starts the monitor's task. Returns false for fail, true
+//for success.
+bool setupHealthMonitor() {
+  BaseType_t created = xTaskCreatePinnedToCore(
+    healthMonitorLoop, "healthMonitor", HEALTH_MONITOR_STACK, nullptr, HEALTH_MONITOR_PRIORITY, &healthMonitorTask, HEALTH_MONITOR_CORE
+  );
+  if(created != pdPASS) {
+    Serial.println("[setupHealthMonitor] - Failed to create health monitor task :(");
+    healthMonitorTask = nullptr;
+    return false;
+  }
+  watchTask("health", healthMonitorTask, HEALTH_MONITOR_STACK);
+  return true;
+}
@@ -0,0 +1,20 @@
+// healthMonitor.h
+// Exports the background monitor that keeps track of whether the tweeter
+// service can be reached
+
+#ifndef HEALTH_MONITOR_USED
+  #define HEALTH_MONITOR_USED
+
+  //Setup func, starts the monitor's task
+  bool setupHealthMonitor();
+
+  //Records whether the tweeter could be reached, e.g. from a /tweet response
+  void recordTweeterHealth(bool reachable);
+
+  //The cached state; true unless the tweeter's known to be unreachable
+  bool tweeterReachable();
+
+  //Asks the monitor to check the tweeter now and waits up to `timeout` ms for
+  //the result. Returns true if the tweeter is reachable.
+  bool waitForTweeterReachable(int timeout);
+#endif
@@ -0,0 +1,146 @@
+// ledFades.h
+// Describes AsyncLED's animations as sequences of fades for the LEDC's fade
+// engine to run in hardware, so the CPU's only woken at the end of each fade
+// rather than every 30ms. It's plain C++ with no Arduino dependencies, so the
+// fades can be checked against the animations' waveforms on the host too (see
+// camera-thing/bench).
+
+#ifndef LED_FADES_USED
+  #define LED_FADES_USED
+
+  #include <math.h>
+  #include <stdint.h>
+
+  //The most fades one loop of an animation can be made of
+  #define LED_MAX_FADES 64
+  //How many fades each half of a cosine curve (breathe & throb) is split into,
+  //at least. More is smoother, but wakes the CPU more often.
+  #define LED_CURVE_FADES 8
+  //The longest a fade can be, in milliseconds. An animation can only be
+  //stopped between fades, so this bounds how long stopping one can take.
+  #define LED_MAX_FADE_MILLIS 250
+
+  //One segment of an animation
+  struct ledFade {
+    uint8_t duty;    //The duty cycle (0-255) the segment ends at
+    uint16_t millis; //How long the segment lasts
+    bool ramp;       //Fade to `duty` linearly over the segment, rather than setting it straight away and holding it
+  };
+
+  //The shapes of curve addCurveFades can add
+  enum ledCurve {
+    LED_CURVE_LINEAR_UP,   //0 -> 255 in a straight line
+    LED_CURVE_LINEAR_DOWN, //255 -> 0 in a straight line
+    LED_CURVE_COS_UP,      //0 -> 255 following (1 - cos) / 2
+    LED_CURVE_COS_DOWN,    //255 -> 0 following (1 + cos) / 2
+  };
+
+  //curveDuty gets the duty cycle `pos` (0-1) of the way along a curve, the same
+  //way AsyncLED's software animations do
+  static inline int curveDuty(ledCurve curve, double pos) {
+    switch(curve) {
+      case LED_CURVE_LINEAR_UP:   return (int)round(255.0 * pos);
+      case LED_CURVE_LINEAR_DOWN: return (int)round(255.0 * (1 - pos));
+      case LED_CURVE_COS_UP:      return (int)round(255.0 * ((1.0 - cos(pos * M_PI)) / 2.0));
+      default:                    return (int)round(255.0 * ((1.0 + cos(pos * M_PI)) / 2.0));
+    }
+  }
+
+  //addHold adds a segment that sets `duty` and holds it for `millis`
+  static inline int addHold(ledFade *fades, int count, int duty, int millis) {
+    if(count < LED_MAX_FADES) {
+      fades[count++] = ledFade{(uint8_t)duty, (uint16_t)millis, false};
+    }
+    return count;
+  }
+
+  //addCurveFades adds ramps approximating `curve` over `millis`, split into
+  //`pieces` at least (but no more than `millis`), and so no ramp's longer than
+  //LED_MAX_FADE_MILLIS. Adds nothing if `millis` is 0. The
+  //pieces end at whole milliseconds, so their lengths add up to `millis`, and
+  //each ends on the curve at that millisecond.
+  static inline int addCurveFades(ledFade *fades, int count, ledCurve curve, int millis, int pieces) {
+    //There's no curve to follow in no time at all
+    if(millis <= 0) {
+      return count;
+    }
+    int maxPieces = (LED_MAX_FADES - count) > 0 ? LED_MAX_FADES - count : 0;
+    int needed = (millis + LED_MAX_FADE_MILLIS - 1) / LED_MAX_FADE_MILLIS;
+    if(needed > pieces) {
+      pieces = needed;
+    }
+    //Each piece needs a millisecond at least
+    if(pieces > millis) {
+      pieces = millis;
+    }
+    if(pieces > maxPieces) {
+      pieces = maxPieces;
+    }
+    int ended = 0;
+    for(int i = 1; i <= pieces; i++) {
+      int end = (int)round((double)millis * i / pieces);
+      fades[count++] = ledFade{(uint8_t)curveDuty(curve, (double)end / millis), (uint16_t)(end - ended), true};
+      ended = end;
+    }
+    return count;
+  }
+
+  //loopMillis is how long one loop of `count` fades lasts
+  static inline int loopMillis(const ledFade *fades, int count) {
+    int millis = 0;
+    for(int i = 0; i < count; i++) {
+      millis += fades[i].millis;
+    }
+    return millis;
+  }
+
+  //Each of these fills `fades` with one loop of an animation, returning how
+  //many fades it's made of. Every loop ends at the duty cycle it starts at.
+
+  //flashFades: on for `delay`, off for `delay`
+  static inline int flashFades(int delay, ledFade *fades) {
+    int count = addHold(fades, 0, 255, delay);
+    return addHold(fades, count, 0, delay);
+  }
+
+  //blinkFades: on for `onPeriod`, off for `offPeriod`
+  static inline int blinkFades(int offPeriod, int onPeriod, ledFade *fades) {
+    int count = addHold(fades, 0, 255, onPeriod);
+    return addHold(fades, count, 0, offPeriod);
+  }
+
+  //triangleFades: straight up to full over half the period, and back down
+  static inline int triangleFades(int period, ledFade *fades) {
+    int count = addCurveFades(fades, 0, LED_CURVE_LINEAR_UP, period / 2, 1);
+    return addCurveFades(fades, count, LED_CURVE_LINEAR_DOWN, period - period / 2, 1);
+  }
+
+  //throbFades: up to full following a cosine over `attack`, then back down
+  //over `decay`
+  static inline int throbFades(int attack, int decay, ledFade *fades) {
+    int count = addCurveFades(fades, 0, LED_CURVE_COS_UP, attack, LED_CURVE_FADES);
+    return addCurveFades(fades, count, LED_CURVE_COS_DOWN, decay, LED_CURVE_FADES);
+  }
+
+  //breatheFades: a throb with the same attack & decay
+  static inline int breatheFades(int period, ledFade *fades) {
+    return throbFades(period / 2, period - period / 2, fades);
+  }
+
+  //stepFades: `steps` levels of brightness from off to full, each held for an
+  //equal share of the period
+  static inline int stepFades(int period, int steps, ledFade *fades) {
+    if(steps < 2) {
+      return addHold(fades, 0, 255, period);
+    }
+    int count = 0;
+    int ended = 0;
+    for(int i = 0; i < steps; i++) {
+      //The software version moves up a step on the first millisecond past it
+      int end = (period * (i + 1) + steps - 1) / steps;
+      count = addHold(fades, count, (int)(255.0 * i / (steps - 1)), end - ended);
+      ended = end;
+    }
+    return count;
+  }
+#endif
@@ -7,11 +7,18 @@
 #include "secrets.h"
 #include "camera.h"
 #include "tweeter.h"
+#include "networkClient.h"
 #include "asyncLed.h"
-
-#ifdef APN
-  #include "gprsClient.h"
-#endif
+#include "pipeline.h"
+#include "healthMonitor.h"
+#include "trace.h"
+#include "telemetry.h"
+#include "power.h"
+#include "motion.h"
+#include "classifier.h"
+#include "preprocess.h"
+#include "frameStream.h"
+#include "timelapse.h"
 
 //I would like to use the GPS featherwing but I have actually just ran out of 
 //GPIO pins...
@@ -28,12 +35,40 @@ int buttonPin = 13;
 //Whether the button is currently down
 bool buttonDown = false;
 
+#ifdef BURST_MODE
+  //How long the button has to be held down for a burst, in milliseconds
+  #define BURST_HOLD_MS 800
+
+  //When the button was last pressed, and whether we've yet to decide between
+  //a photo or a burst for it
+  unsigned long pressedAt = 0;
+  bool pressUndecided = false;
+#endif
+
 //The current loop number
 int loopN = 0;
 
 //Our LED instance (we'll use PWM channel 15)
 AsyncLED myLed = AsyncLED(ledPin, 15);
 
+//Whether the idle animation currently showing is the one for a reachable 
+//tweeter service
+bool idleShowsReachable = true;
+
+/////////////////////////////////////////////////////////////////////////////
+// Utils
+
+//showIdle shows the idle animation: a short blink every 3 seconds, or every 
+//second if the tweeter service can't be reached
+void showIdle() {
+  idleShowsReachable = tweeterReachable();
+  if(idleShowsReachable) {
+    myLed.blink(2950,50);
+  } else {
+    myLed.blink(950,50);
+  }
+}
+
 /////////////////////////////////////////////////////////////////////////////
 // Setup
 
@@ -41,47 +76,59 @@ void setup() {
   //Make LED breathe during setup
   myLed.breathe(1000);
 
-  //Setup serial output
-  Serial.begin(115200);
+  //Setup serial output, faster if it's carrying frames too
+  #ifdef DEBUG_FRAME_STREAM
+    Serial.begin(FRAME_STREAM_BAUD);
+  #else
+    Serial.begin(115200);
+  #endif
   Serial.println("[setup] - arduino started");
   Serial.printf("\n[setup] - wire pins: sda=%d scl=%d\n", SDA, SCL);
 
+  //Keep track of how much of the main loop's stack is used, like the tasks'
+  watchTask("loop", xTaskGetCurrentTaskHandle(), LOOP_STACK);
+
   //Setup pin for button
   pinMode(buttonPin, INPUT_PULLUP);
 
-  //We only setupNetworkConn on startup if we're using WiFI; 2G has to be done 
-  //before every request.
-  #ifdef WIFI_SSID
-    //Setup wifi. This may take a while normally...
-    Serial.println("[setup] - Setting up network connection...");
-    bool networkSuccess = setupNetworkConn();
-    if (!networkSuccess) {
-      Serial.println("[setup] - Failed to connect to network :(");
-      //Signal network failure
-      myLed.step(1000,4);
-      WAIT_MS(3000);
-      ESP.restart();
-    }
-    Serial.println("[setup] - Set up network connection!");
-  #endif
-
-  //Check tweeter service is available. This may also take a while normally...
-  //It's not absolutely neccessary to do this, but a good idea if you want to be
-  //certain that your images should upload when you take them. It can be 
-  //disabled by defining FAST_STARTUP.
-  #define FAST_STARTUP
-  #ifndef FAST_STARTUP
-    Serial.println("[setup] - Checking tweeter service is accessible...");
-    bool tweeterSuccess = checkTweeterAccessible(60000);
-    if (!tweeterSuccess) {
-      Serial.println("[setup] - Failed to check tweeter service health :(");
-      //Signal network failure
-      myLed.step(1000,4);
-      WAIT_MS(3000);
-      ESP.restart();
-    }
-    Serial.println("[setup] - Tweeter is accessible!");
-  #endif
+  //Slow the CPU down until something needs it
+  Serial.println("[setup] - Setting up power management...");
+  bool powerSuccess = setupPower(buttonPin);
+  if (!powerSuccess) {
+    Serial.println("[setup] - Failed to setup power management :(");
+    //Signal hardware failure
+    myLed.flash(100);
+    WAIT_MS(2000);
+    ESP.restart();
+  }
+  Serial.println("[setup] - Set up power management!");
+
+  //Setup wifi, if we're using it. This may take a while normally... 2G has to
+  //be done before every request, so it's left until then, and if WiFi fails
+  //but 2G's set up too, we carry on over 2G.
+  Serial.println("[setup] - Setting up network connection...");
+  bool networkSuccess = setupNetworkClient();
+  if (!networkSuccess) {
+    Serial.println("[setup] - Failed to connect to network :(");
+    //Signal network failure
+    myLed.step(1000,4);
+    WAIT_MS(3000);
+    ESP.restart();
+  }
+  Serial.println("[setup] - Set up network connection!");
+
+  //Start checking the tweeter service is accessible in the background. Until
+  //it's been checked, we assume it's fine so startup isn't held up.
+  Serial.println("[setup] - Starting health monitor...");
+  bool monitorSuccess = setupHealthMonitor();
+  if (!monitorSuccess) {
+    Serial.println("[setup] - Failed to start health monitor :(");
+    //Signal hardware failure
+    myLed.flash(100);
+    WAIT_MS(2000);
+    ESP.restart();
+  }
+  Serial.println("[setup] - Started health monitor!");
 
   // !!! Currently not used, see FIRMWARE.md !!!
   //Setup GPS. Should be pretty fast...
@@ -108,8 +155,80 @@ void setup() {
   }
   Serial.println("[setup] - Set up camera!");
 
+  //Check the on-device classifier's model, if we're labelling photos
+  Serial.println("[setup] - Setting up classifier...");
+  bool classifierSuccess = setupClassifier();
+  if (!classifierSuccess) {
+    Serial.println("[setup] - Failed to setup classifier :(");
+    //Signal hardware failure
+    myLed.flash(100);
+    WAIT_MS(2000);
+    ESP.restart();
+  }
+  Serial.println("[setup] - Set up classifier!");
+
+  //Allocate the preprocessing's scratch, if we're cleaning up frames
+  Serial.println("[setup] - Setting up preprocessing...");
+  bool preprocessSuccess = setupPreprocess();
+  if (!preprocessSuccess) {
+    Serial.println("[setup] - Failed to setup preprocessing :(");
+    //Signal hardware failure
+    myLed.flash(100);
+    WAIT_MS(2000);
+    ESP.restart();
+  }
+  Serial.println("[setup] - Set up preprocessing!");
+
+  //Setup the pipeline that takes, encodes and uploads photos in the background
+  Serial.println("[setup] - Setting up pipeline...");
+  bool pipelineSuccess = setupPipeline();
+  if (!pipelineSuccess) {
+    Serial.println("[setup] - Failed to setup pipeline :(");
+    //Signal hardware failure
+    myLed.flash(100);
+    WAIT_MS(2000);
+    ESP.restart();
+  }
+  Serial.println("[setup] - Set up pipeline!");
+
+  //Start watching for motion, if we're taking photos of it
+  Serial.println("[setup] - Setting up motion detection...");
+  bool motionSuccess = setupMotion();
+  if (!motionSuccess) {
+    Serial.println("[setup] - Failed to setup motion detection :(");
+    //Signal hardware failure
+    myLed.flash(100);
+    WAIT_MS(2000);
+    ESP.restart();
+  }
+  Serial.println("[setup] - Set up motion detection!");
+
+  //Start streaming frames to the viewer, if we're debugging the camera
+  Serial.println("[setup] - Setting up frame stream...");
+  bool frameStreamSuccess = setupFrameStream();
+  if (!frameStreamSuccess) {
+    Serial.println("[setup] - Failed to setup frame stream :(");
+    //Signal hardware failure
+    myLed.flash(100);
+    WAIT_MS(2000);
+    ESP.restart();
+  }
+  Serial.println("[setup] - Set up frame stream!");
+
+  //Start taking photos on a schedule, if we're doing a time-lapse
+  Serial.println("[setup] - Setting up time-lapse...");
+  bool timelapseSuccess = setupTimelapse();
+  if (!timelapseSuccess) {
+    Serial.println("[setup] - Failed to setup time-lapse :(");
+    //Signal hardware failure
+    myLed.flash(100);
+    WAIT_MS(2000);
+    ESP.restart();
+  }
+  Serial.println("[setup] - Set up time-lapse!");
+
   //Blink the LED now to signal the CameraThing is on
-  myLed.blink(2950,50);
+  showIdle();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -126,43 +245,44 @@ void loop() {
       Serial.println("[loop] - Button is pressed! Taking a picture...");
     } else {
       Serial.println("[loop] - Button is no longer pressed!");
-      myLed.blink(2950,50);
+      //Only go back to blinking if we're not busy showing the upload
+      if(pipelineIdle()) {
+        showIdle();
+      }
     }
   }
 
-  //Take a picture if the button has just been pressed
-  if(!prevButtonDown && buttonDown){
-    //////////////////////////////////////////////////////////////////////
-    //Taking photograph
-    //Turn on the LED while we get a JPEG from the camera
-    myLed.on();
-
-    //Get a JPEG from the camera
-    uint8_t *jpgBuffer;
-    size_t jpgLen;
-    bool gotJPEG = getJPEG(&jpgBuffer, &jpgLen);
-
-    //If we fail to get a frame buffer, signal an err and restart
-    if (!gotJPEG || jpgLen == 0) {
-      Serial.println("[loop] - Failed to get JPEG :(");
-      myLed.flash(100); //flash(100) for hardware failure
-      WAIT_MS(2000);
-      myLed.off();
-      delete jpgBuffer;
-      ESP.restart();
+  //Take a picture if the button has just been pressed, or something's moved.
+  //With BURST_MODE, a press only takes a picture once it's released, as
+  //holding the button down takes a burst instead.
+  bool pressed = !prevButtonDown && buttonDown;
+  bool burst = false;
+  #ifdef BURST_MODE
+    if(pressed) {
+      pressedAt = millis();
+      pressUndecided = true;
+      pressed = false;
     }
-
-    //Output success
-    Serial.printf("[loop] - Got JPEG from camera of %d bytes\n", jpgLen);
-
-    //Turn the LED off now the camera is done
-    myLed.off();
-
+    if(pressUndecided && !buttonDown) {
+      pressUndecided = false;
+      pressed = true;
+    } else if(pressUndecided && millis() - pressedAt >= BURST_HOLD_MS) {
+      Serial.println("[loop] - Button held down! Taking a burst...");
+      pressUndecided = false;
+      pressed = true;
+      burst = true;
+    }
+  #endif
+  bool motion = motionDetected();
+  if(motion) {
+    Serial.println("[loop] - Motion detected! Taking a picture...");
+  }
+  if(pressed || motion){
     //////////////////////////////////////////////////////////////////////
     //Geolocation
     //This step is optional and only completed if the user doesn't press down 
     //the button after a second
-    float lat; float lon;
+    float lat = 0; float lon = 0;
     bool geolocationEnabled = false;
 
     // !!! Currently not used, see FIRMWARE.md !!!
@@ -194,7 +314,6 @@ void loop() {
     //     myLed.flash(100); //flash(100) for hardware failure
     //     WAIT_MS(2000);
     //     myLed.off();
-    //     delete jpgBuffer;
     //     ESP.restart();
     //   }
 
@@ -206,75 +325,110 @@ void loop() {
     // }
 
     //////////////////////////////////////////////////////////////////////
-    //Upload
-    //Communicate uploading by throbbing with fast attack, slow decay
-    myLed.throb(900,100);
-
-    //Will contain the URL of the tweet
-    String tweetURL;
-
-    //Upload the information to the tweet service
-    bool tweetSuccess = makeTweetRequest(
-      30000,
-      &tweetURL,
-      geolocationEnabled,
-      lat,
-      lon,
-      &jpgBuffer,
-      &jpgLen
-    );
-
-    //If there is some err getting the data to the tweeter, signal an err and 
-    //return.
-    if(!tweetSuccess) {
-      //Signal network failure
-      myLed.step(1000,4);
-      WAIT_MS(3000);
-      myLed.off();
-      //Restart
-      ESP.restart();
+    //Taking photograph
+    //Hand the photo to the pipeline, which captures it on one core and 
+    //uploads it on the other. Turn on the LED while the camera is capturing.
+    bool requested = burst ? requestBurst(geolocationEnabled, lat, lon) : requestPhoto(geolocationEnabled, lat, lon);
+    if(requested) {
+      myLed.on();
     } else {
-      Serial.print("Tweet URL: ");
-      Serial.println(tweetURL);
+      Serial.println("[loop] - Already waiting on a photo, ignoring press");
     }
+  }
 
-    //Turn the LED off now the upload is done
-    myLed.off();
-
-    //////////////////////////////////////////////////////////////////////
-    //Success SMS 
-    //If we're using GPRS, we can send an SMS containing the tweet URL
-    #ifdef APN
-      if (tweetSuccess) {
-        myLed.throb(100,900);
-        bool SMSSuccess = sendTweetText(tweetURL);
-        if (!SMSSuccess) {
-          Serial.println("Failed to send SMS :(");
-          myLed.flash(100); //flash(100) for hardware failure
-          WAIT_MS(3000);
-          ESP.restart();
-        } else {
-          Serial.println("Successfully sent SMS!");
-        }
+  //////////////////////////////////////////////////////////////////////
+  //Pipeline events
+  //Show what the pipeline is up to on the LED
+  pipelineEvent event;
+  while(getPipelineEvent(&event)) {
+    switch(event.type) {
+      case PIPELINE_CAPTURED:
+        //Communicate uploading by throbbing with fast attack, slow decay
+        Serial.println("[loop] - Got frame from camera, uploading...");
+        myLed.throb(900,100);
+        break;
+
+      case PIPELINE_CAPTURE_FAILED:
+        //If we fail to get a JPEG, signal an err, then go back to idle. Bad
+        //frames have already been recaptured, and restarting won't fix the
+        //ones that are left, so the next press just tries again.
+        Serial.println("[loop] - Failed to get JPEG :(");
+        myLed.flash(100); //flash(100) for hardware failure
+        WAIT_MS(2000);
         myLed.off();
-      }
-    #endif
+        break;
+
+      case PIPELINE_UPLOAD_FAILED:
+        //If there is some err getting the data to the tweeter, signal an err 
+        //and restart.
+        Serial.println("[loop] - Failed to tweet :(");
+        myLed.step(1000,4);
+        WAIT_MS(3000);
+        myLed.off();
+        ESP.restart();
+
+      case PIPELINE_UPLOADED:
+        //If the tweeter queued the photo, we don't have the URL yet, so keep
+        //throbbing until it's been tweeted
+        if(event.tweetURL[0] == '\0') {
+          Serial.println("Photo queued to be tweeted!");
+          break;
+        }
+        //Otherwise it's been tweeted, so fall through
+      case PIPELINE_TWEETED:
+        Serial.print("Tweet URL: ");
+        Serial.println(event.tweetURL);
+        #ifdef APN
+          //Communicate sending the SMS
+          myLed.throb(100,900);
+        #endif
+        break;
+
+      case PIPELINE_JOB_FAILED:
+        //The tweeter's got the photo, so there's nothing to gain by restarting.
+        //Signal the err, then carry on.
+        Serial.println("[loop] - Queued photo wasn't tweeted :(");
+        myLed.step(1000,4);
+        WAIT_MS(3000);
+        break;
+
+      case PIPELINE_SMS_SENT:
+        Serial.println("Successfully sent SMS!");
+        break;
+
+      case PIPELINE_SMS_FAILED:
+        Serial.println("Failed to send SMS :(");
+        myLed.flash(100); //flash(100) for hardware failure
+        WAIT_MS(3000);
+        ESP.restart();
+    }
 
-    //////////////////////////////////////////////////////////////////////
-    //Cleanup
-    //Delete the jpgBuffer now we're done with it so we don't have a memory 
-    //leak!
-    delete jpgBuffer;
+    //Once everything's done, output the trace & go back to the idle LED; or 
+    //start flashing quickly if the button's still held down as a warning
+    if(pipelineIdle()) {
+      TRACE_DUMP();
+      if(buttonDown) {
+        myLed.flash(50);
+      } else {
+        showIdle();
+      }
+    }
+  }
 
-    //////////////////////////////////////////////////////////////////////
-    //Buttondown warning     
-    //Start flashing quickly (will only stay on if the button is still pressed
-    //down; otherwise turned back to blinking in the next loop)
-    myLed.flash(50);
+  //If the tweeter's health has changed while we're idle, update the LED
+  if(pipelineIdle() && !buttonDown && tweeterReachable() != idleShowsReachable) {
+    showIdle();
   }
 
   //Give background processes some time
   if(loopN++ % 100000  == 0) {
     WAIT_MS(10);
   }
+
+  //While there's nothing to do, poll the button lazily so the CPU can idle
+  #ifdef POWER_MANAGEMENT
+    if(pipelineIdle()) {
+      WAIT_MS(POWER_IDLE_POLL_MS);
+    }
+  #endif
 }
\ No newline at end of file
@@ -0,0 +1,199 @@
+// motion.cpp
+// While the pipeline's idle, a task on the camera core grabs frames as fast as
+// the sensor makes them and compares each frame's luma with the last one's,
+// block by block. When enough blocks have changed, but not so many that it's
+// more likely the light changing, the main loop takes a photo just as if the
+// button had been pressed.
+//
+// The comparison is the sum of absolute differences kernel in motionSAD.h,
+// which works on two pixels at once in each 32 bit word. A QQVGA frame takes
+// about a millisecond at 80MHz, so the sensor sets the pace, and the task
+// spends nearly all its time blocked waiting on the next frame.
+
+#include <Arduino.h>
+#include "utils.h"
+#include "camera.h"
+#include "pipeline.h"
+#include "power.h"
+#include "telemetry.h"
+#include "motionSAD.h"
+#include "motion.h"
+
+#ifdef MOTION_TRIGGER
+  /////////////////////////////////////////////////////////////////////////////
+  // Config
+
+  //The detector shares the camera core with the capture stage, below it and
+  //alongside the Arduino loop, so it never holds up a photo or the network
+  #define MOTION_CORE 1
+  #define MOTION_PRIORITY 1
+  #define MOTION_STACK 4096
+
+  //The size of the frames we compare, which must be what camera.cpp captures
+  #define MOTION_FRAME_WIDTH 160
+  #define MOTION_FRAME_HEIGHT 120
+
+  //The size of the blocks frames are compared in, in pixels. The frame's width
+  //and height must be multiples of these, and the width a multiple of 4.
+  #define MOTION_BLOCK_WIDTH 16
+  #define MOTION_BLOCK_HEIGHT 15
+
+  //A block has changed if its pixels' luma has changed by more than this on
+  //average (out of 255)
+  #define MOTION_PIXEL_THRESHOLD 12
+  //It's motion if at least MOTION_MIN_BLOCKS blocks have changed, but no more
+  //than MOTION_MAX_BLOCKS, as that's more likely the lights going on or off
+  #define MOTION_MIN_BLOCKS 3
+  #define MOTION_MAX_BLOCKS 48
+
+  //How many frames to skip comparing after the camera's settled into the
+  //motion profile (e.g. after taking a photo), as the first frame's got
+  //nothing to compare with. The camera lets the exposure settle itself.
+  #define MOTION_SETTLE_FRAMES 1
+  //How long to wait after taking a photo of motion before taking another, in
+  //milliseconds
+  #define MOTION_COOLDOWN 10000
+
+  /////////////////////////////////////////////////////////////////////////////
+  // State
+
+  uint32_t *lastLuma = nullptr;        //The last frame's luma, 4 pixels a word
+  SemaphoreHandle_t motionSeen;        //Given when motion's detected
+  unsigned long lastMotion = 0;        //millis() when motion was last detected
+  bool seenMotion = false;             //If motion's ever been detected
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Detection
+
+  //changedBlocks compares a frame with the last one, returning how many blocks
+  //have changed, and keeps its luma for next time
+  int changedBlocks(camera_fb_t *frameBuffer) {
+    const uint32_t *yuyv = (const uint32_t *)frameBuffer->buf;
+    int width = MOTION_FRAME_WIDTH;
+    int blocksAcross = MOTION_FRAME_WIDTH / MOTION_BLOCK_WIDTH;
+    uint32_t blockTotals[MOTION_FRAME_WIDTH / MOTION_BLOCK_WIDTH];
+    int changed = 0;
+
+    for(int top = 0; top < MOTION_FRAME_HEIGHT; top += MOTION_BLOCK_HEIGHT) {
+      memset(blockTotals, 0, sizeof(blockTotals));
+      for(int y = top; y < top + MOTION_BLOCK_HEIGHT; y++) {
+        const uint32_t *row = yuyv + y * width / 2;
+        uint32_t *lastRow = lastLuma + y * width / 4;
+        for(int b = 0; b < blocksAcross; b++) {
+          int x = b * MOTION_BLOCK_WIDTH;
+          blockTotals[b] += sadLumaRow(row + x / 2, lastRow + x / 4, MOTION_BLOCK_WIDTH);
+        }
+      }
+      for(int b = 0; b < blocksAcross; b++) {
+        if(sumLumaLanes(blockTotals[b]) > MOTION_PIXEL_THRESHOLD * MOTION_BLOCK_WIDTH * MOTION_BLOCK_HEIGHT) {
+          changed++;
+        }
+      }
+    }
+    return changed;
+  }
+
+  //frameUsable checks a frame is one changedBlocks can compare
+  bool frameUsable(camera_fb_t *frameBuffer) {
+    return frameBuffer->format == PIXFORMAT_YUV422
+      && frameBuffer->width == MOTION_FRAME_WIDTH
+      && frameBuffer->height == MOTION_FRAME_HEIGHT
+      && frameBuffer->len == MOTION_FRAME_WIDTH * MOTION_FRAME_HEIGHT * 2;
+  }
+
+  //motionTask compares frames while the pipeline's idle, until the end of time
+  void motionTask(void *p) {
+    int settling = MOTION_SETTLE_FRAMES;
+    int settles = cameraSettles();
+    for(;;) {
+      //Leave the camera to the pipeline while it's taking a photo
+      if(!pipelineIdle()) {
+        settling = MOTION_SETTLE_FRAMES;
+        WAIT_MS(100);
+        continue;
+      }
+
+      camera_fb_t *frameBuffer = grabFrame(pdMS_TO_TICKS(100), PROFILE_MOTION);
+      if(frameBuffer == nullptr) {
+        WAIT_MS(100);
+        continue;
+      }
+      if(!frameUsable(frameBuffer)) {
+        releaseFrame(frameBuffer);
+        Serial.println("[motionTask] - Frames aren't QQVGA YUV422, motion detection stopped :(");
+        //Stop telemetry sampling our stack before it's freed
+        forgetTask(xTaskGetCurrentTaskHandle());
+        vTaskDelete(NULL);
+      }
+
+      //A frame from after the exposure was relocked can't be compared with
+      //one from before
+      if(cameraSettles() != settles) {
+        settles = cameraSettles();
+        settling = MOTION_SETTLE_FRAMES;
+      }
+
+      //Compare the frame, even while settling, so we've always got the last
+      //frame's luma to compare the next one with
+      int changed = changedBlocks(frameBuffer);
+      releaseFrame(frameBuffer);
+      if(settling > 0) {
+        settling--;
+        continue;
+      }
+
+      if(changed < MOTION_MIN_BLOCKS || changed > MOTION_MAX_BLOCKS) {
+        continue;
+      }
+      if(seenMotion && millis() - lastMotion < MOTION_COOLDOWN) {
+        continue;
+      }
+      Serial.printf("[motionTask] - %d blocks changed, that's motion!\n", changed);
+      seenMotion = true;
+      lastMotion = millis();
+      xSemaphoreGive(motionSeen);
+    }
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Setup
+
+  //setupMotion allocates the last frame's luma and starts the detector. Must be
+  //called after setupCamera. Returns false for fail, true for success.
+  bool setupMotion() {
+    //A QQVGA frame's luma is 19200 bytes
+    lastLuma = (uint32_t *)calloc(MOTION_FRAME_WIDTH * MOTION_FRAME_HEIGHT / 4, sizeof(uint32_t));
+    motionSeen = xSemaphoreCreateBinary();
+    if(!lastLuma || !motionSeen) {
+      Serial.println("[setupMotion] - Failed to allocate motion detector :(");
+      return false;
+    }
+
+    //The camera's running all the time now, so the CPU can't light sleep
+    stayAwake(true);
+
+    TaskHandle_t task;
+    BaseType_t created = xTaskCreatePinnedToCore(
+      motionTask, "motionTask", MOTION_STACK, nullptr, MOTION_PRIORITY, &task, MOTION_CORE
+    );
+    if(created != pdPASS) {
+      Serial.println("[setupMotion] - Failed to create motion task :(");
+      return false;
+    }
+    watchTask("motion", task, MOTION_STACK);
+    return true;
+  }
+
+  //motionDetected is true once for each time motion's detected
+  bool motionDetected() {
+    return xSemaphoreTake(motionSeen, 0) == pdTRUE;
+  }
+#else
+  //Without MOTION_TRIGGER, only the button takes photos
+  bool setupMotion() {
+    return true;
+  }
+  bool motionDetected() {
+    return false;
+  }
+#endif
@@ -0,0 +1,17 @@
+// motion.h
+// Exports the motion detector, which watches the camera between photos and
+// takes one when something moves
+
+#ifndef MOTION_USED
+  #define MOTION_USED
+
+  //Uncomment this to take a photo whenever the camera sees something move, as
+  //well as when the button's pressed
+  // #define MOTION_TRIGGER
+
+  //Setup func, starts the detector's task
+  bool setupMotion();
+
+  //True if something's moved since the last call
+  bool motionDetected();
+#endif
@@ -0,0 +1,57 @@
+// motionSAD.h
+// The sum of absolute differences kernel the motion detector runs on every
+// frame. It's plain C++ with no Arduino dependencies, so it can be benchmarked
+// on the host too (see camera-thing/bench).
+
+#ifndef MOTION_SAD_USED
+  #define MOTION_SAD_USED
+
+  #include <stdint.h>
+
+  //The camera's YUV422 frames are Y0 U Y1 V byte by byte, so a little endian
+  //32 bit word holds two pixels' luma in bytes 0 and 2. Masking with
+  //LUMA_LANES gives them a 16 bit lane each, with room to spare to subtract &
+  //accumulate in without borrowing or carrying into the other lane.
+  #define LUMA_LANES    0x00FF00FFu
+  #define LUMA_LANE_LOW 0x00010001u //The lowest bit of each lane
+  #define LUMA_BORROW   0x01000100u //The bit above each lane's luma
+
+  //sadLumaLanes gets |a - b| for each lane of two words of LUMA_LANES, without
+  //branching. Setting the bit above each lane's luma in `a` first means each
+  //lane of the subtraction is a + 256 - b, so nothing borrows from the next
+  //lane, and that bit's still set afterwards only where a >= b. Where it's
+  //not, the lane holds 256 - |a - b|, which we negate back.
+  static inline uint32_t sadLumaLanes(uint32_t a, uint32_t b) {
+    uint32_t diff = (a | LUMA_BORROW) - b;
+    uint32_t negative = (~diff >> 8) & LUMA_LANE_LOW; //1 in lanes where a < b
+    uint32_t low = diff & LUMA_LANES;
+    return (low ^ (negative * 0xFF)) + negative;
+  }
+
+  //sadLumaRow adds up the absolute differences between the luma of `pixels`
+  //pixels of a YUV422 frame and the luma of the same pixels last frame, then
+  //overwrites the last frame's luma with this frame's. `pixels` must be a
+  //multiple of 4. Last frame's luma is packed 4 pixels to a word, so it's
+  //half the size of a frame.
+  //
+  //The total comes back in two 16 bit lanes, which can each hold the
+  //differences of 257 pixels, so no more than 512 pixels' worth of totals may
+  //be added together before the lanes are summed with sumLumaLanes.
+  static inline uint32_t sadLumaRow(const uint32_t *yuyv, uint32_t *lastLuma, int pixels) {
+    uint32_t total = 0;
+    for(int i = 0; i < pixels / 4; i++) {
+      uint32_t luma01 = yuyv[2 * i] & LUMA_LANES;
+      uint32_t luma23 = yuyv[2 * i + 1] & LUMA_LANES;
+      uint32_t last = lastLuma[i];
+      total += sadLumaLanes(luma01, last & LUMA_LANES);
+      total += sadLumaLanes(luma23, (last >> 8) & LUMA_LANES);
+      lastLuma[i] = luma01 | (luma23 << 8);
+    }
+    return total;
+  }
+
+  //sumLumaLanes adds the two lanes of a total from sadLumaRow together
+  static inline uint32_t sumLumaLanes(uint32_t total) {
+    return (total & 0xFFFF) + (total >> 16);
+  }
+#endif
@@ -0,0 +1,374 @@
+// networkClient.cpp
+// Chooses which transport the tweeter's requests go over, when both WiFi & 2G
+// are set up in secrets.h, and forwards webClient's calls to it. Each time a
+// connection's made, how long it took is folded into the transport's latency,
+// and requests go over the quickest transport that's up. A transport that
+// fails to connect or send is skipped for a while, so if our hotspot goes out
+// of range, the request that noticed carries on over 2G, and once the hotspot
+// is back (WiFi reconnects by itself) requests go back over WiFi. The health
+// monitor's checks now & then try the transport we're not using, so we find
+// out if it's got quicker.
+
+#include <Arduino.h>
+#include "utils.h"
+#include "secrets.h"
+#include "networkClient.h"
+
+#ifdef WIFI_SSID
+  #include "wifiClient.h"
+#endif
+#ifdef APN
+  #include "gprsClient.h"
+#endif
+#if !defined(WIFI_SSID) && !defined(APN)
+  #error "Set up WiFi (WIFI_SSID) or 2G (APN) in secrets.h"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// Config
+
+//How long a transport that's failed is skipped for, in milliseconds, while
+//there's another transport to use
+#define TRANSPORT_RETRY_MS 120000
+
+//How long a transport can go unused before the health monitor tries it again,
+//in milliseconds. Trying 2G means restarting the SIM800L, so not too often.
+#define TRANSPORT_PROBE_MS 1800000
+
+//We only move to another transport if its latency is under this percentage of
+//the one we're using, so we don't flip between two that are about the same
+#define TRANSPORT_SWITCH_PERCENT 75
+
+//How much each connection's time counts towards a transport's latency, out of
+//8; the rest is the latency so far
+#define LATENCY_WEIGHT 2
+
+//How long we give WiFi to connect at startup (trials of 1 second, attempts).
+//With 2G to fall back on there's no need to wait as long.
+#define WIFI_STARTUP_TRIALS 60
+#define WIFI_STARTUP_ATTEMPTS 5
+#define WIFI_FAILOVER_TRIALS 15
+//How long we give WiFi to reconnect before a request, if it's dropped
+#define WIFI_RECONNECT_TRIALS 10
+
+/////////////////////////////////////////////////////////////////////////////
+// Transports
+
+struct transport {
+  networkTransport id;
+  Client *client;
+  bool (*bringUp)(); //Gets it ready for a request, false if it can't
+  void (*rest)();    //Saves power while it's not being used
+  int (*quality)();  //Its signal, see networkQuality
+
+  //These start zeroed, as transports[] is a global
+  unsigned long latency;    //Rolling average of connect times in ms, 0 if unmeasured
+  unsigned long measuredAt; //When latency was last updated
+  bool failing;             //Whether it failed the last time it was used
+  unsigned long failedAt;   //When it last failed
+};
+
+#ifdef WIFI_SSID
+  //WiFi reconnects by itself if it drops, so it's only set up again if it
+  //hasn't yet
+  bool wifiBringUp() {
+    return WiFi.status() == WL_CONNECTED || setupWifiClient(WIFI_RECONNECT_TRIALS, 1);
+  }
+
+  //WiFi's power is managed by power.cpp, so there's nothing to do
+  void wifiRest() {}
+
+  //The RSSI from -100 to -50dBm
+  int wifiQuality() {
+    int rssi = WiFi.RSSI();
+    if(rssi == 0) {
+      return -1;
+    }
+    return constrain(2 * (rssi + 100), 0, 100);
+  }
+#endif
+
+#ifdef APN
+  //The SIM800L has to be restarted for every request
+  bool gprsBringUp() {
+    return setupGPRSClient();
+  }
+
+  //The CSQ from the SIM800L, which must be set up
+  int gprsQuality() {
+    int csq = modem.getSignalQuality();
+    if(csq < 0 || csq > 31) {
+      return -1;
+    }
+    return csq * 100 / 31;
+  }
+#endif
+
+//The transports set up in secrets.h, WiFi first as it's the cheaper to use
+transport transports[] = {
+  #ifdef WIFI_SSID
+    {NETWORK_WIFI, &wifiWebClient, wifiBringUp, wifiRest, wifiQuality},
+  #endif
+  #ifdef APN
+    {NETWORK_GPRS, &gprsWebClient, gprsBringUp, sleepGPRSClient, gprsQuality},
+  #endif
+};
+#define TRANSPORT_COUNT (int)(sizeof(transports) / sizeof(transports[0]))
+
+//The transport webClient's using, or nullptr before one's been set up
+transport *active = nullptr;
+
+/////////////////////////////////////////////////////////////////////////////
+// Choosing
+
+//recentlyFailed is true if a transport failed within TRANSPORT_RETRY_MS
+bool recentlyFailed(transport *t) {
+  return t->failing && millis() - t->failedAt < TRANSPORT_RETRY_MS;
+}
+
+//preferred is true if we'd rather use `a` than `b`. Transports that haven't
+//failed recently come first, then the quickest, with some leeway for the one
+//we're using. Unmeasured transports come after measured ones, so 2G isn't
+//tried while WiFi's working until the health monitor probes it.
+bool preferred(transport *a, transport *b) {
+  if(recentlyFailed(a) != recentlyFailed(b)) {
+    return !recentlyFailed(b);
+  }
+  if(a->latency == 0 || b->latency == 0) {
+    return a->latency != 0 && b->latency == 0;
+  }
+  unsigned long aLatency = a->latency * (a == active ? TRANSPORT_SWITCH_PERCENT : 100);
+  unsigned long bLatency = b->latency * (b == active ? TRANSPORT_SWITCH_PERCENT : 100);
+  return aLatency < bLatency;
+}
+
+//stalest gets the transport that's gone longest without being measured, if
+//it's been longer than TRANSPORT_PROBE_MS, or nullptr if none have
+transport *stalest() {
+  transport *found = nullptr;
+  for(int i = 0; i < TRANSPORT_COUNT; i++) {
+    transport *t = &transports[i];
+    bool stale = t->latency == 0 || millis() - t->measuredAt > TRANSPORT_PROBE_MS;
+    if(t == active || !stale || recentlyFailed(t)) {
+      continue;
+    }
+    if(found == nullptr || t->latency == 0 || t->measuredAt < found->measuredAt) {
+      found = t;
+    }
+  }
+  return found;
+}
+
+//prepareNetwork gets the preferred transport ready for a request, falling back
+//to the next if it can't be set up. Returns false if none can.
+bool prepareNetwork(bool probe) {
+  //Order the transports by preference, putting the stalest first if probing
+  transport *order[TRANSPORT_COUNT];
+  for(int i = 0; i < TRANSPORT_COUNT; i++) {
+    order[i] = &transports[i];
+    for(int j = i; j > 0 && preferred(order[j], order[j - 1]); j--) {
+      transport *swap = order[j];
+      order[j] = order[j - 1];
+      order[j - 1] = swap;
+    }
+  }
+  transport *probing = probe ? stalest() : nullptr;
+  if(probing != nullptr) {
+    Serial.printf("[prepareNetwork] - Probing %s\n", transportName(probing->id));
+    for(int i = TRANSPORT_COUNT - 1; i > 0; i--) {
+      if(order[i] == probing) {
+        order[i] = order[i - 1];
+        order[i - 1] = probing;
+      }
+    }
+  }
+
+  for(int i = 0; i < TRANSPORT_COUNT; i++) {
+    transport *t = order[i];
+    if(!t->bringUp()) {
+      Serial.printf("[prepareNetwork] - Couldn't set up %s :(\n", transportName(t->id));
+      t->failing = true;
+      t->failedAt = millis();
+      continue;
+    }
+
+    //Leave the last transport be until it's needed again
+    if(active != nullptr && active != t) {
+      Serial.printf("[prepareNetwork] - Switching from %s to %s\n", transportName(active->id), transportName(t->id));
+      active->client->stop();
+      active->rest();
+    }
+    active = t;
+    return true;
+  }
+  return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// NetworkClient
+
+NetworkClient webClient;
+
+//transportWorked folds a connection's time into the transport's latency
+void NetworkClient::transportWorked(unsigned long connectMillis) {
+  connectMillis = max(connectMillis, 1UL);
+  if(active->latency == 0) {
+    active->latency = connectMillis;
+  } else {
+    active->latency = (active->latency * (8 - LATENCY_WEIGHT) + connectMillis * LATENCY_WEIGHT) / 8;
+  }
+  active->measuredAt = millis();
+  active->failing = false;
+  Serial.printf(
+    "[NetworkClient] - Connected over %s in %lu ms (%lu ms on average)\n",
+    transportName(active->id), connectMillis, active->latency
+  );
+}
+
+//transportFailed marks the transport in use as failing, so the next request
+//goes over another transport if there is one
+void NetworkClient::transportFailed() {
+  if(!active->failing) {
+    Serial.printf("[NetworkClient] - %s failed :(\n", transportName(active->id));
+  }
+  active->failing = true;
+  active->failedAt = millis();
+}
+
+int NetworkClient::connect(IPAddress ip, uint16_t port) {
+  for(int tries = 0; tries < TRANSPORT_COUNT; tries++) {
+    if((tries > 0 || active == nullptr) && !prepareNetwork(false)) {
+      return 0;
+    }
+    unsigned long started = millis();
+    if(active->client->connect(ip, port)) {
+      transportWorked(millis() - started);
+      return 1;
+    }
+    transportFailed();
+  }
+  return 0;
+}
+
+int NetworkClient::connect(const char *host, uint16_t port) {
+  for(int tries = 0; tries < TRANSPORT_COUNT; tries++) {
+    if((tries > 0 || active == nullptr) && !prepareNetwork(false)) {
+      return 0;
+    }
+    unsigned long started = millis();
+    if(active->client->connect(host, port)) {
+      transportWorked(millis() - started);
+      return 1;
+    }
+    transportFailed();
+  }
+  return 0;
+}
+
+size_t NetworkClient::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+//write marks the transport as failing if it can't send everything, as the
+//request it's part of won't make it
+size_t NetworkClient::write(const uint8_t *buf, size_t size) {
+  if(active == nullptr) {
+    return 0;
+  }
+  size_t written = active->client->write(buf, size);
+  if(written < size) {
+    transportFailed();
+  }
+  return written;
+}
+
+int NetworkClient::available() {
+  return active == nullptr ? 0 : active->client->available();
+}
+
+int NetworkClient::read() {
+  return active == nullptr ? -1 : active->client->read();
+}
+
+int NetworkClient::read(uint8_t *buf, size_t size) {
+  return active == nullptr ? -1 : active->client->read(buf, size);
+}
+
+int NetworkClient::peek() {
+  return active == nullptr ? -1 : active->client->peek();
+}
+
+void NetworkClient::flush() {
+  if(active != nullptr) {
+    active->client->flush();
+  }
+}
+
+void NetworkClient::stop() {
+  if(active != nullptr) {
+    active->client->stop();
+  }
+}
+
+uint8_t NetworkClient::connected() {
+  return active == nullptr ? 0 : active->client->connected();
+}
+
+NetworkClient::operator bool() {
+  return active != nullptr && (bool)*active->client;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Utils
+
+//restNetwork saves power on the transport in use until the next request
+void restNetwork() {
+  if(active != nullptr) {
+    active->rest();
+  }
+}
+
+networkTransport currentTransport() {
+  return active == nullptr ? NETWORK_NONE : active->id;
+}
+
+const char *transportName(networkTransport transport) {
+  switch(transport) {
+    case NETWORK_WIFI: return "WiFi";
+    case NETWORK_GPRS: return "2G";
+    default: return "nothing";
+  }
+}
+
+//networkQuality gets how good the transport in use's signal is, from 0 to 100,
+//or -1 if we can't tell
+int networkQuality() {
+  return active == nullptr ? -1 : active->quality();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Setup
+
+//setupNetworkClient connects to WiFi, if it's set up. If that fails and 2G is
+//set up too, we carry on, as 2G's set up before each request anyway. Returns
+//false for fail, true for success.
+bool setupNetworkClient() {
+  #ifdef WIFI_SSID
+    #ifdef APN
+      bool wifiSuccess = setupWifiClient(WIFI_FAILOVER_TRIALS, 1);
+    #else
+      bool wifiSuccess = setupWifiClient(WIFI_STARTUP_TRIALS, WIFI_STARTUP_ATTEMPTS);
+    #endif
+    if(wifiSuccess) {
+      active = &transports[0];
+      return true;
+    }
+    transports[0].failing = true;
+    transports[0].failedAt = millis();
+    #ifndef APN
+      return false;
+    #endif
+  #endif
+  Serial.println("[setupNetworkClient] - Using 2G");
+  return true;
+}
@@ -0,0 +1,61 @@
+// networkClient.h
+// Exports webClient, the Client requests to the tweeter are carried by. It
+// goes over whichever of WiFi & 2G (the ones set up in secrets.h) is up and
+// quicker, failing over to the other when its transport stops working.
+
+#ifndef NETWORK_CLIENT_USED
+  #define NETWORK_CLIENT_USED
+
+  #include <Arduino.h>
+
+  //The transports webClient can go over
+  enum networkTransport {
+    NETWORK_NONE,
+    NETWORK_WIFI,
+    NETWORK_GPRS,
+  };
+
+  class NetworkClient : public Client {
+    private:
+      //Records how the transport in use did, failing over if it's failed
+      void transportWorked(unsigned long connectMillis);
+      void transportFailed();
+
+    public:
+      //Client interface, over the transport in use. connect() fails over to
+      //the other transport if it can't connect over this one.
+      int connect(IPAddress ip, uint16_t port);
+      int connect(const char *host, uint16_t port);
+      size_t write(uint8_t b);
+      size_t write(const uint8_t *buf, size_t size);
+      int available();
+      int read();
+      int read(uint8_t *buf, size_t size);
+      int peek();
+      void flush();
+      void stop();
+      uint8_t connected();
+      operator bool();
+      using Print::write;
+  };
+  extern NetworkClient webClient;
+
+  //Setup func, connects to WiFi if it's set up. 2G is only set up when it's
+  //needed, as it is before every request.
+  bool setupNetworkClient();
+
+  //Gets a transport ready for a request, choosing the quickest that's up. With
+  //`probe`, a transport that hasn't been used for a while is tried instead, to
+  //see if it's got quicker. Returns false if neither can be set up.
+  bool prepareNetwork(bool probe);
+
+  //Turns the 2G radio off until it's next needed, if that's what we're using
+  void restNetwork();
+
+  //The transport in use, and its name for the logs
+  networkTransport currentTransport();
+  const char *transportName(networkTransport transport);
+
+  //How good the transport in use's signal is, from 0 to 100, or -1 if unknown
+  int networkQuality();
+#endif
@@ -0,0 +1,655 @@
+// pipeline.cpp
+// Runs taking a photo as two stages on separate cores, connected by a stream
+// buffer:
+//
+//   core 1: [capture stage] --frame--> encode --JPEG bytes--+
+//                                                           | stream buffer
+//   core 0: [network stage] <-------------------------------+--> webClient
+//
+// The network stage starts writing the JPEG to the socket as soon as the
+// encoder produces its first bytes, so encoding and transmitting overlap. While
+// the network stage is still transmitting (or waiting on the tweeter), the
+// capture stage can already grab the next frame. The WiFi stack lives on core
+// 0, so the network stage goes there and the camera work gets core 1 to itself.
+
+#include <Arduino.h>
+#include "freertos/stream_buffer.h"
+#include "freertos/event_groups.h"
+#include "utils.h"
+#include "secrets.h"
+#include "camera.h"
+#include "tweeter.h"
+#include "trace.h"
+#include "power.h"
+#include "healthMonitor.h"
+#include "classifier.h"
+#include "preprocess.h"
+#include "telemetry.h"
+#include "pipeline.h"
+
+#ifdef APN
+  #include "gprsClient.h"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// Config
+
+//Cores and priorities of the stages. The Arduino loop runs at priority 1 on
+//core 1, so the capture stage will preempt it while it's working.
+#define CAPTURE_STAGE_CORE 1
+#define NETWORK_STAGE_CORE 0
+#define CAPTURE_STAGE_PRIORITY 2
+#define NETWORK_STAGE_PRIORITY 2
+
+//Stack sizes of the stages. A TLS handshake needs a lot more stack!
+#define CAPTURE_STAGE_STACK 10000
+#ifdef TWEETER_TLS
+  #define NETWORK_STAGE_STACK 16384
+#else
+  #define NETWORK_STAGE_STACK 10000
+#endif
+
+//How many bytes of JPEG can be waiting between the encoder and the socket. A
+//QQVGA JPEG is typically 6-8KB, so this is usually enough for the encoder to
+//finish and hand the frame buffer back before the upload is done.
+#define JPEG_STREAM_SIZE 16384
+//The network stage wakes up once this many bytes are waiting, so it writes
+//full chunks instead of dribbling out a few bytes at a time
+#define JPEG_STREAM_TRIGGER 1024
+
+//How long the encoder will wait for space in the stream before giving up on
+//the upload, in milliseconds
+#define ENCODE_STALL_TIMEOUT 60000
+
+//If the tweeter's known to be unreachable when a photo's ready to upload, we
+//give it this many milliseconds to come back before trying anyway
+#define UNREACHABLE_UPLOAD_DELAY 20000
+
+//When the tweeter queues a photo to be tweeted later, we check on it for its
+//URL (and send the SMS with it over 2G) after JOB_FIRST_CHECK_DELAY
+//milliseconds, then every JOB_CHECK_INTERVAL milliseconds, giving up after
+//JOB_MAX_CHECKS. Over 2G each check restarts the SIM800L, so these are fairly
+//relaxed.
+#define JOB_FIRST_CHECK_DELAY 15000
+#define JOB_CHECK_INTERVAL 15000
+#define JOB_MAX_CHECKS 8
+//How many queued photos we can be waiting on at once
+#define JOB_MAX_PENDING 4
+
+//The size of the thumbnail sent ahead of each photo with THUMBNAIL_FIRST,
+//which is QQVGA shrunk by THUMBNAIL_SHRINK each way
+#define THUMBNAIL_SHRINK 2
+#define THUMBNAIL_WIDTH (160 / THUMBNAIL_SHRINK)
+#define THUMBNAIL_HEIGHT (120 / THUMBNAIL_SHRINK)
+
+//How big a raw frame in a burst can be: 160x120 at 2 bytes per pixel
+#define BURST_FRAME_SIZE (160 * 120 * 2)
+
+//Event group bits the capture stage uses to tell the network stage how the
+//encode went
+#define ENCODE_DONE   (1 << 0)
+#define ENCODE_FAILED (1 << 1)
+
+/////////////////////////////////////////////////////////////////////////////
+// State
+
+//A photo being passed along the pipeline
+struct photoJob {
+  bool geolocationEnabled;
+  float lat;
+  float lon;
+  char labels[CLASSIFIER_LABELS_SIZE]; //From the on-device classifier, set by the capture stage
+  int frames; //How many frames to take, more than 1 for a burst
+  bool form;  //Whether the capture stage streams a whole multipart form rather than just a JPEG
+};
+
+QueueHandle_t captureQueue; //photoJobs waiting to be captured
+QueueHandle_t uploadQueue;  //photoJobs whose JPEG is being streamed
+QueueHandle_t eventQueue;   //pipelineEvents for the main loop
+
+StreamBufferHandle_t jpegStream;  //JPEG bytes from the encoder to the socket
+EventGroupHandle_t encodeStatus;  //ENCODE_DONE/ENCODE_FAILED for the current job
+SemaphoreHandle_t jpegStreamFree; //Held by whichever job is using jpegStream
+
+//A photo the tweeter has queued, that we're waiting on for its URL
+struct pendingJob {
+  char jobID[24];
+  unsigned long checkAt; //millis() we should next check on it at
+  int checks;            //How many times we've checked on it
+};
+pendingJob pendingJobs[JOB_MAX_PENDING]; //Only used by the network stage
+int pendingJobCount = 0;
+
+#ifdef THUMBNAIL_FIRST
+  //The thumbnail's greyscale pixels. Only the capture stage uses it.
+  uint8_t thumbnailPixels[THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT];
+#endif
+
+#ifdef BURST_MODE
+  //The raw frames of a burst, allocated once at setup so a burst doesn't need
+  //150KB of heap when the time comes. There may be fewer than BURST_FRAMES if
+  //there wasn't the memory for them all.
+  uint8_t *burstFrames[BURST_FRAMES];
+  int burstFrameCount = 0;
+#endif
+
+//Photos requested that haven't finished going through the pipeline yet
+int photosInFlight = 0;
+portMUX_TYPE photosInFlightMux = portMUX_INITIALIZER_UNLOCKED;
+
+/////////////////////////////////////////////////////////////////////////////
+// Utils
+
+//postEvent sends an event to the main loop. Posting a final event for a photo
+//(`finished`) also marks it as no longer in flight.
+void postEvent(pipelineEventType type, const char *tweetURL, bool finished) {
+  pipelineEvent event = {type, ""};
+  if(tweetURL != nullptr) {
+    strlcpy(event.tweetURL, tweetURL, sizeof(event.tweetURL));
+  }
+  if(xQueueSend(eventQueue, &event, 0) != pdTRUE) {
+    Serial.printf("[postEvent] - Event queue full, dropped event %d :(\n", type);
+  }
+  if(finished) {
+    portENTER_CRITICAL(&photosInFlightMux);
+    photosInFlight--;
+    portEXIT_CRITICAL(&photosInFlightMux);
+    stayAwake(false);
+  }
+}
+
+//streamJPEGChunk is the encoder's output callback; it pushes JPEG bytes into
+//the stream buffer, blocking while the network stage catches up. Returns the
+//number of bytes taken, anything less than `len` aborts the encode.
+size_t streamJPEGChunk(void *arg, size_t index, const void *data, size_t len) {
+  return xStreamBufferSend(jpegStream, data, len, pdMS_TO_TICKS(ENCODE_STALL_TIMEOUT));
+}
+
+//streamFormPartHead writes the head of a part of a multipart/form-data body
+//into jpegStream, ending the previous part first unless this is the `first`
+bool streamFormPartHead(const char *name, const char *filename, bool first) {
+  char partHead[128];
+  int partHeadLen = snprintf(partHead, sizeof(partHead),
+    "%s--" TWEET_FORM_BOUNDARY "\r\n"
+    "Content-Disposition: form-data; name=\"%s\"; filename=\"%s\"\r\n"
+    "\r\n",
+    first ? "" : "\r\n", name, filename
+  );
+  return streamJPEGChunk(nullptr, 0, partHead, partHeadLen) == (size_t)partHeadLen;
+}
+
+//streamFormTail ends the last part of a multipart/form-data body, and the body
+bool streamFormTail() {
+  const char *formTail =
+    "\r\n"
+    "--" TWEET_FORM_BOUNDARY "--\r\n"
+    "\r\n";
+  return streamJPEGChunk(nullptr, 0, formTail, strlen(formTail)) == strlen(formTail);
+}
+
+#ifdef THUMBNAIL_FIRST
+  //makeThumbnail shrinks a QQVGA YUV422 frame into a greyscale thumbnail,
+  //averaging the luma of each THUMBNAIL_SHRINK x THUMBNAIL_SHRINK block
+  void makeThumbnail(camera_fb_t *frameBuffer, camera_fb_t *thumbnail) {
+    const uint8_t *yuyv = frameBuffer->buf;
+    int width = frameBuffer->width;
+    for(int y = 0; y < THUMBNAIL_HEIGHT; y++) {
+      for(int x = 0; x < THUMBNAIL_WIDTH; x++) {
+        int sum = 0;
+        for(int dy = 0; dy < THUMBNAIL_SHRINK; dy++) {
+          const uint8_t *row = yuyv + 2 * ((y * THUMBNAIL_SHRINK + dy) * width + x * THUMBNAIL_SHRINK);
+          for(int dx = 0; dx < THUMBNAIL_SHRINK; dx++) {
+            sum += row[2 * dx];
+          }
+        }
+        thumbnailPixels[y * THUMBNAIL_WIDTH + x] = sum / (THUMBNAIL_SHRINK * THUMBNAIL_SHRINK);
+      }
+    }
+    *thumbnail = *frameBuffer;
+    thumbnail->buf = thumbnailPixels;
+    thumbnail->len = sizeof(thumbnailPixels);
+    thumbnail->width = THUMBNAIL_WIDTH;
+    thumbnail->height = THUMBNAIL_HEIGHT;
+    thumbnail->format = PIXFORMAT_GRAYSCALE;
+  }
+#endif
+
+//encodeForm encodes each of the frames into jpegStream as a part of one
+//multipart/form-data body, so they're all uploaded in a single request. With
+//THUMBNAIL_FIRST, a thumbnail of the first frame goes ahead of them all, so
+//the tweeter can start recognising it while the rest are still arriving.
+bool encodeForm(camera_fb_t *frames, int count) {
+  bool first = true;
+  #ifdef THUMBNAIL_FIRST
+    camera_fb_t thumbnail;
+    makeThumbnail(&frames[0], &thumbnail);
+    if(!streamFormPartHead("thumbnail", "Thumbnail.jpg", true) || !encodeFrame(&thumbnail, streamJPEGChunk, nullptr)) {
+      return false;
+    }
+    first = false;
+  #endif
+  for(int i = 0; i < count; i++) {
+    char filename[16];
+    snprintf(filename, sizeof(filename), "Photo%d.jpg", i + 1);
+    if(!streamFormPartHead("image", filename, first) || !encodeFrame(&frames[i], streamJPEGChunk, nullptr)) {
+      return false;
+    }
+    first = false;
+  }
+  return streamFormTail();
+}
+
+//readJPEGChunk is the jpegSource the network stage pulls the JPEG from
+int readJPEGChunk(uint8_t *buf, size_t len, void *arg) {
+  for(;;) {
+    size_t got = xStreamBufferReceive(jpegStream, buf, len, pdMS_TO_TICKS(50));
+    if(got > 0) {
+      return got;
+    }
+    EventBits_t status = xEventGroupGetBits(encodeStatus);
+    if(status & ENCODE_FAILED) {
+      return -1;
+    }
+    //The encoder may have written its last bytes between us reading and
+    //checking the status, so we only stop once the stream is empty too
+    if((status & ENCODE_DONE) && xStreamBufferIsEmpty(jpegStream)) {
+      return 0;
+    }
+  }
+}
+
+//drainJPEGStream throws away the rest of the current JPEG, so the encoder
+//doesn't stall if the upload gave up early. Returns the encode status.
+EventBits_t drainJPEGStream() {
+  uint8_t discard[256];
+  for(;;) {
+    xStreamBufferReceive(jpegStream, discard, sizeof(discard), pdMS_TO_TICKS(50));
+    EventBits_t status = xEventGroupGetBits(encodeStatus);
+    if((status & (ENCODE_DONE | ENCODE_FAILED)) && xStreamBufferIsEmpty(jpegStream)) {
+      return status;
+    }
+  }
+}
+
+//addPendingJob starts waiting on a job the tweeter queued. Returns false if
+//we're already waiting on too many.
+bool addPendingJob(const String &jobID) {
+  if(pendingJobCount == JOB_MAX_PENDING) {
+    return false;
+  }
+  pendingJob *pending = &pendingJobs[pendingJobCount++];
+  strlcpy(pending->jobID, jobID.c_str(), sizeof(pending->jobID));
+  pending->checkAt = millis() + JOB_FIRST_CHECK_DELAY;
+  pending->checks = 0;
+  return true;
+}
+
+//ticksUntilJobCheck is how long until the next pending job should be checked
+//on, or portMAX_DELAY if there aren't any
+TickType_t ticksUntilJobCheck() {
+  if(pendingJobCount == 0) {
+    return portMAX_DELAY;
+  }
+  long soonest = pendingJobs[0].checkAt - millis();
+  for(int i = 1; i < pendingJobCount; i++) {
+    soonest = min(soonest, (long)(pendingJobs[i].checkAt - millis()));
+  }
+  return soonest > 0 ? pdMS_TO_TICKS(soonest) : 0;
+}
+
+//checkPendingJobs checks on every pending job that's due, telling the main
+//loop (and sending the SMS) for each that's been tweeted. A job that failed,
+//or that we gave up on, is already with the tweeter, so there's nothing more
+//we can do about it than say so.
+void checkPendingJobs() {
+  for(int i = 0; i < pendingJobCount; i++) {
+    pendingJob *pending = &pendingJobs[i];
+    if((long)(pending->checkAt - millis()) > 0) {
+      continue;
+    }
+
+    String tweetURL;
+    tweetJobStatus status = checkTweetJob(10000, pending->jobID, &tweetURL);
+    pending->checks++;
+    if(status == TWEET_JOB_PENDING || status == TWEET_JOB_UNKNOWN) {
+      if(pending->checks < JOB_MAX_CHECKS) {
+        pending->checkAt = millis() + JOB_CHECK_INTERVAL;
+        continue;
+      }
+      Serial.printf("[checkPendingJobs] - Gave up on job %s :(\n", pending->jobID);
+    } else if(status == TWEET_JOB_FAILED) {
+      Serial.printf("[checkPendingJobs] - Tweeter failed to tweet job %s :(\n", pending->jobID);
+    }
+
+    //The job's finished one way or another, so stop waiting on it
+    *pending = pendingJobs[--pendingJobCount];
+    i--;
+
+    if(status != TWEET_JOB_DONE) {
+      postEvent(PIPELINE_JOB_FAILED, nullptr, true);
+      continue;
+    }
+    #ifdef APN
+      postEvent(PIPELINE_TWEETED, tweetURL.c_str(), false);
+      TRACE_BEGIN("sms");
+      bool SMSSuccess = sendTweetText(tweetURL);
+      TRACE_END("sms");
+      postEvent(SMSSuccess ? PIPELINE_SMS_SENT : PIPELINE_SMS_FAILED, nullptr, true);
+    #else
+      postEvent(PIPELINE_TWEETED, tweetURL.c_str(), true);
+    #endif
+  }
+}
+
+#ifdef BURST_MODE
+  //captureBurst grabs up to `count` frames back to back, copying each into the
+  //burst buffers so the camera can get on with the next one straight away.
+  //`frames` are set up to point at the copies. Returns how many it captured.
+  int captureBurst(camera_fb_t *frames, int count) {
+    int captured = 0;
+    for(int i = 0; i < count; i++) {
+      camera_fb_t *frameBuffer = captureFrame();
+      if(frameBuffer == nullptr) {
+        break;
+      }
+      if(frameBuffer->len > BURST_FRAME_SIZE) {
+        Serial.printf("[captureBurst] - Frame of %u bytes is too big for a burst :(\n", (unsigned)frameBuffer->len);
+        releaseFrame(frameBuffer);
+        break;
+      }
+      memcpy(burstFrames[i], frameBuffer->buf, frameBuffer->len);
+      frames[i] = *frameBuffer;
+      frames[i].buf = burstFrames[i];
+      releaseFrame(frameBuffer);
+      captured++;
+    }
+
+    //Clean up the copies once the camera's free again, and let it idle
+    idleCamera();
+    for(int i = 0; i < captured; i++) {
+      preprocessFrame(&frames[i]);
+    }
+    Serial.printf("[captureBurst] - Captured %d of %d frames\n", captured, count);
+    return captured;
+  }
+
+  //captureBurstJob does the capture stage's work for a burst: grabbing all of
+  //the frames first, at the sensor's rate, then encoding them one after
+  //another into the stream as a form.
+  void captureBurstJob(photoJob *job) {
+    boostCPU(POWER_LOCK_CAPTURE);
+
+    TRACE_BEGIN("capture");
+    camera_fb_t frames[BURST_FRAMES];
+    int captured = captureBurst(frames, job->frames);
+    TRACE_END("capture");
+    if(captured == 0) {
+      relaxCPU(POWER_LOCK_CAPTURE);
+      postEvent(PIPELINE_CAPTURE_FAILED, nullptr, true);
+      return;
+    }
+    postEvent(PIPELINE_CAPTURED, nullptr, false);
+
+    //The whole burst gets the first frame's labels
+    classifyFrame(&frames[0], job->labels, sizeof(job->labels));
+
+    xSemaphoreTake(jpegStreamFree, portMAX_DELAY);
+    xStreamBufferReset(jpegStream);
+    xEventGroupClearBits(encodeStatus, ENCODE_DONE | ENCODE_FAILED);
+
+    job->form = true;
+    xQueueSend(uploadQueue, job, portMAX_DELAY);
+    TRACE_BEGIN("encode");
+    bool encoded = encodeForm(frames, captured);
+    TRACE_END("encode");
+    relaxCPU(POWER_LOCK_CAPTURE);
+    xEventGroupSetBits(encodeStatus, encoded ? ENCODE_DONE : ENCODE_FAILED);
+
+    if(!encoded) {
+      postEvent(PIPELINE_CAPTURE_FAILED, nullptr, true);
+    }
+  }
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// Stages
+
+//captureStage takes photoJobs off the captureQueue, grabs a frame for each and
+//encodes it into jpegStream.
+void captureStage(void *p) {
+  photoJob job;
+  for(;;) {
+    xQueueReceive(captureQueue, &job, portMAX_DELAY);
+
+    #ifdef BURST_MODE
+      if(job.frames > 1) {
+        captureBurstJob(&job);
+        continue;
+      }
+    #endif
+
+    //Capturing & encoding are what the CPU's speed matters most for
+    boostCPU(POWER_LOCK_CAPTURE);
+
+    //Grab a frame
+    TRACE_BEGIN("capture");
+    camera_fb_t *frameBuffer = captureFrame();
+    TRACE_END("capture");
+    if(frameBuffer == nullptr) {
+      idleCamera();
+      relaxCPU(POWER_LOCK_CAPTURE);
+      postEvent(PIPELINE_CAPTURE_FAILED, nullptr, true);
+      continue;
+    }
+    postEvent(PIPELINE_CAPTURED, nullptr, false);
+
+    //Clean up the frame before anything looks at it
+    preprocessFrame(frameBuffer);
+
+    //Label the frame while we've still got it raw, so the labels can go in
+    //the request head ahead of the JPEG
+    classifyFrame(frameBuffer, job.labels, sizeof(job.labels));
+
+    //Wait until the last JPEG has been fully consumed before we start writing
+    //this one into the stream
+    xSemaphoreTake(jpegStreamFree, portMAX_DELAY);
+    xStreamBufferReset(jpegStream);
+    xEventGroupClearBits(encodeStatus, ENCODE_DONE | ENCODE_FAILED);
+
+    //Hand the job to the network stage, which starts sending as we encode.
+    //With THUMBNAIL_FIRST, the photo goes in a form after its thumbnail.
+    #ifdef THUMBNAIL_FIRST
+      job.form = true;
+    #endif
+    xQueueSend(uploadQueue, &job, portMAX_DELAY);
+    TRACE_BEGIN("encode");
+    bool encoded = job.form ? encodeForm(frameBuffer, 1) : encodeFrame(frameBuffer, streamJPEGChunk, nullptr);
+    TRACE_END("encode");
+    releaseFrame(frameBuffer);
+    idleCamera();
+    relaxCPU(POWER_LOCK_CAPTURE);
+    xEventGroupSetBits(encodeStatus, encoded ? ENCODE_DONE : ENCODE_FAILED);
+
+    if(!encoded) {
+      postEvent(PIPELINE_CAPTURE_FAILED, nullptr, true);
+    }
+  }
+}
+
+//networkStage takes photoJobs off the uploadQueue and streams their JPEGs to
+//the tweeter as they're encoded. In between uploads, it checks on any photos
+//the tweeter queued that we need the URLs of.
+void networkStage(void *p) {
+  photoJob job;
+  for(;;) {
+    if(xQueueReceive(uploadQueue, &job, ticksUntilJobCheck()) != pdTRUE) {
+      checkPendingJobs();
+      continue;
+    }
+
+    //If the tweeter was unreachable last we heard, check on it before we try
+    if(!tweeterReachable()) {
+      Serial.println("[networkStage] - Tweeter was unreachable, checking before uploading...");
+      waitForTweeterReachable(UNREACHABLE_UPLOAD_DELAY);
+    }
+
+    //Upload the JPEG as it comes out of the encoder. A burst's JPEGs (or a
+    //photo and its thumbnail) come out as a whole form.
+    TRACE_BEGIN("upload");
+    String tweetURL;
+    String jobID;
+    bool tweetSuccess = makeStreamedTweetRequest(
+      30000,
+      &tweetURL,
+      &jobID,
+      job.geolocationEnabled,
+      job.lat,
+      job.lon,
+      job.labels,
+      job.form,
+      readJPEGChunk,
+      nullptr
+    );
+    TRACE_END("upload");
+
+    //Let the capture stage have the stream buffer back
+    EventBits_t status = drainJPEGStream();
+    xSemaphoreGive(jpegStreamFree);
+
+    //If the encode failed, the capture stage has already told the main loop
+    if(status & ENCODE_FAILED) {
+      continue;
+    }
+    if(!tweetSuccess) {
+      postEvent(PIPELINE_UPLOAD_FAILED, nullptr, true);
+      continue;
+    }
+
+    //If the tweeter queued the photo, we don't have its URL yet, so we wait on
+    //it. If we're already waiting on too many, we give up on this one, as the
+    //tweeter's still got it.
+    if(jobID.length() > 0) {
+      Serial.printf("[networkStage] - Tweeter queued the photo as job %s\n", jobID.c_str());
+      postEvent(PIPELINE_UPLOADED, nullptr, false);
+      if(!addPendingJob(jobID)) {
+        Serial.printf("[networkStage] - Already waiting on %d jobs, giving up on job %s :(\n", JOB_MAX_PENDING, jobID.c_str());
+        postEvent(PIPELINE_JOB_FAILED, nullptr, true);
+      }
+      continue;
+    }
+
+    //If we're using GPRS, we can send an SMS containing the tweet URL
+    #ifdef APN
+      postEvent(PIPELINE_UPLOADED, tweetURL.c_str(), false);
+      TRACE_BEGIN("sms");
+      bool SMSSuccess = sendTweetText(tweetURL);
+      TRACE_END("sms");
+      postEvent(SMSSuccess ? PIPELINE_SMS_SENT : PIPELINE_SMS_FAILED, nullptr, true);
+    #else
+      postEvent(PIPELINE_UPLOADED, tweetURL.c_str(), true);
+    #endif
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Setup
+
+//setupPipeline creates the queues & buffers connecting the stages, then the
+//stages themselves. Returns false for fail, true for success.
+bool setupPipeline() {
+  captureQueue = xQueueCreate(1, sizeof(photoJob));
+  uploadQueue = xQueueCreate(1, sizeof(photoJob));
+  eventQueue = xQueueCreate(8, sizeof(pipelineEvent));
+  jpegStream = xStreamBufferCreate(JPEG_STREAM_SIZE, JPEG_STREAM_TRIGGER);
+  encodeStatus = xEventGroupCreate();
+  jpegStreamFree = xSemaphoreCreateBinary();
+  if(!captureQueue || !uploadQueue || !eventQueue || !jpegStream || !encodeStatus || !jpegStreamFree) {
+    Serial.println("[setupPipeline] - Failed to allocate pipeline buffers :(");
+    return false;
+  }
+  xSemaphoreGive(jpegStreamFree);
+
+  //Set aside the burst buffers while the heap's still in one piece. They go in
+  //PSRAM if the board has it.
+  #ifdef BURST_MODE
+    for(burstFrameCount = 0; burstFrameCount < BURST_FRAMES; burstFrameCount++) {
+      uint8_t *frame = (uint8_t*)(psramFound() ? ps_malloc(BURST_FRAME_SIZE) : malloc(BURST_FRAME_SIZE));
+      if(frame == nullptr) {
+        break;
+      }
+      burstFrames[burstFrameCount] = frame;
+    }
+    Serial.printf("[setupPipeline] - Allocated %d burst frames\n", burstFrameCount);
+  #endif
+
+  TaskHandle_t captureTask, networkTask;
+  BaseType_t captureCreated = xTaskCreatePinnedToCore(
+    captureStage, "captureStage", CAPTURE_STAGE_STACK, nullptr, CAPTURE_STAGE_PRIORITY, &captureTask, CAPTURE_STAGE_CORE
+  );
+  BaseType_t networkCreated = xTaskCreatePinnedToCore(
+    networkStage, "networkStage", NETWORK_STAGE_STACK, nullptr, NETWORK_STAGE_PRIORITY, &networkTask, NETWORK_STAGE_CORE
+  );
+  if(captureCreated != pdPASS || networkCreated != pdPASS) {
+    Serial.println("[setupPipeline] - Failed to create pipeline stages :(");
+    return false;
+  }
+  watchTask("capture", captureTask, CAPTURE_STAGE_STACK);
+  watchTask("network", networkTask, NETWORK_STAGE_STACK);
+
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Interface for the main loop
+
+//requestJob queues up a photoJob to be captured. Returns false if there's
+//already one waiting to be captured.
+bool requestJob(photoJob *job) {
+  //Keep the CPU awake until the photo's made it through the pipeline
+  portENTER_CRITICAL(&photosInFlightMux);
+  photosInFlight++;
+  portEXIT_CRITICAL(&photosInFlightMux);
+  stayAwake(true);
+
+  if(xQueueSend(captureQueue, job, 0) != pdTRUE) {
+    portENTER_CRITICAL(&photosInFlightMux);
+    photosInFlight--;
+    portEXIT_CRITICAL(&photosInFlightMux);
+    stayAwake(false);
+    return false;
+  }
+  return true;
+}
+
+//requestPhoto queues up a photo to be taken and tweeted. Returns false if
+//there's already a photo waiting to be captured.
+bool requestPhoto(bool geolocationEnabled, float lat, float lon) {
+  photoJob job = {geolocationEnabled, lat, lon, "", 1, false};
+  return requestJob(&job);
+}
+
+//requestBurst queues up a burst of photos to be taken and tweeted together.
+//If there's only room for one frame, it's just a photo.
+bool requestBurst(bool geolocationEnabled, float lat, float lon) {
+  #ifdef BURST_MODE
+    if(burstFrameCount > 1) {
+      photoJob job = {geolocationEnabled, lat, lon, "", burstFrameCount, false};
+      return requestJob(&job);
+    }
+    Serial.println("[requestBurst] - No memory for a burst, taking a photo instead");
+  #endif
+  return requestPhoto(geolocationEnabled, lat, lon);
+}
+
+//getPipelineEvent gets the next event from the pipeline, if there is one
+bool getPipelineEvent(pipelineEvent *event) {
+  return xQueueReceive(eventQueue, event, 0) == pdTRUE;
+}
+
+//pipelineIdle is true if there are no photos going through the pipeline
+bool pipelineIdle() {
+  portENTER_CRITICAL(&photosInFlightMux);
+  bool idle = photosInFlight == 0;
+  portEXIT_CRITICAL(&photosInFlightMux);
+  return idle;
+}
@@ -0,0 +1,55 @@
+// pipeline.h
+// Exports the capture -> encode -> upload pipeline, which runs the camera work
+// on one core and the network work on the other
+
+#ifndef PIPELINE_USED
+  #define PIPELINE_USED
+
+  #include <Arduino.h>
+
+  //Uncomment to take a burst of photos when the button's held down, which are
+  //uploaded in one request and tweeted together
+  // #define BURST_MODE
+
+  //How many photos a burst takes. A tweet can't have more than 4.
+  #define BURST_FRAMES 4
+
+  //Uncomment to send a small greyscale thumbnail ahead of each photo, in the
+  //same request, which the tweeter can recognise while the photo's uploading
+  // #define THUMBNAIL_FIRST
+
+  //Things the pipeline tells the main loop about, in the order they happen
+  enum pipelineEventType {
+    PIPELINE_CAPTURED,       //A frame has been captured and is being encoded
+    PIPELINE_CAPTURE_FAILED, //Capturing or encoding a frame failed
+    PIPELINE_UPLOADED,       //A photo has been tweeted, or queued by the tweeter to be
+    PIPELINE_UPLOAD_FAILED,  //A photo couldn't be tweeted
+    PIPELINE_TWEETED,        //A photo the tweeter queued has been tweeted
+    PIPELINE_JOB_FAILED,     //A photo the tweeter queued wasn't tweeted, or we gave up on it
+    PIPELINE_SMS_SENT,       //The SMS with the tweet's URL has been sent
+    PIPELINE_SMS_FAILED,     //The SMS with the tweet's URL couldn't be sent
+  };
+
+  struct pipelineEvent {
+    pipelineEventType type;
+    char tweetURL[96]; //Only set for PIPELINE_UPLOADED & PIPELINE_TWEETED
+  };
+
+  //Setup func, creates the stage tasks
+  bool setupPipeline();
+
+  //Asks the pipeline to take a photo and tweet it. Returns false if the
+  //pipeline is too busy to accept another photo right now.
+  bool requestPhoto(bool geolocationEnabled, float lat, float lon);
+
+  //Asks the pipeline to take a burst of photos and tweet them together. Takes
+  //a single photo instead without BURST_MODE, or if there's no memory for one.
+  bool requestBurst(bool geolocationEnabled, float lat, float lon);
+
+  //Gets the next event from the pipeline without blocking. Returns false if
+  //there aren't any.
+  bool getPipelineEvent(pipelineEvent *event);
+
+  //True if no photos are being captured, encoded or uploaded
+  bool pipelineIdle();
+#endif
@@ -0,0 +1,175 @@
+// power.cpp
+// Runs the CPU at POWER_MIN_FREQ unless something's holding a lock to boost it
+// to POWER_MAX_FREQ. Where the SDK's been built with power management, this
+// uses its locks, so it can also light sleep when every task's blocked.
+// Otherwise we count the locks ourselves and set the frequency directly.
+//
+// Time spent boosted is traced as the "fullSpeed" stage, so TRACE_PIPELINE
+// shows how much of each photo runs at which speed.
+
+#include <Arduino.h>
+#include "utils.h"
+#include "trace.h"
+#include "power.h"
+
+#ifdef POWER_MANAGEMENT
+  #if CONFIG_PM_ENABLE
+    #include "esp_pm.h"
+    #include "esp_sleep.h"
+    #include "driver/gpio.h"
+  #endif
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Config
+
+  //The CPU frequencies we switch between, in MHz. Below 80MHz the APB clock
+  //slows down too, which would throw off the camera's XCLK, the UARTs and the
+  //WiFi, so 80MHz is as slow as we go.
+  #define POWER_MAX_FREQ 240
+  #define POWER_MIN_FREQ 80
+
+  /////////////////////////////////////////////////////////////////////////////
+  // State
+
+  #if CONFIG_PM_ENABLE
+    esp_pm_lock_handle_t boostLocks[POWER_LOCK_COUNT];
+    esp_pm_lock_handle_t awakeLock;
+  #endif
+
+  //Which locks are held, and how many, guarded by powerMutex. Changing the
+  //frequency can take a while, so this is a mutex rather than a spinlock.
+  bool boostHeld[POWER_LOCK_COUNT];
+  int boostsHeld = 0;
+  int awakesHeld = 0;
+  SemaphoreHandle_t powerMutex;
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Setup
+
+  //setupPower sets up frequency scaling, starting slow. Returns false for fail,
+  //true for success.
+  bool setupPower(int wakePin) {
+    powerMutex = xSemaphoreCreateMutex();
+    if(!powerMutex) {
+      Serial.println("[setupPower] - Failed to create power mutex :(");
+      return false;
+    }
+
+    #if CONFIG_PM_ENABLE
+      //Let the SDK scale the frequency (and light sleep) for us
+      esp_pm_config_esp32_t config = {};
+      config.max_freq_mhz = POWER_MAX_FREQ;
+      config.min_freq_mhz = POWER_MIN_FREQ;
+      #ifdef POWER_LIGHT_SLEEP
+        config.light_sleep_enable = true;
+        gpio_wakeup_enable((gpio_num_t)wakePin, GPIO_INTR_LOW_LEVEL);
+        esp_sleep_enable_gpio_wakeup();
+      #endif
+      esp_err_t err = esp_pm_configure(&config);
+      if(err != ESP_OK) {
+        Serial.printf("[setupPower] - Failed to configure power management, err: %d :(\n", err);
+        return false;
+      }
+
+      const char *lockNames[POWER_LOCK_COUNT] = {"capture", "tls", "timelapse"};
+      for(int i = 0; i < POWER_LOCK_COUNT; i++) {
+        err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, lockNames[i], &boostLocks[i]);
+        if(err != ESP_OK) {
+          Serial.printf("[setupPower] - Failed to create %s lock, err: %d :(\n", lockNames[i], err);
+          return false;
+        }
+      }
+      err = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "awake", &awakeLock);
+      if(err != ESP_OK) {
+        Serial.printf("[setupPower] - Failed to create awake lock, err: %d :(\n", err);
+        return false;
+      }
+    #else
+      //Without the SDK's power management we can still scale the frequency,
+      //but not light sleep
+      #ifdef POWER_LIGHT_SLEEP
+        Serial.println("[setupPower] - SDK built without CONFIG_PM_ENABLE, so no light sleep");
+      #endif
+      if(!setCpuFrequencyMhz(POWER_MIN_FREQ)) {
+        Serial.println("[setupPower] - Failed to set CPU frequency :(");
+        return false;
+      }
+    #endif
+
+    Serial.printf("[setupPower] - CPU running at %d-%d MHz\n", POWER_MIN_FREQ, POWER_MAX_FREQ);
+    return true;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Locks
+
+  //boostCPU holds the CPU at full speed for `lock`
+  void boostCPU(powerLock lock) {
+    xSemaphoreTake(powerMutex, portMAX_DELAY);
+    if(boostHeld[lock]) {
+      xSemaphoreGive(powerMutex);
+      return;
+    }
+    boostHeld[lock] = true;
+    if(boostsHeld++ == 0) {
+      TRACE_BEGIN("fullSpeed");
+    }
+    #if CONFIG_PM_ENABLE
+      esp_pm_lock_acquire(boostLocks[lock]);
+    #else
+      if(boostsHeld == 1) {
+        setCpuFrequencyMhz(POWER_MAX_FREQ);
+      }
+    #endif
+    xSemaphoreGive(powerMutex);
+  }
+
+  //relaxCPU lets the CPU slow down again once nothing else needs full speed
+  void relaxCPU(powerLock lock) {
+    xSemaphoreTake(powerMutex, portMAX_DELAY);
+    if(!boostHeld[lock]) {
+      xSemaphoreGive(powerMutex);
+      return;
+    }
+    boostHeld[lock] = false;
+    #if CONFIG_PM_ENABLE
+      esp_pm_lock_release(boostLocks[lock]);
+    #else
+      if(boostsHeld == 1) {
+        setCpuFrequencyMhz(POWER_MIN_FREQ);
+      }
+    #endif
+    if(--boostsHeld == 0) {
+      TRACE_END("fullSpeed");
+    }
+    xSemaphoreGive(powerMutex);
+  }
+
+  //stayAwake stops the CPU light sleeping, or lets it again once every
+  //stayAwake(true) has had its stayAwake(false)
+  void stayAwake(bool awake) {
+    xSemaphoreTake(powerMutex, portMAX_DELAY);
+    if(awake) {
+      if(awakesHeld++ == 0) {
+        #if CONFIG_PM_ENABLE
+          esp_pm_lock_acquire(awakeLock);
+        #endif
+      }
+    } else if(awakesHeld > 0) {
+      if(--awakesHeld == 0) {
+        #if CONFIG_PM_ENABLE
+          esp_pm_lock_release(awakeLock);
+        #endif
+      }
+    }
+    xSemaphoreGive(powerMutex);
+  }
+#else
+  //Without POWER_MANAGEMENT, the CPU just stays at full speed
+  bool setupPower(int wakePin) {
+    return true;
+  }
+  void boostCPU(powerLock lock) {}
+  void relaxCPU(powerLock lock) {}
+  void stayAwake(bool awake) {}
+#endif
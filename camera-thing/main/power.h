@@ -0,0 +1,44 @@
+// power.h
+// Exports the power management layer, which runs the CPU slowly while we're
+// waiting on the button or the network, and at full speed while something
+// needs it
+
+#ifndef POWER_USED
+  #define POWER_USED
+
+  #include <Arduino.h>
+
+  //Comment this out to run the CPU at full speed all the time
+  #define POWER_MANAGEMENT
+
+  //Uncomment this to let the CPU light sleep while the pipeline's idle, waking
+  //for the button or the network. Needs CONFIG_PM_ENABLE and
+  //CONFIG_FREERTOS_USE_TICKLESS_IDLE in the sdkconfig. The LED's idle blink
+  //can stutter, as the PWM stops while asleep.
+  // #define POWER_LIGHT_SLEEP
+
+  //How often the main loop polls the button while the pipeline's idle, in
+  //milliseconds, so the CPU gets to idle in between
+  #define POWER_IDLE_POLL_MS 20
+
+  //Things that hold the CPU at full speed while they're working
+  enum powerLock {
+    POWER_LOCK_CAPTURE,   //Capturing & encoding a frame
+    POWER_LOCK_TLS,       //Doing a TLS handshake
+    POWER_LOCK_TIMELAPSE, //Capturing & encoding a time-lapse frame
+    POWER_LOCK_COUNT
+  };
+
+  //Setup func, configures frequency scaling (and light sleep, waking on
+  //`wakePin` going low)
+  bool setupPower(int wakePin);
+
+  //Holds the CPU at full speed until the same lock is released
+  void boostCPU(powerLock lock);
+  void relaxCPU(powerLock lock);
+
+  //Keeps the CPU from light sleeping (but not from slowing down), e.g. while a
+  //photo's going through the pipeline. Calls nest, so each stayAwake(true)
+  //needs its own stayAwake(false).
+  void stayAwake(bool awake);
+#endif
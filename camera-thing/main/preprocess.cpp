@@ -0,0 +1,97 @@
+// preprocess.cpp
+// Cleans up each frame in place between capturing and encoding it. The OV7670
+// often gives us dim, flat frames, so auto levels stretches the luma between
+// the frame's darkest and brightest pixels, and an optional 3x3 denoise takes
+// the edge off the sensor noise, which otherwise costs the JPEG encoder bytes
+// describing it. Both run two pixels at a time (see preprocessKernels.h), so a
+// QQVGA frame takes a few milliseconds.
+
+#include <Arduino.h>
+#include "trace.h"
+#include "preprocess.h"
+
+#if defined(PREPROCESS_LEVELS) || defined(PREPROCESS_DENOISE)
+  #include "preprocessKernels.h"
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Config
+
+  //The frames we preprocess
+  #define PREPROCESS_FRAME_WIDTH 160
+  #define PREPROCESS_FRAME_HEIGHT 120
+
+  //The levels are worked out from every this many rows, which is plenty
+  #define LEVELS_ROW_STEP 2
+  //How many of the darkest & brightest pixels (out of 1024) to ignore when
+  //picking the black & white points, so a few hot pixels don't spoil them
+  #define LEVELS_CLIP 5
+
+  /////////////////////////////////////////////////////////////////////////////
+  // State
+
+  //Only the capture stage preprocesses frames, so one lot of scratch will do
+  uint32_t *histogram = nullptr;
+  uint32_t *denoiseScratch = nullptr;
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Setup
+
+  //setupPreprocess allocates the histogram and the denoise's rows. Returns
+  //false for fail, true for success.
+  bool setupPreprocess() {
+    histogram = (uint32_t*)malloc(256 * sizeof(uint32_t));
+    denoiseScratch = (uint32_t*)malloc(DENOISE_SCRATCH_WORDS(PREPROCESS_FRAME_WIDTH) * sizeof(uint32_t));
+    if(histogram == nullptr || denoiseScratch == nullptr) {
+      Serial.println("[setupPreprocess] - Failed to allocate scratch :(");
+      return false;
+    }
+    return true;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Preprocessing
+
+  //preprocessFrame denoises a frame, then stretches its levels. Denoising
+  //first means the levels aren't picked from noise. Returns false if the frame
+  //isn't one we can preprocess.
+  bool preprocessFrame(camera_fb_t *frameBuffer) {
+    if(
+      frameBuffer->format != PIXFORMAT_YUV422 ||
+      frameBuffer->width != PREPROCESS_FRAME_WIDTH ||
+      frameBuffer->height != PREPROCESS_FRAME_HEIGHT
+    ) {
+      Serial.println("[preprocessFrame] - Frame isn't QQVGA YUV422, not preprocessing it :(");
+      return false;
+    }
+
+    TRACE_BEGIN("preprocess");
+    unsigned long start = micros();
+    uint32_t *yuyv = (uint32_t*)frameBuffer->buf;
+
+    #ifdef PREPROCESS_DENOISE
+      denoiseLuma(yuyv, PREPROCESS_FRAME_WIDTH, PREPROCESS_FRAME_HEIGHT, denoiseScratch);
+    #endif
+
+    #ifdef PREPROCESS_LEVELS
+      int pixels = lumaHistogram(yuyv, PREPROCESS_FRAME_WIDTH, PREPROCESS_FRAME_HEIGHT, LEVELS_ROW_STEP, histogram);
+      lumaLevels levels;
+      if(findLevels(histogram, pixels, LEVELS_CLIP, &levels)) {
+        applyLevels(yuyv, PREPROCESS_FRAME_WIDTH * PREPROCESS_FRAME_HEIGHT / 2, levels);
+        Serial.printf("[preprocessFrame] - Stretched levels from %u, gain %u/%d\n", levels.black, levels.gain, LEVELS_GAIN_ONE);
+      }
+    #endif
+    TRACE_END("preprocess");
+
+    Serial.printf("[preprocessFrame] - Preprocessed frame in %lu us\n", micros() - start);
+    return true;
+  }
+#else
+  //Without PREPROCESS_LEVELS or PREPROCESS_DENOISE, frames are encoded as the
+  //camera gives them to us
+  bool setupPreprocess() {
+    return true;
+  }
+  bool preprocessFrame(camera_fb_t *frameBuffer) {
+    return false;
+  }
+#endif
@@ -0,0 +1,23 @@
+// preprocess.h
+// Exports the preprocessing stage, which cleans up each frame before it's
+// encoded, so photos come out better exposed and compress better
+
+#ifndef PREPROCESS_USED
+  #define PREPROCESS_USED
+
+  #include "esp_camera.h"
+
+  //Uncomment this to stretch each frame's levels so it uses the whole range
+  //of brightness, which the OV7670 often doesn't by itself
+  // #define PREPROCESS_LEVELS
+
+  //Uncomment this to smooth the sensor noise out of each frame too
+  // #define PREPROCESS_DENOISE
+
+  //Setup func, allocates the scratch
+  bool setupPreprocess();
+
+  //Cleans up a QQVGA YUV422 frame in place. Does nothing to other frames, or
+  //without PREPROCESS_LEVELS or PREPROCESS_DENOISE.
+  bool preprocessFrame(camera_fb_t *frameBuffer);
+#endif
@@ -0,0 +1,158 @@
+// preprocessKernels.h
+// The kernels that clean up each frame before it's encoded: auto levels, which
+// stretches the luma out to the whole 0-255 range, and a 3x3 denoise. Like
+// motionSAD.h, they work on two pixels' luma at a time in each 32 bit word,
+// leave the chroma alone, and are plain C++ so they can be benchmarked on the
+// host too (see camera-thing/bench).
+
+#ifndef PREPROCESS_KERNELS_USED
+  #define PREPROCESS_KERNELS_USED
+
+  #include <stdint.h>
+  #include <string.h>
+  #include "motionSAD.h"
+
+  //Gains are fixed point with 6 fractional bits, so up to 255 * 4 fits in a
+  //16 bit lane
+  #define LEVELS_GAIN_BITS 6
+  #define LEVELS_GAIN_ONE (1 << LEVELS_GAIN_BITS)
+  #define LEVELS_MAX_GAIN (4 * LEVELS_GAIN_ONE)
+
+  //How to stretch a frame's luma: (luma - black) * gain, clamped to 0-255
+  struct lumaLevels {
+    uint32_t black;
+    uint32_t gain; //LEVELS_GAIN_ONE is 1
+  };
+
+  //lumaHistogram counts how many pixels have each luma, in every `rowStep`th
+  //row of a YUV422 frame. Returns how many pixels it counted.
+  static inline int lumaHistogram(const uint32_t *yuyv, int width, int height, int rowStep, uint32_t *histogram) {
+    memset(histogram, 0, 256 * sizeof(uint32_t));
+    int words = width / 2;
+    int counted = 0;
+    for(int y = 0; y < height; y += rowStep) {
+      const uint32_t *row = yuyv + y * words;
+      for(int i = 0; i < words; i++) {
+        uint32_t word = row[i];
+        histogram[word & 0xFF]++;
+        histogram[(word >> 16) & 0xFF]++;
+      }
+      counted += width;
+    }
+    return counted;
+  }
+
+  //findLevels picks the black & white points from a luma histogram of `pixels`
+  //pixels, ignoring the darkest and brightest `clip` of them (out of 1024) as
+  //noise, and the gain that stretches between the two. If that would need more
+  //than LEVELS_MAX_GAIN, the middle of the range is kept where it is instead.
+  //Returns false if the frame already uses the whole range.
+  static inline bool findLevels(const uint32_t *histogram, int pixels, int clip, lumaLevels *levels) {
+    uint32_t ignore = (uint32_t)pixels * clip / 1024;
+    uint32_t seen = 0;
+    int black = 0;
+    while(black < 255 && seen + histogram[black] <= ignore) {
+      seen += histogram[black++];
+    }
+    seen = 0;
+    int white = 255;
+    while(white > black && seen + histogram[white] <= ignore) {
+      seen += histogram[white--];
+    }
+    if(white <= black) {
+      return false;
+    }
+
+    int range = white - black;
+    uint32_t gain = (255 * LEVELS_GAIN_ONE + range / 2) / range;
+    if(gain > LEVELS_MAX_GAIN) {
+      gain = LEVELS_MAX_GAIN;
+      int centred = (black + white) / 2 - 128 * LEVELS_GAIN_ONE / LEVELS_MAX_GAIN;
+      black = centred < 0 ? 0 : centred;
+    }
+    if(black == 0 && gain <= LEVELS_GAIN_ONE) {
+      return false;
+    }
+    levels->black = black;
+    levels->gain = gain;
+    return true;
+  }
+
+  //applyLevels stretches the luma of `words` words of a YUV422 frame in place.
+  //Subtracting the black point from a lane with the bit above its luma set
+  //can't borrow from the next lane, and leaves that bit set only where the
+  //luma was at least the black point; the others are zeroed. After scaling,
+  //each lane holds up to 10 bits, and adding 0x7F00 sets its top bit only
+  //where it's over 255, which is then saturated.
+  static inline void applyLevels(uint32_t *yuyv, int words, lumaLevels levels) {
+    uint32_t black = levels.black * LUMA_LANE_LOW;
+    uint32_t round = (LEVELS_GAIN_ONE / 2) * LUMA_LANE_LOW;
+    for(int i = 0; i < words; i++) {
+      uint32_t word = yuyv[i];
+      uint32_t lifted = ((word & LUMA_LANES) | LUMA_BORROW) - black;
+      uint32_t above = (lifted >> 8) & LUMA_LANE_LOW;
+      uint32_t luma = lifted & (above * 0xFF);
+      luma = ((luma * levels.gain + round) >> LEVELS_GAIN_BITS) & 0x03FF03FFu;
+      uint32_t over = ((luma + 0x7F007F00u) >> 15) & LUMA_LANE_LOW;
+      luma = (luma | (over * 0xFF)) & LUMA_LANES;
+      yuyv[i] = (word & ~LUMA_LANES) | luma;
+    }
+  }
+
+  //blurLumaRow sums each pixel's luma with its left & right neighbours',
+  //weighted 1-2-1, for a row of `words` words of a YUV422 frame. The sums go
+  //in 16 bit lanes like LUMA_LANES. Lane 0 of a word is the word's first
+  //pixel, whose neighbours are the last word's second pixel and the word's
+  //second pixel, so the neighbours are the word shifted a lane either way,
+  //with the lane shifted out coming from the next word along. The edges
+  //mirror the pixel inside them.
+  static inline void blurLumaRow(const uint32_t *row, uint32_t *sums, int words) {
+    uint32_t current = row[0] & LUMA_LANES;
+    uint32_t last = current;
+    for(int i = 0; i < words; i++) {
+      uint32_t next = i + 1 < words ? row[i + 1] & LUMA_LANES : current;
+      uint32_t left = (current << 16) | (last >> 16);
+      uint32_t right = (current >> 16) | (next << 16);
+      sums[i] = left + 2 * current + right;
+      last = current;
+      current = next;
+    }
+  }
+
+  //How many words of scratch denoiseLuma needs for a frame `width` pixels
+  //wide: three rows' worth of sums
+  #define DENOISE_SCRATCH_WORDS(width) (3 * (width) / 2)
+
+  //denoiseLuma smooths the luma of a YUV422 frame in place with a 3x3
+  //Gaussian (1-2-1 each way, so dividing by 16 is a shift). Each row's
+  //horizontal sums are worked out before the row above it is overwritten, and
+  //the last three are kept in `scratch`, so the frame's only read once. A
+  //weighted total is at most 16 * 255, which fits in a lane.
+  static inline void denoiseLuma(uint32_t *yuyv, int width, int height, uint32_t *scratch) {
+    int words = width / 2;
+    uint32_t *above = scratch;
+    uint32_t *middle = scratch + words;
+    uint32_t *below = scratch + 2 * words;
+    uint32_t round = 8 * LUMA_LANE_LOW;
+
+    //The top row mirrors the row below it
+    blurLumaRow(yuyv, middle, words);
+    blurLumaRow(yuyv + (height > 1 ? words : 0), above, words);
+    for(int y = 0; y < height; y++) {
+      uint32_t *row = yuyv + y * words;
+      if(y + 1 < height) {
+        blurLumaRow(row + words, below, words);
+      } else {
+        memcpy(below, above, words * sizeof(uint32_t));
+      }
+      for(int i = 0; i < words; i++) {
+        uint32_t luma = ((above[i] + 2 * middle[i] + below[i] + round) >> 4) & LUMA_LANES;
+        row[i] = (row[i] & ~LUMA_LANES) | luma;
+      }
+      uint32_t *done = above;
+      above = middle;
+      middle = below;
+      below = done;
+    }
+  }
+#endif
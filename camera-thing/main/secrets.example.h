@@ -1,13 +1,14 @@
 ///////////////////////////////////////////////////////////////////////////
 // Network credentials
-// Note: Either WiFi OR 2G must be used; not both.
+// Note: WiFi, 2G or both can be used. With both, requests go over whichever is
+// up and quicker, and fail over to the other (see networkClient.cpp).
 
-//Credentials for using the webClient in wifiClient.h
+//Credentials for the WiFi transport in wifiClient.h
 //If WIFI_SSID is defined then the CameraThing will attempt to use WiFi.
 #define WIFI_SSID "Put your SSID in here! :)"
 #define WIFI_PASS "Put your password in here! :)"
 
-//GPRS credentials for the webClient in gprsClient.h
+//GPRS credentials for the 2G transport in gprsClient.h
 //If APN is defined then the CameraThing will attempt to use 2G
 #define APN "Put the APN of your provider here :)"
 #define GPRS_USER "Put the username for your APN here :)"
@@ -23,3 +24,17 @@
 #define TWEETER_HOST "Put the hostname of your tweeter service here! :)"
 #define TWEETER_PORT Put the port of your tweeter here! :)
 #define TWEETER_AUTH_TOKEN "Put the auth token for your tweeter here! :)"
+
+//Uncomment TWEETER_TLS to make requests to your tweeter service over HTTPS, in
+//which case TWEETER_PORT should be the port it serves TLS on. TLS sessions are
+//resumed where possible, so only the first request after a cold boot has to do
+//a full handshake.
+// #define TWEETER_TLS
+//The PEM encoded certificate of the CA that signed your tweeter's certificate.
+//TWEETER_TLS needs this to verify the tweeter's certificate before the auth
+//token's sent, so it won't build without it...
+// #define TWEETER_CA_CERT "-----BEGIN CERTIFICATE-----\n...\n-----END CERTIFICATE-----\n"
+//...unless you uncomment TWEETER_TLS_INSECURE, which doesn't verify the
+//tweeter's certificate at all. That's only OK for testing against a local
+//tweeter, as anyone in between could pretend to be it!
+// #define TWEETER_TLS_INSECURE
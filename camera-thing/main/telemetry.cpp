@@ -0,0 +1,165 @@
+// telemetry.cpp
+// Keeps track of how much of each task's stack has been used, and sums that up
+// with the heap, PSRAM, trace totals & frame check counts in a header sent with
+// each photo. The tasks' stacks were sized by guesswork, so the tweeter service
+// collects these from every CameraThing to size them from instead.
+//
+// The header's one line of fields separated by semicolons, e.g.
+//   Telemetry: id=a1b2c3;up=3600;heap=81234/60120/45000;psram=0/0;
+//     stack=loop:2412/8192,capture:3544/10000;frames=42/1/0/0;trace=capture:42/180/412
+// with:
+//   id      The last 3 bytes of the MAC, to tell CameraThings apart
+//   up      Seconds since boot
+//   heap    Free, least ever free & largest free block, in bytes
+//   psram   Free & total, in bytes, 0/0 without any
+//   stack   Each task's most stack used & its stack size, in bytes
+//   frames  Frames checked, recaptured, kept & given up on, see camera.h
+//   trace   With TRACE_PIPELINE, each stage's runs, average & longest ms
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include "trace.h"
+#include "camera.h"
+#include "telemetry.h"
+
+#ifdef UPLOAD_TELEMETRY
+  /////////////////////////////////////////////////////////////////////////////
+  // Config
+
+  //How many tasks we can keep track of
+  #define TELEMETRY_MAX_TASKS 10
+
+  //The longest the header can be, leaving out what doesn't fit
+  #define TELEMETRY_MAX_LEN 512
+
+  /////////////////////////////////////////////////////////////////////////////
+  // State
+
+  struct watchedTask {
+    const char *name;    //Short name, must be a string literal
+    TaskHandle_t task;   //The task, or nullptr once it's been deleted
+    uint32_t stackSize;  //Its stack size in bytes
+    uint32_t mostUsed;   //The most stack it's used in bytes
+  };
+
+  watchedTask watched[TELEMETRY_MAX_TASKS];
+  int watchedCount = 0;
+
+  //Tasks are watched & forgotten by the main loop while the network stage
+  //sums them up, so we guard with a spinlock. It's held while a task's stack's
+  //looked at, so the task can't be deleted from under us.
+  portMUX_TYPE telemetryMux = portMUX_INITIALIZER_UNLOCKED;
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Stacks
+
+  //sampleTask updates how much stack a task's used. The high water mark is the
+  //least stack it's ever had free, in bytes on the ESP32. Must be called with
+  //telemetryMux held.
+  void sampleTask(watchedTask *w) {
+    if(w->task == nullptr) {
+      return;
+    }
+    uint32_t used = w->stackSize - uxTaskGetStackHighWaterMark(w->task);
+    if(used > w->mostUsed) {
+      w->mostUsed = used;
+    }
+  }
+
+  //watchTask starts keeping track of a task's stack, carrying on from any task
+  //watched before under the same name
+  void watchTask(const char *name, TaskHandle_t task, uint32_t stackSize) {
+    portENTER_CRITICAL(&telemetryMux);
+    watchedTask *w = nullptr;
+    for(int i = 0; i < watchedCount; i++) {
+      if(strcmp(watched[i].name, name) == 0) {
+        w = &watched[i];
+      }
+    }
+    if(w == nullptr && watchedCount < TELEMETRY_MAX_TASKS) {
+      w = &watched[watchedCount++];
+      *w = watchedTask{name, nullptr, 0, 0};
+    }
+    if(w != nullptr) {
+      sampleTask(w);
+      w->task = task;
+      w->stackSize = stackSize;
+    }
+    portEXIT_CRITICAL(&telemetryMux);
+  }
+
+  //forgetTask samples a task's stack for the last time before it's deleted
+  void forgetTask(TaskHandle_t task) {
+    portENTER_CRITICAL(&telemetryMux);
+    for(int i = 0; i < watchedCount; i++) {
+      if(watched[i].task == task) {
+        sampleTask(&watched[i]);
+        watched[i].task = nullptr;
+      }
+    }
+    portEXIT_CRITICAL(&telemetryMux);
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Header
+
+  //appendField adds to the header if it fits, returning false if it doesn't
+  bool appendField(char *header, size_t *used, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(header + *used, TELEMETRY_MAX_LEN - *used, format, args);
+    va_end(args);
+    if(written < 0 || *used + written >= TELEMETRY_MAX_LEN) {
+      header[*used] = '\0';
+      return false;
+    }
+    *used += written;
+    return true;
+  }
+
+  //telemetryHeader samples every watched task's stack, and sums everything up
+  //in a Telemetry header
+  String telemetryHeader() {
+    char header[TELEMETRY_MAX_LEN];
+    size_t used = 0;
+    appendField(
+      header, &used, "Telemetry: id=%06x;up=%lu;heap=%u/%u/%u;psram=%u/%u;stack=",
+      (unsigned)(ESP.getEfuseMac() >> 24) & 0xFFFFFF, millis() / 1000,
+      ESP.getFreeHeap(), ESP.getMinFreeHeap(), ESP.getMaxAllocHeap(),
+      ESP.getFreePsram(), ESP.getPsramSize()
+    );
+
+    for(int i = 0; i < TELEMETRY_MAX_TASKS; i++) {
+      portENTER_CRITICAL(&telemetryMux);
+      if(i >= watchedCount) {
+        portEXIT_CRITICAL(&telemetryMux);
+        break;
+      }
+      sampleTask(&watched[i]);
+      watchedTask w = watched[i];
+      portEXIT_CRITICAL(&telemetryMux);
+      appendField(header, &used, "%s%s:%u/%u", i > 0 ? "," : "", w.name, w.mostUsed, w.stackSize);
+    }
+
+    const frameCheckCounts *checks = frameChecks();
+    appendField(
+      header, &used, ";frames=%d/%d/%d/%d",
+      checks->checked, checks->recaptured, checks->kept, checks->givenUp
+    );
+
+    //The trace totals go last, as they're the longest
+    char trace[TELEMETRY_MAX_LEN];
+    if(traceSummary(trace, sizeof(trace)) > 0) {
+      appendField(header, &used, ";trace=%s", trace);
+    }
+
+    Serial.printf("[telemetryHeader] - %s\n", header);
+    return String(header) + "\r\n";
+  }
+#else
+  void watchTask(const char *name, TaskHandle_t task, uint32_t stackSize) {}
+  void forgetTask(TaskHandle_t task) {}
+  String telemetryHeader() {
+    return "";
+  }
+#endif
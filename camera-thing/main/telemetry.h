@@ -0,0 +1,34 @@
+// telemetry.h
+// Exports the telemetry that's sent with each photo, so the tweeter service can
+// keep track of how much memory & stack CameraThings actually use
+
+#ifndef TELEMETRY_USED
+  #define TELEMETRY_USED
+
+  #include <Arduino.h>
+
+  //Uncomment this to send a Telemetry header with every photo uploaded, with
+  //the free heap, PSRAM, how much of each task's stack has been used, the
+  //pipeline's trace totals and the frame check counts. It's around 200 bytes.
+  // #define UPLOAD_TELEMETRY
+
+  //The main loop's stack, which the Arduino core sets
+  #ifdef CONFIG_ARDUINO_LOOP_STACK_SIZE
+    #define LOOP_STACK CONFIG_ARDUINO_LOOP_STACK_SIZE
+  #else
+    #define LOOP_STACK 8192
+  #endif
+
+  //Starts keeping track of the stack of a task we've created, under a short
+  //`name`. Watching another task under the same name, e.g. the LED's next
+  //animation, carries on from the last one's usage.
+  void watchTask(const char *name, TaskHandle_t task, uint32_t stackSize);
+
+  //Stops keeping track of a task that's about to be deleted, remembering how
+  //much of its stack it used
+  void forgetTask(TaskHandle_t task);
+
+  //Gets the Telemetry header line to add to a request, with its "\r\n", or an
+  //empty string without UPLOAD_TELEMETRY
+  String telemetryHeader();
+#endif
@@ -0,0 +1,282 @@
+// timelapse.cpp
+// Takes a photo every TIMELAPSE_INTERVAL seconds and keeps it in SPIFFS, then
+// uploads the stored photos in batches over one connection. Over 2G, setting
+// up the SIM800L and attaching to GPRS takes far longer (and far more power)
+// than uploading a photo, so the worse the signal, the more photos we wait for
+// before paying for it. The radio's turned off between batches, and the task
+// sleeps between photos, so the CPU can slow down or light sleep (see power.h).
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include "utils.h"
+#include "secrets.h"
+#include "camera.h"
+#include "pipeline.h"
+#include "tweeter.h"
+#include "networkClient.h"
+#include "power.h"
+#include "trace.h"
+#include "telemetry.h"
+#include "timelapse.h"
+
+#ifdef TIMELAPSE_INTERVAL
+  /////////////////////////////////////////////////////////////////////////////
+  // Config
+
+  //The task runs on the network core, below the pipeline's network stage, so
+  //photos taken with the button go first
+  #define TIMELAPSE_CORE 0
+  #define TIMELAPSE_PRIORITY 1
+
+  //Uploads may do a TLS handshake, which needs a lot more stack!
+  #ifdef TWEETER_TLS
+    #define TIMELAPSE_STACK 16384
+  #else
+    #define TIMELAPSE_STACK 10000
+  #endif
+
+  //How many photos we can store. A QQVGA JPEG is 6-8KB, so 64 is about 512KB.
+  //Once it's full, the oldest photo's thrown away to make room.
+  #define TIMELAPSE_MAX_STORED 64
+
+  //How many photos to wait for before uploading a batch, by the quality of the
+  //link the last time we checked (see networkQuality in networkClient.cpp)
+  #define TIMELAPSE_GOOD_QUALITY 60
+  #define TIMELAPSE_FAIR_QUALITY 30
+  #define TIMELAPSE_GOOD_BATCH 2
+  #define TIMELAPSE_FAIR_BATCH 4
+  #define TIMELAPSE_POOR_BATCH 8
+  //However bad the link, we upload once the store's this full, rather than
+  //start throwing photos away
+  #define TIMELAPSE_UPLOAD_AT (TIMELAPSE_MAX_STORED * 3 / 4)
+  //The most photos uploaded in one go, so one batch can't keep the radio on
+  //for too long
+  #define TIMELAPSE_MAX_BATCH 16
+
+  //How long the tweeter has to respond to each photo, in milliseconds
+  #define TIMELAPSE_UPLOAD_TIMEOUT 30000
+
+  //Stored photos are named TIMELAPSE_PREFIX followed by their sequence number
+  #define TIMELAPSE_PREFIX "tl-"
+
+  /////////////////////////////////////////////////////////////////////////////
+  // State
+
+  //The stored photos are numbered oldestPhoto up to (but not including)
+  //nextPhoto. Only the time-lapse task touches these after setup.
+  unsigned long oldestPhoto = 0;
+  unsigned long nextPhoto = 0;
+
+  //The quality of the link the last time we checked, or -1 if we don't know
+  int lastQuality = -1;
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Photo store
+
+  //photoPath gets the path of a stored photo by its sequence number
+  String photoPath(unsigned long photo) {
+    char path[32];
+    snprintf(path, sizeof(path), "/" TIMELAPSE_PREFIX "%08lu.jpg", photo);
+    return String(path);
+  }
+
+  //storedPhotos is how many photos are waiting to be uploaded
+  int storedPhotos() {
+    return nextPhoto - oldestPhoto;
+  }
+
+  //findStoredPhotos picks up where we left off before a reset, by finding the
+  //oldest & newest photos in the store
+  void findStoredPhotos() {
+    bool found = false;
+    File root = SPIFFS.open("/");
+    for(File file = root.openNextFile(); file; file = root.openNextFile()) {
+      //Depending on the core, the name may or may not have a leading /
+      const char *name = strstr(file.name(), TIMELAPSE_PREFIX);
+      if(name == nullptr) {
+        continue;
+      }
+      unsigned long photo = strtoul(name + strlen(TIMELAPSE_PREFIX), nullptr, 10);
+      if(!found || photo < oldestPhoto) {
+        oldestPhoto = photo;
+      }
+      if(!found || photo >= nextPhoto) {
+        nextPhoto = photo + 1;
+      }
+      found = true;
+    }
+  }
+
+  //storePhoto takes a photo and stores it. Returns false for fail, true for
+  //success.
+  bool storePhoto() {
+    //Make room if the store's full
+    if(storedPhotos() >= TIMELAPSE_MAX_STORED) {
+      Serial.printf("[storePhoto] - Store full, throwing away photo %lu :(\n", oldestPhoto);
+      SPIFFS.remove(photoPath(oldestPhoto++));
+    }
+
+    //Take the photo
+    boostCPU(POWER_LOCK_TIMELAPSE);
+    TRACE_BEGIN("timelapse");
+    uint8_t *jpgBuffer = nullptr;
+    size_t jpgLen = 0;
+    bool gotJPEG = getJPEG(&jpgBuffer, &jpgLen);
+    TRACE_END("timelapse");
+    relaxCPU(POWER_LOCK_TIMELAPSE);
+    if(!gotJPEG) {
+      Serial.println("[storePhoto] - Failed to take photo :(");
+      return false;
+    }
+
+    //And store it
+    String path = photoPath(nextPhoto);
+    File file = SPIFFS.open(path, FILE_WRITE);
+    size_t written = file ? file.write(jpgBuffer, jpgLen) : 0;
+    if(file) {
+      file.close();
+    }
+    free(jpgBuffer);
+    if(written != jpgLen) {
+      Serial.printf("[storePhoto] - Failed to store photo %lu :(\n", nextPhoto);
+      SPIFFS.remove(path);
+      return false;
+    }
+    Serial.printf("[storePhoto] - Stored photo %lu (%d bytes), %d waiting\n", nextPhoto, jpgLen, storedPhotos() + 1);
+    nextPhoto++;
+    return true;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Batching
+
+  //batchSize is how many photos we wait for before uploading, going by how
+  //good the link was last time
+  int batchSize() {
+    if(lastQuality >= TIMELAPSE_GOOD_QUALITY) {
+      return TIMELAPSE_GOOD_BATCH;
+    }
+    if(lastQuality >= TIMELAPSE_FAIR_QUALITY || lastQuality < 0) {
+      return TIMELAPSE_FAIR_BATCH;
+    }
+    return TIMELAPSE_POOR_BATCH;
+  }
+
+  //uploadBatch uploads up to TIMELAPSE_MAX_BATCH stored photos, oldest first,
+  //removing each from the store once the tweeter has it. Stops at the first
+  //photo that fails, so it's retried with the next batch. The batch holds the
+  //tweeterClient for as long as it runs, so it also stops as soon as a photo's
+  //taken with the button, leaving the rest stored for the next batch.
+  void uploadBatch() {
+    if(!pipelineIdle()) {
+      Serial.println("[uploadBatch] - Pipeline's busy, leaving the batch for next time");
+      return;
+    }
+    int count = min(storedPhotos(), TIMELAPSE_MAX_BATCH);
+    Serial.printf("[uploadBatch] - Uploading %d of %d stored photos...\n", count, storedPhotos());
+    TRACE_BEGIN("batch");
+    unsigned long started = millis();
+    int uploaded = 0;
+    if(beginTweetBatch()) {
+      lastQuality = networkQuality();
+      for(; uploaded < count; uploaded++) {
+        //Let the pipeline's network stage have the tweeterClient
+        if(!pipelineIdle()) {
+          Serial.println("[uploadBatch] - Pipeline's busy, stopping the batch");
+          break;
+        }
+
+        //Read the photo back out of the store
+        String path = photoPath(oldestPhoto);
+        File file = SPIFFS.open(path, FILE_READ);
+        size_t jpgLen = file ? file.size() : 0;
+        uint8_t *jpgBuffer = jpgLen > 0 ? (uint8_t *)malloc(jpgLen) : nullptr;
+        bool read = jpgBuffer != nullptr && file.read(jpgBuffer, jpgLen) == jpgLen;
+        if(file) {
+          file.close();
+        }
+        if(!read) {
+          Serial.printf("[uploadBatch] - Couldn't read photo %lu, skipping it :(\n", oldestPhoto);
+          free(jpgBuffer);
+          SPIFFS.remove(path);
+          oldestPhoto++;
+          continue;
+        }
+
+        //Upload it. The tweeter may queue it rather than tweet it straight
+        //away, but we don't need the tweet's URL either way.
+        String tweetURL;
+        String jobID;
+        bool tweeted = batchTweet(TIMELAPSE_UPLOAD_TIMEOUT, jpgBuffer, jpgLen, &tweetURL, &jobID);
+        free(jpgBuffer);
+        if(!tweeted) {
+          Serial.printf("[uploadBatch] - Failed to upload photo %lu :(\n", oldestPhoto);
+          break;
+        }
+        SPIFFS.remove(path);
+        oldestPhoto++;
+      }
+    }
+    endTweetBatch();
+    TRACE_END("batch");
+    Serial.printf(
+      "[uploadBatch] - Uploaded %d of %d photos in %lu ms, link quality %d\n",
+      uploaded, count, millis() - started, lastQuality
+    );
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Task
+
+  //timelapseTask takes a photo every TIMELAPSE_INTERVAL seconds, uploading a
+  //batch whenever enough have built up, until the end of time
+  void timelapseTask(void *p) {
+    TickType_t lastWake = xTaskGetTickCount();
+    for(;;) {
+      stayAwake(true);
+      storePhoto();
+
+      //Over WiFi we can check the link without setting anything up
+      if(currentTransport() == NETWORK_WIFI) {
+        lastQuality = networkQuality();
+      }
+      if(storedPhotos() >= batchSize() || storedPhotos() >= TIMELAPSE_UPLOAD_AT) {
+        uploadBatch();
+      }
+      stayAwake(false);
+
+      vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(TIMELAPSE_INTERVAL * 1000UL));
+    }
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Setup
+
+  //setupTimelapse mounts SPIFFS (formatting it if it's never been used), finds
+  //any photos left over from before a reset, and starts the time-lapse task.
+  //Must be called after setupCamera. Returns false for fail, true for success.
+  bool setupTimelapse() {
+    if(!SPIFFS.begin(true)) {
+      Serial.println("[setupTimelapse] - Failed to mount SPIFFS :(");
+      return false;
+    }
+    findStoredPhotos();
+    Serial.printf("[setupTimelapse] - %d photos waiting to be uploaded\n", storedPhotos());
+
+    TaskHandle_t task;
+    BaseType_t created = xTaskCreatePinnedToCore(
+      timelapseTask, "timelapseTask", TIMELAPSE_STACK, nullptr, TIMELAPSE_PRIORITY, &task, TIMELAPSE_CORE
+    );
+    if(created != pdPASS) {
+      Serial.println("[setupTimelapse] - Failed to create time-lapse task :(");
+      return false;
+    }
+    watchTask("timelapse", task, TIMELAPSE_STACK);
+    return true;
+  }
+#else
+  //Without TIMELAPSE_INTERVAL, photos are only taken on demand
+  bool setupTimelapse() {
+    return true;
+  }
+#endif
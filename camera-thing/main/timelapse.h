@@ -0,0 +1,14 @@
+// timelapse.h
+// Exports the time-lapse mode, which takes photos on a schedule and uploads
+// them in batches
+
+#ifndef TIMELAPSE_USED
+  #define TIMELAPSE_USED
+
+  //Uncomment this to take a photo every TIMELAPSE_INTERVAL seconds, as well as
+  //when the button's pressed
+  // #define TIMELAPSE_INTERVAL 300
+
+  //Setup func, mounts the photo store and starts the time-lapse task
+  bool setupTimelapse();
+#endif
@@ -0,0 +1,434 @@
+// tlsClient.cpp
+// A TLS client built on mbedTLS which sends its records over another Client,
+// so the same code works over WiFi and over the SIM800L. A full handshake over
+// 2G takes several seconds, so the session is cached (in RTC memory too, so it
+// survives deep sleep) and offered to the tweeter to resume on every connect.
+
+//Include secrets.h so we can tell if TWEETER_TLS is defined
+#include "secrets.h"
+
+#ifdef TWEETER_TLS
+  //Without a CA cert the tweeter's certificate can't be verified, so anyone in
+  //between could pretend to be it and be sent the auth token
+  #if !defined(TWEETER_CA_CERT) && !defined(TWEETER_TLS_INSECURE)
+    #error "TWEETER_TLS needs TWEETER_CA_CERT, or TWEETER_TLS_INSECURE to not verify the tweeter at all (see secrets.example.h)"
+  #endif
+
+  #include <Arduino.h>
+  #include "mbedtls/ssl.h"
+  #include "mbedtls/net_sockets.h"
+  #include "mbedtls/platform.h"
+  #include "mbedtls/error.h"
+  #include "utils.h"
+  #include "trace.h"
+  #include "power.h"
+  #include "tlsClient.h"
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Config
+
+  //Uncomment this to never offer the cached session, so every handshake is a
+  //full one. Useful for comparing handshake times.
+  // #define TWEETER_TLS_NO_RESUME
+
+  //How long a handshake may take, and how long a read or write may stall for,
+  //in milliseconds. Full handshakes over 2G are slow!
+  #define TLS_HANDSHAKE_TIMEOUT 30000
+  #define TLS_IO_TIMEOUT 30000
+
+  //Largest session ticket we'll keep in RTC memory. Bigger tickets are still
+  //used until the next reset, we just fall back to the session ID after that.
+  #define TLS_MAX_SAVED_TICKET 512
+
+  //Marks savedSession as holding a session rather than zeroes
+  #define TLS_SESSION_MAGIC 0xCA3E5E55
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Session cache
+
+  //The session from the most recent handshake, offered on the next connect
+  mbedtls_ssl_session cachedSession;
+  bool haveCachedSession = false;
+
+  //The parts of cachedSession needed to resume it, kept in RTC memory so they
+  //survive deep sleep. mbedtls_ssl_session is full of pointers, so it can't
+  //just be copied in there.
+  struct savedTLSSession {
+    uint32_t magic;
+    int ciphersuite;
+    int compression;
+    size_t idLen;
+    unsigned char id[32];
+    unsigned char master[48];
+    size_t ticketLen;
+    uint32_t ticketLifetime;
+    unsigned char ticket[TLS_MAX_SAVED_TICKET];
+  };
+  RTC_DATA_ATTR savedTLSSession savedSession;
+
+  //saveSession copies the session out of a connection that's just finished its
+  //handshake into cachedSession and savedSession
+  void saveSession(mbedtls_ssl_context *ssl) {
+    mbedtls_ssl_session_free(&cachedSession);
+    mbedtls_ssl_session_init(&cachedSession);
+    haveCachedSession = mbedtls_ssl_get_session(ssl, &cachedSession) == 0;
+    if(!haveCachedSession) {
+      Serial.println("[saveSession] - Failed to get TLS session :(");
+      savedSession.magic = 0;
+      return;
+    }
+
+    savedSession.ciphersuite = cachedSession.ciphersuite;
+    savedSession.compression = cachedSession.compression;
+    savedSession.idLen = cachedSession.id_len;
+    memcpy(savedSession.id, cachedSession.id, sizeof(savedSession.id));
+    memcpy(savedSession.master, cachedSession.master, sizeof(savedSession.master));
+    savedSession.ticketLen = 0;
+    #if defined(MBEDTLS_SSL_SESSION_TICKETS)
+      if(cachedSession.ticket != NULL && cachedSession.ticket_len <= TLS_MAX_SAVED_TICKET) {
+        memcpy(savedSession.ticket, cachedSession.ticket, cachedSession.ticket_len);
+        savedSession.ticketLen = cachedSession.ticket_len;
+        savedSession.ticketLifetime = cachedSession.ticket_lifetime;
+      }
+    #endif
+    savedSession.magic = TLS_SESSION_MAGIC;
+  }
+
+  //loadSavedSession rebuilds cachedSession from RTC memory after a reset or
+  //deep sleep, if there's a session in there
+  void loadSavedSession() {
+    if(haveCachedSession || savedSession.magic != TLS_SESSION_MAGIC) {
+      return;
+    }
+
+    mbedtls_ssl_session_init(&cachedSession);
+    cachedSession.ciphersuite = savedSession.ciphersuite;
+    cachedSession.compression = savedSession.compression;
+    cachedSession.id_len = savedSession.idLen;
+    memcpy(cachedSession.id, savedSession.id, sizeof(savedSession.id));
+    memcpy(cachedSession.master, savedSession.master, sizeof(savedSession.master));
+    #if defined(MBEDTLS_SSL_SESSION_TICKETS)
+      if(savedSession.ticketLen > 0) {
+        cachedSession.ticket = (unsigned char*)mbedtls_calloc(1, savedSession.ticketLen);
+        if(cachedSession.ticket != NULL) {
+          memcpy(cachedSession.ticket, savedSession.ticket, savedSession.ticketLen);
+          cachedSession.ticket_len = savedSession.ticketLen;
+          cachedSession.ticket_lifetime = savedSession.ticketLifetime;
+        }
+      }
+    #endif
+    haveCachedSession = true;
+    Serial.println("[loadSavedSession] - Loaded TLS session from RTC memory");
+  }
+
+  //resumedSession is true if the handshake that's just finished resumed the
+  //cached session. Resuming by session ID keeps the ID, and resuming by ticket
+  //keeps the master secret (mbedTLS makes up a new ID to go with a ticket),
+  //whereas a full handshake gets a new ID and master secret.
+  bool resumedSession(mbedtls_ssl_context *ssl) {
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    bool resumed = false;
+    if(mbedtls_ssl_get_session(ssl, &session) == 0) {
+      bool sameId = session.id_len > 0 && session.id_len == cachedSession.id_len && memcmp(session.id, cachedSession.id, session.id_len) == 0;
+      bool sameMaster = memcmp(session.master, cachedSession.master, sizeof(session.master)) == 0;
+      resumed = sameId || sameMaster;
+    }
+    mbedtls_ssl_session_free(&session);
+    return resumed;
+  }
+
+  //forgetSession throws away the cached session
+  void TLSClient::forgetSession() {
+    mbedtls_ssl_session_free(&cachedSession);
+    haveCachedSession = false;
+    savedSession.magic = 0;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Constructor & config
+
+  TLSClient::TLSClient(Client &t) {
+    transport = &t;
+  }
+
+  //configure sets up the RNG, CA & mbedTLS config shared by every connection.
+  //It's done on first connect rather than in the constructor, as the entropy
+  //source isn't ready while globals are being constructed.
+  bool TLSClient::configure() {
+    if(configured) {
+      return true;
+    }
+
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_x509_crt_init(&ca);
+
+    const char *pers = "CameraThing";
+    int ret = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy, (const unsigned char*)pers, strlen(pers));
+    if(ret != 0) {
+      Serial.printf("[TLSClient.configure] - Failed to seed RNG, err: -0x%x\n", -ret);
+      return false;
+    }
+
+    ret = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if(ret != 0) {
+      Serial.printf("[TLSClient.configure] - Failed to set config defaults, err: -0x%x\n", -ret);
+      return false;
+    }
+
+    #ifdef TWEETER_CA_CERT
+      ret = mbedtls_x509_crt_parse(&ca, (const unsigned char*)TWEETER_CA_CERT, strlen(TWEETER_CA_CERT) + 1);
+      if(ret != 0) {
+        Serial.printf("[TLSClient.configure] - Failed to parse TWEETER_CA_CERT, err: -0x%x\n", -ret);
+        return false;
+      }
+      mbedtls_ssl_conf_ca_chain(&conf, &ca, NULL);
+      mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    #else
+      Serial.println("[TLSClient.configure] - TWEETER_TLS_INSECURE set, NOT verifying the tweeter's certificate!");
+      mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_NONE);
+    #endif
+
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+    #if defined(MBEDTLS_SSL_SESSION_TICKETS)
+      mbedtls_ssl_conf_session_tickets(&conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    #endif
+
+    configured = true;
+    return true;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // BIO callbacks
+
+  //sendCallback writes encrypted bytes to the transport
+  int TLSClient::sendCallback(void *ctx, const unsigned char *buf, size_t len) {
+    Client *transport = (Client*)ctx;
+    size_t written = transport->write(buf, len);
+    if(written == 0) {
+      return transport->connected() ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_CONN_RESET;
+    }
+    return written;
+  }
+
+  //recvCallback reads encrypted bytes from the transport without blocking
+  int TLSClient::recvCallback(void *ctx, unsigned char *buf, size_t len) {
+    Client *transport = (Client*)ctx;
+    if(transport->available() <= 0) {
+      return transport->connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+    }
+    int got = transport->read(buf, len);
+    if(got <= 0) {
+      return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+    return got;
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Connecting
+
+  int TLSClient::connect(IPAddress ip, uint16_t port) {
+    //We need a hostname for SNI and certificate verification
+    Serial.println("[TLSClient.connect] - Connecting by IP isn't supported, use a hostname :(");
+    return 0;
+  }
+
+  //connect opens the transport, then does the TLS handshake over it, offering
+  //the cached session to resume. Returns 1 for success, 0 for fail.
+  int TLSClient::connect(const char *host, uint16_t port) {
+    //Make sure we're not still holding onto an old connection
+    stop();
+
+    if(!configure()) {
+      return 0;
+    }
+    if(!transport->connect(host, port)) {
+      Serial.println("[TLSClient.connect] - Transport failed to connect :(");
+      return 0;
+    }
+
+    mbedtls_ssl_init(&ssl);
+    sessionOpen = true;
+    int ret = mbedtls_ssl_setup(&ssl, &conf);
+    if(ret == 0) {
+      ret = mbedtls_ssl_set_hostname(&ssl, host);
+    }
+    if(ret != 0) {
+      Serial.printf("[TLSClient.connect] - Failed to setup TLS context, err: -0x%x\n", -ret);
+      stop();
+      return 0;
+    }
+    mbedtls_ssl_set_bio(&ssl, transport, sendCallback, recvCallback, NULL);
+
+    //Offer the last session we had, if we've got one
+    bool offered = false;
+    #ifndef TWEETER_TLS_NO_RESUME
+      loadSavedSession();
+      if(haveCachedSession) {
+        offered = mbedtls_ssl_set_session(&ssl, &cachedSession) == 0;
+      }
+    #endif
+
+    Serial.printf("[TLSClient.connect] - Handshaking (%s)...", offered ? "offering session" : "no session");
+    TRACE_BEGIN("tls");
+    boostCPU(POWER_LOCK_TLS);
+    unsigned long started = millis();
+    handshakeResumed = false;
+    while((ret = mbedtls_ssl_handshake(&ssl)) != 0) {
+      if((ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) && millis() - started < TLS_HANDSHAKE_TIMEOUT) {
+        WAIT_MS(10);
+        continue;
+      }
+
+      //Anything else is fatal
+      relaxCPU(POWER_LOCK_TLS);
+      TRACE_END("tls");
+      char err[100];
+      mbedtls_strerror(ret, err, sizeof(err));
+      Serial.printf(" failed, err: %s :(\n", err);
+      //If we offered a session, it might be what the server didn't like
+      if(offered) {
+        forgetSession();
+      }
+      stop();
+      return 0;
+    }
+    relaxCPU(POWER_LOCK_TLS);
+    TRACE_END("tls");
+    handshakeMillis = millis() - started;
+    handshakeResumed = offered && resumedSession(&ssl);
+    Serial.println(" success!");
+    Serial.printf(
+      "[TLSClient.connect] - %s handshake took %lu ms\n",
+      handshakeResumed ? "Resumed" : "Full", handshakeMillis
+    );
+
+    //Keep the session (it may come with a fresh ticket) for next time
+    saveSession(&ssl);
+    return 1;
+  }
+
+  //closeSession tells the server we're done and frees the TLS context
+  void TLSClient::closeSession() {
+    if(!sessionOpen) {
+      return;
+    }
+    mbedtls_ssl_close_notify(&ssl);
+    mbedtls_ssl_free(&ssl);
+    sessionOpen = false;
+    peeked = -1;
+  }
+
+  void TLSClient::stop() {
+    closeSession();
+    transport->stop();
+  }
+
+  uint8_t TLSClient::connected() {
+    return sessionOpen && (transport->connected() || available() > 0);
+  }
+
+  TLSClient::operator bool() {
+    return connected();
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Reading & writing
+
+  size_t TLSClient::write(uint8_t b) {
+    return write(&b, 1);
+  }
+
+  //write encrypts and sends `size` bytes, returning how many were sent
+  size_t TLSClient::write(const uint8_t *buf, size_t size) {
+    if(!sessionOpen) {
+      return 0;
+    }
+    size_t written = 0;
+    unsigned long started = millis();
+    while(written < size) {
+      int ret = mbedtls_ssl_write(&ssl, buf + written, size - written);
+      if(ret > 0) {
+        written += ret;
+        continue;
+      }
+      if((ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) && millis() - started < TLS_IO_TIMEOUT) {
+        WAIT_MS(10);
+        continue;
+      }
+      Serial.printf("[TLSClient.write] - Failed after %d out of %d bytes, err: -0x%x\n", written, size, -ret);
+      break;
+    }
+    return written;
+  }
+
+  //available gets how many decrypted bytes can be read without blocking
+  int TLSClient::available() {
+    if(!sessionOpen) {
+      return 0;
+    }
+    int avail = mbedtls_ssl_get_bytes_avail(&ssl);
+    //If nothing's decrypted yet but there's a record waiting, decrypt it
+    if(avail == 0 && transport->available() > 0) {
+      mbedtls_ssl_read(&ssl, NULL, 0);
+      avail = mbedtls_ssl_get_bytes_avail(&ssl);
+    }
+    return avail + (peeked >= 0 ? 1 : 0);
+  }
+
+  int TLSClient::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+  }
+
+  //read reads up to `size` decrypted bytes without blocking, returning how many
+  //were read, or -1 if there weren't any
+  int TLSClient::read(uint8_t *buf, size_t size) {
+    if(!sessionOpen || size == 0) {
+      return -1;
+    }
+
+    //Hand over the byte peek() took first
+    int got = 0;
+    if(peeked >= 0) {
+      buf[got++] = peeked;
+      peeked = -1;
+      if(got == size) {
+        return got;
+      }
+    }
+
+    int ret = mbedtls_ssl_read(&ssl, buf + got, size - got);
+    if(ret > 0) {
+      return got + ret;
+    }
+    if(ret != 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+      Serial.printf("[TLSClient.read] - Read failed, err: -0x%x\n", -ret);
+    }
+    return got > 0 ? got : -1;
+  }
+
+  int TLSClient::peek() {
+    if(peeked < 0) {
+      peeked = read();
+    }
+    return peeked;
+  }
+
+  void TLSClient::flush() {
+    transport->flush();
+  }
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Stats
+
+  unsigned long TLSClient::lastHandshakeMillis() {
+    return handshakeMillis;
+  }
+
+  bool TLSClient::lastHandshakeResumed() {
+    return handshakeResumed;
+  }
+#endif
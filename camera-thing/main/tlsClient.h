@@ -0,0 +1,64 @@
+// tlsClient.h
+// Exports a Client that speaks TLS over another Client (webClient, over WiFi
+// or GPRS), resuming the last TLS session where it can
+
+#ifndef TLS_CLIENT_USED
+  #define TLS_CLIENT_USED
+
+  #include <Arduino.h>
+  #include "mbedtls/ssl.h"
+  #include "mbedtls/entropy.h"
+  #include "mbedtls/ctr_drbg.h"
+  #include "mbedtls/x509_crt.h"
+
+  class TLSClient : public Client {
+    private:
+      Client *transport; //The Client carrying the encrypted bytes
+
+      bool configured = false; //Whether the config below has been set up yet
+      bool sessionOpen = false; //Whether ssl is set up for a connection
+      mbedtls_ssl_context ssl;
+      mbedtls_ssl_config conf;
+      mbedtls_entropy_context entropy;
+      mbedtls_ctr_drbg_context drbg;
+      mbedtls_x509_crt ca;
+
+      int peeked = -1; //A byte read by peek() that hasn't been read() yet
+
+      unsigned long handshakeMillis = 0; //How long the last handshake took
+      bool handshakeResumed = false; //Whether the last handshake was resumed
+
+      bool configure();
+      void closeSession();
+
+      //BIO callbacks used by mbedTLS to send & receive over the transport
+      static int sendCallback(void *ctx, const unsigned char *buf, size_t len);
+      static int recvCallback(void *ctx, unsigned char *buf, size_t len);
+
+    public:
+      //Constructor
+      TLSClient(Client &t);
+
+      //Client interface
+      int connect(IPAddress ip, uint16_t port);
+      int connect(const char *host, uint16_t port);
+      size_t write(uint8_t b);
+      size_t write(const uint8_t *buf, size_t size);
+      int available();
+      int read();
+      int read(uint8_t *buf, size_t size);
+      int peek();
+      void flush();
+      void stop();
+      uint8_t connected();
+      operator bool();
+      using Print::write;
+
+      //Handshake stats, for comparing full handshakes to resumed ones
+      unsigned long lastHandshakeMillis();
+      bool lastHandshakeResumed();
+
+      //Forgets the cached session, so the next handshake is a full one
+      static void forgetSession();
+  };
+#endif
@@ -0,0 +1,174 @@
+// trace.cpp
+// A tiny ring buffer of timestamped stage events, safe to write to from tasks
+// on either core
+
+#include <Arduino.h>
+#include "trace.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Config
+
+//How many events we keep before the oldest get overwritten
+#define TRACE_MAX_EVENTS 64
+//How many distinct stages we keep running totals for
+#define TRACE_MAX_STAGES 16
+
+/////////////////////////////////////////////////////////////////////////////
+// Storage
+
+struct traceRecord {
+  unsigned long time; //micros() when the event happened
+  const char* stage;  //Name of the stage, must be a string literal
+  char phase;         //'B' for begin, 'E' for end
+  uint8_t core;       //The core the event happened on
+};
+
+struct traceStage {
+  const char* stage;     //Name of the stage
+  unsigned long began;   //micros() of the last 'B' event
+  unsigned long count;   //How many times the stage has completed
+  unsigned long total;   //Total time spent in the stage in microseconds
+  unsigned long longest; //Longest time spent in the stage in microseconds
+  unsigned long dumped;  //What total was at the last traceDump()
+};
+
+traceRecord traceRecords[TRACE_MAX_EVENTS];
+int traceNext = 0;    //Index the next event will be written to
+int traceCount = 0;   //How many events are in traceRecords
+
+traceStage traceStages[TRACE_MAX_STAGES];
+int traceStageCount = 0;
+
+//micros() of the last traceDump(), so it can say what share of the time since
+//then each stage took
+unsigned long traceLastDump = 0;
+
+//Events can be recorded from both cores at once, so we guard with a spinlock
+portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+
+/////////////////////////////////////////////////////////////////////////////
+// Recording
+
+//findTraceStage gets the running totals for a stage, adding it if it's new.
+//Returns nullptr if we're already tracking too many stages. Must be called with
+//traceMux held.
+traceStage* findTraceStage(const char* stage) {
+  for(int i = 0; i < traceStageCount; i++) {
+    if(strcmp(traceStages[i].stage, stage) == 0) {
+      return &traceStages[i];
+    }
+  }
+  if(traceStageCount == TRACE_MAX_STAGES) {
+    return nullptr;
+  }
+  traceStages[traceStageCount] = traceStage{stage, 0, 0, 0, 0, 0};
+  return &traceStages[traceStageCount++];
+}
+
+//traceEvent records a stage beginning or ending.
+void traceEvent(const char* stage, char phase) {
+  unsigned long now = micros();
+
+  portENTER_CRITICAL(&traceMux);
+  traceRecords[traceNext] = traceRecord{now, stage, phase, (uint8_t)xPortGetCoreID()};
+  traceNext = (traceNext + 1) % TRACE_MAX_EVENTS;
+  if(traceCount < TRACE_MAX_EVENTS) {
+    traceCount++;
+  }
+
+  //Keep the running totals up to date
+  traceStage* totals = findTraceStage(stage);
+  if(totals != nullptr) {
+    if(phase == 'B') {
+      totals->began = now;
+    } else {
+      unsigned long took = now - totals->began;
+      totals->count++;
+      totals->total += took;
+      if(took > totals->longest) {
+        totals->longest = took;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&traceMux);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Output
+
+//traceDump outputs every recorded event in order, then the totals for each
+//stage, and how much of the time since the last dump each took (e.g. how long
+//the CPU was at full speed between photos), then forgets the events (but not
+//the totals).
+void traceDump() {
+  //Copy everything out so we don't hold the spinlock while printing
+  traceRecord records[TRACE_MAX_EVENTS];
+  traceStage stages[TRACE_MAX_STAGES];
+  portENTER_CRITICAL(&traceMux);
+  int count = traceCount;
+  int first = (traceNext - traceCount + TRACE_MAX_EVENTS) % TRACE_MAX_EVENTS;
+  for(int i = 0; i < count; i++) {
+    records[i] = traceRecords[(first + i) % TRACE_MAX_EVENTS];
+  }
+  traceCount = 0;
+  int stageCount = traceStageCount;
+  memcpy(stages, traceStages, sizeof(traceStage) * stageCount);
+  for(int i = 0; i < stageCount; i++) {
+    traceStages[i].dumped = traceStages[i].total;
+  }
+  unsigned long now = micros();
+  unsigned long window = now - traceLastDump;
+  traceLastDump = now;
+  portEXIT_CRITICAL(&traceMux);
+
+  Serial.println("[traceDump] -------------------------Events Start");
+  for(int i = 0; i < count; i++) {
+    Serial.printf(
+      "[traceDump] - %10lu us core%d %c %s\n",
+      records[i].time, records[i].core, records[i].phase, records[i].stage
+    );
+  }
+  Serial.println("[traceDump] -------------------------Events End");
+
+  for(int i = 0; i < stageCount; i++) {
+    traceStage* s = &stages[i];
+    if(s->count == 0) {
+      continue;
+    }
+    //In tenths of a percent, as fullSpeed's share of a long idle can be small
+    unsigned long share = window > 0 ? (uint64_t)(s->total - s->dumped) * 1000 / window : 0;
+    Serial.printf(
+      "[traceDump] - %s: %lu runs, avg %lu us, max %lu us, %lu.%lu%% of the last %lu ms\n",
+      s->stage, s->count, s->total / s->count, s->longest, share / 10, share % 10, window / 1000
+    );
+  }
+}
+
+//traceSummary writes the totals for each stage that's completed on one line,
+//for the telemetry sent with photos
+size_t traceSummary(char *buf, size_t len) {
+  traceStage stages[TRACE_MAX_STAGES];
+  portENTER_CRITICAL(&traceMux);
+  int stageCount = traceStageCount;
+  memcpy(stages, traceStages, sizeof(traceStage) * stageCount);
+  portEXIT_CRITICAL(&traceMux);
+
+  size_t used = 0;
+  buf[0] = '\0';
+  for(int i = 0; i < stageCount; i++) {
+    traceStage* s = &stages[i];
+    if(s->count == 0) {
+      continue;
+    }
+    int written = snprintf(
+      buf + used, len - used, "%s%s:%lu/%lu/%lu",
+      used > 0 ? "," : "", s->stage, s->count, s->total / s->count / 1000, s->longest / 1000
+    );
+    if(written < 0 || used + written >= len) {
+      buf[used] = '\0';
+      break;
+    }
+    used += written;
+  }
+  return used;
+}
@@ -0,0 +1,35 @@
+// trace.h
+// Exports lightweight tracing hooks for timing stages of the firmware across
+// both cores
+
+#ifndef TRACE_USED
+  #define TRACE_USED
+
+  #include <Arduino.h>
+
+  //Uncomment this to record when each stage (capture, encode, upload...) starts
+  //and ends, and on which core. The events are dumped to serial with
+  //TRACE_DUMP() so the timings themselves aren't skewed by serial output.
+  // #define TRACE_PIPELINE
+
+  //Records a stage starting or ending. `phase` is 'B' for begin or 'E' for end.
+  void traceEvent(const char* stage, char phase);
+
+  //Outputs recorded events and per-stage totals to serial, then clears them
+  void traceDump();
+
+  //Writes the per-stage totals to `buf` as stage:runs/average ms/longest ms,
+  //separated by commas, stopping at the first that doesn't fit in `len`.
+  //Returns the length written.
+  size_t traceSummary(char *buf, size_t len);
+
+  #ifdef TRACE_PIPELINE
+    #define TRACE_BEGIN(stage) traceEvent(stage, 'B');
+    #define TRACE_END(stage)   traceEvent(stage, 'E');
+    #define TRACE_DUMP()       traceDump();
+  #else
+    #define TRACE_BEGIN(stage)
+    #define TRACE_END(stage)
+    #define TRACE_DUMP()
+  #endif
+#endif
@@ -5,40 +5,60 @@
 #include "utils.h"
 #include "secrets.h"
 #include "esp_camera.h"
+#include "tweeter.h"
+#include "healthMonitor.h"
+#include "networkClient.h"
+#include "telemetry.h"
 
+//Requests to the tweeter go through tweeterClient. If TWEETER_TLS is defined
+//that's a TLSClient speaking TLS over the webClient, otherwise it's just the
+//webClient.
+#ifdef TWEETER_TLS
+  #include "tlsClient.h"
+  TLSClient secureClient(webClient);
+  Client &tweeterClient = secureClient;
+#else
+  Client &tweeterClient = webClient;
+#endif
+
+//tweeterClient is shared by the pipeline's network stage and the health
+//monitor, so every request is made while holding this lock.
+SemaphoreHandle_t tweeterClientLock() {
+  static SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+  return lock;
+}
 
-//Setup sets up the webClient that the queries to the tweeter service will be 
-//made by. It will setup a WiFi or GSM connection depending upon what values are
-//set in secrets.h
-#ifdef WIFI_SSID
-  #include "wifiClient.h"
-  bool setupNetworkConn() {
-    return setupWifiClient(60, 5);
+//The status code of the last response from the tweeter, or 0 if the last
+//request didn't get a response at all. Used to keep the health monitor updated.
+int lastResponseStatus = 0;
+
+//parseStatusLine gets the status code from an HTTP status line, e.g. 201 from
+//"HTTP/1.1 201 Created", or 0 if it isn't a status line.
+int parseStatusLine(String line) {
+  if(!line.startsWith("HTTP/1.")) {
+    return 0;
   }
-#endif
-#ifdef APN
-  #include "gprsClient.h"
-  bool setupNetworkConn() {
-    return setupGPRSClient();
+  int space = line.indexOf(' ');
+  if(space < 0) {
+    return 0;
   }
-#endif
+  return line.substring(space+1).toInt();
+}
 
-//checkTweeterAccessible queries the tweeter's /health endpoint and checks that
-//the response code provided is 200 OK within a given timeout, in milliseconds.
+//healthRequest queries the tweeter's /health endpoint and checks that the
+//response code provided is 200 OK within a given timeout, in milliseconds.
 //It returns false for fail, true for success.
-bool checkTweeterAccessible(int timeout) {
-  //If we're using GPRS we need to restart the SIM800L every time
-  #ifdef APN
-    bool setupGPRS = setupNetworkConn();
-    if (!setupGPRS) {
-      Serial.println("[checkTweeterAccessible] - Failed to setup GPRS connection :(");
-      return false;
-    }
-  #endif
+bool healthRequest(int timeout) {
+  //Get WiFi or 2G ready, whichever's quicker. Now & then a health check tries
+  //the one we're not using instead, to see if it's got quicker.
+  if (!prepareNetwork(true)) {
+    Serial.println("[checkTweeterAccessible] - Failed to setup network connection :(");
+    return false;
+  }
 
   //Connect to tweeter. If fails to connect, log & return false for fail
   Serial.printf("[checkTweeterAccessible] - Connecting to %s:%d...\n", TWEETER_HOST, TWEETER_PORT);
-  if (!webClient.connect(TWEETER_HOST, TWEETER_PORT)) {
+  if (!tweeterClient.connect(TWEETER_HOST, TWEETER_PORT)) {
     Serial.println("[checkTweeterAccessible] - Failed to connect :(");
     return false;
   }
@@ -55,15 +75,15 @@ bool checkTweeterAccessible(int timeout) {
 
   //Make request
   Serial.println("[checkTweeterAccessible] - Making request...");
-  webClient.print(req);
+  tweeterClient.print(req);
 
   //Handle timeout
   Serial.printf("[checkTweeterAccessible] - Awaiting response (read timeout %d ms)...", timeout);
   int startTime = millis();
-  while(webClient.available() == 0) {
+  while(tweeterClient.available() == 0) {
     if(millis() - startTime > timeout) {
       Serial.println(" timed out :(");
-      webClient.stop();
+      tweeterClient.stop();
       return false;
     }
     WAIT_MS(1000);
@@ -76,9 +96,9 @@ bool checkTweeterAccessible(int timeout) {
   //Will be set to true if the response states 200 OK
   bool success = false;
   //While there are bytes left to print...
-  while(webClient.available()) {
+  while(tweeterClient.available()) {
     //Get a line...
-    String line = webClient.readStringUntil('\r');
+    String line = tweeterClient.readStringUntil('\r');
     //Print it to serial...
     Serial.println(line);
     //Then check if it states 200 OK...
@@ -88,31 +108,167 @@ bool checkTweeterAccessible(int timeout) {
   }
   Serial.println("[makeTweetRequest] -------------------------Response End");
 
-  //Close wifi client
-  webClient.stop();
+  //Close client
+  tweeterClient.stop();
 
   //Return the success flag!
   return success;
 }
 
-//makeTweetRequest makes a request to the tweeter service's /tweet endpoint, 
-//with a provided latitude, longitude and JPEG data, within a given timeout and
+//waitForResponse waits up to `timeout` milliseconds for the tweeter to start
+//responding to a request. Returns false if it timed out. `caller` is used to
+//label the serial output.
+bool waitForResponse(const char *caller, int timeout) {
+  Serial.printf("[%s] - Awaiting response (read timeout %d ms)...", caller, timeout);
+  int startTime = millis();
+  for(int polls = 1; tweeterClient.available() == 0; polls++) {
+    if(millis() - startTime > timeout) {
+      Serial.println(" timed out :(");
+      tweeterClient.stop();
+      return false;
+    }
+    //Poll often, as a kept alive connection can get its response quickly,
+    //but only show progress every second
+    WAIT_MS(100);
+    if(polls % 10 == 0) {
+      Serial.print(".");
+    }
+  }
+  Serial.println(" success!");
+  return true;
+}
+
+//getJSONString gets the value of the string `key` from a line of JSON into
+//`value`, if the line contains it. Returns false if it doesn't.
+bool getJSONString(String line, const char *key, String *value) {
+  String field = String("\"") + key + "\":\"";
+  int i = line.indexOf(field);
+  if (i < 0) {
+    return false;
+  }
+  int start = i + field.length();
+  int end = line.indexOf("\"", start);
+  *value = line.substring(start, end);
+  return true;
+}
+
+//awaitTweetResponse waits up to `timeout` milliseconds for the tweeter to
+//respond to a photo being uploaded, outputs the response to serial and checks
+//that it states 201 Created, or 202 Accepted if the tweeter has queued the
+//photo to be tweeted later. The URL of the tweet is written to `tweetURL`, or
+//the ID of the queued job to `jobID`. Returns false for fail, true for
+//success. `caller` is used to label the serial output.
+bool awaitTweetResponse(const char *caller, int timeout, String *tweetURL, String *jobID) {
+  lastResponseStatus = 0;
+
+  //Await response from server with timeout
+  if (!waitForResponse(caller, timeout)) {
+    return false;
+  }
+
+  //Get response
+  Serial.printf("[%s] -------------------------Response Start\n", caller);
+  //While there are bytes left to print...
+  while(tweeterClient.available()) {
+    //Get a line...
+    String line = tweeterClient.readStringUntil('\r');
+    //Print it to serial...
+    Serial.println(line);
+    //Keep hold of the status to see if we succeeded...
+    if (lastResponseStatus == 0) {
+      lastResponseStatus = parseStatusLine(line);
+    }
+    //And get the tweet URL or job ID if it contains them
+    getJSONString(line, "TweetURL", tweetURL);
+    if (jobID != nullptr) {
+      getJSONString(line, "JobID", jobID);
+    }
+  }
+  Serial.printf("[%s] -------------------------Response End\n", caller);
+
+  //A 202 is no good without a job ID to check on
+  bool queued = lastResponseStatus == 202 && jobID != nullptr && jobID->length() > 0;
+  return lastResponseStatus == 201 || queued;
+}
+
+//jobRequest queries the tweeter's /job endpoint for a photo it queued to be
+//tweeted, waiting up to `timeout` milliseconds for a response. If the photo's
+//been tweeted, its URL is written to `tweetURL`. Returns the state of the job.
+tweetJobStatus jobRequest(int timeout, String jobID, String *tweetURL) {
+  //Get WiFi or 2G ready, whichever's quicker. If we're using 2G, we need to
+  //restart the SIM800L every time.
+  if (!prepareNetwork(false)) {
+    Serial.println("[checkTweetJob] - Failed to setup network connection :(");
+    return TWEET_JOB_UNKNOWN;
+  }
+
+  //Connect to tweeter
+  Serial.printf("[checkTweetJob] - Connecting to %s:%d...\n", TWEETER_HOST, TWEETER_PORT);
+  if (!tweeterClient.connect(TWEETER_HOST, TWEETER_PORT)) {
+    Serial.println("[checkTweetJob] - Failed to connect :(");
+    return TWEET_JOB_UNKNOWN;
+  }
+
+  //Make request
+  String req =
+    "GET /job?id=" + jobID + " HTTP/1.1\r\n"
+    "Host: " TWEETER_HOST "\r\n"
+    "Auth: " TWEETER_AUTH_TOKEN "\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+  Serial.printf("[checkTweetJob] - Checking on job %s...\n", jobID.c_str());
+  tweeterClient.print(req);
+  lastResponseStatus = 0;
+  if (!waitForResponse("checkTweetJob", timeout)) {
+    return TWEET_JOB_UNKNOWN;
+  }
+
+  //Get response
+  Serial.println("[checkTweetJob] -------------------------Response Start");
+  String jobStatus;
+  while(tweeterClient.available()) {
+    String line = tweeterClient.readStringUntil('\r');
+    Serial.println(line);
+    if (lastResponseStatus == 0) {
+      lastResponseStatus = parseStatusLine(line);
+    }
+    getJSONString(line, "Status", &jobStatus);
+    getJSONString(line, "TweetURL", tweetURL);
+  }
+  Serial.println("[checkTweetJob] -------------------------Response End");
+
+  //Close client
+  tweeterClient.stop();
+
+  //Work out what state the job's in
+  if (lastResponseStatus != 200) {
+    return TWEET_JOB_UNKNOWN;
+  }
+  if (jobStatus == "done") {
+    return TWEET_JOB_DONE;
+  }
+  if (jobStatus == "failed") {
+    return TWEET_JOB_FAILED;
+  }
+  return TWEET_JOB_PENDING;
+}
+
+//tweetRequest makes a request to the tweeter service's /tweet endpoint, with
+//a provided latitude, longitude and JPEG data, within a given timeout and
 //checks that the tweeter service returns a 201 Created response. If returns
 //false for fail, true for success. Pointers to the JPEG data are passed into
 //this function to save memory.
-bool makeTweetRequest(int timeout, String *tweetURL, bool geolocationEnabled, float lat, float lon, uint8_t **jpgBuffer, size_t *jpgLen) {
-  //If we're using GPRS we need to restart the SIM800L every time
-  #ifdef APN
-    bool setupGPRS = setupNetworkConn();
-    if (!setupGPRS) {
-      Serial.println("[checkTweeterAccessible] - Failed to setup GPRS connection :(");
-      return false;
-    }
-  #endif
+bool tweetRequest(int timeout, String *tweetURL, bool geolocationEnabled, float lat, float lon, uint8_t **jpgBuffer, size_t *jpgLen) {
+  //Get WiFi or 2G ready, whichever's quicker. If we're using 2G, we need to
+  //restart the SIM800L every time.
+  if (!prepareNetwork(false)) {
+    Serial.println("[checkTweeterAccessible] - Failed to setup network connection :(");
+    return false;
+  }
 
   //Connect to tweeter
   Serial.printf("[makeTweetRequest] - Connecting to %s:%d...\n", TWEETER_HOST, TWEETER_PORT);
-  if (!webClient.connect(TWEETER_HOST, TWEETER_PORT)) {
+  if (!tweeterClient.connect(TWEETER_HOST, TWEETER_PORT)) {
     Serial.println("[makeTweetRequest] - Failed to connect :(");
     return false;
   }
@@ -121,21 +277,21 @@ bool makeTweetRequest(int timeout, String *tweetURL, bool geolocationEnabled, fl
   char *reqHead =
     "POST /tweet?auth=" TWEETER_AUTH_TOKEN " HTTP/1.1\r\n"
     "Host: " TWEETER_HOST "\r\n"
-    "Content-Type: multipart/form-data;boundary=\"boundary\"\r\n"
+    "Content-Type: multipart/form-data;boundary=\"" TWEET_FORM_BOUNDARY "\"\r\n"
     "Content-Length: 39400\r\n" //Max possible size of 120*160*2B image + 1KB for everything else
     "Connection: close\r\n"
     "\r\n"
-    "--boundary\r\n"
+    "--" TWEET_FORM_BOUNDARY "\r\n"
     "Content-Disposition: form-data; name=\"image\"; filename=\"Untitled.jpg\"\r\n"
     "\r\n";
   char *reqTail = 
     "\r\n"
-    "--boundary--\r\n"
+    "--" TWEET_FORM_BOUNDARY "--\r\n"
     "\r\n";
 
   //Write request
   Serial.println("[makeTweetRequest] - Writing request...");
-  int headWritten = webClient.write((uint8_t*)reqHead, strlen(reqHead));
+  int headWritten = tweeterClient.write((uint8_t*)reqHead, strlen(reqHead));
   Serial.printf("[makeTweetRequest] - %d bytes out of %d written from request head\n", headWritten, strlen(reqHead));
 
   //Keep track of how many bytes we've written
@@ -156,7 +312,7 @@ bool makeTweetRequest(int timeout, String *tweetURL, bool geolocationEnabled, fl
     }
 
     //Write up to chunkSize bytes
-    int written = webClient.write((*jpgBuffer)+jpgWritten, chunkSize);
+    int written = tweeterClient.write((*jpgBuffer)+jpgWritten, chunkSize);
 
     //Add the number of bytes written to the accumulator for logging later
     jpgWritten += written;
@@ -177,51 +333,396 @@ bool makeTweetRequest(int timeout, String *tweetURL, bool geolocationEnabled, fl
   //Display JPEG bytes written and success in serial
   Serial.printf("[makeTweetRequest] - %d bytes out of %d written from JPEG\n", jpgWritten, *jpgLen);
 
-  int tailWritten = webClient.write((uint8_t*)reqTail, strlen(reqTail));
+  int tailWritten = tweeterClient.write((uint8_t*)reqTail, strlen(reqTail));
   Serial.printf("[makeTweetRequest] - %d bytes out of %d written from request tail\n", tailWritten, strlen(reqTail));
   Serial.println("[makeTweetRequest] - Finished writing request");
 
-    //Await response from server with timeout
-    Serial.printf("[makeTweetRequest] - Awaiting response (read timeout %d ms)...", timeout);
-    int startTime = millis();
-    while(webClient.available() == 0) {
-      if(millis() - startTime > timeout) {
-        Serial.println(" timed out :(");
-        webClient.stop();
-        return false;
-      }
-      WAIT_MS(1000);
-      Serial.print(".");
+  //Await and read the response
+  bool success = awaitTweetResponse("makeTweetRequest", timeout, tweetURL, nullptr);
+
+  //Close client
+  tweeterClient.stop();
+
+  //Return the success flag!
+  return success;
+}
+
+//If RAW_PHOTO_UPLOAD is defined, streamed photos are sent as a bare JPEG body
+//in a PUT to the tweeter's /photo endpoint, with the auth token & geolocation
+//in headers. That saves the multipart framing on every upload. Comment it out to
+//POST them to /tweet as a multipart form instead, e.g. for an older tweeter.
+#define RAW_PHOTO_UPLOAD
+
+//If ASYNC_TWEETS is defined, streamed photos ask the tweeter to respond as soon
+//as it has the photo, rather than once it's been recognised & tweeted. The
+//tweeter responds with a job ID that can be checked on for the tweet's URL.
+#define ASYNC_TWEETS
+#ifdef ASYNC_TWEETS
+  #define PREFER_HEADER "Prefer: respond-async\r\n"
+#else
+  #define PREFER_HEADER ""
+#endif
+
+//Max size of each chunk of a streamed request body
+#define MAX_CHUNK_SIZE 1024
+//Each chunk is prefixed with its size as 3 hex digits and CRLF, and suffixed
+//with CRLF. 3 hex digits is plenty for MAX_CHUNK_SIZE.
+#define CHUNK_PREFIX_SIZE 5
+#define CHUNK_SUFFIX_SIZE 2
+
+//writeChunk writes one chunk of a chunked request body. `chunk` must have
+//room for the prefix, `len` bytes of data starting at CHUNK_PREFIX_SIZE, and
+//the suffix. Writing it all in one go matters over GPRS, where every write is a
+//separate AT command to the SIM800L. Returns false if it couldn't all be sent.
+bool writeChunk(uint8_t *chunk, int len) {
+  char prefix[CHUNK_PREFIX_SIZE + 1];
+  snprintf(prefix, sizeof(prefix), "%03x\r\n", len);
+  memcpy(chunk, prefix, CHUNK_PREFIX_SIZE);
+  chunk[CHUNK_PREFIX_SIZE + len] = '\r';
+  chunk[CHUNK_PREFIX_SIZE + len + 1] = '\n';
+  int total = CHUNK_PREFIX_SIZE + len + CHUNK_SUFFIX_SIZE;
+  return tweeterClient.write(chunk, total) == total;
+}
+
+//streamedTweetRequest does the same as tweetRequest, but rather than taking a
+//buffer holding the whole JPEG, it pulls the JPEG from `source` while it's
+//still being encoded. We can't know the JPEG's size up front, so the body is
+//sent with chunked transfer encoding instead of a Content-Length. With
+//ASYNC_TWEETS, the tweeter may respond with a job ID rather than a tweet URL.
+//Any `labels` from the on-device classifier are sent along with the
+//geolocation. If `sourceIsForm`, the source gives the whole multipart body
+//rather than a single JPEG, which is how a burst's photos are sent together.
+bool streamedTweetRequest(int timeout, String *tweetURL, String *jobID, bool geolocationEnabled, float lat, float lon, const char *labels, bool sourceIsForm, jpegSource source, void *sourceArg) {
+  //Get WiFi or 2G ready, whichever's quicker. If we're using 2G, we need to
+  //restart the SIM800L every time.
+  if (!prepareNetwork(false)) {
+    Serial.println("[makeStreamedTweetRequest] - Failed to setup network connection :(");
+    return false;
+  }
+
+  //Connect to tweeter
+  Serial.printf("[makeStreamedTweetRequest] - Connecting to %s:%d...\n", TWEETER_HOST, TWEETER_PORT);
+  if (!tweeterClient.connect(TWEETER_HOST, TWEETER_PORT)) {
+    Serial.println("[makeStreamedTweetRequest] - Failed to connect :(");
+    return false;
+  }
+
+  //Construct request head, adding the geolocation if we've got one. For a raw
+  //upload, the JPEG is the whole body so there's no multipart head or tail.
+  //A source that writes the whole form itself can't be sent raw, and needs
+  //no head or tail either.
+  #ifdef RAW_PHOTO_UPLOAD
+    bool raw = !sourceIsForm;
+  #else
+    bool raw = false;
+  #endif
+  String reqHead;
+  const char *partHead = "";
+  const char *partTail = "";
+  if (raw) {
+    reqHead =
+      "PUT /photo HTTP/1.1\r\n"
+      "Host: " TWEETER_HOST "\r\n"
+      "Auth: " TWEETER_AUTH_TOKEN "\r\n";
+    if (geolocationEnabled) {
+      reqHead += "Lat: " + String(lat, 5) + "\r\nLong: " + String(lon, 5) + "\r\n";
+    }
+    if (labels[0] != '\0') {
+      reqHead += "Labels: " + String(labels) + "\r\n";
+    }
+    reqHead += telemetryHeader();
+    reqHead +=
+      "Content-Type: image/jpeg\r\n"
+      PREFER_HEADER
+      "Transfer-Encoding: chunked\r\n"
+      "Connection: close\r\n"
+      "\r\n";
+  } else {
+    reqHead = "POST /tweet?auth=" TWEETER_AUTH_TOKEN;
+    if (geolocationEnabled) {
+      reqHead += "&lat=" + String(lat, 5) + "&long=" + String(lon, 5);
+    }
+    if (labels[0] != '\0') {
+      reqHead += "&labels=" + String(labels);
+    }
+    reqHead +=
+      " HTTP/1.1\r\n"
+      "Host: " TWEETER_HOST "\r\n";
+    reqHead += telemetryHeader();
+    reqHead +=
+      "Content-Type: multipart/form-data;boundary=\"" TWEET_FORM_BOUNDARY "\"\r\n"
+      PREFER_HEADER
+      "Transfer-Encoding: chunked\r\n"
+      "Connection: close\r\n"
+      "\r\n";
+    if (!sourceIsForm) {
+      partHead =
+        "--" TWEET_FORM_BOUNDARY "\r\n"
+        "Content-Disposition: form-data; name=\"image\"; filename=\"Untitled.jpg\"\r\n"
+        "\r\n";
+      partTail =
+        "\r\n"
+        "--" TWEET_FORM_BOUNDARY "--\r\n"
+        "\r\n";
+    }
+  }
+
+  //Write request head
+  Serial.println("[makeStreamedTweetRequest] - Writing request...");
+  int headWritten = tweeterClient.write((uint8_t*)reqHead.c_str(), reqHead.length());
+  Serial.printf("[makeStreamedTweetRequest] - %d bytes out of %d written from request head\n", headWritten, reqHead.length());
+
+  //Everything in the body goes through this buffer one chunk at a time
+  uint8_t chunk[CHUNK_PREFIX_SIZE + MAX_CHUNK_SIZE + CHUNK_SUFFIX_SIZE];
+
+  //The multipart head is the first chunk. A zero length chunk would end the
+  //body, so it's skipped when there isn't one.
+  int partHeadLen = strlen(partHead);
+  memcpy(chunk + CHUNK_PREFIX_SIZE, partHead, partHeadLen);
+  if (partHeadLen > 0 && !writeChunk(chunk, partHeadLen)) {
+    Serial.println("[makeStreamedTweetRequest] - Failed to write multipart head :(");
+    tweeterClient.stop();
+    return false;
+  }
+
+  //Then the JPEG, as fast as the source can give it to us
+  int jpgWritten = 0;
+  int jpgChunks = 0;
+  unsigned long jpgStart = millis();
+  for(;;) {
+    int got = source(chunk + CHUNK_PREFIX_SIZE, MAX_CHUNK_SIZE, sourceArg);
+    if (got < 0) {
+      Serial.printf("[makeStreamedTweetRequest] - JPEG source failed after %d bytes :(\n", jpgWritten);
+      tweeterClient.stop();
+      return false;
+    }
+    if (got == 0) {
+      break;
+    }
+    if (!writeChunk(chunk, got)) {
+      Serial.printf("[makeStreamedTweetRequest] - Failed after writing %d bytes of JPEG\n", jpgWritten);
+      tweeterClient.stop();
+      return false;
     }
-    Serial.println(" success!");
-
-    //Get response
-    Serial.println("[makeTweetRequest] -------------------------Response Start");
-    //Will be set to true if the response states a tweet was created
-    bool success = false;
-    //While there are bytes left to print...
-    while(webClient.available()) {
-      //Get a line...
-      String line = webClient.readStringUntil('\r');
-      //Print it to serial...
-      Serial.println(line);
-      //Then check if it states we succeeded...
-      if (line == "HTTP/1.1 201 Created") {
-        success = true;
-      }
-    //And if it contains the tweet URL
-    int i = line.indexOf("\"TweetURL\":\"");
-    if (i >= 0) {
-      //12 = length of '"TweetURL":"'
-      int end = line.indexOf("\"",i+12);
-      *tweetURL = line.substring(i+12,end);
-    }
-    }
-    Serial.println("[makeTweetRequest] -------------------------Response End");
-
-  //Close wifi client
-  webClient.stop();
+    jpgWritten += got;
+    jpgChunks++;
+    Serial.printf("[makeStreamedTweetRequest] - Written %d bytes of JPEG; %d so far\n", got, jpgWritten);
+  }
+  unsigned long jpgMillis = max(millis() - jpgStart, 1UL);
+  Serial.printf("[makeStreamedTweetRequest] - %d bytes written from JPEG in %lu ms (%lu bytes/s)\n", jpgWritten, jpgMillis, jpgWritten * 1000UL / jpgMillis);
+
+  //Then the multipart tail, followed by the zero length chunk that ends the body
+  int partTailLen = strlen(partTail);
+  memcpy(chunk + CHUNK_PREFIX_SIZE, partTail, partTailLen);
+  bool tailWritten = partTailLen == 0 || writeChunk(chunk, partTailLen);
+  tailWritten = tailWritten && tweeterClient.print("0\r\n\r\n") == 5;
+  if (!tailWritten) {
+    Serial.println("[makeStreamedTweetRequest] - Failed to write request tail :(");
+    tweeterClient.stop();
+    return false;
+  }
+  Serial.println("[makeStreamedTweetRequest] - Finished writing request");
+
+  //Log how many bytes went on everything but the JPEG itself, for comparing
+  //raw uploads to multipart ones. The 5 is the zero length chunk at the end.
+  int chunkCount = jpgChunks + (partHeadLen > 0) + (partTailLen > 0);
+  int overhead = reqHead.length() + partHeadLen + partTailLen + chunkCount * (CHUNK_PREFIX_SIZE + CHUNK_SUFFIX_SIZE) + 5;
+  Serial.printf("[makeStreamedTweetRequest] - %d bytes of request overhead\n", overhead);
+
+  //Await and read the response
+  bool success = awaitTweetResponse("makeStreamedTweetRequest", timeout, tweetURL, jobID);
+
+  //Close client
+  tweeterClient.stop();
 
   //Return the success flag!
   return success;
+}
+
+//readResponse reads exactly one response from the tweeter, waiting up to
+//`timeout` milliseconds for it, so the connection can be kept alive for the
+//next request. Like awaitTweetResponse, it checks the response states 201
+//Created, or 202 Accepted with a job ID, and gets the tweet URL or job ID.
+//`keepAlive` is set false if the tweeter's closing the connection.
+bool readResponse(const char *caller, int timeout, String *tweetURL, String *jobID, bool *keepAlive) {
+  lastResponseStatus = 0;
+  if (!waitForResponse(caller, timeout)) {
+    *keepAlive = false;
+    return false;
+  }
+  tweeterClient.setTimeout(timeout);
+
+  //Read the status line & headers, up to the blank line that ends them
+  Serial.printf("[%s] -------------------------Response Start\n", caller);
+  int contentLength = -1;
+  for(;;) {
+    String line = tweeterClient.readStringUntil('\n');
+    line.trim();
+    if (line.length() == 0) {
+      break;
+    }
+    Serial.println(line);
+    if (lastResponseStatus == 0) {
+      lastResponseStatus = parseStatusLine(line);
+    }
+    line.toLowerCase();
+    if (line.startsWith("content-length:")) {
+      contentLength = line.substring(15).toInt();
+    } else if (line.startsWith("connection:") && line.indexOf("close") >= 0) {
+      *keepAlive = false;
+    }
+  }
+
+  //Then the body, which is a little JSON. Without a Content-Length, the body
+  //runs until the tweeter closes the connection.
+  char body[256];
+  int toRead = contentLength;
+  if (contentLength < 0 || contentLength >= (int)sizeof(body)) {
+    toRead = sizeof(body) - 1;
+    *keepAlive = false;
+  }
+  int got = toRead > 0 ? tweeterClient.readBytes(body, toRead) : 0;
+  body[got] = '\0';
+  Serial.println(body);
+  Serial.printf("[%s] -------------------------Response End\n", caller);
+  if (got < contentLength) {
+    *keepAlive = false;
+  }
+  getJSONString(body, "TweetURL", tweetURL);
+  if (jobID != nullptr) {
+    getJSONString(body, "JobID", jobID);
+  }
+
+  bool queued = lastResponseStatus == 202 && jobID != nullptr && jobID->length() > 0;
+  return lastResponseStatus == 201 || queued;
+}
+
+//batchTweetRequest PUTs a JPEG held in memory to /photo as part of a batch,
+//keeping the connection open afterwards for the next photo in the batch, and
+//reconnecting if the tweeter closed it. Only the first photo of a batch pays
+//for connecting (and the TLS handshake). Returns false for fail, true for
+//success.
+bool batchTweetRequest(int timeout, const uint8_t *jpg, size_t jpgLen, String *tweetURL, String *jobID) {
+  //Connect to tweeter if we're not still connected from the last photo
+  if (!tweeterClient.connected()) {
+    Serial.printf("[batchTweet] - Connecting to %s:%d...\n", TWEETER_HOST, TWEETER_PORT);
+    if (!tweeterClient.connect(TWEETER_HOST, TWEETER_PORT)) {
+      Serial.println("[batchTweet] - Failed to connect :(");
+      return false;
+    }
+  } else {
+    Serial.println("[batchTweet] - Reusing connection to the tweeter");
+  }
+
+  //We know the JPEG's size, so there's no need for chunked encoding
+  String reqHead =
+    "PUT /photo HTTP/1.1\r\n"
+    "Host: " TWEETER_HOST "\r\n"
+    "Auth: " TWEETER_AUTH_TOKEN "\r\n" +
+    telemetryHeader() +
+    "Content-Type: image/jpeg\r\n"
+    PREFER_HEADER
+    "Content-Length: " + String((unsigned long)jpgLen) + "\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+  int headWritten = tweeterClient.write((uint8_t*)reqHead.c_str(), reqHead.length());
+  size_t jpgWritten = 0;
+  while (headWritten == (int)reqHead.length() && jpgWritten < jpgLen) {
+    size_t written = tweeterClient.write(jpg + jpgWritten, min(jpgLen - jpgWritten, (size_t)MAX_CHUNK_SIZE));
+    if (written == 0) {
+      break;
+    }
+    jpgWritten += written;
+  }
+  if (headWritten != (int)reqHead.length() || jpgWritten < jpgLen) {
+    Serial.printf("[batchTweet] - Failed after writing %d out of %d bytes of JPEG\n", jpgWritten, jpgLen);
+    tweeterClient.stop();
+    return false;
+  }
+  Serial.printf("[batchTweet] - Written %d bytes of JPEG\n", jpgWritten);
+
+  //Await and read the response, closing the connection if it's no good anymore
+  bool keepAlive = true;
+  bool success = readResponse("batchTweet", timeout, tweetURL, jobID, &keepAlive);
+  if (!success || !keepAlive) {
+    tweeterClient.stop();
+  }
+  return success;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Entry points
+// These take the tweeterClient lock for the duration of the request, and let
+// the health monitor know how requests other than to /health went.
+
+//checkTweeterAccessible checks the tweeter's /health endpoint returns 200 OK
+//within `timeout` milliseconds. Returns false for fail, true for success.
+bool checkTweeterAccessible(int timeout) {
+  xSemaphoreTake(tweeterClientLock(), portMAX_DELAY);
+  bool success = healthRequest(timeout);
+  xSemaphoreGive(tweeterClientLock());
+  return success;
+}
+
+//makeTweetRequest posts a JPEG held in memory to /tweet, see tweetRequest.
+bool makeTweetRequest(int timeout, String *tweetURL, bool geolocationEnabled, float lat, float lon, uint8_t **jpgBuffer, size_t *jpgLen) {
+  xSemaphoreTake(tweeterClientLock(), portMAX_DELAY);
+  lastResponseStatus = 0;
+  bool success = tweetRequest(timeout, tweetURL, geolocationEnabled, lat, lon, jpgBuffer, jpgLen);
+  //Anything but a server error means the tweeter's up
+  recordTweeterHealth(lastResponseStatus > 0 && lastResponseStatus < 500);
+  xSemaphoreGive(tweeterClientLock());
+  return success;
+}
+
+//makeStreamedTweetRequest uploads a JPEG to the tweeter while it's still being
+//produced, see streamedTweetRequest.
+bool makeStreamedTweetRequest(int timeout, String *tweetURL, String *jobID, bool geolocationEnabled, float lat, float lon, const char *labels, bool sourceIsForm, jpegSource source, void *sourceArg) {
+  xSemaphoreTake(tweeterClientLock(), portMAX_DELAY);
+  lastResponseStatus = 0;
+  bool success = streamedTweetRequest(timeout, tweetURL, jobID, geolocationEnabled, lat, lon, labels, sourceIsForm, source, sourceArg);
+  recordTweeterHealth(lastResponseStatus > 0 && lastResponseStatus < 500);
+  xSemaphoreGive(tweeterClientLock());
+  return success;
+}
+
+//checkTweetJob checks on a photo the tweeter queued to be tweeted later, see
+//jobRequest.
+tweetJobStatus checkTweetJob(int timeout, String jobID, String *tweetURL) {
+  xSemaphoreTake(tweeterClientLock(), portMAX_DELAY);
+  lastResponseStatus = 0;
+  tweetJobStatus status = jobRequest(timeout, jobID, tweetURL);
+  recordTweeterHealth(lastResponseStatus > 0 && lastResponseStatus < 500);
+  xSemaphoreGive(tweeterClientLock());
+  return status;
+}
+
+
+//beginTweetBatch starts a batch of photos to upload with batchTweet over one
+//connection, setting up the network (once, rather than for every photo over
+//2G). The tweeterClient lock is held until endTweetBatch, which must be called
+//even if this fails. Returns false if the network couldn't be set up.
+bool beginTweetBatch() {
+  xSemaphoreTake(tweeterClientLock(), portMAX_DELAY);
+  if (!prepareNetwork(false)) {
+    Serial.println("[beginTweetBatch] - Failed to setup network connection :(");
+    return false;
+  }
+  return true;
+}
+
+//batchTweet uploads a photo as part of a batch, see batchTweetRequest
+bool batchTweet(int timeout, const uint8_t *jpg, size_t jpgLen, String *tweetURL, String *jobID) {
+  lastResponseStatus = 0;
+  bool success = batchTweetRequest(timeout, jpg, jpgLen, tweetURL, jobID);
+  recordTweeterHealth(lastResponseStatus > 0 && lastResponseStatus < 500);
+  return success;
+}
+
+//endTweetBatch closes the batch's connection, and over 2G turns the radio off
+//until it's next needed
+void endTweetBatch() {
+  tweeterClient.stop();
+  restNetwork();
+  xSemaphoreGive(tweeterClientLock());
 }
\ No newline at end of file
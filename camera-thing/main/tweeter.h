@@ -1,11 +1,38 @@
 // tweeter.h
 // Utils for querying the tweeter service's endpoints
 
-//Sets up the network conn we'll use
-bool setupNetworkConn();
-
 //Gets from /health
 bool checkTweeterAccessible(int timeout);
 
 //Posts to /tweet
-bool makeTweetRequest(int timeout, String *tweetURL, bool geolocationEnabled, float lat, float lon, uint8_t **jpgBuffer, size_t *jpgLen);
\ No newline at end of file
+bool makeTweetRequest(int timeout, String *tweetURL, bool geolocationEnabled, float lat, float lon, uint8_t **jpgBuffer, size_t *jpgLen);
+
+//The boundary between the parts of the forms posted to /tweet
+#define TWEET_FORM_BOUNDARY "boundary"
+
+//A jpegSource fills `buf` with up to `len` more bytes of a JPEG, returning how
+//many bytes it wrote, 0 once the JPEG is finished, or -1 if it failed.
+typedef int (*jpegSource)(uint8_t *buf, size_t len, void *arg);
+
+//Uploads a photo while the JPEG is still being produced. If the tweeter queues
+//it to be tweeted later, `jobID` is set rather than `tweetURL`. `labels` are
+//from the on-device classifier, and may be empty. If `sourceIsForm`, the source
+//writes the whole multipart/form-data body itself, with TWEET_FORM_BOUNDARY.
+bool makeStreamedTweetRequest(int timeout, String *tweetURL, String *jobID, bool geolocationEnabled, float lat, float lon, const char *labels, bool sourceIsForm, jpegSource source, void *sourceArg);
+
+//The states of a photo the tweeter has queued to be tweeted
+enum tweetJobStatus {
+  TWEET_JOB_UNKNOWN, //We couldn't find out
+  TWEET_JOB_PENDING, //It hasn't been tweeted yet
+  TWEET_JOB_DONE,    //It's been tweeted
+  TWEET_JOB_FAILED,  //It couldn't be tweeted
+};
+
+//Gets from /job, setting `tweetURL` once the job's done
+tweetJobStatus checkTweetJob(int timeout, String jobID, String *tweetURL);
+
+//Uploads photos held in memory to /photo over one kept alive connection.
+//Every beginTweetBatch must be followed by an endTweetBatch, even if it fails.
+bool beginTweetBatch();
+bool batchTweet(int timeout, const uint8_t *jpg, size_t jpgLen, String *tweetURL, String *jobID);
+void endTweetBatch();
\ No newline at end of file
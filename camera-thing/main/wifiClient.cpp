@@ -51,7 +51,7 @@
             success = true;
             break;
           }
-          if(trial == 59) {
+          if(trial == maxTrials - 1) {
             Serial.print(" failed! :(\n");
           }
         }
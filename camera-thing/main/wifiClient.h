@@ -4,9 +4,10 @@
 #ifndef WIFI_CLIENT_USED
   #define WIFI_CLIENT_USED
 
-  //Include WiFi.h so we can define webClient
+  //Include WiFi.h so we can define the WiFi transport for webClient (see
+  //networkClient.h)
   #include <WiFi.h>
-  inline WiFiClient webClient;
+  inline WiFiClient wifiWebClient;
 
   //Setup func
   bool setupWifiClient(int maxTrials, int maxAttempts);
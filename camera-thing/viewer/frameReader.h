@@ -0,0 +1,131 @@
+// frameReader.h
+// Picks the frames out of the bytes DEBUG_FRAME_STREAM sends over serial (see
+// main/frameStreamProtocol.h), along with the log text around them. Bytes can
+// be fed in however they arrive, and frames that don't check out are dropped.
+
+#ifndef FRAME_READER_USED
+  #define FRAME_READER_USED
+
+  #include <algorithm>
+  #include <cstdint>
+  #include <functional>
+  #include <vector>
+  #include "../main/frameStreamProtocol.h"
+
+  class FrameReader {
+   public:
+    //Called with log text between frames, and with each frame that checks out
+    std::function<void(const uint8_t *text, size_t len)> onText;
+    std::function<void(const frameInfo &info, const std::vector<uint8_t> &payload)> onFrame;
+
+    //How many frames were dropped because they didn't check out
+    int badFrames = 0;
+
+    //feed takes the next bytes off the serial port
+    void feed(const uint8_t *data, size_t len) {
+      buffer.insert(buffer.end(), data, data + len);
+      while(step()) {}
+    }
+
+   private:
+    enum readerState { SEARCHING, PAYLOAD, TRAILER };
+    readerState state = SEARCHING;
+    std::vector<uint8_t> buffer; //Bytes we haven't dealt with yet
+    frameInfo info;              //The frame we're reading
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> scratch;
+    size_t written = 0;          //How much of the payload we've got
+
+    //text passes the first `len` bytes of the buffer on as log text
+    void text(size_t len) {
+      if(len > 0 && onText) {
+        onText(buffer.data(), len);
+      }
+      buffer.erase(buffer.begin(), buffer.begin() + len);
+    }
+
+    //drop gives up on the frame we're reading
+    void drop() {
+      badFrames++;
+      state = SEARCHING;
+    }
+
+    //step deals with as much of the buffer as it can in the current state.
+    //Returns false once it needs more bytes.
+    bool step() {
+      switch(state) {
+        case SEARCHING: {
+          const char *magic = FRAME_STREAM_MAGIC;
+          auto found = std::search(buffer.begin(), buffer.end(), magic, magic + 4);
+          if(found == buffer.end()) {
+            //The end of the buffer might be the start of the magic
+            text(buffer.size() > 3 ? buffer.size() - 3 : 0);
+            return false;
+          }
+          text(found - buffer.begin());
+          if(buffer.size() < FRAME_STREAM_HEADER_SIZE) {
+            return false;
+          }
+          if(!parseFrameHeader(buffer.data(), &info)) {
+            text(1);
+            return true;
+          }
+          buffer.erase(buffer.begin(), buffer.begin() + FRAME_STREAM_HEADER_SIZE);
+          payload.assign(info.rawLength, 0);
+          written = 0;
+          state = PAYLOAD;
+          return true;
+        }
+
+        case PAYLOAD: {
+          size_t used;
+          if(info.encoding == FRAME_ENCODING_RAW) {
+            used = std::min(buffer.size(), payload.size() - written);
+            std::copy(buffer.begin(), buffer.begin() + used, payload.begin() + written);
+            written += used;
+          } else {
+            used = unpackBits(buffer.data(), buffer.size(), payload.data(), payload.size(), &written);
+            //A whole packet that won't fit means the frame's been mangled
+            if(used == 0 && buffer.size() >= 129 && written < payload.size()) {
+              drop();
+              return true;
+            }
+          }
+          buffer.erase(buffer.begin(), buffer.begin() + used);
+          if(written < payload.size()) {
+            return false;
+          }
+          if(info.encoding == FRAME_ENCODING_PACKBITS && info.layout == FRAME_LAYOUT_YUV422) {
+            scratch.resize(payload.size());
+            interleavePlanes(payload.data(), payload.size(), scratch.data());
+          }
+          state = TRAILER;
+          return true;
+        }
+
+        case TRAILER: {
+          if(buffer.size() < FRAME_STREAM_TRAILER_SIZE) {
+            return false;
+          }
+          if(memcmp(buffer.data(), FRAME_STREAM_END_MAGIC, 4) != 0) {
+            drop();
+            return true;
+          }
+          uint32_t crc = frameStreamCRCDone(frameStreamCRC(FRAME_STREAM_CRC_INIT, payload.data(), payload.size()));
+          bool good = getU32(buffer.data() + 4) == crc;
+          buffer.erase(buffer.begin(), buffer.begin() + FRAME_STREAM_TRAILER_SIZE);
+          if(!good) {
+            drop();
+            return true;
+          }
+          state = SEARCHING;
+          if(onFrame) {
+            onFrame(info, payload);
+          }
+          return true;
+        }
+      }
+      return false;
+    }
+  };
+#endif
@@ -0,0 +1,279 @@
+// frameViewer.cpp
+// Shows the frames a CameraThing streams over serial with DEBUG_FRAME_STREAM
+// (see main/frameStream.h), as they arrive, for checking a new unit's wiring
+// and focus. Frames are drawn in the terminal, two pixels to a character, and
+// can be saved as PPM/PGM files too. The CameraThing's log comes out on stderr
+// as usual. A standalone tool for Linux.
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "frameReader.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Usage
+
+const char *USAGE =
+  "Usage: frameViewer [options]\n"
+  "\n"
+  "  --port DEVICE     Serial port the CameraThing's on (default /dev/ttyUSB0)\n"
+  "  --baud BAUD       Its baud, FRAME_STREAM_BAUD (default 2000000)\n"
+  "  --input FILE      Read a recorded stream instead of a serial port, - for stdin\n"
+  "  --save DIR        Save each frame as DIR/frame-NNNNN.ppm (.pgm for just luma)\n"
+  "  --no-display      Don't draw frames in the terminal\n"
+  "  --frames N        Stop after N frames\n";
+
+//usageError outputs the usage and exits
+void usageError(const char *message) {
+  fprintf(stderr, "%s\n\n%s", message, USAGE);
+  exit(1);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Serial
+
+//baudConstant gets termios's constant for a baud, or 0 if it hasn't got one
+speed_t baudConstant(long baud) {
+  switch(baud) {
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    case 1500000: return B1500000;
+    case 2000000: return B2000000;
+    case 3000000: return B3000000;
+  }
+  return 0;
+}
+
+//openSerial opens a serial port raw at a baud, returning its file descriptor
+//or -1 if it can't
+int openSerial(const char *port, long baud) {
+  speed_t speed = baudConstant(baud);
+  if(speed == 0) {
+    fprintf(stderr, "[openSerial] - Unsupported baud %ld :(\n", baud);
+    return -1;
+  }
+  int fd = open(port, O_RDONLY | O_NOCTTY);
+  if(fd < 0) {
+    fprintf(stderr, "[openSerial] - Couldn't open %s: %s :(\n", port, strerror(errno));
+    return -1;
+  }
+  termios tty;
+  if(tcgetattr(fd, &tty) != 0) {
+    fprintf(stderr, "[openSerial] - %s isn't a serial port: %s :(\n", port, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  cfmakeraw(&tty);
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cc[VMIN] = 1;
+  tty.c_cc[VTIME] = 0;
+  if(tcsetattr(fd, TCSANOW, &tty) != 0) {
+    fprintf(stderr, "[openSerial] - Couldn't set up %s: %s :(\n", port, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Frames
+
+//pixelRGB gets pixel (x, y) of a frame's payload as RGB
+void pixelRGB(const frameInfo &info, const std::vector<uint8_t> &payload, int x, int y, uint8_t *rgb) {
+  if(info.layout == FRAME_LAYOUT_LUMA) {
+    rgb[0] = rgb[1] = rgb[2] = payload[y * info.width + x];
+    return;
+  }
+  const uint8_t *pair = payload.data() + (y * info.width + (x & ~1)) * 2;
+  float luma = pair[x & 1 ? 2 : 0];
+  float u = pair[1] - 128.0f;
+  float v = pair[3] - 128.0f;
+  float channels[3] = {luma + 1.402f * v, luma - 0.344f * u - 0.714f * v, luma + 1.772f * u};
+  for(int c = 0; c < 3; c++) {
+    rgb[c] = channels[c] < 0 ? 0 : (channels[c] > 255 ? 255 : (uint8_t)channels[c]);
+  }
+}
+
+//saveFrame writes a frame out as a PPM, or a PGM if it's just luma
+bool saveFrame(const std::string &dir, const frameInfo &info, const std::vector<uint8_t> &payload) {
+  bool grey = info.layout == FRAME_LAYOUT_LUMA;
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/frame-%05u.%s", dir.c_str(), info.sequence, grey ? "pgm" : "ppm");
+  FILE *file = fopen(path, "wb");
+  if(file == nullptr) {
+    fprintf(stderr, "[saveFrame] - Couldn't write %s: %s :(\n", path, strerror(errno));
+    return false;
+  }
+  fprintf(file, "P%d\n%d %d\n255\n", grey ? 5 : 6, info.width, info.height);
+  for(int y = 0; y < info.height; y++) {
+    for(int x = 0; x < info.width; x++) {
+      uint8_t rgb[3];
+      pixelRGB(info, payload, x, y, rgb);
+      fwrite(rgb, 1, grey ? 1 : 3, file);
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+//drawFrame draws a frame at the top of the terminal with 24 bit colour, two
+//pixels to a character (the top one as the upper half block's colour and the
+//bottom one as the background), skipping pixels if the terminal's too narrow
+void drawFrame(const frameInfo &info, const std::vector<uint8_t> &payload, const char *status) {
+  winsize terminal;
+  int columns = 80;
+  if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &terminal) == 0 && terminal.ws_col > 0) {
+    columns = terminal.ws_col;
+  }
+  int step = (info.width + columns - 1) / columns;
+
+  std::string out = "\x1b[H";
+  char cell[64];
+  for(int y = 0; y + step < info.height; y += 2 * step) {
+    for(int x = 0; x < info.width; x += step) {
+      uint8_t top[3], bottom[3];
+      pixelRGB(info, payload, x, y, top);
+      pixelRGB(info, payload, x, y + step, bottom);
+      snprintf(cell, sizeof(cell), "\x1b[38;2;%d;%d;%dm\x1b[48;2;%d;%d;%dm\xe2\x96\x80",
+        top[0], top[1], top[2], bottom[0], bottom[1], bottom[2]);
+      out += cell;
+    }
+    out += "\x1b[0m\n";
+  }
+  out += status;
+  out += "\x1b[K\n";
+  fwrite(out.data(), 1, out.size(), stdout);
+  fflush(stdout);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Main
+
+int main(int argc, char **argv) {
+  //Defaults
+  std::string port = "/dev/ttyUSB0";
+  long baud = 2000000;
+  std::string input;
+  std::string saveDir;
+  bool display = isatty(STDOUT_FILENO);
+  long maxFrames = -1;
+
+  //Parse the args
+  for(int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = [&]() -> const char * {
+      if(i + 1 >= argc) {
+        usageError(("Missing value for " + arg).c_str());
+      }
+      return argv[++i];
+    };
+    if(arg == "--port") {
+      port = value();
+    } else if(arg == "--baud") {
+      baud = atol(value());
+    } else if(arg == "--input") {
+      input = value();
+    } else if(arg == "--save") {
+      saveDir = value();
+    } else if(arg == "--no-display") {
+      display = false;
+    } else if(arg == "--frames") {
+      maxFrames = atol(value());
+    } else if(arg == "--help" || arg == "-h") {
+      printf("%s", USAGE);
+      return 0;
+    } else {
+      usageError(("Unknown option " + arg).c_str());
+    }
+  }
+
+  //Open whatever we're reading frames from
+  int fd;
+  if(input == "-") {
+    fd = STDIN_FILENO;
+  } else if(!input.empty()) {
+    fd = open(input.c_str(), O_RDONLY);
+    if(fd < 0) {
+      fprintf(stderr, "[main] - Couldn't open %s: %s :(\n", input.c_str(), strerror(errno));
+      return 1;
+    }
+  } else {
+    fd = openSerial(port.c_str(), baud);
+    if(fd < 0) {
+      return 1;
+    }
+    fprintf(stderr, "[main] - Reading frames from %s at %ld baud\n", port.c_str(), baud);
+  }
+  if(display) {
+    printf("\x1b[2J");
+  }
+
+  //Show or save each frame as it comes, keeping track of the frame rate and
+  //how fast bytes are arriving over the last few frames
+  auto started = std::chrono::steady_clock::now();
+  auto windowStart = started;
+  long frames = 0, windowFrames = 0;
+  size_t bytes = 0, windowBytes = 0;
+  double fps = 0, bytesPerSecond = 0;
+  FrameReader reader;
+  reader.onText = [](const uint8_t *text, size_t len) {
+    fwrite(text, 1, len, stderr);
+  };
+  reader.onFrame = [&](const frameInfo &info, const std::vector<uint8_t> &payload) {
+    frames++;
+    windowFrames++;
+    auto now = std::chrono::steady_clock::now();
+    double window = std::chrono::duration<double>(now - windowStart).count();
+    if(window >= 2 || windowFrames == 1) {
+      fps = windowFrames > 1 ? windowFrames / window : fps;
+      bytesPerSecond = window > 0 ? windowBytes / window : 0;
+      windowStart = now;
+      windowFrames = 0;
+      windowBytes = 0;
+    }
+    if(!saveDir.empty()) {
+      saveFrame(saveDir, info, payload);
+    }
+    char status[256];
+    snprintf(status, sizeof(status), "frame %u (%dx%d %s %s) at %lu ms, %.1f fps, %.0f bytes/s, %d dropped",
+      info.sequence, info.width, info.height,
+      info.layout == FRAME_LAYOUT_LUMA ? "luma" : "YUV422",
+      info.encoding == FRAME_ENCODING_PACKBITS ? "PackBits" : "raw",
+      (unsigned long)info.millis, fps, bytesPerSecond, reader.badFrames);
+    if(display) {
+      drawFrame(info, payload, status);
+    } else {
+      fprintf(stderr, "[main] - %s\n", status);
+    }
+  };
+
+  uint8_t chunk[4096];
+  while(maxFrames < 0 || frames < maxFrames) {
+    ssize_t got = read(fd, chunk, sizeof(chunk));
+    if(got < 0 && errno == EINTR) {
+      continue;
+    }
+    if(got <= 0) {
+      break;
+    }
+    bytes += got;
+    windowBytes += got;
+    reader.feed(chunk, got);
+  }
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  fprintf(stderr, "[main] - %ld frames (%d dropped) from %zu bytes in %.1f s\n", frames, reader.badFrames, bytes, seconds);
+  return 0;
+}
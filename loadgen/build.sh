@@ -0,0 +1 @@
+g++ -std=c++17 -O2 -Wall -pthread -o loadgen main.cpp device.cpp stats.cpp fakeRecogniser.cpp
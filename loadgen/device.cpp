@@ -0,0 +1,287 @@
+// device.cpp
+// A simulated CameraThing. Requests are byte-for-byte the same as the ones
+// tweeter.cpp makes, written in the same sized pieces, with each write paced
+// to the speed of the device's link.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "device.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Config
+
+//Max size of each write of the JPEG, the same as tweeter.cpp
+#define MAX_CHUNK_SIZE 1024
+
+//Link profiles. 2G is a SIM800L on GPRS, where every write is a round trip of
+//AT commands; WiFi is the ESP32 on a decent access point.
+const LinkProfile LINK_PROFILES[] = {
+  {"2g", 2500, 250, 2000},
+  {"wifi", 500000, 2, 30},
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// Utils
+
+typedef std::chrono::steady_clock steadyClock;
+
+//millisSince is how many milliseconds have passed since `start`
+double millisSince(steadyClock::time_point start) {
+  return std::chrono::duration<double, std::milli>(steadyClock::now() - start).count();
+}
+
+//secondsFromNow is the time `seconds` seconds from now
+steadyClock::time_point secondsFromNow(double seconds) {
+  return steadyClock::now() + std::chrono::duration_cast<steadyClock::duration>(std::chrono::duration<double>(seconds));
+}
+
+//findLinkProfile finds a link profile by name. Returns false if there isn't one.
+bool findLinkProfile(const char *name, LinkProfile *profile) {
+  for(const LinkProfile &p : LINK_PROFILES) {
+    if(strcmp(p.name, name) == 0) {
+      *profile = p;
+      return true;
+    }
+  }
+  return false;
+}
+
+//openConnection connects to the tweeter, taking as long as the link would.
+//Returns the socket, or -1 if it couldn't connect.
+int openConnection(const DeviceConfig &config) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(config.link.connectMillis));
+
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addrs;
+  std::string port = std::to_string(config.port);
+  if(getaddrinfo(config.host.c_str(), port.c_str(), &hints, &addrs) != 0) {
+    return -1;
+  }
+  int fd = -1;
+  for(addrinfo *addr = addrs; addr != nullptr; addr = addr->ai_next) {
+    fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if(fd < 0) {
+      continue;
+    }
+    if(connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addrs);
+  if(fd < 0) {
+    return -1;
+  }
+
+  //Don't wait forever for a response
+  timeval timeout;
+  timeout.tv_sec = (time_t)config.timeoutSeconds;
+  timeout.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+//pacedWrite writes `len` bytes in one go, then waits as long as they'd take to
+//get through the link. Returns false if they couldn't all be written.
+bool pacedWrite(int fd, const DeviceConfig &config, const void *buf, size_t len) {
+  const uint8_t *bytes = (const uint8_t*)buf;
+  size_t written = 0;
+  while(written < len) {
+    ssize_t n = send(fd, bytes + written, len - written, MSG_NOSIGNAL);
+    if(n <= 0) {
+      return false;
+    }
+    written += n;
+  }
+  int millis = config.link.writeMillis + (int)(len * 1000 / config.link.bytesPerSecond);
+  std::this_thread::sleep_for(std::chrono::milliseconds(millis));
+  return true;
+}
+
+//pacedWrite for strings
+bool pacedWrite(int fd, const DeviceConfig &config, const std::string &str) {
+  return pacedWrite(fd, config, str.data(), str.size());
+}
+
+//writeChunk writes one chunk of a chunked request body in a single write, the
+//same as writeChunk in tweeter.cpp
+bool writeChunk(int fd, const DeviceConfig &config, const void *data, size_t len) {
+  char prefix[8];
+  snprintf(prefix, sizeof(prefix), "%03zx\r\n", len);
+  std::string chunk = prefix;
+  chunk.append((const char*)data, len);
+  chunk += "\r\n";
+  return pacedWrite(fd, config, chunk);
+}
+
+//readStatus reads the whole response, which ends when the tweeter closes the
+//connection, and returns its status code, or 0 if there wasn't one
+int readStatus(int fd) {
+  std::string response;
+  char buf[1024];
+  for(;;) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if(n <= 0) {
+      break;
+    }
+    response.append(buf, n);
+  }
+  int status = 0;
+  if(sscanf(response.c_str(), "HTTP/1.%*d %d", &status) != 1) {
+    return 0;
+  }
+  return status;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Requests
+
+//healthRequest makes the same request to /health as healthRequest in
+//tweeter.cpp. Returns true if it got a 200.
+bool healthRequest(const DeviceConfig &config) {
+  int fd = openConnection(config);
+  if(fd < 0) {
+    return false;
+  }
+  std::string req =
+    "GET /health HTTP/1.1\r\n"
+    "Host: " + config.host + "\r\n"
+    "Connection: close\r\n\r\n";
+  bool success = pacedWrite(fd, config, req) && readStatus(fd) == 200;
+  close(fd);
+  return success;
+}
+
+//uploadRequest uploads the photo the same way tweeter.cpp does in
+//`config.mode`. Returns true if it got a 201, or a 202 if async.
+bool uploadRequest(const DeviceConfig &config, float lat, float lon) {
+  int fd = openConnection(config);
+  if(fd < 0) {
+    return false;
+  }
+  const std::vector<uint8_t> &jpeg = *config.jpeg;
+  const char *prefer = config.async ? "Prefer: respond-async\r\n" : "";
+  char geo[64] = "";
+
+  //Write the request the way the firmware would
+  bool written = true;
+  if(config.mode == UPLOAD_BUFFERED) {
+    //makeTweetRequest: head, then the JPEG 1KB at a time, then the tail
+    std::string head =
+      "POST /tweet?auth=" + config.authToken + " HTTP/1.1\r\n"
+      "Host: " + config.host + "\r\n"
+      "Content-Type: multipart/form-data;boundary=\"boundary\"\r\n"
+      "Content-Length: 39400\r\n"
+      "Connection: close\r\n"
+      "\r\n"
+      "--boundary\r\n"
+      "Content-Disposition: form-data; name=\"image\"; filename=\"Untitled.jpg\"\r\n"
+      "\r\n";
+    written = pacedWrite(fd, config, head);
+    for(size_t i = 0; written && i < jpeg.size(); i += MAX_CHUNK_SIZE) {
+      written = pacedWrite(fd, config, jpeg.data() + i, std::min((size_t)MAX_CHUNK_SIZE, jpeg.size() - i));
+    }
+    written = written && pacedWrite(fd, config, "\r\n--boundary--\r\n\r\n");
+  } else {
+    //makeStreamedTweetRequest: head, then the body as chunks of up to 1KB
+    std::string head;
+    const char *partHead = "";
+    const char *partTail = "";
+    if(config.mode == UPLOAD_RAW) {
+      if(config.geolocation) {
+        snprintf(geo, sizeof(geo), "Lat: %.5f\r\nLong: %.5f\r\n", lat, lon);
+      }
+      head =
+        "PUT /photo HTTP/1.1\r\n"
+        "Host: " + config.host + "\r\n"
+        "Auth: " + config.authToken + "\r\n" +
+        geo +
+        "Content-Type: image/jpeg\r\n" +
+        prefer +
+        "Transfer-Encoding: chunked\r\n"
+        "Connection: close\r\n"
+        "\r\n";
+    } else {
+      if(config.geolocation) {
+        snprintf(geo, sizeof(geo), "&lat=%.5f&long=%.5f", lat, lon);
+      }
+      head =
+        "POST /tweet?auth=" + config.authToken + geo + " HTTP/1.1\r\n"
+        "Host: " + config.host + "\r\n"
+        "Content-Type: multipart/form-data;boundary=\"boundary\"\r\n" +
+        prefer +
+        "Transfer-Encoding: chunked\r\n"
+        "Connection: close\r\n"
+        "\r\n";
+      partHead =
+        "--boundary\r\n"
+        "Content-Disposition: form-data; name=\"image\"; filename=\"Untitled.jpg\"\r\n"
+        "\r\n";
+      partTail =
+        "\r\n"
+        "--boundary--\r\n"
+        "\r\n";
+    }
+    written = pacedWrite(fd, config, head);
+    if(written && strlen(partHead) > 0) {
+      written = writeChunk(fd, config, partHead, strlen(partHead));
+    }
+    for(size_t i = 0; written && i < jpeg.size(); i += MAX_CHUNK_SIZE) {
+      written = writeChunk(fd, config, jpeg.data() + i, std::min((size_t)MAX_CHUNK_SIZE, jpeg.size() - i));
+    }
+    if(written && strlen(partTail) > 0) {
+      written = writeChunk(fd, config, partTail, strlen(partTail));
+    }
+    written = written && pacedWrite(fd, config, "0\r\n\r\n");
+  }
+
+  int status = written ? readStatus(fd) : 0;
+  close(fd);
+  return status == 201 || (config.async && status == 202);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Device
+
+//runDevice takes photos at random intervals averaging `thinkSeconds`, and
+//checks the tweeter's health every `healthSeconds`, until `running` is false.
+//Like the firmware, it only makes one request at a time.
+void runDevice(int id, const DeviceConfig &config, FleetStats *stats, std::atomic<bool> *running) {
+  std::mt19937 random(id);
+  std::exponential_distribution<double> think(1.0 / config.thinkSeconds);
+  std::uniform_real_distribution<double> jitter(0, 1);
+
+  //Spread the devices out so they don't all start at once, and give each one
+  //its own spot on the map
+  steadyClock::time_point nextPhoto = secondsFromNow(jitter(random) * config.thinkSeconds);
+  steadyClock::time_point nextHealth = secondsFromNow(jitter(random) * config.healthSeconds);
+  float lat = 53.0f + jitter(random);
+  float lon = -1.5f + jitter(random);
+
+  while(*running) {
+    steadyClock::time_point now = steadyClock::now();
+    if(now >= nextPhoto) {
+      steadyClock::time_point start = now;
+      bool success = uploadRequest(config, lat, lon);
+      stats->upload.record(millisSince(start), success);
+      nextPhoto = secondsFromNow(think(random));
+    } else if(config.healthSeconds > 0 && now >= nextHealth) {
+      steadyClock::time_point start = now;
+      bool success = healthRequest(config);
+      stats->health.record(millisSince(start), success);
+      nextHealth = secondsFromNow(config.healthSeconds);
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+  }
+}
@@ -0,0 +1,53 @@
+// device.h
+// Exports a simulated CameraThing, which uploads photos and checks the
+// tweeter's health over a simulated link the same way the firmware does
+
+#ifndef DEVICE_USED
+  #define DEVICE_USED
+
+  #include <atomic>
+  #include <cstdint>
+  #include <string>
+  #include <vector>
+  #include "stats.h"
+
+  //How fast a device's link to the tweeter is
+  struct LinkProfile {
+    const char *name;
+    int bytesPerSecond; //Upload speed
+    int writeMillis;    //Extra time each write takes, e.g. for the SIM800L's AT+CIPSEND
+    int connectMillis;  //Extra time opening a connection takes
+  };
+
+  //Finds a link profile by name, returns false if there isn't one
+  bool findLinkProfile(const char *name, LinkProfile *profile);
+
+  //The ways the firmware can upload photos, see tweeter.cpp
+  enum UploadMode {
+    UPLOAD_BUFFERED, //makeTweetRequest: multipart POST to /tweet with a Content-Length
+    UPLOAD_STREAMED, //makeStreamedTweetRequest: chunked multipart POST to /tweet
+    UPLOAD_RAW,      //makeStreamedTweetRequest with RAW_PHOTO_UPLOAD: chunked PUT to /photo
+  };
+
+  struct DeviceConfig {
+    std::string host;
+    int port;
+    std::string authToken;
+    UploadMode mode;
+    bool async;            //Whether to send Prefer: respond-async, like ASYNC_TWEETS
+    bool geolocation;      //Whether to send a lat & long with each photo
+    LinkProfile link;
+    double thinkSeconds;   //Mean time between photos
+    double healthSeconds;  //Time between /health checks, 0 for none
+    double timeoutSeconds; //How long to wait for a response
+    const std::vector<uint8_t> *jpeg; //The photo every device uploads
+  };
+
+  struct FleetStats {
+    LatencyStats upload;
+    LatencyStats health;
+  };
+
+  //Runs a device until `running` is false
+  void runDevice(int id, const DeviceConfig &config, FleetStats *stats, std::atomic<bool> *running);
+#endif
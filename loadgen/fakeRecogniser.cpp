@@ -0,0 +1,138 @@
+// fakeRecogniser.cpp
+// A minimal HTTP server that answers like go-tensorflow-image-recognition's
+// /recognize endpoint. Connections are kept alive, as the tweeter reuses them.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <netinet/in.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "fakeRecogniser.h"
+
+//The response to every image
+const char *FAKE_LABELS = "{\"filename\":\"Untitled.jpg\",\"labels\":[{\"label\":\"load test\",\"probability\":1}]}";
+
+//Reads from a connection into `buffered` until it holds at least `len` bytes.
+//Returns false if the connection closed first.
+bool fillTo(int fd, std::string &buffered, size_t len) {
+  char buf[4096];
+  while(buffered.size() < len) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if(n <= 0) {
+      return false;
+    }
+    buffered.append(buf, n);
+  }
+  return true;
+}
+
+//Reads from a connection into `buffered` until it contains `delim`. Returns
+//the position of `delim`, or std::string::npos if the connection closed first.
+size_t fillUntil(int fd, std::string &buffered, const char *delim) {
+  char buf[4096];
+  size_t pos;
+  while((pos = buffered.find(delim)) == std::string::npos) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if(n <= 0) {
+      return std::string::npos;
+    }
+    buffered.append(buf, n);
+  }
+  return pos;
+}
+
+//readRequest reads one request off a connection, throwing away the body.
+//Returns false once the connection's closed.
+bool readRequest(int fd, std::string &buffered) {
+  size_t headEnd = fillUntil(fd, buffered, "\r\n\r\n");
+  if(headEnd == std::string::npos) {
+    return false;
+  }
+  std::string head = buffered.substr(0, headEnd + 2);
+  buffered.erase(0, headEnd + 4);
+
+  //Find how the body's framed. Header names are case insensitive.
+  bool chunked = false;
+  size_t contentLength = 0;
+  size_t lineStart = head.find("\r\n") + 2;
+  while(lineStart < head.size()) {
+    size_t lineEnd = head.find("\r\n", lineStart);
+    std::string line = head.substr(lineStart, lineEnd - lineStart);
+    if(strncasecmp(line.c_str(), "Content-Length:", 15) == 0) {
+      contentLength = strtoul(line.c_str() + 15, nullptr, 10);
+    } else if(strncasecmp(line.c_str(), "Transfer-Encoding:", 18) == 0 && line.find("chunked") != std::string::npos) {
+      chunked = true;
+    }
+    lineStart = lineEnd + 2;
+  }
+
+  //Throw the body away
+  if(!chunked) {
+    if(!fillTo(fd, buffered, contentLength)) {
+      return false;
+    }
+    buffered.erase(0, contentLength);
+    return true;
+  }
+  for(;;) {
+    size_t sizeEnd = fillUntil(fd, buffered, "\r\n");
+    if(sizeEnd == std::string::npos) {
+      return false;
+    }
+    size_t size = strtoul(buffered.c_str(), nullptr, 16);
+    if(!fillTo(fd, buffered, sizeEnd + 2 + size + 2)) {
+      return false;
+    }
+    buffered.erase(0, sizeEnd + 2 + size + 2);
+    if(size == 0) {
+      return true;
+    }
+  }
+}
+
+//serveConnection answers every request on a connection until it's closed
+void serveConnection(int fd, int delayMillis) {
+  std::string buffered;
+  while(readRequest(fd, buffered)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(delayMillis));
+    std::string response =
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Type: application/json\r\n"
+      "Content-Length: " + std::to_string(strlen(FAKE_LABELS)) + "\r\n"
+      "\r\n" + FAKE_LABELS;
+    if(send(fd, response.data(), response.size(), MSG_NOSIGNAL) != (ssize_t)response.size()) {
+      break;
+    }
+  }
+  close(fd);
+}
+
+//runFakeRecogniser serves forever, with a thread per connection
+bool runFakeRecogniser(int port, int delayMillis) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int yes = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if(bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 64) != 0) {
+    printf("[runFakeRecogniser] - Couldn't listen on port %d :(\n", port);
+    close(listener);
+    return false;
+  }
+  printf("[runFakeRecogniser] - Serving /recognize on port %d with a %d ms delay\n", port, delayMillis);
+
+  for(;;) {
+    int fd = accept(listener, nullptr, nullptr);
+    if(fd < 0) {
+      continue;
+    }
+    std::thread(serveConnection, fd, delayMillis).detach();
+  }
+}
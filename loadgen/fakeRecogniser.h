@@ -0,0 +1,11 @@
+// fakeRecogniser.h
+// Exports a stand-in for go-tensorflow-image-recognition, so the tweeter can
+// be load tested without TensorFlow setting the pace
+
+#ifndef FAKE_RECOGNISER_USED
+  #define FAKE_RECOGNISER_USED
+
+  //Serves /recognize on `port`, responding to every image with the same label
+  //after `delayMillis` milliseconds. Only returns if it couldn't start.
+  bool runFakeRecogniser(int port, int delayMillis);
+#endif
@@ -0,0 +1,181 @@
+// main.cpp
+// A load generator that simulates a fleet of CameraThings uploading photos to
+// the tweeter at once, and reports how the tweeter held up
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+#include "device.h"
+#include "fakeRecogniser.h"
+#include "stats.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// Usage
+
+const char *USAGE =
+  "Usage: loadgen [options]\n"
+  "\n"
+  "Simulating CameraThings:\n"
+  "  --image FILE            JPEG every device uploads (required)\n"
+  "  --host HOST             Tweeter host (default localhost)\n"
+  "  --port PORT             Tweeter port (default 8080)\n"
+  "  --auth TOKEN            TWEET_AUTH_TOKEN of the tweeter (default dev)\n"
+  "  --devices N             How many devices to simulate (default 10)\n"
+  "  --duration SECONDS      How long to run for (default 60)\n"
+  "  --link 2g|wifi          Link speed profile of the devices (default 2g)\n"
+  "  --mode raw|streamed|buffered\n"
+  "                          How devices upload photos, see tweeter.cpp (default raw)\n"
+  "  --async                 Ask for asynchronous tweets, like ASYNC_TWEETS\n"
+  "  --geolocation           Send a lat & long with each photo\n"
+  "  --think SECONDS         Mean time between each device's photos (default 30)\n"
+  "  --health SECONDS        Time between each device's /health checks, 0 for none (default 300)\n"
+  "  --timeout SECONDS       How long to wait for a response (default 60)\n"
+  "\n"
+  "Standing in for the recogniser:\n"
+  "  --fake-recogniser PORT  Serve a fake /recognize on PORT instead\n"
+  "  --recognise-delay MS    How long the fake recogniser takes (default 500)\n";
+
+//usageError outputs the usage and exits
+void usageError(const char *message) {
+  fprintf(stderr, "%s\n\n%s", message, USAGE);
+  exit(1);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Main
+
+int main(int argc, char **argv) {
+  //Defaults
+  DeviceConfig config;
+  config.host = "localhost";
+  config.port = 8080;
+  config.authToken = "dev";
+  config.mode = UPLOAD_RAW;
+  config.async = false;
+  config.geolocation = false;
+  findLinkProfile("2g", &config.link);
+  config.thinkSeconds = 30;
+  config.healthSeconds = 300;
+  config.timeoutSeconds = 60;
+  const char *imagePath = nullptr;
+  int devices = 10;
+  double duration = 60;
+  int fakeRecogniserPort = 0;
+  int recogniseDelay = 500;
+
+  //Parse args
+  for(int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    const char *value = hasValue ? argv[i+1] : nullptr;
+    if(strcmp(arg, "--async") == 0) {
+      config.async = true;
+      continue;
+    }
+    if(strcmp(arg, "--geolocation") == 0) {
+      config.geolocation = true;
+      continue;
+    }
+    if(strcmp(arg, "--help") == 0) {
+      printf("%s", USAGE);
+      return 0;
+    }
+    if(!hasValue) {
+      usageError("Missing value for an option");
+    }
+    i++;
+    if(strcmp(arg, "--image") == 0) {
+      imagePath = value;
+    } else if(strcmp(arg, "--host") == 0) {
+      config.host = value;
+    } else if(strcmp(arg, "--port") == 0) {
+      config.port = atoi(value);
+    } else if(strcmp(arg, "--auth") == 0) {
+      config.authToken = value;
+    } else if(strcmp(arg, "--devices") == 0) {
+      devices = atoi(value);
+    } else if(strcmp(arg, "--duration") == 0) {
+      duration = atof(value);
+    } else if(strcmp(arg, "--link") == 0) {
+      if(!findLinkProfile(value, &config.link)) {
+        usageError("Unknown link profile");
+      }
+    } else if(strcmp(arg, "--mode") == 0) {
+      if(strcmp(value, "raw") == 0) {
+        config.mode = UPLOAD_RAW;
+      } else if(strcmp(value, "streamed") == 0) {
+        config.mode = UPLOAD_STREAMED;
+      } else if(strcmp(value, "buffered") == 0) {
+        config.mode = UPLOAD_BUFFERED;
+      } else {
+        usageError("Unknown upload mode");
+      }
+    } else if(strcmp(arg, "--think") == 0) {
+      config.thinkSeconds = atof(value);
+    } else if(strcmp(arg, "--health") == 0) {
+      config.healthSeconds = atof(value);
+    } else if(strcmp(arg, "--timeout") == 0) {
+      config.timeoutSeconds = atof(value);
+    } else if(strcmp(arg, "--fake-recogniser") == 0) {
+      fakeRecogniserPort = atoi(value);
+    } else if(strcmp(arg, "--recognise-delay") == 0) {
+      recogniseDelay = atoi(value);
+    } else {
+      usageError("Unknown option");
+    }
+  }
+
+  //If we're standing in for the recogniser, that's all we do
+  if(fakeRecogniserPort > 0) {
+    return runFakeRecogniser(fakeRecogniserPort, recogniseDelay) ? 0 : 1;
+  }
+
+  //Load the photo
+  if(imagePath == nullptr) {
+    usageError("--image is required");
+  }
+  std::ifstream imageFile(imagePath, std::ios::binary);
+  if(!imageFile) {
+    printf("[main] - Couldn't open %s :(\n", imagePath);
+    return 1;
+  }
+  std::vector<uint8_t> jpeg((std::istreambuf_iterator<char>(imageFile)), std::istreambuf_iterator<char>());
+  config.jpeg = &jpeg;
+  if(config.thinkSeconds <= 0 || devices <= 0 || duration <= 0) {
+    usageError("--think, --devices and --duration must be positive");
+  }
+
+  //Start the devices
+  printf(
+    "[main] - Simulating %d devices on %s for %.0f s, uploading a %zu byte photo every %.0f s on average\n",
+    devices, config.link.name, duration, jpeg.size(), config.thinkSeconds
+  );
+  FleetStats stats;
+  std::atomic<bool> running(true);
+  std::vector<std::thread> threads;
+  for(int i = 0; i < devices; i++) {
+    threads.emplace_back(runDevice, i, std::cref(config), &stats, &running);
+  }
+
+  //Let them run, then wait for them to finish their last requests
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+  running = false;
+  printf("[main] - Time's up, waiting for requests in flight...\n");
+  for(std::thread &thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  //Report
+  const char *uploadPath = config.mode == UPLOAD_RAW ? "/photo" : "/tweet";
+  stats.upload.report(uploadPath, seconds);
+  stats.health.report("/health", seconds);
+  return 0;
+}
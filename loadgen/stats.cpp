@@ -0,0 +1,40 @@
+// stats.cpp
+// Collects request latencies and reports on them
+
+#include <algorithm>
+#include <cstdio>
+#include "stats.h"
+
+//record adds a request to the stats. Only the latencies of successful requests
+//are kept, as failures are often quick and would skew the percentiles.
+void LatencyStats::record(double millis, bool success) {
+  std::lock_guard<std::mutex> guard(lock);
+  if(success) {
+    latencies.push_back(millis);
+  } else {
+    failures++;
+  }
+}
+
+//percentile gets the p-th percentile of a sorted, non-empty set of latencies
+double percentile(const std::vector<double> &sorted, double p) {
+  size_t i = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+//report outputs how many requests succeeded & failed, the throughput of
+//successful requests, and their latency percentiles
+void LatencyStats::report(const char *name, double seconds) {
+  std::lock_guard<std::mutex> guard(lock);
+  std::vector<double> sorted = latencies;
+  std::sort(sorted.begin(), sorted.end());
+
+  printf("[report] - %s: %zu ok, %d failed, %.2f req/s\n", name, sorted.size(), failures, sorted.size() / seconds);
+  if(sorted.empty()) {
+    return;
+  }
+  printf(
+    "[report] - %s: p50 %.0f ms, p90 %.0f ms, p99 %.0f ms, max %.0f ms\n",
+    name, percentile(sorted, 50), percentile(sorted, 90), percentile(sorted, 99), sorted.back()
+  );
+}
@@ -0,0 +1,25 @@
+// stats.h
+// Exports the LatencyStats class, which collects the latencies of requests
+// made from many threads and reports on them
+
+#ifndef STATS_USED
+  #define STATS_USED
+
+  #include <mutex>
+  #include <vector>
+
+  class LatencyStats {
+    private:
+      std::mutex lock;
+      std::vector<double> latencies; //Latencies of successful requests, in ms
+      int failures = 0; //How many requests failed
+
+    public:
+      //Records a request that took `millis` milliseconds
+      void record(double millis, bool success);
+
+      //Outputs the throughput & latency percentiles for requests to `name`
+      //over a run that lasted `seconds`
+      void report(const char *name, double seconds);
+  };
+#endif
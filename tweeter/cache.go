@@ -0,0 +1,133 @@
+package main
+
+import (
+	"container/list"
+	"crypto/sha256"
+	"expvar"
+	"image"
+	"image/color"
+	"sync"
+	"time"
+)
+
+//Metrics for the photo cache, published at /debug/vars
+var (
+	photoCacheHits       = expvar.NewInt("photoCacheHits")       //Photos we'd already tweeted the exact same bytes of
+	photoCacheLabelHits  = expvar.NewInt("photoCacheLabelHits")  //Photos that looked the same as one we'd recognised
+	photoCacheMisses     = expvar.NewInt("photoCacheMisses")     //Photos we had to process from scratch
+	photoCacheMsSaved    = expvar.NewInt("photoCacheMsSaved")    //Milliseconds of recognising & upscaling skipped
+	photoCacheEntryCount = expvar.NewInt("photoCacheEntryCount") //Photos in the cache right now
+)
+
+//A cachedPhoto holds the results of processing a photo, so if the same photo
+//is uploaded again (e.g. a CameraThing retrying after a reset) we don't have
+//to process it again
+type cachedPhoto struct {
+	sum           [sha256.Size]byte //Hash of the photo's bytes
+	look          uint64            //Perceptual hash of the photo, see lookHash
+	labels        []LabelResult
+	upscaled      []byte        //The upscaled photo, JPEG encoded
+	recogniseTime time.Duration //How long recognising the photo took
+	upscaleTime   time.Duration //How long upscaling & encoding the photo took
+}
+
+//A photoCache keeps the most recently processed photos, forgetting the least
+//recently used when it's full. Photos are found by the hash of their bytes,
+//and their labels can also be found by what they look like.
+type photoCache struct {
+	lock   sync.Mutex
+	size   int
+	order  *list.List //Most recently used at the front
+	bySum  map[[sha256.Size]byte]*list.Element
+	byLook map[uint64]*list.Element
+}
+
+//Constructor
+func newPhotoCache() (*photoCache, error) {
+	//Load how many photos to keep from env var, defaulting to 32. Each one's
+	//typically 100-200KB once upscaled. 0 turns the cache off.
+	size, err := intFromEnv("PHOTO_CACHE_SIZE", 32, 0)
+	if err != nil {
+		return nil, err
+	}
+
+	return &photoCache{
+		size:   size,
+		order:  list.New(),
+		bySum:  make(map[[sha256.Size]byte]*list.Element),
+		byLook: make(map[uint64]*list.Element),
+	}, nil
+}
+
+//get finds a photo with exactly the same bytes
+func (c *photoCache) get(sum [sha256.Size]byte) (*cachedPhoto, bool) {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	element, found := c.bySum[sum]
+	if !found {
+		return nil, false
+	}
+	c.order.MoveToFront(element)
+	return element.Value.(*cachedPhoto), true
+}
+
+//getLabels finds the labels of a photo that looks the same
+func (c *photoCache) getLabels(look uint64) ([]LabelResult, time.Duration, bool) {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	element, found := c.byLook[look]
+	if !found {
+		return nil, 0, false
+	}
+	c.order.MoveToFront(element)
+	photo := element.Value.(*cachedPhoto)
+	return photo.labels, photo.recogniseTime, true
+}
+
+//put adds a photo to the cache, forgetting the least recently used if full
+func (c *photoCache) put(photo *cachedPhoto) {
+	c.lock.Lock()
+	defer c.lock.Unlock()
+	if _, found := c.bySum[photo.sum]; found || c.size == 0 {
+		return
+	}
+	element := c.order.PushFront(photo)
+	c.bySum[photo.sum] = element
+	c.byLook[photo.look] = element
+
+	for c.order.Len() > c.size {
+		oldest := c.order.Back()
+		old := oldest.Value.(*cachedPhoto)
+		c.order.Remove(oldest)
+		delete(c.bySum, old.sum)
+		if c.byLook[old.look] == oldest {
+			delete(c.byLook, old.look)
+		}
+	}
+	photoCacheEntryCount.Set(int64(c.order.Len()))
+}
+
+/*lookHash is a perceptual (difference) hash of an image: it's shrunk to 9x8
+grey pixels, and each bit says whether a pixel is brighter than the one to its
+right. Two photos of the same scene taken a moment apart, e.g. from a double
+press, usually hash the same even though their bytes differ.*/
+func lookHash(img image.Image) uint64 {
+	bounds := img.Bounds()
+	var hash uint64
+	for y := 0; y < 8; y++ {
+		sy := bounds.Min.Y + (2*y+1)*bounds.Dy()/16
+		var last uint8
+		for x := 0; x < 9; x++ {
+			sx := bounds.Min.X + (2*x+1)*bounds.Dx()/18
+			grey := color.GrayModel.Convert(img.At(sx, sy)).(color.Gray).Y
+			if x > 0 {
+				hash <<= 1
+				if last > grey {
+					hash |= 1
+				}
+			}
+			last = grey
+		}
+	}
+	return hash
+}
@@ -0,0 +1,68 @@
+package main
+
+import (
+	"encoding/json"
+	"errors"
+	"log"
+	"net/http"
+	"os"
+)
+
+//jobEndpoint lets clients look up photos they've asked to be tweeted
+//asynchronously
+type jobEndpoint struct {
+	authToken string //The auth token that must be provided to use this endpoint
+}
+
+//Constructor
+func newJobEndpoint() (*jobEndpoint, error) {
+	//Load authToken from env var
+	authToken, authTokenSet := os.LookupEnv("TWEET_AUTH_TOKEN")
+	if !authTokenSet && env == DEV {
+		//Default value if not set for dev env
+		authToken = "dev"
+	} else if !authTokenSet && env == PROD {
+		return nil, errors.New("TWEET_AUTH_TOKEN not set")
+	}
+
+	//Return jobEndpoint
+	return &jobEndpoint{
+		authToken: authToken,
+	}, nil
+}
+
+//Endpoint handler
+func (je *jobEndpoint) handle(w http.ResponseWriter, r *http.Request) {
+	//Log req occurred
+	log.Println("      [/job] - Request @ /job!")
+
+	//Check request for auth token, in either the query or a header
+	authToken := r.FormValue("auth")
+	if authToken == "" {
+		authToken = r.Header.Get("Auth")
+	}
+	if authToken != je.authToken {
+		log.Println("[401] [/job] - No auth token supplied")
+		w.Header().Set("Content-Type", "application/json")
+		w.WriteHeader(http.StatusUnauthorized)
+		json.NewEncoder(w).Encode("Invalid auth token")
+		return
+	}
+
+	//Look the job up
+	id := r.FormValue("id")
+	job, found := myJobQueue.get(id)
+	if !found {
+		log.Printf("[404] [/job] - No job %[1]v", id)
+		w.Header().Set("Content-Type", "application/json")
+		w.WriteHeader(http.StatusNotFound)
+		json.NewEncoder(w).Encode("No such job")
+		return
+	}
+
+	//Respond
+	log.Printf("[200] [/job] - Job %[1]v is %[2]v", id, job.Status)
+	w.Header().Set("Content-Type", "application/json")
+	w.WriteHeader(http.StatusOK)
+	json.NewEncoder(w).Encode(job)
+}
@@ -0,0 +1,149 @@
+package main
+
+import (
+	"crypto/rand"
+	"encoding/hex"
+	"errors"
+	"log"
+	"sync"
+	"time"
+)
+
+//The states a tweetJob goes through
+const (
+	jobPending = "pending"
+	jobDone    = "done"
+	jobFailed  = "failed"
+)
+
+//A tweetJob is a photo waiting to be (or that has been) tweeted by a worker
+type tweetJob struct {
+	ID          string
+	Status      string
+	Result      *tweetResult `json:",omitempty"`
+	Error       string       `json:",omitempty"`
+	path        string       //The endpoint the photo came in on, for logging
+	images      [][]byte
+	geolocation *Geolocation
+	labels      []LabelResult         //From the CameraThing's classifier, if it sent any
+	thumbnail   *thumbnailRecognition //The first photo's thumbnail's labels, if it sent one
+	submitted   time.Time             //When the job was queued
+	finished    time.Time             //When the job stopped being pending
+}
+
+//A jobQueue tweets photos on a pool of workers, and keeps hold of the results
+//for a while so clients can look them up
+type jobQueue struct {
+	queue   chan *tweetJob
+	lock    sync.Mutex
+	jobs    map[string]*tweetJob
+	keepFor time.Duration //How long finished jobs are kept
+}
+
+//Constructor, starts the workers
+func newJobQueue() (*jobQueue, error) {
+	//Load the number of workers and how many jobs can wait for one from env
+	//vars, defaulting to 2 & 16
+	workers, err := intFromEnv("TWEET_WORKERS", 2, 1)
+	if err != nil {
+		return nil, err
+	}
+	queueSize, err := intFromEnv("TWEET_QUEUE_SIZE", 16, 1)
+	if err != nil {
+		return nil, err
+	}
+
+	q := &jobQueue{
+		queue:   make(chan *tweetJob, queueSize),
+		jobs:    make(map[string]*tweetJob),
+		keepFor: time.Hour,
+	}
+	for i := 0; i < workers; i++ {
+		go q.work()
+	}
+	log.Printf("Started %[1]v tweet workers", workers)
+	return q, nil
+}
+
+//submit queues a photo (or a burst of them) to be tweeted, returning the job.
+//Errs if the queue is full.
+func (q *jobQueue) submit(path string, images [][]byte, geolocation *Geolocation, labels []LabelResult, thumbnail *thumbnailRecognition) (*tweetJob, error) {
+	id, err := newJobID()
+	if err != nil {
+		return nil, err
+	}
+	job := &tweetJob{
+		ID:          id,
+		Status:      jobPending,
+		path:        path,
+		images:      images,
+		geolocation: geolocation,
+		labels:      labels,
+		thumbnail:   thumbnail,
+		submitted:   time.Now(),
+	}
+
+	q.lock.Lock()
+	defer q.lock.Unlock()
+	q.forgetOldJobs()
+	select {
+	case q.queue <- job:
+		q.jobs[id] = job
+		return job, nil
+	default:
+		return nil, errors.New("job queue full")
+	}
+}
+
+//get gets a copy of a job by its ID, or false if there's no such job
+func (q *jobQueue) get(id string) (tweetJob, bool) {
+	q.lock.Lock()
+	defer q.lock.Unlock()
+	job, found := q.jobs[id]
+	if !found {
+		return tweetJob{}, false
+	}
+	return *job, true
+}
+
+//work tweets queued photos until the end of time
+func (q *jobQueue) work() {
+	for job := range q.queue {
+		myMetrics.observeStage("jobQueued", job.submitted)
+		result, _, message := processPhoto(job.path, job.images, job.geolocation, job.labels, job.thumbnail)
+		myMetrics.observeStage("job", job.submitted)
+
+		q.lock.Lock()
+		if result != nil {
+			job.Status = jobDone
+			job.Result = result
+		} else {
+			job.Status = jobFailed
+			job.Error = message
+		}
+		job.images = nil
+		job.thumbnail = nil
+		job.finished = time.Now()
+		q.lock.Unlock()
+	}
+}
+
+//forgetOldJobs removes jobs that finished more than keepFor ago. Must be
+//called with the lock held.
+func (q *jobQueue) forgetOldJobs() {
+	for id, job := range q.jobs {
+		if job.Status != jobPending && time.Since(job.finished) > q.keepFor {
+			delete(q.jobs, id)
+		}
+	}
+}
+
+//newJobID makes a random ID for a job
+func newJobID() (string, error) {
+	b := make([]byte, 8)
+	_, err := rand.Read(b)
+	if err != nil {
+		return "", err
+	}
+	return hex.EncodeToString(b), nil
+}
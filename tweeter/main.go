@@ -16,6 +16,8 @@ const (
 var env Environment
 var myRecogniser *recogniser
 var myTweeter *tweeter
+var myJobQueue *jobQueue
+var myPhotoCache *photoCache
 
 func main() {
 	var err error
@@ -50,6 +52,26 @@ func main() {
 	}
 	log.Printf("Logged into twitter as: %[1]v", myTweeter.username)
 
+	//Create photo cache
+	log.Println("Creating photo cache...")
+	myPhotoCache, err = newPhotoCache()
+	if err != nil {
+		log.Fatalf(
+			"Couldn't create photo cache, err: %[1]v",
+			err.Error(),
+		)
+	}
+
+	//Create job queue, for photos tweeted asynchronously
+	log.Println("Creating job queue...")
+	myJobQueue, err = newJobQueue()
+	if err != nil {
+		log.Fatalf(
+			"Couldn't create job queue, err: %[1]v",
+			err.Error(),
+		)
+	}
+
 	//Create endpoints
 	log.Println("Creating endpoint instances...")
 	myHealthEndpoint, err := newHealthEndpoint()
@@ -67,10 +89,37 @@ func main() {
 		)
 	}
 
+	myPhotoEndpoint, err := newPhotoEndpoint()
+	if err != nil {
+		log.Fatalf(
+			"Couldn't create photoEndpoint instance, err: %[1]v",
+			err.Error(),
+		)
+	}
+
+	myJobEndpoint, err := newJobEndpoint()
+	if err != nil {
+		log.Fatalf(
+			"Couldn't create jobEndpoint instance, err: %[1]v",
+			err.Error(),
+		)
+	}
+
+	myMetricsEndpoint, err := newMetricsEndpoint()
+	if err != nil {
+		log.Fatalf(
+			"Couldn't create metricsEndpoint instance, err: %[1]v",
+			err.Error(),
+		)
+	}
+
 	//Attach endpoint handlers
 	log.Println("Attaching endpoint handlers...")
 	http.HandleFunc("/health", myHealthEndpoint.handle)
-	http.HandleFunc("/tweet", myTweetEndpoint.handle)
+	http.HandleFunc("/metrics", myMetricsEndpoint.handle)
+	http.HandleFunc("/tweet", myMetrics.instrument("/tweet", myTweetEndpoint.handle))
+	http.HandleFunc("/photo", myMetrics.instrument("/photo", myPhotoEndpoint.handle))
+	http.HandleFunc("/job", myMetrics.instrument("/job", myJobEndpoint.handle))
 
 	//Determine port to use from env vars (default to 8080)
 	port, portSet := os.LookupEnv("PORT")
@@ -79,7 +128,20 @@ func main() {
 	}
 	log.Printf("Using port %[1]v...", port)
 
+	//Serve over TLS if we've been given a certificate & key. Go's TLS server
+	//issues session tickets by default, so CameraThings can resume sessions
+	//rather than doing a full handshake for every request.
+	certFile, certFileSet := os.LookupEnv("TLS_CERT_FILE")
+	keyFile, keyFileSet := os.LookupEnv("TLS_KEY_FILE")
+	if certFileSet != keyFileSet {
+		log.Fatalf("TLS_CERT_FILE and TLS_KEY_FILE must be set together, or not at all.")
+	}
+
 	//Now everything is set up, listen & serve...
+	if certFileSet {
+		log.Printf("Listening and serving over TLS!")
+		log.Fatal(http.ListenAndServeTLS(":"+port, certFile, keyFile, nil))
+	}
 	log.Printf("Listening and serving!")
 	log.Fatal(http.ListenAndServe(":"+port, nil))
 }
@@ -0,0 +1,170 @@
+package main
+
+import (
+	"net/http"
+	"strconv"
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+//The upper bounds of the buckets latencies are counted in, in milliseconds
+var histogramBuckets = []float64{5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000}
+
+//A histogram counts how many times something took how long
+type histogram struct {
+	lock   sync.Mutex
+	counts []uint64 //One per bucket, plus one for anything slower
+	count  uint64
+	sumMs  float64
+	maxMs  float64
+}
+
+//A histogramSnapshot is how a histogram's shown at /metrics. Buckets are
+//cumulative, keyed by their upper bound in milliseconds.
+type histogramSnapshot struct {
+	Buckets map[string]uint64
+	Count   uint64
+	SumMs   float64
+	MaxMs   float64
+	P50Ms   float64
+	P90Ms   float64
+	P99Ms   float64
+}
+
+//observe counts something that took d
+func (h *histogram) observe(d time.Duration) {
+	ms := float64(d) / float64(time.Millisecond)
+	bucket := len(histogramBuckets)
+	for i, bound := range histogramBuckets {
+		if ms <= bound {
+			bucket = i
+			break
+		}
+	}
+
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	if h.counts == nil {
+		h.counts = make([]uint64, len(histogramBuckets)+1)
+	}
+	h.counts[bucket]++
+	h.count++
+	h.sumMs += ms
+	if ms > h.maxMs {
+		h.maxMs = ms
+	}
+}
+
+//snapshot gets the histogram's counts so far, with percentiles estimated as
+//the upper bound of the bucket they fall in (or the slowest seen, if that's
+//less)
+func (h *histogram) snapshot() histogramSnapshot {
+	h.lock.Lock()
+	defer h.lock.Unlock()
+	snapshot := histogramSnapshot{
+		Buckets: make(map[string]uint64),
+		Count:   h.count,
+		SumMs:   h.sumMs,
+		MaxMs:   h.maxMs,
+	}
+	if h.count == 0 {
+		return snapshot
+	}
+
+	var cumulative uint64
+	percentiles := []struct {
+		p    float64
+		into *float64
+	}{{0.5, &snapshot.P50Ms}, {0.9, &snapshot.P90Ms}, {0.99, &snapshot.P99Ms}}
+	for i, count := range h.counts {
+		cumulative += count
+		bound := h.maxMs
+		key := "+Inf"
+		if i < len(histogramBuckets) {
+			key = strconv.FormatFloat(histogramBuckets[i], 'f', -1, 64)
+			if histogramBuckets[i] < bound {
+				bound = histogramBuckets[i]
+			}
+		}
+		snapshot.Buckets[key] = cumulative
+		for _, percentile := range percentiles {
+			if *percentile.into == 0 && float64(cumulative) >= percentile.p*float64(h.count) {
+				*percentile.into = bound
+			}
+		}
+	}
+	return snapshot
+}
+
+//The tweeter's metrics. Stage histograms & error counters are made as they're
+//first used, so adding one is just a matter of using it.
+type metrics struct {
+	lock      sync.Mutex
+	stages    map[string]*histogram        //How long each stage of processing a photo takes
+	inFlight  map[string]*int64            //Requests being handled, by endpoint
+	responses map[string]map[string]uint64 //Responses sent, by endpoint then status code
+	errors    map[string]uint64            //Things that went wrong but didn't fail a request
+}
+
+var myMetrics = &metrics{
+	stages:    make(map[string]*histogram),
+	inFlight:  make(map[string]*int64),
+	responses: make(map[string]map[string]uint64),
+	errors:    make(map[string]uint64),
+}
+
+//observeStage counts a stage of processing a photo that started at start
+func (m *metrics) observeStage(stage string, start time.Time) {
+	elapsed := time.Since(start)
+	m.lock.Lock()
+	h, found := m.stages[stage]
+	if !found {
+		h = &histogram{}
+		m.stages[stage] = h
+	}
+	m.lock.Unlock()
+	h.observe(elapsed)
+}
+
+//countError counts something going wrong that didn't fail a request
+func (m *metrics) countError(name string) {
+	m.lock.Lock()
+	m.errors[name]++
+	m.lock.Unlock()
+}
+
+//A statusRecorder is a ResponseWriter that remembers the status code written
+type statusRecorder struct {
+	http.ResponseWriter
+	status int
+}
+
+func (sr *statusRecorder) WriteHeader(status int) {
+	sr.status = status
+	sr.ResponseWriter.WriteHeader(status)
+}
+
+//instrument wraps an endpoint handler, keeping count of the requests in flight
+//and the responses sent, and timing each request as the stage "path total"
+func (m *metrics) instrument(path string, handler http.HandlerFunc) http.HandlerFunc {
+	m.lock.Lock()
+	inFlight := new(int64)
+	m.inFlight[path] = inFlight
+	m.responses[path] = make(map[string]uint64)
+	m.lock.Unlock()
+
+	return func(w http.ResponseWriter, r *http.Request) {
+		start := time.Now()
+		atomic.AddInt64(inFlight, 1)
+		defer atomic.AddInt64(inFlight, -1)
+
+		recorder := &statusRecorder{ResponseWriter: w, status: http.StatusOK}
+		handler(recorder, r)
+
+		m.observeStage(path+" total", start)
+		m.lock.Lock()
+		m.responses[path][strconv.Itoa(recorder.status)]++
+		m.lock.Unlock()
+	}
+}
@@ -0,0 +1,75 @@
+package main
+
+import (
+	"encoding/json"
+	"log"
+	"net/http"
+	"sync/atomic"
+)
+
+type metricsEndpoint struct {
+}
+
+//Constructor
+func newMetricsEndpoint() (*metricsEndpoint, error) {
+	//Return metricsEndpoint
+	return &metricsEndpoint{}, nil
+}
+
+//Endpoint handler
+func (me *metricsEndpoint) handle(w http.ResponseWriter, r *http.Request) {
+	//Log req occurred
+	log.Println("Request @ /metrics!")
+
+	//Gather up the metrics
+	response := map[string]interface{}{}
+
+	myMetrics.lock.Lock()
+	stages := map[string]histogramSnapshot{}
+	for stage, h := range myMetrics.stages {
+		stages[stage] = h.snapshot()
+	}
+	inFlight := map[string]int64{}
+	for path, n := range myMetrics.inFlight {
+		inFlight[path] = atomic.LoadInt64(n)
+	}
+	responses := map[string]map[string]uint64{}
+	for path, counts := range myMetrics.responses {
+		responses[path] = map[string]uint64{}
+		for status, n := range counts {
+			responses[path][status] = n
+		}
+	}
+	errors := map[string]uint64{}
+	for name, n := range myMetrics.errors {
+		errors[name] = n
+	}
+	myMetrics.lock.Unlock()
+
+	response["Stages"] = stages
+	response["InFlight"] = inFlight
+	response["Responses"] = responses
+	response["Errors"] = errors
+	response["Queues"] = map[string]int{
+		"jobsWaiting":          len(myJobQueue.queue),
+		"recognising":          len(myRecogniser.slots),
+		"waitingForRecogniser": len(myRecogniser.admitted) - len(myRecogniser.slots),
+	}
+	response["PhotoCache"] = map[string]int64{
+		"hits":       photoCacheHits.Value(),
+		"labelHits":  photoCacheLabelHits.Value(),
+		"misses":     photoCacheMisses.Value(),
+		"msSaved":    photoCacheMsSaved.Value(),
+		"entryCount": photoCacheEntryCount.Value(),
+	}
+	response["DeviceLabels"] = map[string]int64{
+		"trusted":   deviceLabelsTrusted.Value(),
+		"untrusted": deviceLabelsUntrusted.Value(),
+	}
+	response["Telemetry"] = myTelemetry.snapshot()
+
+	//Respond
+	w.Header().Set("Content-Type", "application/json")
+	w.WriteHeader(http.StatusOK)
+	json.NewEncoder(w).Encode(response)
+}
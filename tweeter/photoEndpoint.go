@@ -0,0 +1,93 @@
+package main
+
+import (
+	"encoding/json"
+	"errors"
+	"log"
+	"net/http"
+	"os"
+	"time"
+)
+
+//photoEndpoint takes a bare JPEG as the request body, with the auth token and
+//geolocation in headers. It tweets the photo exactly like tweetEndpoint, but
+//without the multipart framing, which costs bytes over 2G and means buffering
+//the whole form before we can look at it.
+type photoEndpoint struct {
+	authToken string //The auth token that must be provided to use this endpoint
+}
+
+//Constructor
+func newPhotoEndpoint() (*photoEndpoint, error) {
+	//Load authToken from env var
+	authToken, authTokenSet := os.LookupEnv("TWEET_AUTH_TOKEN")
+	if !authTokenSet && env == DEV {
+		//Default value if not set for dev env
+		authToken = "dev"
+	} else if !authTokenSet && env == PROD {
+		return nil, errors.New("TWEET_AUTH_TOKEN not set")
+	}
+
+	//Return photoEndpoint
+	return &photoEndpoint{
+		authToken: authToken,
+	}, nil
+}
+
+//Endpoint handler
+func (pe *photoEndpoint) handle(w http.ResponseWriter, r *http.Request) {
+	//Log req occurred
+	log.Println("      [/photo] - Request @ /photo!")
+
+	//Photos can only be PUT
+	if r.Method != http.MethodPut {
+		log.Printf("[405] [/photo] - Method %[1]v not allowed", r.Method)
+		w.Header().Set("Allow", http.MethodPut)
+		w.Header().Set("Content-Type", "application/json")
+		w.WriteHeader(http.StatusMethodNotAllowed)
+		json.NewEncoder(w).Encode("Photos must be PUT")
+		return
+	}
+
+	//Check request for auth token
+	if r.Header.Get("Auth") != pe.authToken {
+		log.Println("[401] [/photo] - No auth token supplied")
+		w.Header().Set("Content-Type", "application/json")
+		w.WriteHeader(http.StatusUnauthorized)
+		json.NewEncoder(w).Encode("Invalid auth token")
+		return
+	}
+
+	//Check it's a JPEG we're being sent
+	if r.Header.Get("Content-Type") != "image/jpeg" {
+		log.Printf("[415] [/photo] - Content-Type %[1]v not supported", r.Header.Get("Content-Type"))
+		w.Header().Set("Content-Type", "application/json")
+		w.WriteHeader(http.StatusUnsupportedMediaType)
+		json.NewEncoder(w).Encode("Content-Type must be image/jpeg")
+		return
+	}
+
+	//////////////////////////////////////////////////////////////////////
+	//Get GPS location from headers
+	geolocation, ok := parseGeolocation("/photo", w, r.Header.Get("Lat"), r.Header.Get("Long"))
+	if !ok {
+		return
+	}
+
+	//////////////////////////////////////////////////////////////////////
+	//Read the image straight out of the body. Past maxPhotoSize, the rest of
+	//the body isn't read, and the connection's closed rather than kept alive.
+	r.Body = http.MaxBytesReader(w, r.Body, maxPhotoSize+1)
+	readStart := time.Now()
+	imageBytes, err := readPhoto(r.Body, r.ContentLength)
+	myMetrics.observeStage("read", readStart)
+	if err != nil {
+		rejectPhoto("/photo", w, err)
+		return
+	}
+
+	//Get any labels the CameraThing's classifier gave the photo
+	deviceLabels := parseDeviceLabels("/photo", r.Header.Get("Labels"))
+
+	tweetPhoto("/photo", w, r, [][]byte{imageBytes}, geolocation, deviceLabels, nil)
+}
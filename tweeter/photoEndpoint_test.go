@@ -0,0 +1,188 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"fmt"
+	"image"
+	"image/jpeg"
+	"io"
+	"io/ioutil"
+	"log"
+	"math/rand"
+	"net"
+	"net/http"
+	"net/http/httptest"
+	"sync"
+	"testing"
+)
+
+//The photos the benchmarks upload: QQVGA JPEGs like a CameraThing's, of a
+//dim room with a mug in it, from plain to noisy, so they come out at around
+//the 2-8KB a CameraThing's do. The upscale benchmarks use them too.
+var testPhotoScenes = []struct {
+	name  string
+	noise int
+}{
+	{"plain", 4},
+	{"room", 16},
+	{"noisy", 40},
+}
+
+//testPhoto draws one of testPhotoScenes as a QQVGA YCbCr image, like the
+//CameraThing's camera gives it
+func testPhoto(noise int) *image.YCbCr {
+	img := image.NewYCbCr(image.Rect(0, 0, 160, 120), image.YCbCrSubsampleRatio422)
+	random := rand.New(rand.NewSource(1))
+	for y := 0; y < 120; y++ {
+		for x := 0; x < 160; x++ {
+			luma := 70 + 40*x/160 + 20*y/120
+			if (x-60)*(x-60)+(y-70)*(y-70) < 30*30 {
+				luma = 190
+			}
+			if noise > 0 {
+				luma += random.Intn(2*noise+1) - noise
+			}
+			img.Y[img.YOffset(x, y)] = uint8(luma)
+		}
+	}
+	for i := range img.Cb {
+		img.Cb[i] = 120
+		img.Cr[i] = 136
+	}
+	return img
+}
+
+//testJPEG encodes one of testPhotoScenes like the CameraThing does
+func testJPEG(b *testing.B, noise int) []byte {
+	var buf bytes.Buffer
+	if err := jpeg.Encode(&buf, testPhoto(noise), &jpeg.Options{Quality: 70}); err != nil {
+		b.Fatal(err)
+	}
+	return buf.Bytes()
+}
+
+//The labels sent with each photo, confident enough that the tweeter uses them
+//rather than going to the recogniser
+const testLabels = "coffee_mug:95,cup:3"
+
+var setupTestTweeterOnce sync.Once
+
+//setupTestTweeter sets up a DEV tweeter that pretends to tweet, with its log
+//thrown away so it doesn't swamp the benchmarks
+func setupTestTweeter(b *testing.B) {
+	setupTestTweeterOnce.Do(func() {
+		var err error
+		env = DEV
+		log.SetOutput(ioutil.Discard)
+		myTweeter = &tweeter{username: "Dev"}
+		if myRecogniser, err = newRecogniser(); err != nil {
+			b.Fatal(err)
+		}
+		if myPhotoCache, err = newPhotoCache(); err != nil {
+			b.Fatal(err)
+		}
+		if myJobQueue, err = newJobQueue(); err != nil {
+			b.Fatal(err)
+		}
+	})
+}
+
+//chunked writes a body as the CameraThing does, in chunks of up to 1KB with
+//3 digit lengths (see writeChunk in camera-thing/main/tweeter.cpp)
+func chunked(parts ...[]byte) []byte {
+	var body bytes.Buffer
+	for _, part := range parts {
+		for len(part) > 0 {
+			n := len(part)
+			if n > 1024 {
+				n = 1024
+			}
+			fmt.Fprintf(&body, "%03x\r\n", n)
+			body.Write(part[:n])
+			body.WriteString("\r\n")
+			part = part[n:]
+		}
+	}
+	body.WriteString("0\r\n\r\n")
+	return body.Bytes()
+}
+
+//uploadRequest is a request to upload a photo to path exactly as the
+//CameraThing's makeStreamedTweetRequest writes it, but kept alive so each
+//benchmark's requests can go over one connection
+func uploadRequest(path string, photo []byte) []byte {
+	if path == "/photo" {
+		head := "PUT /photo HTTP/1.1\r\n" +
+			"Host: tweeter\r\n" +
+			"Auth: dev\r\n" +
+			"Lat: 51.50722\r\nLong: -0.12750\r\n" +
+			"Labels: " + testLabels + "\r\n" +
+			"Content-Type: image/jpeg\r\n" +
+			"Transfer-Encoding: chunked\r\n" +
+			"\r\n"
+		return append([]byte(head), chunked(photo)...)
+	}
+	head := "POST /tweet?auth=dev&lat=51.50722&long=-0.12750&labels=" + testLabels + " HTTP/1.1\r\n" +
+		"Host: tweeter\r\n" +
+		"Content-Type: multipart/form-data;boundary=\"boundary\"\r\n" +
+		"Transfer-Encoding: chunked\r\n" +
+		"\r\n"
+	partHead := "--boundary\r\n" +
+		"Content-Disposition: form-data; name=\"image\"; filename=\"Untitled.jpg\"\r\n" +
+		"\r\n"
+	partTail := "\r\n--boundary--\r\n\r\n"
+	return append([]byte(head), chunked([]byte(partHead), photo, []byte(partTail))...)
+}
+
+//benchmarkUpload uploads each of testPhotoScenes to path on a test server
+//over and over, reporting the bytes on the wire per upload. Each photo's
+//labels and upscaled image are cached after its first upload, as when a
+//CameraThing retries, so what's timed is mostly getting the photo out of the
+//request, which is where the endpoints differ.
+func benchmarkUpload(b *testing.B, path string, handler http.HandlerFunc) {
+	setupTestTweeter(b)
+	server := httptest.NewServer(myMetrics.instrument(path, handler))
+	defer server.Close()
+
+	for _, scene := range testPhotoScenes {
+		photo := testJPEG(b, scene.noise)
+		request := uploadRequest(path, photo)
+		b.Run(fmt.Sprintf("%v-%vB", scene.name, len(photo)), func(b *testing.B) {
+			conn, err := net.Dial("tcp", server.Listener.Addr().String())
+			if err != nil {
+				b.Fatal(err)
+			}
+			defer conn.Close()
+			responses := bufio.NewReader(conn)
+
+			b.ReportAllocs()
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				if _, err := conn.Write(request); err != nil {
+					b.Fatal(err)
+				}
+				resp, err := http.ReadResponse(responses, nil)
+				if err != nil {
+					b.Fatal(err)
+				}
+				io.Copy(ioutil.Discard, resp.Body)
+				resp.Body.Close()
+				if resp.StatusCode != http.StatusCreated {
+					b.Fatalf("%v responded %v", path, resp.Status)
+				}
+			}
+			b.ReportMetric(float64(len(request)), "wire-B/op")
+		})
+	}
+}
+
+func BenchmarkUploadPhoto(b *testing.B) {
+	endpoint := &photoEndpoint{authToken: "dev"}
+	benchmarkUpload(b, "/photo", endpoint.handle)
+}
+
+func BenchmarkUploadTweet(b *testing.B) {
+	endpoint := &tweetEndpoint{authToken: "dev"}
+	benchmarkUpload(b, "/tweet", endpoint.handle)
+}
@@ -1,22 +1,56 @@
 package main
 
 import (
-	"bytes"
+	"context"
 	"encoding/json"
 	"errors"
+	"expvar"
 	"fmt"
 	"io"
 	"io/ioutil"
+	"log"
 	"mime/multipart"
+	"net"
 	"net/http"
 	"os"
+	"sort"
+	"strconv"
+	"strings"
+	"time"
 )
 
 //Manages a connection to our recogniser service
 type recogniser struct {
 	endpoint string
+	client   *http.Client
+	timeout  time.Duration //How long a photo can take to be recognised, including waiting for a slot
+	admitted chan struct{} //Photos being recognised or waiting to be; when full, we shed load
+	slots    chan struct{} //Photos being recognised right now
+
+	//How sure a CameraThing's on-device classifier must be of its top label
+	//for us to use its labels rather than recognising the photo, from 0 to 1.
+	//Over 1 never trusts them.
+	deviceConfidence float32
 }
 
+//Metrics for labels from CameraThings' on-device classifiers, published at
+///debug/vars
+var (
+	deviceLabelsTrusted   = expvar.NewInt("deviceLabelsTrusted")   //Photos tweeted with the CameraThing's labels
+	deviceLabelsUntrusted = expvar.NewInt("deviceLabelsUntrusted") //Photos with labels we weren't confident enough in
+)
+
+//Metrics for thumbnails sent ahead of photos, published at /debug/vars
+var (
+	thumbnailLabelsUsed   = expvar.NewInt("thumbnailLabelsUsed")   //Photos tweeted with their thumbnail's labels
+	thumbnailLabelsFailed = expvar.NewInt("thumbnailLabelsFailed") //Thumbnails that couldn't be recognised, so their photo was instead
+	thumbnailMsWaited     = expvar.NewInt("thumbnailMsWaited")     //How long photos waited for their thumbnail's labels, once they'd arrived
+)
+
+//errRecogniserBusy is returned by recognise when too many photos are already
+//waiting for the recogniser
+var errRecogniserBusy = errors.New("recogniser busy, not waiting for it")
+
 //Constructor
 func newRecogniser() (*recogniser, error) {
 	//Load endpoint from env var
@@ -28,44 +62,189 @@ func newRecogniser() (*recogniser, error) {
 		return nil, errors.New("RECOGNISER_ENDPOINT not set")
 	}
 
+	//Load how many photos can be recognised at once, how many more can wait
+	//for a turn, and how long they can take, from env vars
+	concurrency, err := intFromEnv("RECOGNISER_CONCURRENCY", 4, 1)
+	if err != nil {
+		return nil, err
+	}
+	queueSize, err := intFromEnv("RECOGNISER_QUEUE_SIZE", 8, 1)
+	if err != nil {
+		return nil, err
+	}
+	timeout, err := intFromEnv("RECOGNISER_TIMEOUT", 10, 1)
+	if err != nil {
+		return nil, err
+	}
+
+	//Load how confident an on-device classifier must be for us to skip the
+	//recogniser, as a percentage
+	deviceConfidence, err := intFromEnv("DEVICE_LABEL_CONFIDENCE", 80, 1)
+	if err != nil {
+		return nil, err
+	}
+
+	//Keep a connection open to the recogniser for each photo that can be
+	//recognised at once, so we're not reconnecting for every photo
+	transport := &http.Transport{
+		Proxy: http.ProxyFromEnvironment,
+		DialContext: (&net.Dialer{
+			Timeout:   5 * time.Second,
+			KeepAlive: 30 * time.Second,
+		}).DialContext,
+		MaxIdleConns:        concurrency,
+		MaxIdleConnsPerHost: concurrency,
+		MaxConnsPerHost:     concurrency,
+		IdleConnTimeout:     90 * time.Second,
+	}
+
 	//Return recogniser
 	return &recogniser{
 		endpoint: endpoint,
+		client:   &http.Client{Transport: transport},
+		timeout:  time.Duration(timeout) * time.Second,
+		admitted: make(chan struct{}, concurrency+queueSize),
+		slots:    make(chan struct{}, concurrency),
+
+		deviceConfidence: float32(deviceConfidence) / 100,
 	}, nil
 }
 
+/*Parses the labels a CameraThing's on-device classifier sent with a photo, as
+"label:confidence,..." with confidences from 0 to 100, and sorts them most
+confident first. Labels can't contain spaces, so they're sent with underscores instead. Labels
+that can't be parsed are skipped, as we can always recognise the photo
+ourselves.*/
+func parseDeviceLabels(path string, labelsStr string) []LabelResult {
+	if labelsStr == "" {
+		return nil
+	}
+	var labels []LabelResult
+	for _, field := range strings.Split(labelsStr, ",") {
+		colon := strings.LastIndex(field, ":")
+		if colon <= 0 {
+			log.Printf("      [%[1]v] - Skipping device label %[2]q, no confidence", path, field)
+			continue
+		}
+		confidence, err := strconv.Atoi(field[colon+1:])
+		if err != nil || confidence < 0 || confidence > 100 {
+			log.Printf("      [%[1]v] - Skipping device label %[2]q, bad confidence", path, field)
+			continue
+		}
+		labels = append(labels, LabelResult{
+			Label:       strings.ReplaceAll(field[:colon], "_", " "),
+			Probability: float32(confidence) / 100,
+		})
+	}
+	sort.SliceStable(labels, func(i, j int) bool {
+		return labels[i].Probability > labels[j].Probability
+	})
+	return labels
+}
+
+/*Checks whether a CameraThing was confident enough in its labels for a photo
+for us to use them instead of recognising it*/
+func (r *recogniser) trustsDeviceLabels(labels []LabelResult) bool {
+	if len(labels) == 0 {
+		return false
+	}
+	if labels[0].Probability < r.deviceConfidence {
+		deviceLabelsUntrusted.Add(1)
+		return false
+	}
+	deviceLabelsTrusted.Add(1)
+	return true
+}
+
+/*A thumbnailRecognition is the labels for a photo's thumbnail, which are
+worked out while the photo itself is still being uploaded*/
+type thumbnailRecognition struct {
+	done   chan struct{} //Closed once the labels are in
+	labels []LabelResult
+	err    error
+}
+
+/*Starts recognising a photo's thumbnail in the background, so the recogniser
+and the upload of the full photo can run at the same time*/
+func (r *recogniser) recogniseThumbnail(thumbnail []byte) *thumbnailRecognition {
+	t := &thumbnailRecognition{done: make(chan struct{})}
+	go func() {
+		recogniseStart := time.Now()
+		t.labels, t.err = r.recognise(thumbnail)
+		myMetrics.observeStage("recogniseThumbnail", recogniseStart)
+		close(t.done)
+	}()
+	return t
+}
+
+/*Waits for a thumbnail to be recognised, and gets its labels. Errs if the
+thumbnail couldn't be recognised.*/
+func (t *thumbnailRecognition) wait() ([]LabelResult, error) {
+	waitStart := time.Now()
+	<-t.done
+	thumbnailMsWaited.Add(int64(time.Since(waitStart) / time.Millisecond))
+	return t.labels, t.err
+}
+
 /*Queries the recogniser with the provided image encoded as a slice of bytes.
 Errs if the request could not be constructed, recogniser could not be reached,
-or the recogniser returns a response that's unexpected or can't be decoded.*/
+or the recogniser returns a response that's unexpected or can't be decoded.
+Only so many photos are recognised at once; if too many are already waiting
+their turn, or this one doesn't get recognised within the timeout, it errs
+straight away rather than holding up the tweet.*/
 func (r *recogniser) recognise(img []byte) ([]LabelResult, error) {
-	//Create request body with multipart writer
-	var b bytes.Buffer
-	multipartWriter := multipart.NewWriter(&b)
-
-	//Create image field in request body
-	fileWriter, err := multipartWriter.CreateFormFile("image", "Untitled.jpg")
-	if err != nil {
-		return nil, errors.New(fmt.Sprintf(
-			"Failed to create form file for recogniser request, err: %[1]v",
-			err.Error(),
-		))
+	//Join the queue, unless it's full
+	select {
+	case r.admitted <- struct{}{}:
+		defer func() { <-r.admitted }()
+	default:
+		return nil, errRecogniserBusy
 	}
 
-	//Write image to request body
-	_, err = io.Copy(fileWriter, bytes.NewReader(img))
-	if err != nil {
-		return nil, errors.New(fmt.Sprintf(
-			"Failed to write image to recogniser request, err: %[1]v",
-			err.Error(),
-		))
+	//Wait for our turn, within the deadline
+	ctx, cancel := context.WithTimeout(context.Background(), r.timeout)
+	defer cancel()
+	select {
+	case r.slots <- struct{}{}:
+		defer func() { <-r.slots }()
+	case <-ctx.Done():
+		return nil, errors.New("timed out waiting for the recogniser")
 	}
 
-	//Close the multipart writer so terminating boundary set in request
-	multipartWriter.Close()
+	//Create request body with multipart writer. The form's written into a pipe
+	//as the request is sent, rather than building the whole thing in memory
+	//first.
+	bodyReader, bodyWriter := io.Pipe()
+	multipartWriter := multipart.NewWriter(bodyWriter)
+	go func() {
+		//Create image field in request body
+		fileWriter, err := multipartWriter.CreateFormFile("image", "Untitled.jpg")
+		if err != nil {
+			bodyWriter.CloseWithError(errors.New(fmt.Sprintf(
+				"Failed to create form file for recogniser request, err: %[1]v",
+				err.Error(),
+			)))
+			return
+		}
+
+		//Write image to request body
+		_, err = fileWriter.Write(img)
+		if err != nil {
+			bodyWriter.CloseWithError(errors.New(fmt.Sprintf(
+				"Failed to write image to recogniser request, err: %[1]v",
+				err.Error(),
+			)))
+			return
+		}
+
+		//Close the multipart writer so terminating boundary set in request
+		bodyWriter.CloseWithError(multipartWriter.Close())
+	}()
 
 	//Create request with request body
-	req, err := http.NewRequest("POST", r.endpoint, &b)
+	req, err := http.NewRequestWithContext(ctx, "POST", r.endpoint, bodyReader)
 	if err != nil {
+		bodyReader.Close()
 		return nil, errors.New(fmt.Sprintf(
 			"Failed to create recogniser request, err: %[1]v",
 			err.Error(),
@@ -76,10 +255,11 @@ func (r *recogniser) recognise(img []byte) ([]LabelResult, error) {
 	req.Header.Set("Content-Type", multipartWriter.FormDataContentType())
 
 	//Make POST request to recogniser
-	resp, err := http.DefaultClient.Do(req)
+	resp, err := r.client.Do(req)
 	if err != nil {
 		return nil, err
 	}
+	defer resp.Body.Close()
 
 	//Check status code is correct
 	if resp.StatusCode != 200 {
@@ -0,0 +1,198 @@
+package main
+
+import (
+	"errors"
+	"log"
+	"strconv"
+	"strings"
+	"sync"
+	"time"
+)
+
+//How many CameraThings' last reports are kept, so a misbehaving client can't
+//fill up memory with made up IDs
+const maxTelemetryDevices = 256
+
+//How many tasks' stack peaks are kept. The names come from the CameraThings,
+//so this stops made up ones filling up memory too. A CameraThing watches at
+//most 10 (TELEMETRY_MAX_TASKS in camera-thing/main/telemetry.cpp).
+const maxTelemetryTasks = 64
+
+//A stackUsage is how much of a task's stack a CameraThing has used, in bytes
+type stackUsage struct {
+	Used int64
+	Size int64
+}
+
+//A telemetryReport is what a CameraThing said about itself in the Telemetry
+//header sent with a photo. See camera-thing/main/telemetry.cpp for the format.
+type telemetryReport struct {
+	UptimeS     int64
+	HeapFree    int64
+	HeapMinFree int64 //The least heap it's had free since it booted
+	HeapLargest int64 //The largest block it could allocate
+	PsramFree   int64
+	PsramSize   int64
+	Stacks      map[string]stackUsage //By task
+	Frames      map[string]int64      `json:",omitempty"` //Frames checked, and what was done with bad ones
+	Trace       map[string]string     `json:",omitempty"` //Runs/average ms/longest ms, by stage
+	Received    time.Time
+}
+
+//The telemetry of every CameraThing: each one's last report, and the worst
+//seen across all of them, which is what stacks & buffers need sizing for
+type fleetTelemetry struct {
+	lock           sync.Mutex
+	reports        uint64
+	devices        map[string]*telemetryReport //Last report, by device ID
+	stackPeaks     map[string]stackUsage       //The most of each task's stack any CameraThing's used
+	heapMinFree    int64                       //The least heap any CameraThing's had free, -1 before any reports
+	heapLargestMin int64                       //The smallest largest free block reported, -1 before any reports
+}
+
+var myTelemetry = &fleetTelemetry{
+	devices:        make(map[string]*telemetryReport),
+	stackPeaks:     make(map[string]stackUsage),
+	heapMinFree:    -1,
+	heapLargestMin: -1,
+}
+
+//parseNumbers parses a field's numbers, separated by slashes, making sure
+//there are `count` of them
+func parseNumbers(value string, count int) ([]int64, error) {
+	parts := strings.Split(value, "/")
+	if len(parts) != count {
+		return nil, errors.New("expected " + strconv.Itoa(count) + " numbers in " + strconv.Quote(value))
+	}
+	numbers := make([]int64, count)
+	for i, part := range parts {
+		n, err := strconv.ParseInt(part, 10, 64)
+		if err != nil {
+			return nil, err
+		}
+		numbers[i] = n
+	}
+	return numbers, nil
+}
+
+//parseTelemetry parses a Telemetry header into the device's ID and its
+//report. Fields we don't know about are skipped, so CameraThings can add more.
+func parseTelemetry(header string) (string, *telemetryReport, error) {
+	id := ""
+	report := &telemetryReport{
+		Stacks:   make(map[string]stackUsage),
+		Received: time.Now(),
+	}
+	for _, field := range strings.Split(header, ";") {
+		equals := strings.Index(field, "=")
+		if equals <= 0 {
+			return "", nil, errors.New("field " + strconv.Quote(field) + " has no value")
+		}
+		key, value := field[:equals], field[equals+1:]
+
+		var err error
+		var numbers []int64
+		switch key {
+		case "id":
+			id = value
+		case "up":
+			report.UptimeS, err = strconv.ParseInt(value, 10, 64)
+		case "heap":
+			if numbers, err = parseNumbers(value, 3); err == nil {
+				report.HeapFree, report.HeapMinFree, report.HeapLargest = numbers[0], numbers[1], numbers[2]
+			}
+		case "psram":
+			if numbers, err = parseNumbers(value, 2); err == nil {
+				report.PsramFree, report.PsramSize = numbers[0], numbers[1]
+			}
+		case "frames":
+			if numbers, err = parseNumbers(value, 4); err == nil {
+				report.Frames = map[string]int64{
+					"checked":    numbers[0],
+					"recaptured": numbers[1],
+					"kept":       numbers[2],
+					"givenUp":    numbers[3],
+				}
+			}
+		case "stack", "trace":
+			for _, entry := range strings.Split(value, ",") {
+				colon := strings.LastIndex(entry, ":")
+				if colon <= 0 {
+					err = errors.New("entry " + strconv.Quote(entry) + " has no name")
+					break
+				}
+				name := entry[:colon]
+				if key == "trace" {
+					if report.Trace == nil {
+						report.Trace = make(map[string]string)
+					}
+					report.Trace[name] = entry[colon+1:]
+					continue
+				}
+				if numbers, err = parseNumbers(entry[colon+1:], 2); err != nil {
+					break
+				}
+				report.Stacks[name] = stackUsage{Used: numbers[0], Size: numbers[1]}
+			}
+		}
+		if err != nil {
+			return "", nil, errors.New("bad " + key + ": " + err.Error())
+		}
+	}
+	if id == "" {
+		return "", nil, errors.New("no id")
+	}
+	return id, report, nil
+}
+
+//record keeps a CameraThing's Telemetry header, logging it and folding it into
+//the worst seen across the fleet
+func (ft *fleetTelemetry) record(path string, header string) {
+	id, report, err := parseTelemetry(header)
+	if err != nil {
+		log.Printf("      [%[1]v] - Couldn't parse telemetry %[2]q, err: %[3]v", path, header, err.Error())
+		myMetrics.countError("telemetry")
+		return
+	}
+	log.Printf("      [%[1]v] - Telemetry from %[2]v: %[3]v", path, id, header)
+
+	ft.lock.Lock()
+	defer ft.lock.Unlock()
+	ft.reports++
+	if _, known := ft.devices[id]; known || len(ft.devices) < maxTelemetryDevices {
+		ft.devices[id] = report
+	}
+	for task, usage := range report.Stacks {
+		peak, found := ft.stackPeaks[task]
+		if (!found && len(ft.stackPeaks) < maxTelemetryTasks) || (found && usage.Used > peak.Used) {
+			ft.stackPeaks[task] = usage
+		}
+	}
+	if ft.heapMinFree < 0 || report.HeapMinFree < ft.heapMinFree {
+		ft.heapMinFree = report.HeapMinFree
+	}
+	if ft.heapLargestMin < 0 || report.HeapLargest < ft.heapLargestMin {
+		ft.heapLargestMin = report.HeapLargest
+	}
+}
+
+//snapshot gets the fleet's telemetry, for /metrics
+func (ft *fleetTelemetry) snapshot() map[string]interface{} {
+	ft.lock.Lock()
+	defer ft.lock.Unlock()
+	devices := map[string]telemetryReport{}
+	for id, report := range ft.devices {
+		devices[id] = *report
+	}
+	stackPeaks := map[string]stackUsage{}
+	for task, usage := range ft.stackPeaks {
+		stackPeaks[task] = usage
+	}
+	return map[string]interface{}{
+		"Reports":        ft.reports,
+		"Devices":        devices,
+		"StackPeaks":     stackPeaks,
+		"HeapMinFree":    ft.heapMinFree,
+		"HeapLargestMin": ft.heapLargestMin,
+	}
+}
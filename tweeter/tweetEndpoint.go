@@ -2,6 +2,7 @@ package main
 
 import (
 	"bytes"
+	"crypto/sha256"
 	"encoding/json"
 	"errors"
 	"fmt"
@@ -12,8 +13,7 @@ import (
 	"os"
 	"strconv"
 	"strings"
-
-	"github.com/nfnt/resize"
+	"time"
 )
 
 type tweetEndpoint struct {
@@ -42,9 +42,10 @@ func (te *tweetEndpoint) handle(w http.ResponseWriter, r *http.Request) {
 	//Log req occurred
 	log.Println("      [/tweet] - Request @ /tweet!")
 
-	//Check request for auth token
-	authToken := r.FormValue("auth")
-	if authToken != te.authToken {
+	//Check request for auth token. Everything but the image is in the URL, so
+	//we can check it all before reading any of the body.
+	query := r.URL.Query()
+	if query.Get("auth") != te.authToken {
 		log.Println("[401] [/tweet] - No auth token supplied")
 		w.Header().Set("Content-Type", "application/json")
 		w.WriteHeader(http.StatusUnauthorized)
@@ -54,84 +55,285 @@ func (te *tweetEndpoint) handle(w http.ResponseWriter, r *http.Request) {
 
 	//////////////////////////////////////////////////////////////////////
 	//Get GPS location from request
-	//We only add GPS data to the tweet if both lat and long are provided
+	geolocation, ok := parseGeolocation("/tweet", w, query.Get("lat"), query.Get("long"))
+	if !ok {
+		return
+	}
+
+	//////////////////////////////////////////////////////////////////////
+	//Find the images in the form. There's usually one, but a burst from a
+	//CameraThing has up to maxImages, all tweeted together. The parts are read
+	//one at a time as they arrive, rather than buffering the whole form first,
+	//and the body as a whole can't be much bigger than the images (and a
+	//thumbnail) can be.
+	r.Body = http.MaxBytesReader(w, r.Body, (maxImages+1)*maxPhotoSize+maxFormOverhead)
+	multipartReader, err := r.MultipartReader()
+	if err != nil {
+		log.Printf("[400] [/tweet] - Couldn't read form, err: %[1]v", err.Error())
+		w.Header().Set("Content-Type", "application/json")
+		w.WriteHeader(http.StatusBadRequest)
+		json.NewEncoder(w).Encode("Failed to read image file")
+		return
+	}
+
+	//////////////////////////////////////////////////////////////////////
+	//Get each image's data out into a slice of bytes. If there's a thumbnail
+	//ahead of the images, we start recognising it straight away, while the
+	//images are still arriving.
+	readStart := time.Now()
+	var images [][]byte
+	var thumbnail *thumbnailRecognition
+	for {
+		part, err := multipartReader.NextPart()
+		if err == io.EOF {
+			break
+		}
+		if err != nil {
+			log.Printf("[400] [/tweet] - Couldn't read image file, err: %[1]v", err.Error())
+			w.Header().Set("Content-Type", "application/json")
+			w.WriteHeader(http.StatusBadRequest)
+			json.NewEncoder(w).Encode("Failed to read image file")
+			return
+		}
+		if part.FormName() == "thumbnail" && thumbnail == nil && len(images) == 0 {
+			thumbnailBytes, err := readPhoto(part, -1)
+			if err != nil {
+				rejectPhoto("/tweet", w, err)
+				return
+			}
+			log.Printf("      [/tweet] - Got a %[1]v byte thumbnail, recognising it while the image arrives", len(thumbnailBytes))
+			thumbnail = myRecogniser.recogniseThumbnail(thumbnailBytes)
+			continue
+		}
+		if part.FormName() != "image" {
+			continue
+		}
+		if len(images) == maxImages {
+			log.Printf("[400] [/tweet] - More than %[1]v images", maxImages)
+			w.Header().Set("Content-Type", "application/json")
+			w.WriteHeader(http.StatusBadRequest)
+			json.NewEncoder(w).Encode(fmt.Sprintf("At most %[1]v images can be tweeted at once", maxImages))
+			return
+		}
+
+		//Only the first image can use the request's size as a hint
+		sizeHint := r.ContentLength
+		if len(images) > 0 {
+			sizeHint = -1
+		}
+		imageBytes, err := readPhoto(part, sizeHint)
+		if err != nil {
+			rejectPhoto("/tweet", w, err)
+			return
+		}
+		images = append(images, imageBytes)
+	}
+	myMetrics.observeStage("read", readStart)
+	if len(images) == 0 {
+		log.Println("[400] [/tweet] - No image in form")
+		w.Header().Set("Content-Type", "application/json")
+		w.WriteHeader(http.StatusBadRequest)
+		json.NewEncoder(w).Encode("Failed to read image file")
+		return
+	}
+
+	//Get any labels the CameraThing's classifier gave the (first) photo
+	deviceLabels := parseDeviceLabels("/tweet", query.Get("labels"))
+
+	tweetPhoto("/tweet", w, r, images, geolocation, deviceLabels, thumbnail)
+}
+
+//The biggest photo we'll accept, in bytes. A QQVGA JPEG from a CameraThing is
+//6-8KB, and even an uncompressed one would be under 40KB.
+const maxPhotoSize = 1 << 20
+
+//The most photos that can be tweeted together, which is twitter's limit
+const maxImages = 4
+
+//How many bytes of a multipart form we'll accept on top of the photo, for the
+//boundaries, part headers, and any other fields
+const maxFormOverhead = 64 << 10
+
+//errPhotoTooBig is returned by readPhoto for photos over maxPhotoSize
+var errPhotoTooBig = errors.New("photo is over the size limit")
+
+//readPhoto reads a photo of up to maxPhotoSize bytes into a slice of bytes.
+//sizeHint is how big we expect the photo to be, or -1 if we've no idea.
+func readPhoto(photo io.Reader, sizeHint int64) ([]byte, error) {
+	var photoBuffer bytes.Buffer
+	if sizeHint > 0 && sizeHint <= maxPhotoSize {
+		photoBuffer.Grow(int(sizeHint))
+	}
+	n, err := photoBuffer.ReadFrom(io.LimitReader(photo, maxPhotoSize+1))
+	if err != nil {
+		return nil, err
+	}
+	if n > maxPhotoSize {
+		return nil, errPhotoTooBig
+	}
+	return photoBuffer.Bytes(), nil
+}
+
+//rejectPhoto responds to a photo readPhoto couldn't read from an endpoint at
+//path, with a 413 if it was too big or a 400 otherwise
+func rejectPhoto(path string, w http.ResponseWriter, err error) {
+	w.Header().Set("Content-Type", "application/json")
+	if err == errPhotoTooBig {
+		log.Printf("[413] [%[1]v] - Image too big", path)
+		w.WriteHeader(http.StatusRequestEntityTooLarge)
+		json.NewEncoder(w).Encode("Image too big")
+		return
+	}
+	log.Printf("[400] [%[1]v] - Couldn't read image file, err: %[2]v", path, err.Error())
+	w.WriteHeader(http.StatusBadRequest)
+	json.NewEncoder(w).Encode("Failed to read image file")
+}
+
+//parseGeolocation parses the latitude and longitude provided to an endpoint at
+//path. We only add GPS data to the tweet if both lat and long are provided, so
+//this returns nil if neither are. If they're invalid it responds with a 400 and
+//returns false.
+func parseGeolocation(path string, w http.ResponseWriter, latStr string, longStr string) (*Geolocation, bool) {
 	longitudeProvided := true
 	latitudeProvided := true
 
-	latStr := r.FormValue("lat")
 	lat, err := strconv.ParseFloat(latStr, 64)
 	if latStr == "" || err != nil {
 		latitudeProvided = false
 	} else if lat < -180 || lat > 180 {
-		log.Println("[400] [/tweet] - Latitude out of range")
+		log.Printf("[400] [%[1]v] - Latitude out of range", path)
 		w.Header().Set("Content-Type", "application/json")
 		w.WriteHeader(http.StatusBadRequest)
 		json.NewEncoder(w).Encode("Latitude out of range (min -180, max 180)")
-		return
+		return nil, false
 	}
 
-	longStr := r.FormValue("long")
 	long, err := strconv.ParseFloat(longStr, 64)
 	if longStr == "" || err != nil {
 		longitudeProvided = false
 	} else if long < -90 || long > 90 {
-		log.Println("[400] [/tweet] - Longitude out of range")
+		log.Printf("[400] [%[1]v] - Longitude out of range", path)
 		w.Header().Set("Content-Type", "application/json")
 		w.WriteHeader(http.StatusBadRequest)
 		json.NewEncoder(w).Encode("Longitude out of range (min -90, max 90)")
-		return
+		return nil, false
 	}
 
 	if !longitudeProvided && !latitudeProvided {
-		log.Println("      [/tweet] - No longitude or latitude provided, not using geolocation")
+		log.Printf("      [%[1]v] - No longitude or latitude provided, not using geolocation", path)
+		return nil, true
 	} else if longitudeProvided && latitudeProvided {
-		log.Println("      [/tweet] - Longitude and latitude provided, using geolocation")
+		log.Printf("      [%[1]v] - Longitude and latitude provided, using geolocation", path)
+		return &Geolocation{lat: lat, long: long}, true
+	}
+
+	if longitudeProvided {
+		log.Printf("[400] [%[1]v] - Only longitude provided", path)
 	} else {
-		if longitudeProvided {
-			log.Println("[400] [/tweet] - Only longitude provided")
-		} else {
-			log.Println("[400] [/tweet] - Only latitude provided")
+		log.Printf("[400] [%[1]v] - Only latitude provided", path)
+	}
+	w.Header().Set("Content-Type", "application/json")
+	w.WriteHeader(http.StatusBadRequest)
+	json.NewEncoder(w).Encode("Longitude and latitude must be provided, or neither")
+	return nil, false
+}
+
+//tweetResult is what we respond with once a photo's been tweeted
+type tweetResult struct {
+	Tweet    string
+	TweetURL string `json:",omitempty"`
+}
+
+//tweetPhoto tweets a photo uploaded to the endpoint at path, and responds with
+//the tweet. If the client asked for an asynchronous response with a "Prefer:
+//respond-async" header, the photo is queued for a worker to tweet and we
+//respond 202 Accepted straight away, with a job ID the client can look up at
+//the /job endpoint. Otherwise the photo's tweeted before we respond 201.
+//A burst of photos is tweeted together in one tweet. thumbnail is the labels
+//for the first photo's thumbnail, if it came with one.
+func tweetPhoto(path string, w http.ResponseWriter, r *http.Request, images [][]byte, geolocation *Geolocation, deviceLabels []LabelResult, thumbnail *thumbnailRecognition) {
+	if telemetry := r.Header.Get("Telemetry"); telemetry != "" {
+		myTelemetry.record(path, telemetry)
+	}
+
+	if strings.Contains(r.Header.Get("Prefer"), "respond-async") {
+		job, err := myJobQueue.submit(path, images, geolocation, deviceLabels, thumbnail)
+		if err != nil {
+			log.Printf("[503] [%[1]v] - Couldn't queue job, err: %[2]v", path, err.Error())
+			myMetrics.countError("jobQueueFull")
+			w.Header().Set("Content-Type", "application/json")
+			w.WriteHeader(http.StatusServiceUnavailable)
+			json.NewEncoder(w).Encode("Too many photos waiting to be tweeted")
+			return
 		}
+		log.Printf("[202] [%[1]v] - Queued job %[2]v", path, job.ID)
 		w.Header().Set("Content-Type", "application/json")
-		w.WriteHeader(http.StatusBadRequest)
-		json.NewEncoder(w).Encode("Longitude and latitude must be provided, or neither")
+		w.Header().Set("Location", "/job?id="+job.ID)
+		w.WriteHeader(http.StatusAccepted)
+		json.NewEncoder(w).Encode(map[string]string{"JobID": job.ID})
 		return
 	}
 
-	//////////////////////////////////////////////////////////////////////
-	//Read image from form
-	imageFile, _, err := r.FormFile("image")
-	if err != nil {
-		log.Printf("[400] [/tweet] - Couldn't read image file, err: %[1]v", err.Error())
-		w.Header().Set("Content-Type", "application/json")
-		w.WriteHeader(http.StatusBadRequest)
-		json.NewEncoder(w).Encode("Failed to read image file")
+	result, status, message := processPhoto(path, images, geolocation, deviceLabels, thumbnail)
+	w.Header().Set("Content-Type", "application/json")
+	w.WriteHeader(status)
+	if result == nil {
+		json.NewEncoder(w).Encode(message)
 		return
 	}
-	defer imageFile.Close()
+	json.NewEncoder(w).Encode(result)
+}
 
+//processPhoto recognises what's in one or more JPEGs and tweets them. It returns
+//the tweet and 201 Created, or nil, the status code and a message to respond
+//with if it fails. path is the endpoint the photos came in on, for logging,
+//and deviceLabels are any labels the CameraThing sent with the first one, as
+//thumbnail is any thumbnail it sent ahead of it.
+func processPhoto(path string, images [][]byte, geolocation *Geolocation, deviceLabels []LabelResult, thumbnail *thumbnailRecognition) (*tweetResult, int, string) {
 	//////////////////////////////////////////////////////////////////////
-	//Get image data out into slice of bytes
-	var imageBuffer bytes.Buffer
-	io.Copy(&imageBuffer, imageFile)
-	imageBytes := imageBuffer.Bytes()
+	//Get each image's labels & upscaled image, from the cache if we've seen
+	//this exact photo before. The photos in a burst usually look alike, so
+	//they're prepared in turn, and all but the first usually get the first's
+	//labels from the cache rather than going to the recogniser again.
+	photos := make([]*cachedPhoto, len(images))
+	for i, imageBytes := range images {
+		sum := sha256.Sum256(imageBytes)
+		photo, cached := myPhotoCache.get(sum)
+		if cached {
+			log.Printf("      [%[1]v] - Seen this photo before, using cached labels and upscaled image", path)
+			photoCacheHits.Add(1)
+			photoCacheMsSaved.Add(int64((photo.recogniseTime + photo.upscaleTime) / time.Millisecond))
+		} else {
+			var status int
+			var message string
+			var labels []LabelResult
+			var thumb *thumbnailRecognition
+			if i == 0 {
+				labels = deviceLabels
+				thumb = thumbnail
+			}
+			photo, status, message = preparePhoto(path, sum, imageBytes, labels, thumb)
+			if photo == nil {
+				return nil, status, message
+			}
+		}
+		photos[i] = photo
+	}
 
-	//////////////////////////////////////////////////////////////////////
-	//Get image labels
-	labels, err := myRecogniser.recognise(imageBytes)
-	recogniserFailed := false //We still tweet if the recogniser fails.
-	if err != nil {
-		log.Printf("[XXX] [/tweet] - Image recognition failed, err: %[1]v", err.Error())
-		recogniserFailed = true
+	//The tweet's about the first photo, unless it couldn't be recognised
+	photo := photos[0]
+	for _, p := range photos {
+		if len(p.labels) > 0 {
+			photo = p
+			break
+		}
 	}
 
 	//////////////////////////////////////////////////////////////////////
 	//Construct a tweetBody of up to five labels followed by question marks
 	tweetBody := ""
-	if !recogniserFailed {
-		for i := 0; i < 5 && i < len(labels); i++ {
-			tweetBody += strings.Title(labels[i].Label) + "? "
-		}
+	for i := 0; i < 5 && i < len(photo.labels); i++ {
+		tweetBody += strings.Title(photo.labels[i].Label) + "? "
 	}
 	//If no labels were returned, or the tweeter otherwise failed, say we've got
 	//no idea what it is
@@ -140,52 +342,132 @@ func (te *tweetEndpoint) handle(w http.ResponseWriter, r *http.Request) {
 	}
 
 	//Add the location to the tweet if we have both lat and long
-	if longitudeProvided && latitudeProvided {
-		tweetBody += fmt.Sprintf("(%.5f,%.5f)", lat, long)
+	if geolocation != nil {
+		tweetBody += fmt.Sprintf("(%.5f,%.5f)", geolocation.lat, geolocation.long)
 	}
 
+	//Make tweet
+	tweetStart := time.Now()
+	upscaled := make([][]byte, len(photos))
+	for i, p := range photos {
+		upscaled[i] = p.upscaled
+	}
+	tweetMade, err := myTweeter.tweetWithImages(tweetBody, upscaled)
+	myMetrics.observeStage("twitter", tweetStart)
+	if err != nil {
+		myMetrics.countError("twitter")
+		log.Printf("[500] [%[1]v] - Failed to tweet image, err: %[2]v", path, err.Error())
+		return nil, http.StatusInternalServerError, "Failed to tweet image"
+	}
+
+	//Return the tweet
+	result := &tweetResult{Tweet: tweetBody}
+	if tweetMade != nil {
+		result.TweetURL = "https://twitter.com/" + tweetMade.User.ScreenName + "/status/" + tweetMade.IDStr
+
+	}
+	log.Printf("[201] [%[1]v] - Successfully tweeted: %[2]v", path, strings.ReplaceAll(tweetBody, "\n", ""))
+	return result, http.StatusCreated, ""
+}
+
+//preparePhoto gets the labels for a photo (from the cache if one that looks the
+//same has been recognised before, from the CameraThing if it's confident
+//enough in them, or from its thumbnail if it came with one) and upscales it,
+//adding it to the cache. It returns nil, the status code and a message to
+//respond with if it fails.
+func preparePhoto(path string, sum [sha256.Size]byte, imageBytes []byte, deviceLabels []LabelResult, thumbnail *thumbnailRecognition) (*cachedPhoto, int, string) {
 	//////////////////////////////////////////////////////////////////////
 	//Decode image into jpeg
+	decodeStart := time.Now()
 	img, err := jpeg.Decode(bytes.NewReader(imageBytes))
+	myMetrics.observeStage("decode", decodeStart)
 	if err != nil {
-		log.Printf("[500] [/tweet] - Failed to decode image as jpeg, err: %[1]v", err.Error())
-		w.Header().Set("Content-Type", "application/json")
-		w.WriteHeader(http.StatusInternalServerError)
-		json.NewEncoder(w).Encode("Failed to decode image as jpeg")
-		return
+		myMetrics.countError("decode")
+		log.Printf("[500] [%[1]v] - Failed to decode image as jpeg, err: %[2]v", path, err.Error())
+		return nil, http.StatusInternalServerError, "Failed to decode image as jpeg"
+	}
+
+	//////////////////////////////////////////////////////////////////////
+	//Get image labels
+	photo := &cachedPhoto{sum: sum, look: lookHash(img)}
+	labels, recogniseTime, found := myPhotoCache.getLabels(photo.look)
+	recognised := found
+	if found {
+		log.Printf("      [%[1]v] - Looks like a photo we've seen before, using cached labels", path)
+		photoCacheLabelHits.Add(1)
+		photoCacheMsSaved.Add(int64(recogniseTime / time.Millisecond))
+	} else if myRecogniser.trustsDeviceLabels(deviceLabels) {
+		log.Printf("      [%[1]v] - CameraThing is %.0[2]f%% sure it's a %[3]v, using its labels", path, deviceLabels[0].Probability*100, deviceLabels[0].Label)
+		photoCacheMisses.Add(1)
+		labels = deviceLabels
+		recognised = true
+	} else if thumbnailLabels, ok := thumbnailLabels(path, thumbnail); ok {
+		photoCacheMisses.Add(1)
+		labels = thumbnailLabels
+		recognised = true
+	} else {
+		photoCacheMisses.Add(1)
+		recogniseStart := time.Now()
+		labels, err = myRecogniser.recognise(imageBytes)
+		recogniseTime = time.Since(recogniseStart)
+		myMetrics.observeStage("recognise", recogniseStart)
+		recognised = err == nil //We still tweet if the recogniser fails.
+		if err == errRecogniserBusy {
+			myMetrics.countError("recogniserBusy")
+		} else if err != nil {
+			myMetrics.countError("recogniser")
+		}
+		if err != nil {
+			log.Printf("[XXX] [%[1]v] - Image recognition failed, err: %[2]v", path, err.Error())
+			labels = nil
+		}
 	}
+	photo.labels = labels
+	photo.recogniseTime = recogniseTime
 
 	//////////////////////////////////////////////////////////////////////
 	//Upscale image with no interpolation
-	bigImg := resize.Resize(1280, 0, img, resize.NearestNeighbor)
-	bigImgBytesBuf := new(bytes.Buffer)
+	upscaleStart := time.Now()
+	bigImg := upscale(img, 1280)
+	defer releaseUpscaled(bigImg)
+	myMetrics.observeStage("upscale", upscaleStart)
+
+	//And encode it back into a jpeg
+	encodeStart := time.Now()
+	bigImgBytesBuf := encodeBufferPool.Get().(*bytes.Buffer)
+	bigImgBytesBuf.Reset()
+	defer encodeBufferPool.Put(bigImgBytesBuf)
 	err = jpeg.Encode(bigImgBytesBuf, bigImg, nil)
 	if err != nil {
-		log.Printf("[500] [/tweet] - Failed to upscale image, err: %[1]v", err.Error())
-		w.Header().Set("Content-Type", "application/json")
-		w.WriteHeader(http.StatusInternalServerError)
-		json.NewEncoder(w).Encode("Failed to upscale image")
-		return
+		myMetrics.countError("encode")
+		log.Printf("[500] [%[1]v] - Failed to upscale image, err: %[2]v", path, err.Error())
+		return nil, http.StatusInternalServerError, "Failed to upscale image"
 	}
+	photo.upscaled = append([]byte(nil), bigImgBytesBuf.Bytes()...)
+	myMetrics.observeStage("encode", encodeStart)
+	photo.upscaleTime = time.Since(upscaleStart)
 
-	//Make tweet
-	tweetMade, err := myTweeter.tweetWithImage(tweetBody, bigImgBytesBuf.Bytes())
-	if err != nil {
-		log.Printf("[500] [/tweet] - Failed to tweet image, err: %[1]v", err.Error())
-		w.Header().Set("Content-Type", "application/json")
-		w.WriteHeader(http.StatusInternalServerError)
-		json.NewEncoder(w).Encode("Failed to tweet image")
-		return
+	//Only cache photos we've got labels for, so if the recogniser failed we try
+	//it again next time
+	if recognised {
+		myPhotoCache.put(photo)
 	}
+	return photo, 0, ""
+}
 
-	//Respond
-	response := map[string]string{"Tweet": tweetBody}
-	if tweetMade != nil {
-		response["TweetURL"] = "https://twitter.com/" + tweetMade.User.ScreenName + "/status/" + tweetMade.IDStr
-
+//thumbnailLabels waits for the labels of a photo's thumbnail, if it came with
+//one, returning false if it didn't or the thumbnail couldn't be recognised
+func thumbnailLabels(path string, thumbnail *thumbnailRecognition) ([]LabelResult, bool) {
+	if thumbnail == nil {
+		return nil, false
 	}
-	log.Printf("[201] [/tweet] - Successfully tweeted: %[1]v", strings.ReplaceAll(tweetBody, "\n", ""))
-	w.Header().Set("Content-Type", "application/json")
-	w.WriteHeader(http.StatusCreated)
-	json.NewEncoder(w).Encode(response)
+	labels, err := thumbnail.wait()
+	if err != nil {
+		log.Printf("      [%[1]v] - Couldn't recognise thumbnail, recognising the image instead, err: %[2]v", path, err.Error())
+		thumbnailLabelsFailed.Add(1)
+		return nil, false
+	}
+	log.Printf("      [%[1]v] - Using the thumbnail's labels", path)
+	thumbnailLabelsUsed.Add(1)
+	return labels, true
 }
@@ -6,6 +6,8 @@ import (
 	"log"
 	"os"
 	"strings"
+	"sync"
+	"time"
 
 	"github.com/dghubble/go-twitter/twitter"
 	"github.com/dghubble/oauth1"
@@ -15,6 +17,7 @@ import (
 type tweeter struct {
 	client   *twitter.Client
 	username string
+	devDelay time.Duration //How long pretend tweets take when client is nil
 }
 
 //Constructor
@@ -40,10 +43,17 @@ func newTweeter() (*tweeter, error) {
 	}
 
 	//If the creds aren't set, & we are in dev, return a tweeter with nil client
+	//DEV_TWEET_DELAY can be set to how many milliseconds it should pretend
+	//tweeting takes, to stand in for twitter when load testing
 	if !gotAllCreds && env == DEV {
+		devDelay, err := intFromEnv("DEV_TWEET_DELAY", 0, 0)
+		if err != nil {
+			return nil, err
+		}
 		return &tweeter{
 			client:   nil,
 			username: "Dev",
+			devDelay: time.Duration(devDelay) * time.Millisecond,
 		}, nil
 	}
 
@@ -71,43 +81,67 @@ func newTweeter() (*tweeter, error) {
 	}, nil
 }
 
-/*tweetWithImage makes a tweet with a single image and a tweet body. It fails if
-it cannot upload the image, or create the tweet. If the client of the recieving
-tweeter instance is nil, then it simply outputs the tweet that would be made to
-the logs as follows:
+/*tweetWithImages makes a tweet with up to four images and a tweet body. The
+images are uploaded to twitter in parallel, then tweeted together in the order
+given. It fails if it cannot upload any of the images, or create the tweet. If
+the client of the recieving tweeter instance is nil, then it simply outputs the
+tweet that would be made to the logs as follows:
 
 [DEV] [TWITTER] - Tweeted: Test Tweet
 */
-func (t *tweeter) tweetWithImage(tweetBody string, image []byte) (*twitter.Tweet, error) {
+func (t *tweeter) tweetWithImages(tweetBody string, images [][]byte) (*twitter.Tweet, error) {
 	//If client is nil, we just log it
 	if t.client == nil {
+		time.Sleep(t.devDelay)
+		withImages := ""
+		if len(images) > 1 {
+			withImages = fmt.Sprintf(" [%[1]v images]", len(images))
+		}
 		log.Printf(
-			"[DEV] [TWITTER] - Tweeted: %[1]v",
+			"[DEV] [TWITTER] - Tweeted: %[1]v%[2]v",
 			strings.ReplaceAll(tweetBody, "\n", "\\n"),
+			withImages,
 		)
 		return nil, nil
 	}
 
-	//Upload our picture
-	media, resp, err := t.client.Media.Upload(image, "tweet_image")
-	if err != nil {
-		log.Println(len(image))
-		if resp != nil {
-			log.Println(resp)
+	//Upload our pictures, all at once
+	mediaIDs := make([]int64, len(images))
+	uploadErrs := make([]error, len(images))
+	var uploads sync.WaitGroup
+	for i, image := range images {
+		uploads.Add(1)
+		go func(i int, image []byte) {
+			defer uploads.Done()
+			media, resp, err := t.client.Media.Upload(image, "tweet_image")
+			if err != nil {
+				log.Println(len(image))
+				if resp != nil {
+					log.Println(resp)
+				}
+				uploadErrs[i] = err
+				return
+			}
+			mediaIDs[i] = media.MediaID
+		}(i, image)
+	}
+	uploads.Wait()
+	for _, err := range uploadErrs {
+		if err != nil {
+			return nil, errors.New(fmt.Sprintf(
+				"Failed to upload image, err: %[1]v",
+				err.Error(),
+			))
 		}
-		return nil, errors.New(fmt.Sprintf(
-			"Failed to upload image, err: %[1]v",
-			err.Error(),
-		))
 	}
 
 	//@todo: Find place ID of nearby places to add as a placeID in the tweet.
 
-	//Make the tweet using the media ID
+	//Make the tweet using the media IDs
 	tweetCreated, _, err := t.client.Statuses.Update(
 		tweetBody,
 		&twitter.StatusUpdateParams{
-			MediaIds: []int64{media.MediaID},
+			MediaIds: mediaIDs,
 		},
 	)
 	if err != nil {
@@ -0,0 +1,91 @@
+package main
+
+import (
+	"bytes"
+	"image"
+	"sync"
+
+	"github.com/nfnt/resize"
+)
+
+//Upscaled images and the buffers they're encoded into are big (a 1280x960
+//YCbCr is 1.8MB), and we make one of each per photo, so we reuse them across
+//requests rather than leaving them for the garbage collector
+var upscaledPool sync.Pool
+var encodeBufferPool = sync.Pool{
+	New: func() interface{} { return new(bytes.Buffer) },
+}
+
+/*upscale scales img up to be width pixels wide with no interpolation. Photos
+from the CameraThing are decoded as YCbCr and always scale up by a whole
+number, so in that case each pixel is just copied into a square of pixels in
+a pooled image, one row at a time. Anything else falls back to resize. Images
+returned by upscale should be given back with releaseUpscaled once done with.*/
+func upscale(img image.Image, width int) image.Image {
+	src, isYCbCr := img.(*image.YCbCr)
+	srcWidth := img.Bounds().Dx()
+	if !isYCbCr || srcWidth == 0 || width%srcWidth != 0 {
+		return resize.Resize(uint(width), 0, img, resize.NearestNeighbor)
+	}
+	scale := width / srcWidth
+	rect := image.Rect(0, 0, width, img.Bounds().Dy()*scale)
+	dst := getUpscaled(rect, src.SubsampleRatio)
+
+	//Every plane scales by the same factor, as each chroma sample covers the
+	//same number of luma samples before and after
+	cw, ch := src.CStride, 0
+	if src.Cb != nil {
+		ch = len(src.Cb) / src.CStride
+	}
+	scalePlane(dst.Y, dst.YStride, rect.Dy(), src.Y[src.YOffset(src.Rect.Min.X, src.Rect.Min.Y):], src.YStride, srcWidth, img.Bounds().Dy(), scale)
+	if ch > 0 {
+		dstCW := dst.CStride
+		dstCH := len(dst.Cb) / dst.CStride
+		srcCW := minInt(cw, (dstCW+scale-1)/scale)
+		srcCOffset := src.COffset(src.Rect.Min.X, src.Rect.Min.Y)
+		scalePlane(dst.Cb, dst.CStride, dstCH, src.Cb[srcCOffset:], src.CStride, srcCW, ch, scale)
+		scalePlane(dst.Cr, dst.CStride, dstCH, src.Cr[srcCOffset:], src.CStride, srcCW, ch, scale)
+	}
+	return dst
+}
+
+/*scalePlane fills a plane dstHeight rows high with the plane src scaled up by
+scale. Each output row is built once by repeating each source sample, then
+copied to the rest of the rows it covers.*/
+func scalePlane(dst []byte, dstStride int, dstHeight int, src []byte, srcStride int, srcWidth int, srcHeight int, scale int) {
+	for y := 0; y < dstHeight; y += scale {
+		srcRow := src[minInt(y/scale, srcHeight-1)*srcStride:]
+		row := dst[y*dstStride : y*dstStride+dstStride]
+		for x := range row {
+			row[x] = srcRow[minInt(x/scale, srcWidth-1)]
+		}
+		for i := 1; i < scale && y+i < dstHeight; i++ {
+			copy(dst[(y+i)*dstStride:(y+i+1)*dstStride], row)
+		}
+	}
+}
+
+//getUpscaled gets a YCbCr image of the given size from the pool, or makes one
+func getUpscaled(rect image.Rectangle, ratio image.YCbCrSubsampleRatio) *image.YCbCr {
+	if pooled, ok := upscaledPool.Get().(*image.YCbCr); ok {
+		if pooled.Rect == rect && pooled.SubsampleRatio == ratio {
+			return pooled
+		}
+	}
+	return image.NewYCbCr(rect, ratio)
+}
+
+//releaseUpscaled gives an image returned by upscale back to the pool
+func releaseUpscaled(img image.Image) {
+	if upscaled, ok := img.(*image.YCbCr); ok {
+		upscaledPool.Put(upscaled)
+	}
+}
+
+//minInt is the smaller of a and b
+func minInt(a int, b int) int {
+	if a < b {
+		return a
+	}
+	return b
+}
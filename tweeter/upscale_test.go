@@ -0,0 +1,82 @@
+package main
+
+import (
+	"bytes"
+	"image"
+	"image/jpeg"
+	"testing"
+
+	"github.com/nfnt/resize"
+)
+
+//benchmarkUpscale upscales the same QQVGA frame as a CameraThing's "room"
+//photo to 1280 wide with `scale`, then encodes it, as preparePhoto does. The
+//upscale is timed on its own, and with the encode, which is what it costs per
+//photo.
+func benchmarkUpscale(b *testing.B, scale func(img image.Image) image.Image, release func(img image.Image)) {
+	img, err := jpeg.Decode(bytes.NewReader(testJPEG(b, testPhotoScenes[1].noise)))
+	if err != nil {
+		b.Fatal(err)
+	}
+
+	b.Run("upscale", func(b *testing.B) {
+		b.ReportAllocs()
+		for i := 0; i < b.N; i++ {
+			release(scale(img))
+		}
+	})
+	b.Run("upscale+encode", func(b *testing.B) {
+		var buf bytes.Buffer
+		b.ReportAllocs()
+		for i := 0; i < b.N; i++ {
+			bigImg := scale(img)
+			buf.Reset()
+			if err := jpeg.Encode(&buf, bigImg, nil); err != nil {
+				b.Fatal(err)
+			}
+			release(bigImg)
+		}
+	})
+}
+
+//BenchmarkUpscaleResize is how photos were upscaled before upscale, with
+//resize's nearest neighbour
+func BenchmarkUpscaleResize(b *testing.B) {
+	benchmarkUpscale(b, func(img image.Image) image.Image {
+		return resize.Resize(1280, 0, img, resize.NearestNeighbor)
+	}, func(img image.Image) {})
+}
+
+//BenchmarkUpscaleReplicate is upscale, copying each sample into a pooled image
+func BenchmarkUpscaleReplicate(b *testing.B) {
+	benchmarkUpscale(b, func(img image.Image) image.Image {
+		return upscale(img, 1280)
+	}, releaseUpscaled)
+}
+
+//TestUpscaleReplicate checks upscale gives exactly what nearest neighbour
+//would, for every pixel
+func TestUpscaleReplicate(t *testing.T) {
+	for _, ratio := range []image.YCbCrSubsampleRatio{image.YCbCrSubsampleRatio420, image.YCbCrSubsampleRatio422, image.YCbCrSubsampleRatio444} {
+		src := image.NewYCbCr(image.Rect(0, 0, 160, 120), ratio)
+		for i := range src.Y {
+			src.Y[i] = uint8(i * 7)
+		}
+		for i := range src.Cb {
+			src.Cb[i] = uint8(i * 3)
+			src.Cr[i] = uint8(i * 5)
+		}
+		dst := upscale(src, 1280)
+		if dst.Bounds() != image.Rect(0, 0, 1280, 960) {
+			t.Fatalf("%v: upscaled to %v", ratio, dst.Bounds())
+		}
+		for y := 0; y < 960; y++ {
+			for x := 0; x < 1280; x++ {
+				if dst.At(x, y) != src.At(x/8, y/8) {
+					t.Fatalf("%v: pixel %v,%v is %v rather than %v", ratio, x, y, dst.At(x, y), src.At(x/8, y/8))
+				}
+			}
+		}
+		releaseUpscaled(dst)
+	}
+}
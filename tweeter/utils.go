@@ -1,5 +1,11 @@
 package main
 
+import (
+	"fmt"
+	"os"
+	"strconv"
+)
+
 //The format of a response from the recogniser service
 type ClassifyResult struct {
 	Filename string        `json:"filename"`
@@ -17,3 +23,17 @@ type Geolocation struct {
 	lat  float64
 	long float64
 }
+
+//intFromEnv gets an int of at least min from an env var, or the default if
+//it's unset
+func intFromEnv(name string, def int, min int) (int, error) {
+	str, set := os.LookupEnv(name)
+	if !set {
+		return def, nil
+	}
+	n, err := strconv.Atoi(str)
+	if err != nil || n < min {
+		return 0, fmt.Errorf("%[1]v must be an integer of at least %[2]v", name, min)
+	}
+	return n, nil
+}